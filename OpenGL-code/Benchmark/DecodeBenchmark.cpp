@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "../Common/DecodeArena.h"
+#include "../Common/ThreadPool.h"
+#include "SyntheticImages.h"
+
+// decode throughput benchmark for stb_image
+// -----------------------------------------
+// Builds a deterministic corpus in memory (see SyntheticImages.h) plus the demos' Sea.jpg,
+// decodes every image a few times and writes one JSON document: per image the best and median
+// decode time, output and input MB/s (1 MB = 10^6 bytes), heap allocations and peak heap bytes
+// of one decode, and per format path the totals plus the process's peak resident set while
+// that path ran. Images are on one line each with a fixed key order, so two builds diff cleanly.
+//
+// usage: DecodeBenchmark [--repeat N] [--threads N] [--channels N] [--arena] [--only TEXT]
+//                        [--sea FILE] [--dump DIR] [--out FILE]
+//   --threads N   split JPEG restart segments and colour conversion across N workers
+//   --channels N  ask stb_image for N channels instead of the file's own
+//   --arena       route stb_image's scratch memory through a DecodeArena
+//   --only TEXT   decode only the images whose name contains TEXT
+//   --dump DIR    also write the corpus files to DIR
+//
+// Huffman table widths: the JSON reports the STBI_FAST_BITS and STBI_ZFAST_BITS the build
+// used, and the corpus has 1x1 images ("jpeg/tiny", "png/tiny") on which table building is
+// most of the decode. To compare widths, build once per width and set the 1x1 times against
+// the large images' (say jpeg-baseline-420-2048x2048 and png-rgb8-adaptive-1024x768), for N
+// from 9 to 12:
+//   g++ -O2 -std=c++14 -DSTBI_FAST_BITS=N -DSTBI_ZFAST_BITS=N DecodeBenchmark.cpp -pthread -o decodeN
+//   ./decodeN --repeat 50 --out bitsN.json
+
+// every STBI_MALLOC block carries its size in front so frees can be accounted for
+namespace heapcount
+{
+    static const size_t HEADER = 16;
+    static std::atomic<size_t> allocations(0), live(0), peak(0);
+
+    static void note(size_t size)
+    {
+        size_t now = live.fetch_add(size) + size;
+        size_t seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now))
+        {
+        }
+    }
+
+    static void* allocate(size_t size)
+    {
+        unsigned char* block = (unsigned char*)std::malloc(size + HEADER);
+        if (!block)
+            return NULL;
+        std::memcpy(block, &size, sizeof(size));
+        allocations++;
+        note(size);
+        return block + HEADER;
+    }
+
+    static void release(void* p)
+    {
+        if (!p)
+            return;
+        unsigned char* block = (unsigned char*)p - HEADER;
+        size_t size;
+        std::memcpy(&size, block, sizeof(size));
+        live -= size;
+        std::free(block);
+    }
+
+    static void* reallocate(void* p, size_t size)
+    {
+        if (!p)
+            return allocate(size);
+        unsigned char* block = (unsigned char*)p - HEADER;
+        size_t old;
+        std::memcpy(&old, block, sizeof(old));
+        unsigned char* moved = (unsigned char*)std::realloc(block, size + HEADER);
+        if (!moved)
+            return NULL;
+        std::memcpy(moved, &size, sizeof(size));
+        allocations++;
+        live -= old;
+        note(size);
+        return moved + HEADER;
+    }
+}
+
+#define STBI_MALLOC(size) heapcount::allocate(size)
+#define STBI_REALLOC(p, size) heapcount::reallocate(p, size)
+#define STBI_FREE(p) heapcount::release(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Q3/stb_image.h"
+
+// peak resident set of the process in bytes; resetPeakRss() restarts the measurement where
+// the platform allows it (Linux), elsewhere the peak covers the whole run so far
+static size_t statusField(const char* field)
+{
+#if defined(__linux__)
+    FILE* status = std::fopen("/proc/self/status", "r");
+    if (!status)
+        return 0;
+    char line[256];
+    size_t kilobytes = 0, length = std::strlen(field);
+    while (std::fgets(line, sizeof(line), status))
+        if (!std::strncmp(line, field, length) && line[length] == ':')
+            kilobytes = std::strtoul(line + length + 1, NULL, 10);
+    std::fclose(status);
+    return kilobytes * 1024;
+#else
+    (void)field;
+    return 0;
+#endif
+}
+
+static size_t residentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+    return statusField("VmRSS");
+#endif
+}
+
+static size_t peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    size_t peak = statusField("VmHWM");
+    if (peak)
+        return peak;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static void resetPeakRss()
+{
+#if defined(__linux__)
+    // "5" resets the high-water mark to the current resident set
+    if (FILE* refs = std::fopen("/proc/self/clear_refs", "w"))
+    {
+        std::fputs("5", refs);
+        std::fclose(refs);
+    }
+#endif
+}
+
+struct CorpusImage
+{
+    std::string name, path, extension;
+    std::vector<unsigned char> bytes;
+    bool wide;  // decode through stbi_load_16
+};
+
+static bool readFile(const std::string& file, std::vector<unsigned char>& bytes)
+{
+    FILE* f = std::fopen(file.c_str(), "rb");
+    if (!f)
+        return false;
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    bytes.resize(size > 0 ? (size_t)size : 0);
+    bool ok = size > 0 && std::fread(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    std::fclose(f);
+    return ok;
+}
+
+static std::vector<CorpusImage> buildCorpus(const std::string& seaFile, const std::string& only)
+{
+    using namespace syntheticimages;
+    std::vector<CorpusImage> corpus;
+    unsigned int seed = 1;
+    auto add = [&](const std::string& name, const char* path, const char* extension, bool wide,
+                   const std::function<std::vector<unsigned char>()>& encode)
+    {
+        seed++;
+        if (!only.empty() && name.find(only) == std::string::npos)
+            return;
+        CorpusImage image = { name, path, extension, encode(), wide };
+        corpus.push_back(image);
+    };
+    auto size = [](int width, int height)
+    {
+        return "-" + std::to_string(width) + "x" + std::to_string(height);
+    };
+
+    static const int sizes[3][2] = { { 256, 256 }, { 1024, 768 }, { 2048, 2048 } };
+    for (int s = 0; s < 3; s++)
+    {
+        int width = sizes[s][0], height = sizes[s][1];
+        std::string dims = size(width, height);
+        auto jpeg = [&](const std::string& name, const char* path, int channels, int lumaH, int lumaV, int restart, bool progressive)
+        {
+            add(name + dims, path, "jpg", false, [=]()
+            {
+                JpegOptions options;
+                options.lumaH = lumaH;
+                options.lumaV = lumaV;
+                options.restartInterval = restart;
+                options.progressive = progressive;
+                std::vector<unsigned char> pixels = toBytes(makePicture(width, height, channels, seed));
+                return encodeJpeg(pixels.data(), width, height, channels, options);
+            });
+        };
+        jpeg("jpeg-baseline-420", "jpeg/baseline", 3, 2, 2, 0, false);
+        jpeg("jpeg-baseline-444", "jpeg/baseline", 3, 1, 1, 0, false);
+        jpeg("jpeg-restart-420", "jpeg/restart", 3, 2, 2, 16, false);
+        jpeg("jpeg-restart-444", "jpeg/restart", 3, 1, 1, 16, false);
+        jpeg("jpeg-progressive-420", "jpeg/progressive", 3, 2, 2, 0, true);
+        jpeg("jpeg-progressive-444", "jpeg/progressive", 3, 1, 1, 0, true);
+        if (s == 1)
+        {
+            jpeg("jpeg-baseline-422", "jpeg/baseline", 3, 2, 1, 0, false);
+            jpeg("jpeg-baseline-grey", "jpeg/baseline", 1, 1, 1, 0, false);
+            jpeg("jpeg-progressive-restart-420", "jpeg/progressive", 3, 2, 2, 8, true);
+        }
+
+        auto png = [&](const std::string& name, const char* path, int channels, int depth, int filter, bool interlaced)
+        {
+            add(name + dims, path, "png", depth == 16, [=]()
+            {
+                PngOptions options;
+                options.depth = depth;
+                options.filter = filter;
+                options.interlaced = interlaced;
+                std::vector<unsigned short> samples = makePicture(width, height, channels, seed);
+                return encodePng(samples.data(), width, height, channels, options);
+            });
+        };
+        // the full filter and layout matrix is cheap to decode but slow to encode at 2048x2048
+        png("png-rgb8-adaptive", "png/8-bit", 3, 8, -1, false);
+        png("png-rgba8-adaptive", "png/8-bit", 4, 8, -1, false);
+        png("png-rgb16-adaptive", "png/16-bit", 3, 16, -1, false);
+        if (s == 2)
+            continue;
+        static const char* filters[5] = { "none", "sub", "up", "average", "paeth" };
+        for (int f = 0; f < 5; f++)
+            png(std::string("png-rgb8-") + filters[f], "png/8-bit", 3, 8, f, false);
+        png("png-grey8-adaptive", "png/8-bit", 1, 8, -1, false);
+        png("png-greyalpha8-adaptive", "png/8-bit", 2, 8, -1, false);
+        png("png-rgba16-adaptive", "png/16-bit", 4, 16, -1, false);
+        png("png-rgb8-interlaced", "png/interlaced", 3, 8, -1, true);
+        png("png-rgba16-interlaced", "png/interlaced", 4, 16, -1, true);
+    }
+
+    // icon-sized images, where rebuilding the Huffman tables outweighs the decode itself
+    add("jpeg-baseline-420" + size(1, 1), "jpeg/tiny", "jpg", false, [=]()
+    {
+        std::vector<unsigned char> pixels = toBytes(makePicture(1, 1, 3, seed));
+        return encodeJpeg(pixels.data(), 1, 1, 3, JpegOptions());
+    });
+    add("png-rgb8-adaptive" + size(1, 1), "png/tiny", "png", false, [=]()
+    {
+        std::vector<unsigned short> samples = makePicture(1, 1, 3, seed);
+        return encodePng(samples.data(), 1, 1, 3, PngOptions());
+    });
+    if (only.empty() || std::string("jpeg-photo-sea").find(only) != std::string::npos)
+    {
+        CorpusImage sea = { "jpeg-photo-sea", "jpeg/photo", "jpg", std::vector<unsigned char>(), false };
+        if (readFile(seaFile, sea.bytes))
+            corpus.push_back(sea);
+        else
+            std::fprintf(stderr, "DecodeBenchmark: %s not found, skipping the photo path\n", seaFile.c_str());
+    }
+    return corpus;
+}
+
+struct Result
+{
+    int width, height, channels;
+    size_t decodedBytes;
+    double bestMs, medianMs;
+    size_t allocations, peakHeap;
+    std::string error;
+};
+
+static Result measure(const CorpusImage& image, int repeat, int channels, bool arena)
+{
+    Result result = { 0, 0, 0, 0, 0.0, 0.0, 0, 0, std::string() };
+    std::vector<double> times;
+    for (int run = 0; run < repeat; run++)
+    {
+        size_t allocationsBefore = heapcount::allocations.load();
+        size_t liveBefore = heapcount::live.load();
+        heapcount::peak = liveBefore;
+
+        int x = 0, y = 0, comp = 0;
+        auto start = std::chrono::steady_clock::now();
+        void* pixels;
+        {
+            std::unique_ptr<ScopedDecodeArena> scope(arena ? new ScopedDecodeArena() : NULL);
+            if (image.wide)
+                pixels = stbi_load_16_from_memory(image.bytes.data(), (int)image.bytes.size(), &x, &y, &comp, channels);
+            else
+                pixels = stbi_load_from_memory(image.bytes.data(), (int)image.bytes.size(), &x, &y, &comp, channels);
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (!pixels)
+        {
+            result.error = stbi_failure_reason() ? stbi_failure_reason() : "unknown error";
+            return result;
+        }
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        result.allocations = heapcount::allocations.load() - allocationsBefore;
+        result.peakHeap = heapcount::peak.load() - liveBefore;
+        stbi_image_free(pixels);
+
+        result.width = x;
+        result.height = y;
+        result.channels = channels ? channels : comp;
+        result.decodedBytes = (size_t)x * y * result.channels * (image.wide ? 2 : 1);
+    }
+    std::sort(times.begin(), times.end());
+    result.bestMs = times.front();
+    result.medianMs = times[times.size() / 2];
+    return result;
+}
+
+static double megabytesPerSecond(size_t bytes, double ms)
+{
+    return ms > 0.0 ? bytes / (ms * 1000.0) : 0.0;
+}
+
+static std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+            quoted += '\\';
+        quoted += text[i];
+    }
+    return quoted + "\"";
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 5, threads = 0, channels = 0;
+    bool arena = false;
+    std::string only, seaFile = "../Q3/Sea.jpg", dumpDir, outFile;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--repeat" && hasValue)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue)
+            threads = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--channels" && hasValue)
+            channels = std::min(4, std::max(0, std::atoi(argv[++i])));
+        else if (arg == "--arena")
+            arena = true;
+        else if (arg == "--only" && hasValue)
+            only = argv[++i];
+        else if (arg == "--sea" && hasValue)
+            seaFile = argv[++i];
+        else if (arg == "--dump" && hasValue)
+            dumpDir = argv[++i];
+        else if (arg == "--out" && hasValue)
+            outFile = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--repeat N] [--threads N] [--channels N] [--arena] [--only TEXT]"
+                                 " [--sea FILE] [--dump DIR] [--out FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<CorpusImage> corpus = buildCorpus(seaFile, only);
+    if (!dumpDir.empty())
+        for (size_t i = 0; i < corpus.size(); i++)
+        {
+            std::string file = dumpDir + "/" + corpus[i].name + "." + corpus[i].extension;
+            FILE* f = std::fopen(file.c_str(), "wb");
+            if (!f || std::fwrite(corpus[i].bytes.data(), 1, corpus[i].bytes.size(), f) != corpus[i].bytes.size())
+                std::fprintf(stderr, "DecodeBenchmark: could not write %s\n", file.c_str());
+            if (f)
+                std::fclose(f);
+        }
+
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 0)
+    {
+        pool.reset(new ThreadPool(threads));
+        stbi_set_parallel_for([](void* user, int count, void (*task)(void* arg, int index), void* arg)
+        {
+            static_cast<ThreadPool*>(user)->parallelFor(count, [task, arg](int index) { task(arg, index); });
+        }, pool.get());
+    }
+
+    FILE* out = outFile.empty() ? stdout : std::fopen(outFile.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "DecodeBenchmark: could not open %s\n", outFile.c_str());
+        return 1;
+    }
+
+    // the SIMD paths this build compiled in and this machine can run
+    std::string features;
+    auto feature = [&](const char* name)
+    {
+        features += std::string(features.empty() ? "\"" : ", \"") + name + "\"";
+    };
+#ifdef STBI_SSE2
+    if (stbi__sse2_available())
+        feature("sse2");
+#endif
+#ifdef STBI_SSSE3
+    if (stbi__ssse3_available())
+        feature("ssse3");
+#endif
+#ifdef STBI_AVX2
+    if (stbi__avx2_available())
+        feature("avx2");
+#endif
+#ifdef STBI_NEON
+    feature("neon");
+#endif
+    std::fprintf(out, "{\n  \"benchmark\": \"stb_image decode\",\n  \"repeat\": %d,\n  \"threads\": %d,\n"
+                      "  \"channels\": %d,\n  \"arena\": %s,\n  \"simd\": [%s],\n  \"fast_bits\": %d,\n  \"zfast_bits\": %d,\n"
+                      "  \"images\": [\n",
+                 repeat, threads, channels, arena ? "true" : "false", features.c_str(), STBI_FAST_BITS, STBI_ZFAST_BITS);
+
+    // images of one path are decoded back to back so the resident-set peak belongs to that path
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < corpus.size(); i++)
+        if (std::find(paths.begin(), paths.end(), corpus[i].path) == paths.end())
+            paths.push_back(corpus[i].path);
+
+    struct Summary
+    {
+        int images;
+        size_t encodedBytes, decodedBytes, allocations, peakHeap, startRss, peakRss;
+        double bestMs;
+    };
+    std::vector<Summary> summaries;
+    bool failed = false, first = true;
+    for (size_t p = 0; p < paths.size(); p++)
+    {
+        Summary summary = { 0, 0, 0, 0, 0, 0, 0, 0.0 };
+        resetPeakRss();
+        summary.startRss = residentBytes();
+        for (size_t i = 0; i < corpus.size(); i++)
+        {
+            const CorpusImage& image = corpus[i];
+            if (image.path != paths[p])
+                continue;
+            Result r = measure(image, repeat, channels, arena);
+            std::fprintf(out, "%s    {\"name\": %s, \"path\": %s, ", first ? "" : ",\n",
+                         jsonString(image.name).c_str(), jsonString(image.path).c_str());
+            first = false;
+            if (!r.error.empty())
+            {
+                std::fprintf(out, "\"encoded_bytes\": %zu, \"error\": %s}", image.bytes.size(), jsonString(r.error).c_str());
+                failed = true;
+                continue;
+            }
+            std::fprintf(out, "\"width\": %d, \"height\": %d, \"channels\": %d, \"bits\": %d, "
+                              "\"encoded_bytes\": %zu, \"decoded_bytes\": %zu, \"best_ms\": %.3f, \"median_ms\": %.3f, "
+                              "\"mb_per_s\": %.1f, \"input_mb_per_s\": %.1f, \"allocations\": %zu, \"peak_heap_bytes\": %zu}",
+                         r.width, r.height, r.channels, image.wide ? 16 : 8,
+                         image.bytes.size(), r.decodedBytes, r.bestMs, r.medianMs,
+                         megabytesPerSecond(r.decodedBytes, r.bestMs), megabytesPerSecond(image.bytes.size(), r.bestMs),
+                         r.allocations, r.peakHeap);
+            summary.images++;
+            summary.encodedBytes += image.bytes.size();
+            summary.decodedBytes += r.decodedBytes;
+            summary.allocations += r.allocations;
+            summary.peakHeap = std::max(summary.peakHeap, r.peakHeap);
+            summary.bestMs += r.bestMs;
+        }
+        summary.peakRss = peakResidentBytes();
+        summaries.push_back(summary);
+    }
+
+    std::fprintf(out, "\n  ],\n  \"paths\": [\n");
+    for (size_t p = 0; p < paths.size(); p++)
+    {
+        const Summary& s = summaries[p];
+        std::fprintf(out, "    {\"path\": %s, \"images\": %d, \"encoded_bytes\": %zu, \"decoded_bytes\": %zu, "
+                          "\"best_ms\": %.3f, \"mb_per_s\": %.1f, \"input_mb_per_s\": %.1f, \"allocations\": %zu, "
+                          "\"peak_heap_bytes\": %zu, \"start_rss_bytes\": %zu, \"peak_rss_bytes\": %zu}%s\n",
+                     jsonString(paths[p]).c_str(), s.images, s.encodedBytes, s.decodedBytes, s.bestMs,
+                     megabytesPerSecond(s.decodedBytes, s.bestMs), megabytesPerSecond(s.encodedBytes, s.bestMs),
+                     s.allocations, s.peakHeap, s.startRss, s.peakRss, p + 1 < paths.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+
+    if (out != stdout)
+        std::fclose(out);
+    stbi_set_parallel_for(NULL, NULL);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../Common/ImageWriter.h"
+#include "SyntheticImages.h"
+
+// frame capture encoding benchmark for ImageWriter.h
+// --------------------------------------------------
+// Encodes a run of frames, each to its own file, with every writer (PPM, QOI and PNG) on one
+// thread and on a pool, and writes one JSON document with frames per second, input megabytes per
+// second (RGB, 1 MB = 10^6 bytes) and the compression ratio of each case. Frames reach the
+// writers bottom-up in 64-row bands, as glReadPixels returns them. Two kinds of frame: "rendered"
+// ones (flat shapes over a gradient, like the engine's scenes) and "photo" ones (the decode
+// benchmark's synthetic pictures, grain included), eight different frames of each in turn.
+//
+// usage: EncodeBenchmark [--frames N] [--size WxH] [--threads N] [--direct] [--only TEXT]
+//                        [--dir DIR] [--out FILE]
+//   --frames N    frames per case (default 60)
+//   --size WxH    frame size (default 1920x1080)
+//   --threads N   workers in the pooled cases (default: one per hardware thread, less one)
+//   --direct      open the files with the page cache bypassed where possible
+//   --only TEXT   run only the cases whose name contains TEXT
+//   --dir DIR     where the frames are written (default: the current folder)
+
+// flat discs and bars over a vertical gradient, moved along by frame
+static std::vector<unsigned char> renderedFrame(int width, int height, int frame)
+{
+    std::vector<unsigned char> pixels((size_t)width * height * 4);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            unsigned char* p = &pixels[((size_t)y * width + x) * 4];
+            p[0] = (unsigned char)(30 + 60 * y / height);
+            p[1] = (unsigned char)(40 + 90 * y / height);
+            p[2] = (unsigned char)(90 + 120 * y / height);
+            p[3] = 255;
+        }
+    for (int i = 0; i < 24; i++)
+    {
+        unsigned int h = syntheticimages::hash(i * 31 + 7);
+        int cx = (int)((h & 0xFFFF) * (unsigned)width >> 16) + frame * (i % 5 + 1) * 3;
+        int cy = (int)((h >> 16) * (unsigned)height >> 16);
+        int radius = height / 40 + (int)(h % (unsigned)(height / 12 + 1));
+        unsigned char colour[3] = { (unsigned char)(h >> 3), (unsigned char)(h >> 11), (unsigned char)(h >> 19) };
+        cx %= width;
+        for (int y = std::max(0, cy - radius); y < std::min(height, cy + radius); y++)
+            for (int x = std::max(0, cx - radius); x < std::min(width, cx + radius); x++)
+            {
+                bool inside = i % 3 ? (x - cx) * (x - cx) + (y - cy) * (y - cy) < radius * radius : std::abs(y - cy) < radius / 4;
+                if (inside)
+                    std::memcpy(&pixels[((size_t)y * width + x) * 4], colour, 3);
+            }
+    }
+    return pixels;
+}
+
+static std::vector<unsigned char> photoFrame(int width, int height, int frame)
+{
+    std::vector<unsigned short> samples = syntheticimages::makePicture(width, height, 3, (unsigned int)frame + 1);
+    std::vector<unsigned char> pixels((size_t)width * height * 4, 255);
+    for (size_t i = 0; i < (size_t)width * height; i++)
+        for (int c = 0; c < 3; c++)
+            pixels[i * 4 + c] = (unsigned char)(samples[i * 3 + c] >> 8);
+    return pixels;
+}
+
+static std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+            quoted += '\\';
+        quoted += text[i];
+    }
+    return quoted + "\"";
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 60, width = 1920, height = 1080, threads = 0;
+    bool direct = false;
+    std::string only, dir = ".", outFile;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--frames" && hasValue)
+            frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--size" && hasValue)
+        {
+            const char* size = argv[++i];
+            width = height = std::atoi(size);
+            if (const char* x = std::strchr(size, 'x'))
+                height = std::atoi(x + 1);
+        }
+        else if (arg == "--threads" && hasValue)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--direct")
+            direct = true;
+        else if (arg == "--only" && hasValue)
+            only = argv[++i];
+        else if (arg == "--dir" && hasValue)
+            dir = argv[++i];
+        else if (arg == "--out" && hasValue)
+            outFile = argv[++i];
+        else
+            width = 0;
+    }
+    if (width < 1 || height < 1)
+    {
+        std::fprintf(stderr, "usage: EncodeBenchmark [--frames N] [--size WxH] [--threads N] [--direct] [--only TEXT] "
+                             "[--dir DIR] [--out FILE]\n");
+        return 1;
+    }
+
+    FILE* out = outFile.empty() ? stdout : std::fopen(outFile.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "EncodeBenchmark: could not open %s\n", outFile.c_str());
+        return 1;
+    }
+    ThreadPool pool(threads);
+    std::fprintf(out, "{\n  \"benchmark\": \"frame encode\",\n  \"frames\": %d,\n  \"width\": %d,\n  \"height\": %d,\n"
+                      "  \"threads\": %u,\n  \"direct\": %s,\n  \"cases\": [\n",
+                 frames, width, height, pool.size() + 1, direct ? "true" : "false");
+
+    const int DISTINCT = 8, BAND = 64;
+    const char* formats[3] = { "ppm", "qoi", "png" };
+    const char* kinds[2] = { "rendered", "photo" };
+    bool first = true;
+    for (int kind = 0; kind < 2; kind++)
+    {
+        std::vector<std::vector<unsigned char> > images;
+        for (int f = 0; f < DISTINCT; f++)
+            images.push_back(kind == 0 ? renderedFrame(width, height, f) : photoFrame(width, height, f));
+        for (int format = 0; format < 3; format++)
+            for (int pooled = 0; pooled < 2; pooled++)
+            {
+                // PPM is never encoded in parallel
+                if (pooled && format == 0)
+                    continue;
+                std::string name = std::string(kinds[kind]) + " " + formats[format] + (pooled ? " pool" : " 1 thread");
+                if (!only.empty() && name.find(only) == std::string::npos)
+                    continue;
+                unsigned long long outputBytes = 0;
+                bool ok = true;
+                auto start = std::chrono::steady_clock::now();
+                for (int f = 0; f < frames && ok; f++)
+                {
+                    char path[64];
+                    std::snprintf(path, sizeof(path), "/frame%03d.%s", f, formats[format]);
+                    std::string file = dir + path;
+                    std::unique_ptr<ImageSink> writer;
+                    if (format == 0)
+                        writer.reset(new PpmWriter(file));
+                    else if (format == 1)
+                        writer.reset(new QoiWriter(file, pooled ? &pool : NULL, false, direct));
+                    else
+                        writer.reset(new PngWriter(file, pooled ? &pool : NULL, false, direct));
+                    const std::vector<unsigned char>& image = images[f % DISTINCT];
+                    std::ptrdiff_t stride = (std::ptrdiff_t)width * 4;
+                    ok = writer->begin(width, height);
+                    for (int top = 0; top < height && ok; top += BAND)
+                    {
+                        int rows = std::min(BAND, height - top);
+                        ok = writer->write(&image[(size_t)(top + rows - 1) * stride], rows, -stride);
+                    }
+                    ok = writer->finish() && ok;
+                    if (format == 0)
+                        outputBytes += (unsigned long long)width * height * 3 + std::snprintf(NULL, 0, "P6\n%d %d\n255\n", width, height);
+                    else
+                        outputBytes += static_cast<BandedImageWriter*>(writer.get())->bytesWritten();
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (!ok)
+                {
+                    std::fprintf(stderr, "EncodeBenchmark: could not write to %s\n", dir.c_str());
+                    return 1;
+                }
+                double inputBytes = (double)width * height * 3 * frames;
+                std::fprintf(out, "%s    {\"name\": %s, \"fps\": %.1f, \"mb_per_s\": %.1f, \"ratio\": %.3f}", first ? "" : ",\n",
+                             jsonString(name).c_str(), frames / seconds, inputBytes / 1e6 / seconds, inputBytes / outputBytes);
+                first = false;
+            }
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
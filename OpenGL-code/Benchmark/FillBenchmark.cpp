@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "../Common/SoftRasterizer.h"
+
+// triangle fill throughput benchmark for SoftRasterizer.h
+// -------------------------------------------------------
+// Times the gradient row kernels on their own, once per SIMD path this machine can run, and
+// then softraster::fillTriangle() (which picks the widest path) on a few triangle sets: the
+// demos' colour gradient triangle filling most of the image, thousands of small triangles, and
+// the same sets textured. Writes one JSON document with the best and median time of each case
+// and its throughput in megapixels per second, counting covered pixels only (1 Mpix = 10^6).
+//
+// usage: FillBenchmark [--repeat N] [--size N] [--small N] [--only TEXT] [--out FILE]
+//   --size N      fill an N x N image (default 1000)
+//   --small N     number of small triangles (default 20000)
+//   --only TEXT   run only the cases whose name contains TEXT
+
+struct Timing
+{
+    double bestMs, medianMs;
+};
+
+static Timing measure(int repeat, const std::function<void()>& run)
+{
+    std::vector<double> times;
+    for (int r = 0; r < repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    Timing timing = { times.front(), times[times.size() / 2] };
+    return timing;
+}
+
+static double megapixelsPerSecond(size_t pixels, double ms)
+{
+    return ms > 0.0 ? pixels / (ms * 1000.0) : 0.0;
+}
+
+// pixels fillTriangle() covers for a triangle inside the image, from the same setup
+static size_t coveredPixels(int width, int height, const softraster::FillVertex vertices[3])
+{
+    using namespace softraster;
+    float x[3], y[3];
+    const float* attributes[3];
+    float none[ATTRIBUTES] = {};
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = vertices[i].x;
+        y[i] = vertices[i].y;
+        attributes[i] = none;
+    }
+    Triangle t;
+    if (!setupTriangle(x, y, attributes, width, height, t))
+        return 0;
+    size_t covered = 0;
+    for (int y0 = t.minY; y0 <= t.maxY; y0++)
+        for (int x0 = t.minX; x0 <= t.maxX; x0 += 64)
+        {
+            int count = std::min(64, t.maxX - x0 + 1), e[3];
+            for (int i = 0; i < 3; i++)
+                e[i] = (int)((long long)t.A[i] * x0 + (long long)t.B[i] * y0 + t.C[i]);
+            unsigned long long mask = coverRowScalar(e, t.A, count);
+            for (; mask; mask &= mask - 1)
+                covered++;
+        }
+    return covered;
+}
+
+static softraster::FillVertex fillVertex(float x, float y, float r, float g, float b, float u, float v)
+{
+    softraster::FillVertex vertex = { x, y, { r, g, b, 1.0f }, u, v };
+    return vertex;
+}
+
+// the demos' colour gradient triangle, scaled to the image
+static std::vector<softraster::FillVertex> largeTriangle(int size)
+{
+    std::vector<softraster::FillVertex> vertices;
+    vertices.push_back(fillVertex(size * 0.05f, size * 0.05f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+    vertices.push_back(fillVertex(size * 0.95f, size * 0.05f, 0.0f, 1.0f, 0.0f, 4.0f, 0.0f));
+    vertices.push_back(fillVertex(size * 0.5f, size * 0.95f, 0.0f, 0.0f, 1.0f, 2.0f, 4.0f));
+    return vertices;
+}
+
+// count triangles of 4-16 pixels a side scattered over the image, in a fixed pseudo-random order
+static std::vector<softraster::FillVertex> smallTriangles(int size, int count)
+{
+    std::vector<softraster::FillVertex> vertices;
+    unsigned int state = 12345;
+    auto next = [&state](float range)
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f) * range;
+    };
+    for (int i = 0; i < count; i++)
+    {
+        float side = 4.0f + next(12.0f);
+        float x = next(size - side), y = next(size - side);
+        vertices.push_back(fillVertex(x, y, next(1.0f), next(1.0f), next(1.0f), 0.0f, 0.0f));
+        vertices.push_back(fillVertex(x + side, y + next(side), next(1.0f), next(1.0f), next(1.0f), 1.0f, 0.0f));
+        vertices.push_back(fillVertex(x + next(side), y + side, next(1.0f), next(1.0f), next(1.0f), 0.0f, 1.0f));
+    }
+    return vertices;
+}
+
+static std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+            quoted += '\\';
+        quoted += text[i];
+    }
+    return quoted + "\"";
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 5, size = 1000, smallCount = 20000;
+    std::string only, outFile;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--repeat" && hasValue)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--size" && hasValue)
+            size = std::max(16, std::min(softraster::MAX_SIZE, std::atoi(argv[++i])));
+        else if (arg == "--small" && hasValue)
+            smallCount = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--only" && hasValue)
+            only = argv[++i];
+        else if (arg == "--out" && hasValue)
+            outFile = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "usage: FillBenchmark [--repeat N] [--size N] [--small N] [--only TEXT] [--out FILE]\n");
+            return 1;
+        }
+    }
+
+    FILE* out = outFile.empty() ? stdout : std::fopen(outFile.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "FillBenchmark: could not open %s\n", outFile.c_str());
+        return 1;
+    }
+    std::fprintf(out, "{\n  \"benchmark\": \"triangle fill\",\n  \"repeat\": %d,\n  \"size\": %d,\n  \"cases\": [\n", repeat, size);
+    bool first = true;
+    auto report = [&](const std::string& name, const char* path, size_t pixels, const Timing& timing)
+    {
+        std::fprintf(out, "%s    {\"name\": %s, \"path\": %s, \"pixels\": %zu, \"best_ms\": %.3f, \"median_ms\": %.3f, "
+                          "\"mpix_per_s\": %.1f}",
+                     first ? "" : ",\n", jsonString(name).c_str(), jsonString(path).c_str(), pixels, timing.bestMs,
+                     timing.medianMs, megapixelsPerSecond(pixels, timing.bestMs));
+        first = false;
+    };
+    auto wanted = [&only](const std::string& name)
+    {
+        return only.empty() || name.find(only) != std::string::npos;
+    };
+
+    std::vector<unsigned char> image((size_t)size * size * 4, 0);
+
+    // row kernels: every row of the image fully covered, one 64-pixel call at a time
+    typedef std::function<int(const int*, const int*, int, const float*, const float*, const float*, unsigned char*)> RowKernel;
+    struct KernelPath
+    {
+        const char* name;
+        bool available;
+        RowKernel kernel;
+    };
+    std::vector<KernelPath> kernels;
+    kernels.push_back(KernelPath{ "scalar", true, [](const int*, const int*, int, const float*, const float*, const float*, unsigned char*) { return 0; } });
+#if defined(CPU_SSE2)
+    kernels.push_back(KernelPath{ "sse2", true, softraster::gradientRowSSE2 });
+#endif
+#if defined(CPU_X86)
+    kernels.push_back(KernelPath{ "avx2", cpufeatures::hasAVX2(), softraster::gradientRowAVX2 });
+    kernels.push_back(KernelPath{ "avx512", cpufeatures::hasAVX512BW(), softraster::gradientRowAVX512 });
+#elif defined(CPU_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+    kernels.push_back(KernelPath{ "neon", true, softraster::gradientRowNEON });
+#endif
+    // the path gradientRow() dispatches to: the widest one available
+    const char* widest = "scalar";
+    for (size_t k = 0; k < kernels.size(); k++)
+        if (kernels[k].available)
+            widest = kernels[k].name;
+    for (size_t k = 0; k < kernels.size(); k++)
+    {
+        std::string name = std::string("row kernel ") + kernels[k].name;
+        if (!kernels[k].available || !wanted(name))
+            continue;
+        const RowKernel& kernel = kernels[k].kernel;
+        Timing timing = measure(repeat, [&]()
+        {
+            static const int e[3] = { 0, 0, 0 }, step[3] = { 0, 0, 0 };
+            static const float delta[4] = { 0.001f, -0.001f, 0.0005f, 0.0f }, scale[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x += 64)
+                {
+                    float start[4] = { 0.1f, 0.9f, (float)y / size, 1.0f };
+                    int count = std::min(64, size - x);
+                    unsigned char* row = &image[((size_t)y * size + x) * 4];
+                    int done = kernel(e, step, count, start, delta, scale, row);
+                    softraster::gradientRowScalar(e, step, count, start, delta, scale, row, done);
+                }
+        });
+        report(name, kernels[k].name, (size_t)size * size, timing);
+    }
+
+    // whole triangles through fillTriangle()
+    SoftTexture texture;
+    {
+        std::vector<unsigned char> checker(256 * 256 * 3);
+        for (int y = 0; y < 256; y++)
+            for (int x = 0; x < 256; x++)
+            {
+                unsigned char* texel = &checker[((size_t)y * 256 + x) * 3];
+                bool dark = ((x >> 5) ^ (y >> 5)) & 1;
+                texel[0] = dark ? 40 : 220;
+                texel[1] = (unsigned char)x;
+                texel[2] = (unsigned char)y;
+            }
+        texture.assign(checker.data(), 256, 256, 3);
+        texture.minFilter = GL_LINEAR;
+    }
+    struct FillCase
+    {
+        const char* name;
+        std::vector<softraster::FillVertex> vertices;
+        const SoftTexture* texture;
+    };
+    std::vector<FillCase> cases;
+    cases.push_back(FillCase{ "gradient large", largeTriangle(size), NULL });
+    cases.push_back(FillCase{ "gradient small", smallTriangles(size, smallCount), NULL });
+    cases.push_back(FillCase{ "textured large", largeTriangle(size), &texture });
+    cases.push_back(FillCase{ "textured small", smallTriangles(size, smallCount), &texture });
+    for (size_t c = 0; c < cases.size(); c++)
+    {
+        const FillCase& fill = cases[c];
+        if (!wanted(fill.name))
+            continue;
+        size_t pixels = 0;
+        for (size_t i = 0; i + 2 < fill.vertices.size(); i += 3)
+            pixels += coveredPixels(size, size, &fill.vertices[i]);
+        Timing timing = measure(repeat, [&]()
+        {
+            for (size_t i = 0; i + 2 < fill.vertices.size(); i += 3)
+                softraster::fillTriangle(image.data(), size, size, (size_t)size * 4, &fill.vertices[i], fill.texture);
+        });
+        report(fill.name, widest, pixels, timing);
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
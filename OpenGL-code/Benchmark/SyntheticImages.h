@@ -0,0 +1,940 @@
+#ifndef SYNTHETIC_IMAGES_H
+#define SYNTHETIC_IMAGES_H
+
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+// deterministic test pictures and small JPEG/PNG encoders for the decode benchmark
+// --------------------------------------------------------------------------------
+// The pictures are a smooth gradient with a few soft discs, ripples and per-pixel grain:
+// close enough to a photograph that the decoders see realistic coefficients and filter
+// residuals, and bit-identical on every machine and build. The encoders cover the decoder
+// paths that differ: baseline and progressive (spectral selection) JPEG with any sampling
+// factors and restart interval, and 8/16-bit PNG with a fixed or per-row filter, Adam7
+// interlacing and dynamic-Huffman deflate. They favour being short over compressing well.
+
+namespace syntheticimages
+{
+    inline unsigned int hash(unsigned int x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // width * height * channels 16-bit samples, row-major; the last channel of 2- and
+    // 4-channel pictures is an alpha mask that fades out towards the corners
+    inline std::vector<unsigned short> makePicture(int width, int height, int channels, unsigned int seed)
+    {
+        std::vector<unsigned short> samples((size_t)width * height * channels);
+        float discX[4], discY[4], discR[4];
+        for (int i = 0; i < 4; i++)
+        {
+            discX[i] = (hash(seed * 8 + i * 2) & 1023) / 1023.0f;
+            discY[i] = (hash(seed * 8 + i * 2 + 1) & 1023) / 1023.0f;
+            discR[i] = 0.05f + (hash(seed * 8 + i + 100) & 255) / 1200.0f;
+        }
+        bool hasAlpha = channels == 2 || channels == 4;
+        int colours = hasAlpha ? channels - 1 : channels;
+        size_t at = 0;
+        for (int y = 0; y < height; y++)
+        {
+            float v = (y + 0.5f) / height;
+            for (int x = 0; x < width; x++)
+            {
+                float u = (x + 0.5f) / width;
+                float shade = 0.0f;
+                for (int i = 0; i < 4; i++)
+                {
+                    float dx = u - discX[i], dy = v - discY[i];
+                    float d = std::sqrt(dx * dx + dy * dy) / discR[i];
+                    if (d < 1.0f)
+                        shade += 0.25f * (1.0f - d * d);
+                }
+                float ripple = 0.06f * std::sin(u * 41.0f + std::sin(v * 13.0f) * 3.0f);
+                for (int c = 0; c < colours; c++)
+                {
+                    float value = 0.2f + 0.55f * v + 0.15f * (c - 1) * (u - 0.5f) + shade * (1.0f - 0.3f * c) + ripple;
+                    unsigned int grain = hash((unsigned int)y * 73856093u ^ (unsigned int)x * 19349663u ^ (unsigned int)c * 83492791u ^ seed);
+                    value += ((grain & 1023) / 1023.0f - 0.5f) * 0.035f;
+                    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+                    samples[at++] = (unsigned short)(value * 65535.0f + 0.5f);
+                }
+                if (hasAlpha)
+                {
+                    float dx = u - 0.5f, dy = v - 0.5f;
+                    float alpha = 1.4f - 2.2f * (dx * dx + dy * dy) * 2.0f;
+                    alpha = alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+                    samples[at++] = (unsigned short)(alpha * 65535.0f + 0.5f);
+                }
+            }
+        }
+        return samples;
+    }
+
+    // the top byte of every sample
+    inline std::vector<unsigned char> toBytes(const std::vector<unsigned short>& samples)
+    {
+        std::vector<unsigned char> bytes(samples.size());
+        for (size_t i = 0; i < samples.size(); i++)
+            bytes[i] = (unsigned char)(samples[i] >> 8);
+        return bytes;
+    }
+
+    // ---------------------------------------------------------------- JPEG
+
+    struct JpegOptions
+    {
+        int lumaH = 2, lumaV = 2;   // luma sampling factors: 2x2 is 4:2:0, 2x1 4:2:2, 1x1 4:4:4
+        int restartInterval = 0;    // in MCUs, 0 for none
+        bool progressive = false;   // DC scan, then two AC bands per component
+        int quality = 85;
+    };
+
+    namespace jpeg
+    {
+        // the example tables of ITU T.81 Annex K
+        static const unsigned char dcLengths[2][16] = {
+            { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+            { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 } };
+        static const unsigned char dcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+        static const unsigned char acLengths[2][16] = {
+            { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d },
+            { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 } };
+        static const unsigned char acSymbols[2][162] = {
+            { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+              0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+              0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+              0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+              0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+              0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+              0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+              0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+              0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+              0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+              0xf9, 0xfa },
+            { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+              0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+              0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+              0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+              0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+              0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+              0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+              0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+              0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+              0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+              0xf9, 0xfa } };
+        static const int baseQuant[2][64] = {
+            { 16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+              14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+              18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+              49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99 },
+            { 17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+              24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+              99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+              99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99 } };
+        static const int zigzag[64] = {
+            0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+            12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+            35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+            58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+        struct HuffmanCode
+        {
+            unsigned short code[256];
+            unsigned char length[256];
+
+            void build(const unsigned char lengths[16], const unsigned char* symbols)
+            {
+                int k = 0, code = 0;
+                for (int bits = 1; bits <= 16; bits++)
+                {
+                    for (int i = 0; i < lengths[bits - 1]; i++, k++)
+                    {
+                        this->code[symbols[k]] = (unsigned short)code++;
+                        length[symbols[k]] = (unsigned char)bits;
+                    }
+                    code <<= 1;
+                }
+            }
+        };
+
+        // MSB-first entropy-coded segment with 0xFF byte stuffing
+        struct BitWriter
+        {
+            std::vector<unsigned char>& out;
+            unsigned int buffer = 0;
+            int count = 0;
+
+            explicit BitWriter(std::vector<unsigned char>& target) : out(target) {}
+
+            void put(unsigned int bits, int length)
+            {
+                buffer = (buffer << length) | (bits & ((1u << length) - 1));
+                count += length;
+                while (count >= 8)
+                {
+                    unsigned char byte = (unsigned char)(buffer >> (count - 8));
+                    out.push_back(byte);
+                    if (byte == 0xff)
+                        out.push_back(0);
+                    count -= 8;
+                }
+                buffer &= (1u << count) - 1;
+            }
+            // pads with one bits up to a byte boundary
+            void flush()
+            {
+                if (count)
+                    put(0x7f, 8 - count);
+            }
+        };
+
+        inline int magnitudeBits(int value)
+        {
+            value = value < 0 ? -value : value;
+            int bits = 0;
+            for (; value; value >>= 1)
+                bits++;
+            return bits;
+        }
+
+        inline void putValue(BitWriter& writer, const HuffmanCode& table, int symbol, int value, int bits)
+        {
+            writer.put(table.code[symbol], table.length[symbol]);
+            if (bits)
+                writer.put(value < 0 ? value + (1 << bits) - 1 : value, bits);
+        }
+
+        inline void put16(std::vector<unsigned char>& out, int value)
+        {
+            out.push_back((unsigned char)(value >> 8));
+            out.push_back((unsigned char)value);
+        }
+    }
+
+    // pixels: width * height * channels bytes, grey (1) or RGB (3)
+    inline std::vector<unsigned char> encodeJpeg(const unsigned char* pixels, int width, int height, int channels, const JpegOptions& options)
+    {
+        using namespace jpeg;
+        int components = channels == 1 ? 1 : 3;
+        int h[3] = { options.lumaH, 1, 1 }, v[3] = { options.lumaV, 1, 1 };
+        if (components == 1)
+            h[0] = v[0] = 1;
+        int mcuX = (width + 8 * h[0] - 1) / (8 * h[0]);
+        int mcuY = (height + 8 * v[0] - 1) / (8 * v[0]);
+
+        int quant[2][64];
+        int scale = options.quality < 50 ? 5000 / options.quality : 200 - options.quality * 2;
+        for (int t = 0; t < 2; t++)
+            for (int i = 0; i < 64; i++)
+            {
+                int q = (baseQuant[t][i] * scale + 50) / 100;
+                quant[t][i] = q < 1 ? 1 : (q > 255 ? 255 : q);
+            }
+
+        // quantised coefficients of every block of every component, over the MCU-padded planes
+        float basis[8][8];
+        for (int x = 0; x < 8; x++)
+            for (int u = 0; u < 8; u++)
+                basis[x][u] = std::cos((2 * x + 1) * u * 3.14159265f / 16.0f) * (u ? 0.5f : 0.35355339f);
+        std::vector<int> coefficients[3];
+        int blocksX[3], blocksY[3];
+        for (int c = 0; c < components; c++)
+        {
+            int stepX = h[0] / h[c], stepY = v[0] / v[c];
+            blocksX[c] = mcuX * h[c];
+            blocksY[c] = mcuY * v[c];
+            coefficients[c].resize((size_t)blocksX[c] * blocksY[c] * 64);
+            const int* q = quant[c ? 1 : 0];
+            for (int by = 0; by < blocksY[c]; by++)
+                for (int bx = 0; bx < blocksX[c]; bx++)
+                {
+                    // level-shifted samples, box-filtered down for subsampled chroma
+                    float block[64], rows[64];
+                    for (int y = 0; y < 8; y++)
+                        for (int x = 0; x < 8; x++)
+                        {
+                            float sum = 0.0f;
+                            for (int dy = 0; dy < stepY; dy++)
+                                for (int dx = 0; dx < stepX; dx++)
+                                {
+                                    int sx = ((bx * 8 + x) * stepX + dx), sy = ((by * 8 + y) * stepY + dy);
+                                    sx = sx < width ? sx : width - 1;
+                                    sy = sy < height ? sy : height - 1;
+                                    const unsigned char* p = pixels + ((size_t)sy * width + sx) * channels;
+                                    float value;
+                                    if (components == 1)
+                                        value = p[0];
+                                    else if (c == 0)
+                                        value = 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+                                    else if (c == 1)
+                                        value = -0.168736f * p[0] - 0.331264f * p[1] + 0.5f * p[2] + 128.0f;
+                                    else
+                                        value = 0.5f * p[0] - 0.418688f * p[1] - 0.081312f * p[2] + 128.0f;
+                                    sum += value;
+                                }
+                            block[y * 8 + x] = sum / (stepX * stepY) - 128.0f;
+                        }
+                    for (int y = 0; y < 8; y++)
+                        for (int u = 0; u < 8; u++)
+                        {
+                            float sum = 0.0f;
+                            for (int x = 0; x < 8; x++)
+                                sum += block[y * 8 + x] * basis[x][u];
+                            rows[y * 8 + u] = sum;
+                        }
+                    int* out = &coefficients[c][((size_t)by * blocksX[c] + bx) * 64];
+                    for (int vv = 0; vv < 8; vv++)
+                        for (int u = 0; u < 8; u++)
+                        {
+                            float sum = 0.0f;
+                            for (int y = 0; y < 8; y++)
+                                sum += rows[y * 8 + u] * basis[y][vv];
+                            int value = (int)std::floor(sum / q[vv * 8 + u] + 0.5f);
+                            // AC categories stop at 10 bits
+                            out[vv * 8 + u] = value < -1023 ? -1023 : (value > 1023 ? 1023 : value);
+                        }
+                }
+        }
+
+        HuffmanCode dcCodes[2], acCodes[2];
+        for (int t = 0; t < 2; t++)
+        {
+            dcCodes[t].build(dcLengths[t], dcSymbols);
+            acCodes[t].build(acLengths[t], acSymbols[t]);
+        }
+
+        std::vector<unsigned char> out;
+        out.push_back(0xff); out.push_back(0xd8);
+        int tables = components == 1 ? 1 : 2;
+        for (int t = 0; t < tables; t++)
+        {
+            out.push_back(0xff); out.push_back(0xdb);
+            put16(out, 67);
+            out.push_back((unsigned char)t);
+            for (int i = 0; i < 64; i++)
+                out.push_back((unsigned char)quant[t][zigzag[i]]);
+        }
+        out.push_back(0xff); out.push_back(options.progressive ? 0xc2 : 0xc0);
+        put16(out, 8 + 3 * components);
+        out.push_back(8);
+        put16(out, height);
+        put16(out, width);
+        out.push_back((unsigned char)components);
+        for (int c = 0; c < components; c++)
+        {
+            out.push_back((unsigned char)(c + 1));
+            out.push_back((unsigned char)(h[c] * 16 + v[c]));
+            out.push_back(c ? 1 : 0);
+        }
+        for (int t = 0; t < tables; t++)
+        {
+            int count = 0;
+            for (int i = 0; i < 16; i++)
+                count += dcLengths[t][i];
+            out.push_back(0xff); out.push_back(0xc4);
+            put16(out, 19 + count);
+            out.push_back((unsigned char)t);
+            out.insert(out.end(), dcLengths[t], dcLengths[t] + 16);
+            out.insert(out.end(), dcSymbols, dcSymbols + count);
+            count = 0;
+            for (int i = 0; i < 16; i++)
+                count += acLengths[t][i];
+            out.push_back(0xff); out.push_back(0xc4);
+            put16(out, 19 + count);
+            out.push_back((unsigned char)(0x10 | t));
+            out.insert(out.end(), acLengths[t], acLengths[t] + 16);
+            out.insert(out.end(), acSymbols[t], acSymbols[t] + count);
+        }
+        if (options.restartInterval)
+        {
+            out.push_back(0xff); out.push_back(0xdd);
+            put16(out, 4);
+            put16(out, options.restartInterval);
+        }
+
+        // one scan over the given components and zigzag band [first, last]
+        auto scan = [&](const int* list, int count, int first, int last)
+        {
+            out.push_back(0xff); out.push_back(0xda);
+            put16(out, 6 + 2 * count);
+            out.push_back((unsigned char)count);
+            for (int i = 0; i < count; i++)
+            {
+                out.push_back((unsigned char)(list[i] + 1));
+                out.push_back(list[i] ? 0x11 : 0x00);
+            }
+            out.push_back((unsigned char)first);
+            out.push_back((unsigned char)last);
+            out.push_back(0);
+
+            BitWriter writer(out);
+            int predictor[3] = { 0, 0, 0 };
+            int units = 0, marker = 0;
+            auto encodeBlock = [&](int c, int bx, int by)
+            {
+                const int* block = &coefficients[c][((size_t)by * blocksX[c] + bx) * 64];
+                int t = c ? 1 : 0;
+                if (first == 0)
+                {
+                    int diff = block[0] - predictor[c];
+                    predictor[c] = block[0];
+                    int bits = magnitudeBits(diff);
+                    putValue(writer, dcCodes[t], bits, diff, bits);
+                }
+                if (last == 0)
+                    return;
+                int run = 0;
+                for (int k = first ? first : 1; k <= last; k++)
+                {
+                    int value = block[zigzag[k]];
+                    if (!value)
+                    {
+                        run++;
+                        continue;
+                    }
+                    for (; run > 15; run -= 16)
+                        writer.put(acCodes[t].code[0xf0], acCodes[t].length[0xf0]);
+                    int bits = magnitudeBits(value);
+                    putValue(writer, acCodes[t], run * 16 + bits, value, bits);
+                    run = 0;
+                }
+                if (run)
+                    writer.put(acCodes[t].code[0], acCodes[t].length[0]);
+            };
+            // a marker after every restartInterval units but the last
+            auto unitDone = [&](bool final)
+            {
+                if (!options.restartInterval || ++units < options.restartInterval || final)
+                    return;
+                writer.flush();
+                out.push_back(0xff);
+                out.push_back((unsigned char)(0xd0 + (marker++ & 7)));
+                units = 0;
+                predictor[0] = predictor[1] = predictor[2] = 0;
+            };
+            if (count == 1)
+            {
+                // non-interleaved: the component's own blocks, without the MCU padding
+                int c = list[0];
+                int w = (int)std::ceil(std::ceil(width * h[c] / (double)h[0]) / 8.0);
+                int hh = (int)std::ceil(std::ceil(height * v[c] / (double)v[0]) / 8.0);
+                for (int by = 0; by < hh; by++)
+                    for (int bx = 0; bx < w; bx++)
+                    {
+                        encodeBlock(c, bx, by);
+                        unitDone(by == hh - 1 && bx == w - 1);
+                    }
+            }
+            else
+            {
+                for (int my = 0; my < mcuY; my++)
+                    for (int mx = 0; mx < mcuX; mx++)
+                    {
+                        for (int i = 0; i < count; i++)
+                        {
+                            int c = list[i];
+                            for (int y = 0; y < v[c]; y++)
+                                for (int x = 0; x < h[c]; x++)
+                                    encodeBlock(c, mx * h[c] + x, my * v[c] + y);
+                        }
+                        unitDone(my == mcuY - 1 && mx == mcuX - 1);
+                    }
+            }
+            writer.flush();
+        };
+
+        int all[3] = { 0, 1, 2 };
+        if (!options.progressive)
+            scan(all, components, 0, 63);
+        else
+        {
+            scan(all, components, 0, 0);
+            for (int c = 0; c < components; c++)
+            {
+                scan(&all[c], 1, 1, 5);
+                scan(&all[c], 1, 6, 63);
+            }
+        }
+        out.push_back(0xff); out.push_back(0xd9);
+        return out;
+    }
+
+    // ---------------------------------------------------------------- PNG
+
+    struct PngOptions
+    {
+        int depth = 8;              // 8 or 16 bits per sample
+        int filter = -1;            // 0-4 (none, sub, up, average, Paeth) on every row, -1 to pick per row
+        bool interlaced = false;    // Adam7
+    };
+
+    namespace png
+    {
+        // LSB-first deflate bit stream
+        struct BitWriter
+        {
+            std::vector<unsigned char>& out;
+            unsigned long long buffer = 0;
+            int count = 0;
+
+            explicit BitWriter(std::vector<unsigned char>& target) : out(target) {}
+
+            void put(unsigned int bits, int length)
+            {
+                buffer |= (unsigned long long)bits << count;
+                count += length;
+                while (count >= 8)
+                {
+                    out.push_back((unsigned char)buffer);
+                    buffer >>= 8;
+                    count -= 8;
+                }
+            }
+            // Huffman codes go in most significant bit first
+            void putCode(unsigned int code, int length)
+            {
+                unsigned int reversed = 0;
+                for (int i = 0; i < length; i++)
+                    reversed |= ((code >> i) & 1) << (length - 1 - i);
+                put(reversed, length);
+            }
+            void flush()
+            {
+                if (count)
+                    put(0, 8 - count);
+            }
+        };
+
+        // Huffman code lengths of at most limit bits; frequencies are halved until they fit
+        inline void buildLengths(const unsigned int* frequencies, int count, int limit, unsigned char* lengths)
+        {
+            std::vector<unsigned int> weights(frequencies, frequencies + count);
+            for (;;)
+            {
+                memset(lengths, 0, count);
+                std::vector<int> parent;
+                std::priority_queue<std::pair<unsigned long long, int>,
+                                    std::vector<std::pair<unsigned long long, int> >,
+                                    std::greater<std::pair<unsigned long long, int> > > queue;
+                std::vector<int> leaves;
+                for (int i = 0; i < count; i++)
+                    if (weights[i])
+                    {
+                        queue.push(std::make_pair((unsigned long long)weights[i], (int)parent.size()));
+                        parent.push_back(-1);
+                        leaves.push_back(i);
+                    }
+                if (leaves.size() == 1)
+                    lengths[leaves[0]] = 1;
+                if (leaves.size() <= 1)
+                    return;
+                while (queue.size() > 1)
+                {
+                    std::pair<unsigned long long, int> a = queue.top(); queue.pop();
+                    std::pair<unsigned long long, int> b = queue.top(); queue.pop();
+                    int node = (int)parent.size();
+                    parent.push_back(-1);
+                    parent[a.second] = parent[b.second] = node;
+                    queue.push(std::make_pair(a.first + b.first, node));
+                }
+                int longest = 0;
+                for (size_t i = 0; i < leaves.size(); i++)
+                {
+                    int depth = 0;
+                    for (int node = (int)i; parent[node] >= 0; node = parent[node])
+                        depth++;
+                    lengths[leaves[i]] = (unsigned char)depth;
+                    longest = depth > longest ? depth : longest;
+                }
+                if (longest <= limit)
+                    return;
+                for (int i = 0; i < count; i++)
+                    if (weights[i])
+                        weights[i] = (weights[i] + 1) / 2;
+            }
+        }
+
+        inline void canonicalCodes(const unsigned char* lengths, int count, unsigned int* codes)
+        {
+            int lengthCount[16] = { 0 }, next[16];
+            for (int i = 0; i < count; i++)
+                lengthCount[lengths[i]]++;
+            lengthCount[0] = 0;
+            int code = 0;
+            for (int bits = 1; bits < 16; bits++)
+            {
+                code = (code + lengthCount[bits - 1]) << 1;
+                next[bits] = code;
+            }
+            for (int i = 0; i < count; i++)
+                if (lengths[i])
+                    codes[i] = (unsigned int)next[lengths[i]]++;
+        }
+
+        static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                             3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                              257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                              8193, 12289, 16385, 24577 };
+        static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                               7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        // a literal (distance 0) or a match
+        struct Token
+        {
+            unsigned short length, distance;
+        };
+
+        inline int lengthSymbol(int length)
+        {
+            int i = 28;
+            while (lengthBase[i] > length)
+                i--;
+            return i;
+        }
+        inline int distanceSymbol(int distance)
+        {
+            int i = 29;
+            while (distanceBase[i] > distance)
+                i--;
+            return i;
+        }
+
+        // greedy LZ77 over a 32 KB window with hash chains, then one dynamic-Huffman block per
+        // 64K tokens
+        inline void deflate(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+        {
+            const int hashBits = 15, window = 32768, maxChain = 48;
+            std::vector<int> head((size_t)1 << hashBits, -1), previous(window, -1);
+            std::vector<Token> tokens;
+            BitWriter writer(out);
+            size_t at = 0;
+            auto hashAt = [&](size_t i)
+            {
+                return (unsigned int)((data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - hashBits);
+            };
+            auto insert = [&](size_t i)
+            {
+                if (i + 3 > size)
+                    return;
+                unsigned int key = hashAt(i);
+                previous[i & (window - 1)] = head[key];
+                head[key] = (int)i;
+            };
+            auto flushBlock = [&](bool final)
+            {
+                unsigned int litFrequency[286] = { 0 }, distFrequency[30] = { 0 };
+                for (size_t i = 0; i < tokens.size(); i++)
+                {
+                    if (tokens[i].distance)
+                    {
+                        litFrequency[257 + lengthSymbol(tokens[i].length)]++;
+                        distFrequency[distanceSymbol(tokens[i].distance)]++;
+                    }
+                    else
+                        litFrequency[tokens[i].length]++;
+                }
+                litFrequency[256] = 1;
+                unsigned char lengths[286 + 30];
+                buildLengths(litFrequency, 286, 15, lengths);
+                buildLengths(distFrequency, 30, 15, lengths + 286);
+                int litCount = 286, distCount = 30;
+                while (litCount > 257 && !lengths[litCount - 1])
+                    litCount--;
+                while (distCount > 1 && !lengths[286 + distCount - 1])
+                    distCount--;
+                unsigned int litCodes[286], distCodes[30];
+                canonicalCodes(lengths, 286, litCodes);
+                canonicalCodes(lengths + 286, 30, distCodes);
+
+                // code-length sequence with runs: 16 repeats the previous length, 17/18 are zeros
+                unsigned char sequence[286 + 30];
+                memcpy(sequence, lengths, litCount);
+                memcpy(sequence + litCount, lengths + 286, distCount);
+                int total = litCount + distCount;
+                std::vector<int> symbols, extras;
+                for (int i = 0; i < total;)
+                {
+                    int run = 1;
+                    while (i + run < total && sequence[i + run] == sequence[i])
+                        run++;
+                    if (sequence[i] == 0 && run >= 3)
+                    {
+                        run = run > 138 ? 138 : run;
+                        symbols.push_back(run >= 11 ? 18 : 17);
+                        extras.push_back(run >= 11 ? run - 11 : run - 3);
+                    }
+                    else if (sequence[i] != 0 && run >= 4)
+                    {
+                        run = run > 7 ? 7 : run;
+                        symbols.push_back(sequence[i]);
+                        extras.push_back(0);
+                        symbols.push_back(16);
+                        extras.push_back(run - 4);
+                    }
+                    else
+                    {
+                        run = 1;
+                        symbols.push_back(sequence[i]);
+                        extras.push_back(0);
+                    }
+                    i += run;
+                }
+                unsigned int clFrequency[19] = { 0 };
+                for (size_t i = 0; i < symbols.size(); i++)
+                    clFrequency[symbols[i]]++;
+                unsigned char clLengths[19];
+                unsigned int clCodes[19];
+                buildLengths(clFrequency, 19, 7, clLengths);
+                canonicalCodes(clLengths, 19, clCodes);
+                static const int order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+                int clCount = 19;
+                while (clCount > 4 && !clLengths[order[clCount - 1]])
+                    clCount--;
+
+                writer.put(final ? 1 : 0, 1);
+                writer.put(2, 2);
+                writer.put(litCount - 257, 5);
+                writer.put(distCount - 1, 5);
+                writer.put(clCount - 4, 4);
+                for (int i = 0; i < clCount; i++)
+                    writer.put(clLengths[order[i]], 3);
+                for (size_t i = 0; i < symbols.size(); i++)
+                {
+                    writer.putCode(clCodes[symbols[i]], clLengths[symbols[i]]);
+                    if (symbols[i] == 16) writer.put(extras[i], 2);
+                    else if (symbols[i] == 17) writer.put(extras[i], 3);
+                    else if (symbols[i] == 18) writer.put(extras[i], 7);
+                }
+                for (size_t i = 0; i < tokens.size(); i++)
+                {
+                    const Token& token = tokens[i];
+                    if (!token.distance)
+                    {
+                        writer.putCode(litCodes[token.length], lengths[token.length]);
+                        continue;
+                    }
+                    int ls = lengthSymbol(token.length), ds = distanceSymbol(token.distance);
+                    writer.putCode(litCodes[257 + ls], lengths[257 + ls]);
+                    writer.put(token.length - lengthBase[ls], lengthExtra[ls]);
+                    writer.putCode(distCodes[ds], lengths[286 + ds]);
+                    writer.put(token.distance - distanceBase[ds], distanceExtra[ds]);
+                }
+                writer.putCode(litCodes[256], lengths[256]);
+                tokens.clear();
+            };
+
+            while (at < size)
+            {
+                int bestLength = 0, bestDistance = 0;
+                if (at + 3 <= size)
+                {
+                    int limit = (int)(size - at < 258 ? size - at : 258);
+                    int candidate = head[hashAt(at)];
+                    for (int chain = 0; candidate >= 0 && chain < maxChain; chain++)
+                    {
+                        int distance = (int)(at - candidate);
+                        if (distance > window - 1)
+                            break;
+                        int length = 0;
+                        while (length < limit && data[candidate + length] == data[at + length])
+                            length++;
+                        if (length > bestLength)
+                        {
+                            bestLength = length;
+                            bestDistance = distance;
+                            if (length == limit)
+                                break;
+                        }
+                        int next = previous[candidate & (window - 1)];
+                        if (next >= candidate)
+                            break;
+                        candidate = next;
+                    }
+                }
+                Token token;
+                if (bestLength >= 3)
+                {
+                    token.length = (unsigned short)bestLength;
+                    token.distance = (unsigned short)bestDistance;
+                    for (int i = 0; i < bestLength; i++)
+                        insert(at + i);
+                    at += bestLength;
+                }
+                else
+                {
+                    token.length = data[at];
+                    token.distance = 0;
+                    insert(at);
+                    at++;
+                }
+                tokens.push_back(token);
+                if (tokens.size() == 65536)
+                    flushBlock(false);
+            }
+            flushBlock(true);
+            writer.flush();
+        }
+
+        inline unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+        {
+            static unsigned int table[256];
+            if (!table[1])
+                for (unsigned int n = 0; n < 256; n++)
+                {
+                    unsigned int c = n;
+                    for (int k = 0; k < 8; k++)
+                        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    table[n] = c;
+                }
+            crc = ~crc;
+            for (size_t i = 0; i < size; i++)
+                crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            return ~crc;
+        }
+
+        inline void put32(std::vector<unsigned char>& out, unsigned int value)
+        {
+            out.push_back((unsigned char)(value >> 24));
+            out.push_back((unsigned char)(value >> 16));
+            out.push_back((unsigned char)(value >> 8));
+            out.push_back((unsigned char)value);
+        }
+
+        inline void chunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+        {
+            put32(out, (unsigned int)data.size());
+            size_t start = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data.begin(), data.end());
+            put32(out, crc32(&out[start], out.size() - start));
+        }
+
+        inline int paeth(int a, int b, int c)
+        {
+            int p = a + b - c, pa = p > a ? p - a : a - p, pb = p > b ? p - b : b - p, pc = p > c ? p - c : c - p;
+            return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+        }
+
+        // filters one row of bytes into out; prior is NULL on a pass's first row
+        inline void filterRow(int filter, const unsigned char* row, const unsigned char* prior, size_t size, int bpp, unsigned char* out)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+                int b = prior ? prior[i] : 0;
+                int c = prior && i >= (size_t)bpp ? prior[i - bpp] : 0;
+                int predicted = 0;
+                switch (filter)
+                {
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) >> 1; break;
+                case 4: predicted = paeth(a, b, c); break;
+                }
+                out[i] = (unsigned char)(row[i] - predicted);
+            }
+        }
+    }
+
+    // samples: width * height * channels 16-bit values; channels 1-4 are grey, grey+alpha, RGB, RGBA
+    inline std::vector<unsigned char> encodePng(const unsigned short* samples, int width, int height, int channels, const PngOptions& options)
+    {
+        using namespace png;
+        int bytesPerSample = options.depth / 8;
+        int bpp = channels * bytesPerSample;
+
+        // the filtered scanlines of every pass, each row behind its filter type byte
+        static const int startX[7] = { 0, 4, 0, 2, 0, 1, 0 }, startY[7] = { 0, 0, 4, 0, 2, 0, 1 };
+        static const int stepX[7] = { 8, 8, 4, 4, 2, 2, 1 }, stepY[7] = { 8, 8, 8, 4, 4, 2, 2 };
+        std::vector<unsigned char> raw;
+        int passes = options.interlaced ? 7 : 1;
+        for (int pass = 0; pass < passes; pass++)
+        {
+            int x0 = options.interlaced ? startX[pass] : 0, dx = options.interlaced ? stepX[pass] : 1;
+            int y0 = options.interlaced ? startY[pass] : 0, dy = options.interlaced ? stepY[pass] : 1;
+            if (x0 >= width || y0 >= height)
+                continue;
+            int passWidth = (width - x0 + dx - 1) / dx;
+            size_t rowBytes = (size_t)passWidth * bpp;
+            std::vector<unsigned char> row(rowBytes), prior, filtered(rowBytes), best(rowBytes);
+            for (int y = y0; y < height; y += dy)
+            {
+                unsigned char* p = row.data();
+                for (int x = x0; x < width; x += dx)
+                    for (int c = 0; c < channels; c++)
+                    {
+                        unsigned short s = samples[((size_t)y * width + x) * channels + c];
+                        if (bytesPerSample == 2)
+                            *p++ = (unsigned char)(s >> 8);
+                        *p++ = (unsigned char)(bytesPerSample == 2 ? s : s >> 8);
+                    }
+                const unsigned char* above = prior.empty() ? NULL : prior.data();
+                int chosen = options.filter;
+                if (chosen < 0)
+                {
+                    // the usual heuristic: smallest sum of residuals read as signed bytes
+                    unsigned long long bestCost = ~0ull;
+                    for (int f = 0; f < 5; f++)
+                    {
+                        filterRow(f, row.data(), above, rowBytes, bpp, filtered.data());
+                        unsigned long long cost = 0;
+                        for (size_t i = 0; i < rowBytes; i++)
+                            cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+                        if (cost < bestCost)
+                        {
+                            bestCost = cost;
+                            chosen = f;
+                            best.swap(filtered);
+                        }
+                    }
+                }
+                else
+                    filterRow(chosen, row.data(), above, rowBytes, bpp, best.data());
+                raw.push_back((unsigned char)chosen);
+                raw.insert(raw.end(), best.begin(), best.end());
+                prior = row;
+            }
+        }
+
+        std::vector<unsigned char> zlib;
+        zlib.push_back(0x78);
+        zlib.push_back(0x9c);
+        deflate(raw.data(), raw.size(), zlib);
+        unsigned int a = 1, b = 0;
+        for (size_t i = 0; i < raw.size(); i++)
+        {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        put32(zlib, (b << 16) | a);
+
+        static const unsigned char colourTypes[5] = { 0, 0, 4, 2, 6 };
+        std::vector<unsigned char> header;
+        put32(header, (unsigned int)width);
+        put32(header, (unsigned int)height);
+        header.push_back((unsigned char)options.depth);
+        header.push_back(colourTypes[channels]);
+        header.push_back(0);
+        header.push_back(0);
+        header.push_back(options.interlaced ? 1 : 0);
+
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        std::vector<unsigned char> out(signature, signature + 8);
+        chunk(out, "IHDR", header);
+        chunk(out, "IDAT", zlib);
+        chunk(out, "IEND", std::vector<unsigned char>());
+        return out;
+    }
+}
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstring>
+
+// CPU encoders for 4x4 block-compressed texture formats
+// -----------------------------------------------------
+// Both take a 4x4 block of RGBA8 texels (row-major, 64 bytes; alpha is ignored) and write
+// one 8-byte block: BC1 (DXT1, GL_COMPRESSED_RGB_S3TC_DXT1_EXT) for desktop drivers and
+// ETC2 RGB8 (GL_COMPRESSED_RGB8_ETC2, core since GL 4.3) for everything else. The ETC2
+// blocks only use the ETC1-compatible individual/differential modes.
+
+namespace blockcompression
+{
+    inline int clampByte(int value)
+    {
+        return value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+
+    // ---------------------------------------------------------------- BC1
+
+    inline unsigned short packRGB565(const float colour[3])
+    {
+        int r = (int)(colour[0] * 31.0f / 255.0f + 0.5f);
+        int g = (int)(colour[1] * 63.0f / 255.0f + 0.5f);
+        int b = (int)(colour[2] * 31.0f / 255.0f + 0.5f);
+        r = r < 0 ? 0 : (r > 31 ? 31 : r);
+        g = g < 0 ? 0 : (g > 63 ? 63 : g);
+        b = b < 0 ? 0 : (b > 31 ? 31 : b);
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRGB565(unsigned short packed, int colour[3])
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        colour[0] = (r << 3) | (r >> 2);
+        colour[1] = (g << 2) | (g >> 4);
+        colour[2] = (b << 3) | (b >> 2);
+    }
+
+    // endpoints are the extremes of the block's texels projected on their principal axis
+    inline void encodeBC1Block(const unsigned char rgba[64], unsigned char out[8])
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += rgba[i * 4 + c] / 16.0f;
+        float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+        {
+            float r = rgba[i * 4] - mean[0], g = rgba[i * 4 + 1] - mean[1], b = rgba[i * 4 + 2] - mean[2];
+            covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+            covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+        }
+        // a few power iterations are plenty for a 3x3 symmetric matrix
+        float axis[3] = { 0.9f, 1.0f, 0.7f };
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float largest = x * x > y * y ? x : y;
+            largest = largest * largest > z * z ? largest : z;
+            if (largest == 0.0f)
+                break;
+            axis[0] = x / largest; axis[1] = y / largest; axis[2] = z / largest;
+        }
+        float lowest = 0.0f, highest = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = (rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+            if (i == 0 || t < lowest) lowest = t;
+            if (i == 0 || t > highest) highest = t;
+        }
+        float length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if (length > 0.0f)
+        {
+            lowest /= length;
+            highest /= length;
+        }
+        float end0[3], end1[3];
+        for (int c = 0; c < 3; c++)
+        {
+            end0[c] = mean[c] + axis[c] * highest;
+            end1[c] = mean[c] + axis[c] * lowest;
+        }
+        unsigned short colour0 = packRGB565(end0), colour1 = packRGB565(end1);
+        // colour0 > colour1 selects the four-colour mode
+        if (colour0 < colour1)
+        {
+            unsigned short swap = colour0; colour0 = colour1; colour1 = swap;
+        }
+        unsigned int indices = 0;
+        if (colour0 != colour1)
+        {
+            int palette[4][3];
+            unpackRGB565(colour0, palette[0]);
+            unpackRGB565(colour1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestError = 0x7fffffff;
+                for (int p = 0; p < 4; p++)
+                {
+                    int dr = rgba[i * 4] - palette[p][0], dg = rgba[i * 4 + 1] - palette[p][1], db = rgba[i * 4 + 2] - palette[p][2];
+                    int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (unsigned int)best << (2 * i);
+            }
+        }
+        out[0] = (unsigned char)(colour0 & 0xff); out[1] = (unsigned char)(colour0 >> 8);
+        out[2] = (unsigned char)(colour1 & 0xff); out[3] = (unsigned char)(colour1 >> 8);
+        out[4] = (unsigned char)(indices & 0xff); out[5] = (unsigned char)(indices >> 8);
+        out[6] = (unsigned char)(indices >> 16); out[7] = (unsigned char)(indices >> 24);
+    }
+
+    // ---------------------------------------------------------------- ETC2 (ETC1 modes)
+
+    const int etcModifiers[8][2] = {
+        { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+    };
+
+    // picks the modifier table and per-texel indices for one half block around base; returns the error
+    inline int fitETCSubblock(const unsigned char rgba[64], const int texels[8], const int base[3], int& table, int selectors[8])
+    {
+        int bestTotal = 0x7fffffff;
+        for (int t = 0; t < 8; t++)
+        {
+            int total = 0, picked[8];
+            for (int i = 0; i < 8; i++)
+            {
+                const unsigned char* texel = rgba + texels[i] * 4;
+                int bestError = 0x7fffffff;
+                for (int s = 0; s < 4; s++)
+                {
+                    // selector bits: msb is the sign, lsb picks the large modifier
+                    int modifier = (s & 2) ? -etcModifiers[t][s & 1] : etcModifiers[t][s & 1];
+                    int dr = clampByte(base[0] + modifier) - texel[0];
+                    int dg = clampByte(base[1] + modifier) - texel[1];
+                    int db = clampByte(base[2] + modifier) - texel[2];
+                    int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        picked[i] = s;
+                    }
+                }
+                total += bestError;
+            }
+            if (total < bestTotal)
+            {
+                bestTotal = total;
+                table = t;
+                memcpy(selectors, picked, sizeof(picked));
+            }
+        }
+        return bestTotal;
+    }
+
+    inline void encodeETC2Block(const unsigned char rgba[64], unsigned char out[8])
+    {
+        unsigned long long bestBits = 0;
+        int bestError = 0x7fffffff;
+        for (int flip = 0; flip < 2; flip++)
+        {
+            // texel indices (row-major) of the two half blocks: left/right when flip is 0, top/bottom when 1
+            int halves[2][8];
+            float average[2][3] = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+            int count[2] = { 0, 0 };
+            for (int y = 0; y < 4; y++)
+                for (int x = 0; x < 4; x++)
+                {
+                    int half = flip ? (y >= 2) : (x >= 2);
+                    halves[half][count[half]++] = y * 4 + x;
+                    for (int c = 0; c < 3; c++)
+                        average[half][c] += rgba[(y * 4 + x) * 4 + c] / 8.0f;
+                }
+
+            // differential mode (5-bit base plus 3-bit signed delta) when the averages are close, else individual 4-bit bases
+            int quantised[2][3], expanded[2][3];
+            bool differential = true;
+            for (int c = 0; c < 3; c++)
+            {
+                quantised[0][c] = (int)(average[0][c] * 31.0f / 255.0f + 0.5f);
+                quantised[1][c] = (int)(average[1][c] * 31.0f / 255.0f + 0.5f);
+                int delta = quantised[1][c] - quantised[0][c];
+                if (delta < -4 || delta > 3)
+                    differential = false;
+            }
+            for (int c = 0; c < 3; c++)
+                for (int h = 0; h < 2; h++)
+                {
+                    if (differential)
+                        expanded[h][c] = (quantised[h][c] << 3) | (quantised[h][c] >> 2);
+                    else
+                    {
+                        quantised[h][c] = (int)(average[h][c] * 15.0f / 255.0f + 0.5f);
+                        expanded[h][c] = (quantised[h][c] << 4) | quantised[h][c];
+                    }
+                }
+
+            int tables[2] = { 0, 0 }, selectors[2][8];
+            int error = fitETCSubblock(rgba, halves[0], expanded[0], tables[0], selectors[0])
+                + fitETCSubblock(rgba, halves[1], expanded[1], tables[1], selectors[1]);
+            if (error >= bestError)
+                continue;
+            bestError = error;
+
+            unsigned long long bits = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned long long field;
+                if (differential)
+                    field = ((unsigned long long)quantised[0][c] << 3) | (unsigned long long)((quantised[1][c] - quantised[0][c]) & 7);
+                else
+                    field = ((unsigned long long)quantised[0][c] << 4) | (unsigned long long)quantised[1][c];
+                bits |= field << (56 - 8 * c);
+            }
+            bits |= (unsigned long long)tables[0] << 37;
+            bits |= (unsigned long long)tables[1] << 34;
+            bits |= (unsigned long long)(differential ? 1 : 0) << 33;
+            bits |= (unsigned long long)flip << 32;
+            // selector bits are stored column-major: texel (x, y) is bit x * 4 + y of each plane
+            for (int h = 0; h < 2; h++)
+                for (int i = 0; i < 8; i++)
+                {
+                    int texel = halves[h][i];
+                    int bit = (texel % 4) * 4 + texel / 4;
+                    bits |= (unsigned long long)(selectors[h][i] >> 1) << (16 + bit);
+                    bits |= (unsigned long long)(selectors[h][i] & 1) << bit;
+                }
+            bestBits = bits;
+        }
+        for (int i = 0; i < 8; i++)
+            out[i] = (unsigned char)(bestBits >> (56 - 8 * i));
+    }
+
+    // compresses a whole RGBA8 image; edge blocks repeat the last row/column. Returns the byte count.
+    typedef void (*BlockEncoder)(const unsigned char rgba[64], unsigned char out[8]);
+    inline size_t compressImage(const unsigned char* rgba, int width, int height, BlockEncoder encoder, unsigned char* out)
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        unsigned char block[64];
+        for (int by = 0; by < blocksY; by++)
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                for (int y = 0; y < 4; y++)
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+                        int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+                        memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                    }
+                encoder(block, out + ((size_t)by * blocksX + bx) * 8);
+            }
+        return (size_t)blocksX * blocksY * 8;
+    }
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef CAMERA_2D_H
+#define CAMERA_2D_H
+
+#include <GL/glew.h>
+
+// pan/zoom camera over the demos' 2D world
+// ----------------------------------------
+// At zoom 1 the shorter side of the framebuffer spans -1 .. 1, so a square window shows
+// exactly what the standalone demos show; zooming in by 2 halves the visible area's sides.
+// resize() is fed from framebuffer_size_callback. A tile narrows the framebuffer to part of
+// the view, in normalized coordinates of the whole view, so a poster larger than any
+// framebuffer can be rendered piece by piece; width and height stay the whole poster's.
+struct Camera2D
+{
+    float centreX = 0.0f, centreY = 0.0f;
+    float zoom = 1.0f;
+    int width = 1, height = 1;
+    float tileMinX = -1.0f, tileMinY = -1.0f, tileMaxX = 1.0f, tileMaxY = 1.0f;
+
+    void resize(int framebufferWidth, int framebufferHeight)
+    {
+        width = framebufferWidth > 0 ? framebufferWidth : 1;
+        height = framebufferHeight > 0 ? framebufferHeight : 1;
+    }
+
+    // half the visible extent in world units
+    float halfWidth() const
+    {
+        return (width > height ? (float)width / height : 1.0f) / zoom;
+    }
+    float halfHeight() const
+    {
+        return (height > width ? (float)height / width : 1.0f) / zoom;
+    }
+
+    // the framebuffer shows [minX, maxX] x [minY, maxY] of the whole view, in normalized
+    // device coordinates; resetTile() shows all of it again
+    void setTile(float minX, float minY, float maxX, float maxY)
+    {
+        tileMinX = minX;
+        tileMinY = minY;
+        tileMaxX = maxX;
+        tileMaxY = maxY;
+    }
+    void resetTile()
+    {
+        setTile(-1.0f, -1.0f, 1.0f, 1.0f);
+    }
+
+    // the world rectangle on screen (in the current tile)
+    void bounds(float& minX, float& minY, float& maxX, float& maxY) const
+    {
+        minX = centreX + tileMinX * halfWidth();
+        maxX = centreX + tileMaxX * halfWidth();
+        minY = centreY + tileMinY * halfHeight();
+        maxY = centreY + tileMaxY * halfHeight();
+    }
+
+    // pixels of the whole view per world unit, the same on both axes
+    float pixelsPerUnit() const
+    {
+        return height / (2.0f * halfHeight());
+    }
+
+    void screenToWorld(double x, double y, float& worldX, float& worldY) const
+    {
+        worldX = centreX + ((float)x / width * 2.0f - 1.0f) * halfWidth();
+        worldY = centreY + (1.0f - (float)y / height * 2.0f) * halfHeight();
+    }
+
+    // sets the program's vec4 view uniform: world position p goes to (p - view.xy) * view.zw;
+    // the program must be in use
+    void apply(unsigned int program) const
+    {
+        glUniform4f(glGetUniformLocation(program, "view"), centreX + (tileMinX + tileMaxX) * 0.5f * halfWidth(),
+                    centreY + (tileMinY + tileMaxY) * 0.5f * halfHeight(), 2.0f / ((tileMaxX - tileMinX) * halfWidth()),
+                    2.0f / ((tileMaxY - tileMinY) * halfHeight()));
+    }
+
+    // the same for geometry given in normalized device coordinates of the whole view, which
+    // the camera does not move: only the tile applies
+    void applyScreen(unsigned int program) const
+    {
+        glUniform4f(glGetUniformLocation(program, "view"), (tileMinX + tileMaxX) * 0.5f, (tileMinY + tileMaxY) * 0.5f,
+                    2.0f / (tileMaxX - tileMinX), 2.0f / (tileMaxY - tileMinY));
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// runtime CPU feature checks for the SIMD kernels
+// -----------------------------------------------
+// SSE2 (x86-64) and NEON (AArch64) are part of the baseline ABI and are selected at compile
+// time; wider instruction sets are compiled per function with TARGET_AVX2 (or TARGET_AVX512)
+// and only called when the running CPU (and OS, for the YMM / ZMM state) supports them.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86 1
+#if defined(__x86_64__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define CPU_SSE2 1
+#include <emmintrin.h>
+#endif
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_SSSE3
+#define TARGET_AVX512
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64) || (defined(__ARM_NEON) && defined(__arm__))
+#define CPU_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace cpufeatures
+{
+#ifdef CPU_X86
+    inline void cpuid(int leaf, int subleaf, unsigned int regs[4])
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuidex(info, leaf, subleaf);
+        for (int i = 0; i < 4; i++)
+            regs[i] = (unsigned int)info[i];
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    inline unsigned long long xgetbv0()
+    {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((unsigned long long)edx << 32) | eax;
+#endif
+    }
+
+    struct Features
+    {
+        bool ssse3, sse41, avx2, avx512bw;
+        Features() : ssse3(false), sse41(false), avx2(false), avx512bw(false)
+        {
+            unsigned int regs[4];
+            cpuid(0, 0, regs);
+            unsigned int maxLeaf = regs[0];
+            cpuid(1, 0, regs);
+            ssse3 = (regs[2] & (1u << 9)) != 0;
+            sse41 = (regs[2] & (1u << 19)) != 0;
+            bool osxsave = (regs[2] & (1u << 27)) != 0;
+            bool avx = (regs[2] & (1u << 28)) != 0;
+            if (!osxsave || !avx || maxLeaf < 7)
+                return;
+            unsigned long long xcr0 = xgetbv0();
+            bool ymmState = (xcr0 & 0x6) == 0x6;
+            bool zmmState = (xcr0 & 0xe6) == 0xe6;
+            cpuid(7, 0, regs);
+            avx2 = ymmState && (regs[1] & (1u << 5)) != 0;
+            avx512bw = zmmState && (regs[1] & (1u << 16)) != 0 && (regs[1] & (1u << 30)) != 0;
+        }
+    };
+
+    inline const Features& features()
+    {
+        static const Features detected;
+        return detected;
+    }
+#endif
+
+    inline bool hasSSSE3()
+    {
+#ifdef CPU_X86
+        return features().ssse3;
+#else
+        return false;
+#endif
+    }
+    inline bool hasSSE41()
+    {
+#ifdef CPU_X86
+        return features().sse41;
+#else
+        return false;
+#endif
+    }
+    inline bool hasAVX2()
+    {
+#ifdef CPU_X86
+        return features().avx2;
+#else
+        return false;
+#endif
+    }
+    inline bool hasAVX512BW()
+    {
+#ifdef CPU_X86
+        return features().avx512bw;
+#else
+        return false;
+#endif
+    }
+}
+
+#endif
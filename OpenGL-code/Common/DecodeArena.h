@@ -0,0 +1,181 @@
+#ifndef DECODE_ARENA_H
+#define DECODE_ARENA_H
+
+#include "../Q3/stb_image.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// per-thread bump arena for stb_image's scratch memory
+// ----------------------------------------------------
+// A decode allocates and frees its component planes, line buffers and inflate output many
+// times over; with several loader workers decoding at once all of that goes through the heap
+// lock. DecodeArena hands the blocks out of a few large chunks and takes them all back in
+// reset(), which also merges the chunks so the next image of the same size fits in one.
+class DecodeArena
+{
+public:
+    // reset() keeps up to retainBytes of chunks for the next image and frees the rest
+    explicit DecodeArena(size_t retainBytes = 32u << 20)
+        : retain(retainBytes), nextChunk(MIN_CHUNK), top(0), lastOffset(0), last(NULL)
+    {
+    }
+    ~DecodeArena()
+    {
+        releaseChunks();
+    }
+
+    void* allocate(size_t size)
+    {
+        size = roundUp(size);
+        if (chunks.empty() || chunks.back().size - top < size)
+        {
+            size_t chunkSize = size > nextChunk ? size : nextChunk;
+            Chunk chunk = { (unsigned char*)std::malloc(chunkSize), chunkSize };
+            if (!chunk.bytes)
+                return NULL;
+            chunks.push_back(chunk);
+            nextChunk = chunkSize * 2;
+            top = 0;
+        }
+        last = chunks.back().bytes + top;
+        lastOffset = top;
+        top += size;
+        return last;
+    }
+
+    // grows the most recent block in place when its chunk has room, otherwise copies
+    void* reallocate(void* block, size_t oldSize, size_t newSize)
+    {
+        if (!block)
+            return allocate(newSize);
+        if (block == last && chunks.back().size - lastOffset >= roundUp(newSize))
+        {
+            top = lastOffset + roundUp(newSize);
+            return block;
+        }
+        void* moved = allocate(newSize);
+        if (moved)
+            std::memcpy(moved, block, oldSize < newSize ? oldSize : newSize);
+        return moved;
+    }
+
+    // only the most recent block is actually handed back; reset() reclaims the others
+    void release(void* block)
+    {
+        if (block && block == last)
+        {
+            top = lastOffset;
+            last = NULL;
+        }
+    }
+
+    void reset()
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < chunks.size(); i++)
+            total += chunks[i].size;
+        if (chunks.size() > 1 || total > retain)
+        {
+            releaseChunks();
+            nextChunk = MIN_CHUNK;
+            if (total <= retain)
+                nextChunk = total;
+        }
+        top = 0;
+        last = NULL;
+    }
+
+    // stb_image hooks that route scratch allocations to this arena
+    stbi_scratch_allocator hooks()
+    {
+        stbi_scratch_allocator allocator = { allocThunk, reallocThunk, freeThunk, this };
+        return allocator;
+    }
+
+    // the calling thread's arena
+    static DecodeArena& local()
+    {
+        static thread_local DecodeArena arena;
+        return arena;
+    }
+
+private:
+    static const size_t MIN_CHUNK = 1u << 20;
+    static const size_t ALIGNMENT = 16;
+
+    struct Chunk
+    {
+        unsigned char* bytes;
+        size_t size;
+    };
+    std::vector<Chunk> chunks;
+    size_t retain, nextChunk;
+    size_t top, lastOffset;
+    void* last;
+
+    static size_t roundUp(size_t size)
+    {
+        return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    void releaseChunks()
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+            std::free(chunks[i].bytes);
+        chunks.clear();
+    }
+
+    static void* allocThunk(void* user, size_t size)
+    {
+        return static_cast<DecodeArena*>(user)->allocate(size);
+    }
+    static void* reallocThunk(void* user, void* block, size_t oldSize, size_t newSize)
+    {
+        return static_cast<DecodeArena*>(user)->reallocate(block, oldSize, newSize);
+    }
+    static void freeThunk(void* user, void* block)
+    {
+        static_cast<DecodeArena*>(user)->release(block);
+    }
+};
+
+// routes the scratch memory of every stb_image call on this thread through its DecodeArena
+// for the lifetime of the scope, then resets the arena; nested scopes leave it to the outer one
+class ScopedDecodeArena
+{
+public:
+    ScopedDecodeArena() : outermost(depth()++ == 0)
+    {
+        if (outermost)
+        {
+            stbi_scratch_allocator hooks = DecodeArena::local().hooks();
+            stbi_set_scratch_allocator_thread(&hooks);
+        }
+    }
+    ~ScopedDecodeArena()
+    {
+        --depth();
+        if (outermost)
+        {
+            stbi_set_scratch_allocator_thread(NULL);
+            DecodeArena::local().reset();
+        }
+    }
+
+private:
+    bool outermost;
+
+    ScopedDecodeArena(const ScopedDecodeArena&);
+    ScopedDecodeArena& operator=(const ScopedDecodeArena&);
+
+    static int& depth()
+    {
+        static thread_local int scopes = 0;
+        return scopes;
+    }
+};
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <GL/glew.h>
+
+#include "YuvConverter.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// recording the default framebuffer as a video stream
+// ---------------------------------------------------
+// capture(), called once a frame after rendering, starts an asynchronous glReadPixels into the
+// next pixel buffer object of a small ring and guards it with a fence. Finished read-backs (the
+// fence has signalled, so mapping does not wait) are copied into a free slot of a bounded frame
+// queue. A worker thread converts queued frames to YUV 4:2:0 (YuvConverter.h) and writes them as
+// a Y4M stream, or as bare I420 frames for an external encoder, to a file or to stdout ("-").
+// The render thread never waits: a frame is dropped when its read-back slot is still busy or the
+// queue is full, and the counters in CaptureStats say how many went where. The stream's size is
+// fixed at start(); frames of another framebuffer size are skipped. Needs a current GL 3.2+
+// context for every call except stats().
+
+struct CaptureStats
+{
+    long long offered = 0;          // capture() calls while recording
+    long long queued = 0;           // frames handed to the worker
+    long long droppedReadback = 0;  // every read-back slot still in flight
+    long long droppedQueue = 0;     // the worker had no free slot
+    long long skipped = 0;          // framebuffer size differed from the stream's
+    long long written = 0;          // frames in the output
+    bool writeFailed = false;
+};
+
+class FrameCapture
+{
+public:
+    // readbackDepth pixel buffer objects, queueDepth frames waiting for the worker
+    explicit FrameCapture(int readbackDepth = 3, int queueDepth = 4)
+        : slots(readbackDepth > 1 ? readbackDepth : 2), queueSize(queueDepth > 1 ? queueDepth : 1)
+    {
+    }
+    ~FrameCapture()
+    {
+        stop();
+    }
+
+    // begins a width x height stream at fps frames per second into path ("-" for stdout); raw
+    // leaves out the Y4M headers. False when the output cannot be opened.
+    bool start(const std::string& path, int width, int height, int fps = 60, bool raw = false)
+    {
+        stop();
+        if (width < 1 || height < 1)
+            return false;
+        if (path == "-")
+        {
+            out = stdout;
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        }
+        else
+        {
+            out = std::fopen(path.c_str(), "wb");
+            if (out)
+                std::setvbuf(out, NULL, _IOFBF, 4 * 1024 * 1024);
+        }
+        if (!out)
+            return false;
+        if (!raw)
+            std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, fps > 0 ? fps : 60);
+
+        streamWidth = width;
+        streamHeight = height;
+        bareFrames = raw;
+        size_t frameBytes = (size_t)width * height * 4;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            glGenBuffers(1, &slots[i].buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)frameBytes, NULL, GL_STREAM_READ);
+            slots[i].fence = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        next = oldest = inFlight = 0;
+
+        frames.assign(queueSize, std::vector<unsigned char>(frameBytes));
+        idle.clear();
+        ready.clear();
+        for (int i = 0; i < queueSize; i++)
+            idle.push_back(i);
+        counters = CaptureStats();
+        written = 0;
+        failed = false;
+        stopping = false;
+        worker = std::thread(&FrameCapture::run, this);
+        recording = true;
+        return true;
+    }
+
+    bool active() const
+    {
+        return recording;
+    }
+
+    // queues the default framebuffer's current contents; call after rendering, before the swap
+    void capture(int framebufferWidth, int framebufferHeight)
+    {
+        if (!recording)
+            return;
+        count(&CaptureStats::offered);
+        collect(false);
+        if (framebufferWidth != streamWidth || framebufferHeight != streamHeight)
+        {
+            count(&CaptureStats::skipped);
+            return;
+        }
+        if (inFlight == (int)slots.size())
+        {
+            count(&CaptureStats::droppedReadback);
+            return;
+        }
+        Slot& slot = slots[next];
+        GLint readFramebuffer = 0, packAlignment = 4;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glReadPixels(0, 0, streamWidth, streamHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % (int)slots.size();
+        inFlight++;
+    }
+
+    // waits for the read-backs in flight and for the worker to write everything queued, then
+    // closes the output (stdout is only flushed) and frees the GL objects
+    void stop()
+    {
+        if (!recording)
+            return;
+        collect(true);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        for (size_t i = 0; i < slots.size(); i++)
+            glDeleteBuffers(1, &slots[i].buffer);
+        bool closed = out == stdout ? std::fflush(out) == 0 : std::fclose(out) == 0;
+        failed = failed || !closed;
+        out = NULL;
+        frames.clear();
+        recording = false;
+    }
+
+    // a snapshot of the counters; may be called from any thread
+    CaptureStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CaptureStats snapshot = counters;
+        snapshot.written = written;
+        snapshot.writeFailed = failed;
+        return snapshot;
+    }
+
+private:
+    struct Slot
+    {
+        unsigned int buffer = 0;
+        GLsync fence = 0;
+    };
+
+    std::vector<Slot> slots;
+    int next = 0, oldest = 0, inFlight = 0;
+    int queueSize;
+    int streamWidth = 0, streamHeight = 0;
+    bool bareFrames = false, recording = false;
+    FILE* out = NULL;
+
+    // frames[i] is a slot of the queue; idle and ready hold their indices. mutex guards those
+    // two, the counters and the worker's results
+    std::vector<std::vector<unsigned char> > frames;
+    std::deque<int> idle, ready;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread worker;
+    CaptureStats counters;
+    long long written = 0;
+    bool failed = false;
+
+    void count(long long CaptureStats::*counter)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.*counter += 1;
+    }
+
+    // moves finished read-backs, oldest first, into the queue; wait blocks on the fences (only
+    // when stopping)
+    void collect(bool wait)
+    {
+        while (inFlight)
+        {
+            Slot& slot = slots[oldest];
+            GLenum state = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+            if (state == GL_TIMEOUT_EXPIRED && !wait)
+                return;
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+            oldest = (oldest + 1) % (int)slots.size();
+            inFlight--;
+            if (state == GL_WAIT_FAILED || state == GL_TIMEOUT_EXPIRED)
+            {
+                count(&CaptureStats::droppedReadback);
+                continue;
+            }
+
+            int index = -1;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!idle.empty())
+                {
+                    index = idle.front();
+                    idle.pop_front();
+                }
+                else
+                    counters.droppedQueue++;
+            }
+            if (index < 0)
+                continue;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)frames[index].size(), GL_MAP_READ_BIT);
+            if (pixels)
+                std::memcpy(frames[index].data(), pixels, frames[index].size());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pixels)
+                {
+                    ready.push_back(index);
+                    counters.queued++;
+                }
+                else
+                    idle.push_back(index);
+            }
+            wake.notify_one();
+        }
+    }
+
+    // worker: converts and writes queued frames until stopped and drained
+    void run()
+    {
+        std::vector<unsigned char> planes(yuv::frameBytes(streamWidth, streamHeight));
+        std::ptrdiff_t stride = (std::ptrdiff_t)streamWidth * 4;
+        for (;;)
+        {
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !ready.empty(); });
+                if (ready.empty())
+                    return;
+                index = ready.front();
+                ready.pop_front();
+            }
+            // read-backs are bottom-up
+            const std::vector<unsigned char>& frame = frames[index];
+            yuv::rgbaToI420(&frame[(size_t)(streamHeight - 1) * stride], -stride, streamWidth, streamHeight, planes.data());
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                idle.push_back(index);
+            }
+            bool ok = !failed;
+            if (ok && !bareFrames)
+                ok = std::fwrite("FRAME\n", 1, 6, out) == 6;
+            if (ok)
+                ok = std::fwrite(planes.data(), 1, planes.size(), out) == planes.size();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok)
+                written++;
+            else
+                failed = true;
+        }
+    }
+
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+};
+
+#endif
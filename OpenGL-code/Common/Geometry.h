@@ -0,0 +1,193 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <GL/glew.h>
+
+#include "Material.h"
+
+#include <cmath>
+#include <vector>
+
+// vertex data of the demo shapes and the VAO/VBO that holds it
+// ------------------------------------------------------------
+// The builders produce the same vertices as the Q1-Q3 demos, interleaved in the order the
+// material program reads them: position (3 floats) at location 0, then texture coordinates
+// (2 floats) at 1 and colour (3 floats) at 2 when the layout has them. A per-vertex material
+// index can go in a second buffer on MATERIAL_ATTRIB.
+
+// vertex layout flags; position is always present
+const unsigned int VERTEX_TEXCOORD = 1u;
+const unsigned int VERTEX_COLOUR = 2u;
+
+inline int vertexFloats(unsigned int layout)
+{
+    return 3 + (layout & VERTEX_TEXCOORD ? 2 : 0) + (layout & VERTEX_COLOUR ? 3 : 0);
+}
+
+struct Mesh
+{
+    unsigned int VAO = 0, VBO = 0, materialVBO = 0;
+    GLenum mode = GL_TRIANGLES;
+    int count = 0;
+
+    void draw() const
+    {
+        glBindVertexArray(VAO);
+        glDrawArrays(mode, 0, count);
+    }
+
+    void release()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        if (materialVBO)
+            glDeleteBuffers(1, &materialVBO);
+        VAO = VBO = materialVBO = 0;
+    }
+};
+
+// uploads interleaved vertices in the given layout; materials, when not empty, holds one
+// material index per vertex
+inline Mesh createMesh(const std::vector<float>& vertices, unsigned int layout, GLenum mode,
+                       const std::vector<int>& materials = std::vector<int>())
+{
+    Mesh mesh;
+    mesh.mode = mode;
+    int floats = vertexFloats(layout);
+    mesh.count = (int)vertices.size() / floats;
+    glGenVertexArrays(1, &mesh.VAO);
+    glGenBuffers(1, &mesh.VBO);
+    glBindVertexArray(mesh.VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    GLsizei stride = floats * sizeof(float);
+    size_t offset = 0;
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    glEnableVertexAttribArray(0);
+    offset += 3 * sizeof(float);
+    if (layout & VERTEX_TEXCOORD)
+    {
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        glEnableVertexAttribArray(1);
+        offset += 2 * sizeof(float);
+    }
+    if (layout & VERTEX_COLOUR)
+    {
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        glEnableVertexAttribArray(2);
+    }
+
+    if (!materials.empty())
+    {
+        glGenBuffers(1, &mesh.materialVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.materialVBO);
+        glBufferData(GL_ARRAY_BUFFER, materials.size() * sizeof(int), materials.data(), GL_STATIC_DRAW);
+        glVertexAttribIPointer(MATERIAL_ATTRIB, 1, GL_INT, sizeof(int), (void*)0);
+        glEnableVertexAttribArray(MATERIAL_ATTRIB);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return mesh;
+}
+
+// a point of the 360-sided circle of radius 0.5 the demos use, i = 0 .. 360 going round once
+inline void circlePoint(int i, float& x, float& y)
+{
+    const float twoPi = 6.28318531f;
+    x = 0.5f * std::cos(i * twoPi / 360);
+    y = 0.5f * std::sin(i * twoPi / 360);
+}
+
+// disk as a triangle fan: the centre, then 361 rim points. Texture coordinates are the
+// positions themselves, except at the centre, which samples the middle of the texture.
+inline std::vector<float> diskVertices(unsigned int layout)
+{
+    std::vector<float> vertices;
+    bool textured = (layout & VERTEX_TEXCOORD) != 0;
+    float centre[5] = { 0.0f, 0.0f, 0.0f, 0.5f, 0.5f };
+    vertices.insert(vertices.end(), centre, centre + (textured ? 5 : 3));
+    for (int i = 1; i < 360 + 2; i++)
+    {
+        float x, y;
+        circlePoint(i, x, y);
+        float point[5] = { x, y, 0.0f, x, y };
+        vertices.insert(vertices.end(), point, point + (textured ? 5 : 3));
+    }
+    return vertices;
+}
+
+// ring as a line strip of 361 points, closing on the first
+inline std::vector<float> ringVertices(unsigned int layout)
+{
+    std::vector<float> vertices;
+    bool textured = (layout & VERTEX_TEXCOORD) != 0;
+    for (int i = 0; i < 360 + 1; i++)
+    {
+        float x, y;
+        circlePoint(i, x, y);
+        float point[5] = { x, y, 0.0f, x, y };
+        vertices.insert(vertices.end(), point, point + (textured ? 5 : 3));
+    }
+    return vertices;
+}
+
+// right trapezium as a triangle fan, texture coordinates spanning the unit square
+inline std::vector<float> rightTrapeziumVertices(unsigned int layout)
+{
+    static const float corners[4][5] = {
+        { -0.5f, 0.5f, 0.0f, 0.0f, 1.0f },
+        { 0.5f, 0.5f, 0.0f, 1.0f, 1.0f },
+        { 0.5f, -0.5f, 0.0f, 1.0f, 0.0f },
+        { -0.5f, 0.0f, 0.0f, 0.0f, 0.0f }
+    };
+    std::vector<float> vertices;
+    bool textured = (layout & VERTEX_TEXCOORD) != 0;
+    for (int i = 0; i < 4; i++)
+        vertices.insert(vertices.end(), corners[i], corners[i] + (textured ? 5 : 3));
+    return vertices;
+}
+
+// the red/green/blue triangle of ColourGradientTriangle
+inline std::vector<float> gradientTriangleVertices()
+{
+    static const float corners[3 * 6] = {
+        // positions         // colors
+         0.5f, -0.5f, 0.0f,  1.0f, 0.0f, 0.0f,  // bottom right
+        -0.5f, -0.5f, 0.0f,  0.0f, 1.0f, 0.0f,  // bottom left
+         0.0f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f   // top
+    };
+    return std::vector<float>(corners, corners + 3 * 6);
+}
+
+// 8x8 board over the whole viewport as two triangles per square, dark squares (the bottom
+// left one among them) first; squareMaterials gets one entry per vertex, dark or light.
+// Texture coordinates are the positions, so a GL_REPEAT texture repeats once per half window.
+inline std::vector<float> chessBoardVertices(unsigned int layout, int dark, int light, std::vector<int>& squareMaterials)
+{
+    std::vector<float> vertices;
+    bool textured = (layout & VERTEX_TEXCOORD) != 0;
+    squareMaterials.clear();
+    for (int colour = 0; colour < 2; colour++)
+        for (int column = 0; column < 8; column++)
+            for (int row = 0; row < 8; row++)
+            {
+                if ((column + row) % 2 != colour)
+                    continue;
+                float x = -1.0f + column * 0.25f, y = -1.0f + row * 0.25f;
+                float corners[6][2] = {
+                    { x, y }, { x, y + 0.25f }, { x + 0.25f, y },
+                    { x + 0.25f, y + 0.25f }, { x, y + 0.25f }, { x + 0.25f, y }
+                };
+                for (int i = 0; i < 6; i++)
+                {
+                    float point[5] = { corners[i][0], corners[i][1], 0.0f, corners[i][0], corners[i][1] };
+                    vertices.insert(vertices.end(), point, point + (textured ? 5 : 3));
+                    squareMaterials.push_back(colour ? light : dark);
+                }
+            }
+    return vertices;
+}
+
+#endif
@@ -0,0 +1,451 @@
+#ifndef GPU_SHAPE_RENDERER_H
+#define GPU_SHAPE_RENDERER_H
+
+#include <GL/glew.h>
+
+#include "Camera2D.h"
+#include "Shader.h"
+#include "ShapeStore.h"
+
+#include <vector>
+
+// GPU-driven culling and drawing for a ShapeStore (GL 4.3)
+// --------------------------------------------------------
+// The store's arrays live in a shader storage buffer. Each frame three compute passes replace
+// SpatialGrid and ShapeStoreRenderer::uploadVisible():
+//   classify  culls every shape against the camera's rectangle and picks its level of detail
+//             as shapeLod() does, with the level each slot had last frame kept in a buffer,
+//             counting each 64-shape group's shapes per (kind, level) bucket;
+//   scan      turns those counts, in group order within bucket order, into where each group's
+//             shapes start in the instance buffer, and writes one DrawArraysIndirectCommand per
+//             bucket at the bucket's own index, empty buckets drawing zero instances;
+//   scatter   copies each visible shape into its place, ranked within its group and bucket.
+// No step depends on the order the GPU runs invocations in, so every bucket's instances stay in
+// store order and overlapping shapes are drawn the same way every frame. The frame is then one
+// glMultiDrawArraysIndirect over every bucket. Nothing is read back except by visibleCount().
+// Only core 4.3 features are used, so Mesa's llvmpipe runs it.
+
+const int SHAPE_BUCKETS = SHAPE_KINDS * SHAPE_LOD_LEVELS;
+
+// The shaders below spell out SHAPE_KINDS, SHAPE_LOD_LEVELS and SHAPE_BUCKETS (3, 6 and 18) and
+// the kind order of ShapeKind. Shape i belongs to kind 0 below kindStart.x, 1 below kindStart.y
+// and 2 after; every buffer holds its values as blocks of capacity uints, the order of
+// ShapeStoreRenderer's instance buffers (centre x, centre y, radius, inner radius, material),
+// with the shape buffer adding each shape's slot as a sixth block. The group buffer holds 18
+// uints per group: its shapes in each bucket after classify, their first instance after scan.
+// Within a group, bit t of members[bucket * 2 + t / 32] says whether shape t is in the bucket.
+const char* const shapeClassifyComputeShaderSource = "#version 430 core\n"
+"layout (local_size_x = 64) in;\n"
+"layout (std430, binding = 0) readonly buffer Shapes { uint shapes[]; };\n"
+"layout (std430, binding = 1) writeonly buffer Buckets { uint bucketOf[]; };\n"
+"layout (std430, binding = 5) buffer Levels { uint levels[]; };\n"     // per slot, ~0 for none
+"layout (std430, binding = 6) writeonly buffer Groups { uint groups[]; };\n"
+"uniform uint shapeCount;\n"
+"uniform uint capacity;\n"
+"uniform uvec2 kindStart;\n"
+"uniform vec4 bounds;\n"          // min x, min y, max x, max y
+"uniform float pixelsPerUnit;\n"
+"uniform float lodPixels[6];\n"
+"uniform float hysteresis;\n"
+"shared uint members[36];\n"
+"void main()\n"
+"{\n"
+"   uint t = gl_LocalInvocationID.x;\n"
+"   if (t < 36u)\n"
+"       members[t] = 0u;\n"
+"   memoryBarrierShared();\n"
+"   barrier();\n"
+"   uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;\n"
+"   uint i = group * 64u + t;\n"
+"   if (i < shapeCount)\n"
+"   {\n"
+"       float x = uintBitsToFloat(shapes[i]);\n"
+"       float y = uintBitsToFloat(shapes[capacity + i]);\n"
+"       float r = uintBitsToFloat(shapes[2u * capacity + i]);\n"
+"       uint bucket = 0xFFFFFFFFu;\n"
+"       if (x + r >= bounds.x && x - r <= bounds.z && y + r >= bounds.y && y - r <= bounds.w)\n"
+"       {\n"
+"           uint kind = i >= kindStart.y ? 2u : i >= kindStart.x ? 1u : 0u;\n"
+"           uint lod = 0u;\n"
+"           if (kind != 2u)\n"
+"           {\n"
+"               uint slot = shapes[5u * capacity + i];\n"
+"               int previous = int(levels[slot]);\n"
+"               float pixels = r * pixelsPerUnit;\n"
+"               while (lod + 1u < 6u && pixels >= lodPixels[lod + 1u] * (int(lod) + 1 <= previous ? hysteresis : 1.0))\n"
+"                   lod++;\n"
+"               levels[slot] = lod;\n"
+"           }\n"
+"           bucket = kind * 6u + lod;\n"
+"           atomicOr(members[bucket * 2u + (t >> 5u)], 1u << (t & 31u));\n"
+"       }\n"
+"       bucketOf[i] = bucket;\n"
+"   }\n"
+"   memoryBarrierShared();\n"
+"   barrier();\n"
+"   if (t < 18u && group * 64u < shapeCount)\n"
+"       groups[group * 18u + t] = uint(bitCount(members[2u * t]) + bitCount(members[2u * t + 1u]));\n"
+"}\0";
+
+// one group of 256: each invocation sums a run of groups per bucket, the runs are scanned in
+// shared memory, and each invocation then walks its run again writing the offsets
+const char* const shapeScanComputeShaderSource = "#version 430 core\n"
+"layout (local_size_x = 256) in;\n"
+"layout (std430, binding = 2) writeonly buffer Counts { uint counts[18]; };\n"
+"layout (std430, binding = 4) writeonly buffer Commands { uvec4 commands[18]; };\n"
+"layout (std430, binding = 6) buffer Groups { uint groups[]; };\n"
+"uniform uint groupCount;\n"
+"uniform uint meshFirst[18];\n"
+"uniform uint meshCount[18];\n"
+"shared uint runs[18 * 256];\n"
+"shared uint totals[18];\n"
+"void main()\n"
+"{\n"
+"   uint t = gl_LocalInvocationID.x;\n"
+"   uint span = (groupCount + 255u) / 256u;\n"
+"   uint begin = min(t * span, groupCount), end = min(begin + span, groupCount);\n"
+"   uint offset[18];\n"
+"   for (uint b = 0u; b < 18u; b++)\n"
+"       offset[b] = 0u;\n"
+"   for (uint g = begin; g < end; g++)\n"
+"       for (uint b = 0u; b < 18u; b++)\n"
+"           offset[b] += groups[g * 18u + b];\n"
+"   for (uint b = 0u; b < 18u; b++)\n"
+"       runs[b * 256u + t] = offset[b];\n"
+"   memoryBarrierShared();\n"
+"   barrier();\n"
+"   if (t < 18u)\n"                          // exclusive scan of bucket t's runs
+"   {\n"
+"       uint sum = 0u;\n"
+"       for (uint k = 0u; k < 256u; k++)\n"
+"       {\n"
+"           uint run = runs[t * 256u + k];\n"
+"           runs[t * 256u + k] = sum;\n"
+"           sum += run;\n"
+"       }\n"
+"       totals[t] = sum;\n"
+"   }\n"
+"   memoryBarrierShared();\n"
+"   barrier();\n"
+"   uint base = 0u;\n"
+"   for (uint b = 0u; b < 18u; b++)\n"
+"   {\n"
+"       offset[b] = base + runs[b * 256u + t];\n"
+"       if (b == t)\n"                       // count, instance count, first, base instance
+"       {\n"
+"           counts[b] = totals[b];\n"
+"           commands[b] = uvec4(meshCount[b], totals[b], meshFirst[b], base);\n"
+"       }\n"
+"       base += totals[b];\n"
+"   }\n"
+"   for (uint g = begin; g < end; g++)\n"
+"       for (uint b = 0u; b < 18u; b++)\n"
+"       {\n"
+"           uint count = groups[g * 18u + b];\n"
+"           groups[g * 18u + b] = offset[b];\n"
+"           offset[b] += count;\n"
+"       }\n"
+"}\0";
+
+const char* const shapeScatterComputeShaderSource = "#version 430 core\n"
+"layout (local_size_x = 64) in;\n"
+"layout (std430, binding = 0) readonly buffer Shapes { uint shapes[]; };\n"
+"layout (std430, binding = 1) readonly buffer Buckets { uint bucketOf[]; };\n"
+"layout (std430, binding = 3) writeonly buffer Instances { uint instances[]; };\n"
+"layout (std430, binding = 6) readonly buffer Groups { uint groups[]; };\n"
+"uniform uint shapeCount;\n"
+"uniform uint capacity;\n"
+"shared uint members[36];\n"
+"void main()\n"
+"{\n"
+"   uint t = gl_LocalInvocationID.x;\n"
+"   if (t < 36u)\n"
+"       members[t] = 0u;\n"
+"   memoryBarrierShared();\n"
+"   barrier();\n"
+"   uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;\n"
+"   uint i = group * 64u + t;\n"
+"   uint bucket = i < shapeCount ? bucketOf[i] : 0xFFFFFFFFu;\n"
+"   if (bucket != 0xFFFFFFFFu)\n"
+"       atomicOr(members[bucket * 2u + (t >> 5u)], 1u << (t & 31u));\n"
+"   memoryBarrierShared();\n"
+"   barrier();\n"
+"   if (bucket != 0xFFFFFFFFu)\n"
+"   {\n"                                      // the bucket's shapes before this one in the group
+"       uint rank = uint(bitCount(members[bucket * 2u + (t >> 5u)] & ((1u << (t & 31u)) - 1u)));\n"
+"       if (t >= 32u)\n"
+"           rank += uint(bitCount(members[bucket * 2u]));\n"
+"       uint j = groups[group * 18u + bucket] + rank;\n"
+"       for (uint s = 0u; s < 5u; s++)\n"
+"           instances[s * capacity + j] = shapes[s * capacity + i];\n"
+"   }\n"
+"}\0";
+
+class GpuShapeRenderer
+{
+public:
+    // whether the current context can run this renderer
+    static bool supported()
+    {
+        return GLEW_VERSION_4_3 != 0;
+    }
+
+    // compiles the passes and builds the outline meshes; needs a current GL 4.3 context. Draw
+    // with shapeVertexShaderSource and materialFragmentShaderSource as for ShapeStoreRenderer.
+    GpuShapeRenderer()
+    {
+        classifyProgram = compileComputeProgram(shapeClassifyComputeShaderSource);
+        scanProgram = compileComputeProgram(shapeScanComputeShaderSource);
+        scatterProgram = compileComputeProgram(shapeScatterComputeShaderSource);
+
+        // every level of the annulus and the trapezium in one buffer, so that one multi-draw
+        // covers all kinds
+        int first[SHAPE_LOD_LEVELS + 1], count[SHAPE_LOD_LEVELS + 1];
+        std::vector<float> outline = shapeOutlines(first, count);
+        unsigned int meshFirst[SHAPE_BUCKETS], meshCount[SHAPE_BUCKETS];
+        for (int b = 0; b < SHAPE_BUCKETS; b++)
+        {
+            int mesh = b / SHAPE_LOD_LEVELS == SHAPE_TRAPEZIUM ? SHAPE_LOD_LEVELS : b % SHAPE_LOD_LEVELS;
+            meshFirst[b] = first[mesh];
+            meshCount[b] = count[mesh];
+            bucketVertices[b] = count[mesh];
+            bucketFullVertices[b] = count[mesh == SHAPE_LOD_LEVELS ? mesh : SHAPE_LOD_LEVELS - 1];
+        }
+        glUseProgram(classifyProgram);
+        glUniform1fv(glGetUniformLocation(classifyProgram, "lodPixels"), SHAPE_LOD_LEVELS, shapeLodPixels);
+        glUniform1f(glGetUniformLocation(classifyProgram, "hysteresis"), SHAPE_LOD_HYSTERESIS);
+        glUseProgram(scanProgram);
+        glUniform1uiv(glGetUniformLocation(scanProgram, "meshFirst"), SHAPE_BUCKETS, meshFirst);
+        glUniform1uiv(glGetUniformLocation(scanProgram, "meshCount"), SHAPE_BUCKETS, meshCount);
+        glUseProgram(0);
+
+        glGenBuffers(1, &meshVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        glBufferData(GL_ARRAY_BUFFER, outline.size() * sizeof(float), outline.data(), GL_STATIC_DRAW);
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &shapeSSBO);
+        glGenBuffers(1, &bucketSSBO);
+        glGenBuffers(1, &groupSSBO);
+        glGenBuffers(1, &levelSSBO);
+        glGenBuffers(1, &instanceVBO);
+        glGenBuffers(1, &countSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, SHAPE_BUCKETS * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, SHAPE_BUCKETS * 4 * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        capacity = slotCapacity = 0;
+        for (int k = 0; k < SHAPE_KINDS; k++)
+            sizes[k] = 0;
+    }
+
+    bool valid() const
+    {
+        return classifyProgram && scanProgram && scatterProgram;
+    }
+
+    // copies what changed since the last upload into the shape buffer; a change in the number of
+    // shapes of any kind moves the later kinds, so that copies everything
+    void upload(ShapeStore& store)
+    {
+        size_t start[SHAPE_KINDS], total = 0;
+        bool all = false;
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            start[k] = total;
+            total += store.arrays((ShapeKind)k).size();
+            all = all || store.arrays((ShapeKind)k).size() != sizes[k];
+        }
+        if (total > capacity)
+        {
+            grow(total);
+            all = true;
+        }
+        if (store.slotCount() > slotCapacity)
+        {
+            // a fresh level buffer: every shape starts without a previous level
+            static const unsigned int none = 0xFFFFFFFFu;
+            slotCapacity = store.slotCount() > 2 * slotCapacity ? store.slotCount() : 2 * slotCapacity;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, levelSSBO);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, slotCapacity * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &none);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, shapeSSBO);
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            const ShapeArrays& a = store.arrays((ShapeKind)k);
+            size_t begin = all ? 0 : a.dirtyBegin, end = all ? a.size() : a.dirtyEnd;
+            sizes[k] = a.size();
+            if (begin >= end)
+                continue;
+            const void* streams[6] = { a.centreX.data(), a.centreY.data(), a.radius.data(),
+                                       a.innerRadius.data(), a.material.data(), a.slot.data() };
+            for (int s = 0; s < 6; s++)
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, (s * capacity + start[k] + begin) * 4, (end - begin) * 4,
+                                (const char*)streams[s] + begin * 4);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        kindStart[0] = (unsigned int)start[SHAPE_RING];
+        kindStart[1] = (unsigned int)start[SHAPE_TRAPEZIUM];
+        shapeCount = total;
+        store.clearDirty();
+    }
+
+    // runs the three passes against the camera's view
+    void cull(const Camera2D& camera)
+    {
+        if (!shapeCount)
+        {
+            // the scan pass writes every count and command, so only an empty store clears them
+            static const unsigned int zero = 0;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, countSSBO);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            return;
+        }
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, shapeSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bucketSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, instanceVBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, levelSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, groupSSBO);
+
+        // a grid of 64-wide groups no wider than the guaranteed 65535
+        unsigned int groups = (unsigned int)((shapeCount + 63) / 64);
+        unsigned int groupsX = groups < 65535u ? groups : 65535u, groupsY = (groups + groupsX - 1) / groupsX;
+
+        float minX, minY, maxX, maxY;
+        camera.bounds(minX, minY, maxX, maxY);
+        glUseProgram(classifyProgram);
+        glUniform1ui(glGetUniformLocation(classifyProgram, "shapeCount"), (unsigned int)shapeCount);
+        glUniform1ui(glGetUniformLocation(classifyProgram, "capacity"), (unsigned int)capacity);
+        glUniform2ui(glGetUniformLocation(classifyProgram, "kindStart"), kindStart[0], kindStart[1]);
+        glUniform4f(glGetUniformLocation(classifyProgram, "bounds"), minX, minY, maxX, maxY);
+        glUniform1f(glGetUniformLocation(classifyProgram, "pixelsPerUnit"), camera.pixelsPerUnit());
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(scanProgram);
+        glUniform1ui(glGetUniformLocation(scanProgram, "groupCount"), groups);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(scatterProgram);
+        glUniform1ui(glGetUniformLocation(scatterProgram, "shapeCount"), (unsigned int)shapeCount);
+        glUniform1ui(glGetUniformLocation(scatterProgram, "capacity"), (unsigned int)capacity);
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        glUseProgram(0);
+    }
+
+    // the commands the last cull() wrote; the caller has the program, its view and the material
+    // table bound
+    void draw() const
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)0, SHAPE_BUCKETS, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // shapes the last cull() kept, per bucket (kind * SHAPE_LOD_LEVELS + level) when counts is given;
+    // reads the counts back, so it waits for the GPU
+    size_t visibleCount(unsigned int* counts = NULL) const
+    {
+        unsigned int bucketCounts[SHAPE_BUCKETS];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countSSBO);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(bucketCounts), bucketCounts);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        size_t visible = 0;
+        for (int b = 0; b < SHAPE_BUCKETS; b++)
+        {
+            visible += bucketCounts[b];
+            if (counts)
+                counts[b] = bucketCounts[b];
+        }
+        return visible;
+    }
+
+    // vertices the commands for these bucket counts draw, or would draw with every disk and ring
+    // at 360 sides
+    size_t vertices(const unsigned int* counts, bool fullDetail = false) const
+    {
+        size_t total = 0;
+        for (int b = 0; b < SHAPE_BUCKETS; b++)
+            total += (size_t)counts[b] * (fullDetail ? bucketFullVertices[b] : bucketVertices[b]);
+        return total;
+    }
+
+    // shapes in the shape buffer as of the last upload()
+    size_t size() const
+    {
+        return shapeCount;
+    }
+
+    void release()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        unsigned int buffers[8] = { meshVBO, shapeSSBO, bucketSSBO, groupSSBO, levelSSBO, instanceVBO, countSSBO,
+                                    commandBuffer };
+        glDeleteBuffers(8, buffers);
+        glDeleteProgram(classifyProgram);
+        glDeleteProgram(scanProgram);
+        glDeleteProgram(scatterProgram);
+    }
+
+private:
+    // centre x, centre y, radius and inner radius floats plus the int material, 4 bytes each;
+    // the shape buffer adds the slot
+    static const size_t STREAM_BYTES = 5 * 4;
+    static const size_t SHAPE_STREAM_BYTES = 6 * 4;
+
+    unsigned int classifyProgram, scanProgram, scatterProgram;
+    unsigned int VAO, meshVBO, shapeSSBO, bucketSSBO, groupSSBO, levelSSBO, instanceVBO, countSSBO, commandBuffer;
+    size_t capacity, slotCapacity, shapeCount = 0, sizes[SHAPE_KINDS];
+    unsigned int bucketVertices[SHAPE_BUCKETS], bucketFullVertices[SHAPE_BUCKETS];
+    unsigned int kindStart[2] = { 0, 0 };
+
+    // reallocates the per-shape buffers for at least n shapes; the old contents are lost
+    void grow(size_t n)
+    {
+        capacity = n > 2 * capacity ? n : 2 * capacity;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, shapeSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * SHAPE_STREAM_BYTES, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bucketSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, groupSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (capacity + 63) / 64 * SHAPE_BUCKETS * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // the instance buffer is ShapeStoreRenderer's layout, with the base instance of each
+        // command selecting its bucket's run
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, capacity * STREAM_BYTES, NULL, GL_DYNAMIC_COPY);
+        glBindVertexArray(VAO);
+        for (int s = 0; s < 4; s++)
+        {
+            glVertexAttribPointer(4 + s, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(s * capacity * 4));
+            glVertexAttribDivisor(4 + s, 1);
+            glEnableVertexAttribArray(4 + s);
+        }
+        glVertexAttribIPointer(MATERIAL_ATTRIB, 1, GL_INT, sizeof(int), (void*)(4 * capacity * 4));
+        glVertexAttribDivisor(MATERIAL_ATTRIB, 1);
+        glEnableVertexAttribArray(MATERIAL_ATTRIB);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,754 @@
+#ifndef IMAGE_ENCODER_H
+#define IMAGE_ENCODER_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// QOI and PNG encoding of independent row bands
+// ---------------------------------------------
+// The kernels behind QoiWriter and PngWriter. Each encodes one band of RGBA8 rows on its own,
+// given only the row above it, so the bands of an image can be encoded on different threads
+// and their outputs simply concatenated:
+//   qoi       a band starts from the last pixel of the row above, as the decoder will, but
+//             trusts no colour-index slot until the band has filled it itself;
+//   deflate   a fast single-pass compressor (greedy matches found through one hash table, one
+//             dynamic Huffman block, or stored blocks when those are smaller) that ends every
+//             band on a byte boundary with an empty stored block, the way pigz splits its work;
+//   png       filters a band's rows with the Up filter, deflates them and wraps the result in
+//             an IDAT chunk, also returning the Adler-32 of the filtered bytes; adler32Combine()
+//             folds the bands' checksums into the zlib stream's.
+
+namespace qoi
+{
+    const unsigned char OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xC0, OP_RGB = 0xFE, OP_RGBA = 0xFF;
+    const unsigned char END_MARKER[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+    // the 14-byte file header; channels 3 or 4, colour space 0 (sRGB with linear alpha)
+    inline void header(int width, int height, int channels, unsigned char out[14])
+    {
+        std::memcpy(out, "qoif", 4);
+        for (int i = 0; i < 4; i++)
+        {
+            out[4 + i] = (unsigned char)(width >> (24 - 8 * i));
+            out[8 + i] = (unsigned char)(height >> (24 - 8 * i));
+        }
+        out[12] = (unsigned char)channels;
+        out[13] = 0;
+    }
+
+    // appends rows x width RGBA8 pixels (rows stride bytes apart, top first) to out; previous is
+    // the last pixel before the band, NULL for the first band. Without alpha every pixel is
+    // encoded as opaque, matching a 3-channel header.
+    inline void encodeBand(const unsigned char* pixels, int width, int rows, std::ptrdiff_t stride, const unsigned char* previous,
+                           bool alpha, std::vector<unsigned char>& out)
+    {
+        // pixels are compared as 32-bit words, bytes in memory order
+        unsigned int index[64], prev, opaque;
+        bool known[64] = {};
+        const unsigned char opaqueBlack[4] = { 0, 0, 0, 255 };
+        std::memcpy(&prev, previous ? previous : opaqueBlack, 4);
+        std::memcpy(&opaque, opaqueBlack, 4);
+        if (!alpha)
+            prev |= opaque;
+        unsigned char* op = NULL;
+        int run = 0;
+        for (int y = 0; y < rows; y++)
+        {
+            // room for the row at five bytes a pixel at most, plus a pending run
+            size_t used = op ? op - out.data() : out.size(), needed = used + (size_t)width * 5 + 1;
+            if (out.size() < needed)
+                out.resize(std::max(needed, out.size() * 2));
+            op = out.data() + used;
+            const unsigned char* row = pixels + y * stride;
+            for (int x = 0; x < width; x++)
+            {
+                unsigned int word;
+                std::memcpy(&word, row + x * 4, 4);
+                if (!alpha)
+                    word |= opaque;
+                if (word == prev)
+                {
+                    if (++run == 62)
+                    {
+                        *op++ = (unsigned char)(OP_RUN | (run - 1));
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run)
+                {
+                    *op++ = (unsigned char)(OP_RUN | (run - 1));
+                    run = 0;
+                }
+                unsigned char px[4], last[4];
+                std::memcpy(px, &word, 4);
+                std::memcpy(last, &prev, 4);
+                prev = word;
+                int slot = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+                if (known[slot] && index[slot] == word)
+                {
+                    *op++ = (unsigned char)(OP_INDEX | slot);
+                    continue;
+                }
+                index[slot] = word;
+                known[slot] = true;
+                if (px[3] == last[3])
+                {
+                    int dr = (signed char)(px[0] - last[0]), dg = (signed char)(px[1] - last[1]), db = (signed char)(px[2] - last[2]);
+                    int drg = dr - dg, dbg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                        *op++ = (unsigned char)(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                    else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                    {
+                        op[0] = (unsigned char)(OP_LUMA | (dg + 32));
+                        op[1] = (unsigned char)((drg + 8) << 4 | (dbg + 8));
+                        op += 2;
+                    }
+                    else
+                    {
+                        op[0] = OP_RGB;
+                        std::memcpy(op + 1, px, 3);
+                        op += 4;
+                    }
+                }
+                else
+                {
+                    op[0] = OP_RGBA;
+                    std::memcpy(op + 1, px, 4);
+                    op += 5;
+                }
+            }
+        }
+        if (!op)
+            return;
+        if (run)
+            *op++ = (unsigned char)(OP_RUN | (run - 1));
+        out.resize(op - out.data());
+    }
+}
+
+namespace deflate
+{
+    // ---------------------------------------------------------------- checksums
+
+    inline unsigned int adler32(const unsigned char* data, size_t size, unsigned int adler = 1)
+    {
+        unsigned int a = adler & 0xFFFF, b = adler >> 16;
+        while (size)
+        {
+            // 5552 bytes is the most that cannot overflow b before the modulo
+            size_t part = size < 5552 ? size : 5552;
+            size -= part;
+            for (size_t i = 0; i < part; i++)
+            {
+                a += data[i];
+                b += a;
+            }
+            data += part;
+            a %= 65521;
+            b %= 65521;
+        }
+        return b << 16 | a;
+    }
+
+    // the Adler-32 of A followed by B from those of A and B and the length of B (zlib's formula)
+    inline unsigned int adler32Combine(unsigned int first, unsigned int second, unsigned long long secondLength)
+    {
+        const unsigned int BASE = 65521;
+        unsigned int rem = (unsigned int)(secondLength % BASE);
+        unsigned int sum1 = first & 0xFFFF;
+        unsigned int sum2 = (unsigned int)((unsigned long long)rem * sum1 % BASE);
+        sum1 += (second & 0xFFFF) + BASE - 1;
+        sum2 += (first >> 16) + (second >> 16) + BASE - rem;
+        if (sum1 >= BASE)
+            sum1 -= BASE;
+        if (sum1 >= BASE)
+            sum1 -= BASE;
+        if (sum2 >= 2 * BASE)
+            sum2 -= 2 * BASE;
+        if (sum2 >= BASE)
+            sum2 -= BASE;
+        return sum2 << 16 | sum1;
+    }
+
+    // CRC-32 as PNG chunks use it, eight bytes per step (slicing-by-8); the tables are built
+    // once, by whichever thread first needs them
+    struct CrcTables
+    {
+        unsigned int entries[8][256];
+
+        CrcTables()
+        {
+            for (unsigned int n = 0; n < 256; n++)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[0][n] = c;
+            }
+            for (unsigned int n = 0; n < 256; n++)
+                for (int t = 1; t < 8; t++)
+                    entries[t][n] = (entries[t - 1][n] >> 8) ^ entries[0][entries[t - 1][n] & 0xFF];
+        }
+    };
+
+    inline const unsigned int* crcTables()
+    {
+        static const CrcTables tables;
+        return &tables.entries[0][0];
+    }
+
+    inline unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+    {
+        const unsigned int* t = crcTables();
+        crc = ~crc;
+        for (; size >= 8; size -= 8, data += 8)
+        {
+            unsigned int low = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | (unsigned int)data[3] << 24);
+            unsigned int high = data[4] | data[5] << 8 | data[6] << 16 | (unsigned int)data[7] << 24;
+            crc = t[7 * 256 + (low & 0xFF)] ^ t[6 * 256 + ((low >> 8) & 0xFF)] ^ t[5 * 256 + ((low >> 16) & 0xFF)] ^
+                  t[4 * 256 + (low >> 24)] ^ t[3 * 256 + (high & 0xFF)] ^ t[2 * 256 + ((high >> 8) & 0xFF)] ^
+                  t[1 * 256 + ((high >> 16) & 0xFF)] ^ t[high >> 24];
+        }
+        for (size_t i = 0; i < size; i++)
+            crc = t[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    // ---------------------------------------------------------------- bit output
+
+    // LSB-first bit packer, as deflate streams are written, storing four bytes at a time into
+    // room made beforehand with reserve()
+    struct BitWriter
+    {
+        std::vector<unsigned char>& out;
+        size_t used;
+        unsigned long long bits = 0;
+        int count = 0;
+
+        explicit BitWriter(std::vector<unsigned char>& output) : out(output), used(output.size()) {}
+
+        void reserve(size_t bytes)
+        {
+            if (out.size() < used + bytes + 8)
+                out.resize(used + bytes + 8);
+        }
+        void put(unsigned int value, int length)
+        {
+            bits |= (unsigned long long)value << count;
+            count += length;
+            if (count >= 32)
+            {
+                unsigned int word = (unsigned int)bits;
+                unsigned char* p = &out[used];
+                p[0] = (unsigned char)word;
+                p[1] = (unsigned char)(word >> 8);
+                p[2] = (unsigned char)(word >> 16);
+                p[3] = (unsigned char)(word >> 24);
+                used += 4;
+                bits >>= 32;
+                count -= 32;
+            }
+        }
+        // pads to a byte boundary and stores what is left
+        void align()
+        {
+            for (count = (count + 7) & ~7; count > 0; count -= 8)
+            {
+                out[used++] = (unsigned char)bits;
+                bits >>= 8;
+            }
+            bits = 0;
+            count = 0;
+        }
+        void bytes(const unsigned char* data, size_t size)
+        {
+            align();
+            reserve(size);
+            std::memcpy(&out[used], data, size);
+            used += size;
+        }
+        // trims the output to what was written
+        void finish()
+        {
+            align();
+            out.resize(used);
+        }
+    };
+
+    // ---------------------------------------------------------------- Huffman codes
+
+    // code lengths of at most maxBits for the symbols with nonzero frequency (0 for the others).
+    // Plain Huffman lengths, then, when any is too long, miniz's adjustment: the surplus codes
+    // are pushed down one level at a time until the Kraft sum fits, and the lengths are handed
+    // out again from shortest to the most frequent symbols.
+    inline void codeLengths(const unsigned int* frequencies, int symbols, int maxBits, unsigned char* lengths)
+    {
+        std::vector<int> used;
+        for (int s = 0; s < symbols; s++)
+        {
+            lengths[s] = 0;
+            if (frequencies[s])
+                used.push_back(s);
+        }
+        if (used.empty())
+            return;
+        if (used.size() == 1)
+        {
+            lengths[used[0]] = 1;
+            return;
+        }
+        std::sort(used.begin(), used.end(), [frequencies](int a, int b)
+        {
+            return frequencies[a] < frequencies[b] || (frequencies[a] == frequencies[b] && a < b);
+        });
+
+        // two-queue Huffman over the sorted leaves: internal nodes are made in increasing weight
+        int n = (int)used.size();
+        std::vector<unsigned long long> weight(2 * n - 1);
+        std::vector<int> parent(2 * n - 1, -1);
+        for (int i = 0; i < n; i++)
+            weight[i] = frequencies[used[i]];
+        int leaf = 0, node = n, next = n;
+        auto smallest = [&]() -> int
+        {
+            if (leaf < n && (node >= next || weight[leaf] <= weight[node]))
+                return leaf++;
+            return node++;
+        };
+        for (; next < 2 * n - 1; next++)
+        {
+            int a = smallest(), b = smallest();
+            weight[next] = weight[a] + weight[b];
+            parent[a] = parent[b] = next;
+        }
+        std::vector<int> depth(2 * n - 1, 0);
+        int counts[64] = {};
+        for (int i = 2 * n - 3; i >= 0; i--)
+            depth[i] = depth[parent[i]] + 1;
+        for (int i = 0; i < n; i++)
+            counts[std::min(depth[i], 63)]++;
+
+        int longest = 0;
+        for (int i = 0; i < n; i++)
+            longest = std::max(longest, depth[i]);
+        if (longest > maxBits)
+        {
+            for (int length = maxBits + 1; length < 64; length++)
+            {
+                counts[maxBits] += counts[length];
+                counts[length] = 0;
+            }
+            unsigned long long total = 0;
+            for (int length = 1; length <= maxBits; length++)
+                total += (unsigned long long)counts[length] << (maxBits - length);
+            while (total != 1ull << maxBits)
+            {
+                counts[maxBits]--;
+                for (int length = maxBits - 1; length > 0; length--)
+                    if (counts[length])
+                    {
+                        counts[length]--;
+                        counts[length + 1] += 2;
+                        break;
+                    }
+                total--;
+            }
+        }
+        // the least frequent symbols take the longest codes
+        int i = 0;
+        for (int length = 63; length > 0; length--)
+            for (int k = 0; k < counts[length]; k++)
+                lengths[used[i++]] = (unsigned char)length;
+    }
+
+    // canonical codes for the lengths, bit-reversed for LSB-first output
+    inline void canonicalCodes(const unsigned char* lengths, int symbols, unsigned short* codes)
+    {
+        int counts[16] = {}, next[16] = {};
+        for (int s = 0; s < symbols; s++)
+            counts[lengths[s]]++;
+        counts[0] = 0;
+        for (int length = 1, code = 0; length < 16; length++)
+        {
+            code = (code + counts[length - 1]) << 1;
+            next[length] = code;
+        }
+        for (int s = 0; s < symbols; s++)
+        {
+            int length = lengths[s];
+            if (!length)
+            {
+                codes[s] = 0;
+                continue;
+            }
+            unsigned int code = (unsigned int)next[length]++, reversed = 0;
+            for (int b = 0; b < length; b++)
+                reversed |= ((code >> b) & 1) << (length - 1 - b);
+            codes[s] = (unsigned short)reversed;
+        }
+    }
+
+    // ---------------------------------------------------------------- length and distance codes
+
+    const unsigned short LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                             67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const unsigned char LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const unsigned short DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                               1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const unsigned char DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+                                               11, 11, 12, 12, 13, 13 };
+    const unsigned char CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    // length 3..258 to its code's index (0..28), distance 1..32768 to its code (0..29)
+    // length 3..258 to its code's index (0..28), distance 1..32768 to its code (0..29)
+    struct CodeTables
+    {
+        unsigned char lengths[259], distances[512];
+
+        CodeTables()
+        {
+            for (int code = 0; code < 28; code++)
+                for (int l = LENGTH_BASE[code]; l < LENGTH_BASE[code + 1]; l++)
+                    lengths[l] = (unsigned char)code;
+            lengths[258] = 28;
+            // distances up to 256 one by one, longer ones by 128s, as zlib does
+            for (int code = 0; code < 30; code++)
+            {
+                int end = code == 29 ? 32769 : DISTANCE_BASE[code + 1];
+                for (int d = DISTANCE_BASE[code]; d < end; d++)
+                    distances[d <= 256 ? d - 1 : 256 + ((d - 1) >> 7)] = (unsigned char)code;
+            }
+        }
+    };
+
+    inline const CodeTables& codeTables()
+    {
+        static const CodeTables tables;
+        return tables;
+    }
+    inline int lengthCode(int length)
+    {
+        return codeTables().lengths[length];
+    }
+    inline int distanceCode(int distance)
+    {
+        return codeTables().distances[distance <= 256 ? distance - 1 : 256 + ((distance - 1) >> 7)];
+    }
+
+    // ---------------------------------------------------------------- compressor
+
+    const int WINDOW = 32768, MIN_MATCH = 4, MAX_MATCH = 258, HASH_BITS = 15;
+
+    // one token per literal (the byte) or match (length << 16 | distance, top bit set)
+    const unsigned int MATCH_FLAG = 0x80000000u;
+
+    inline unsigned int read32(const unsigned char* p)
+    {
+        unsigned int v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    // greedy LZ77 parse of data through one hash table of the last position per 4-byte hash.
+    // After 32 misses in a row the search skips ahead, one byte more for every further 32,
+    // emitting the skipped bytes as literals, so noise that will not compress passes quickly.
+    inline void findMatches(const unsigned char* data, size_t size, std::vector<unsigned int>& tokens)
+    {
+        std::vector<int> head((size_t)1 << HASH_BITS, -1);
+        tokens.resize(size + 1);
+        unsigned int* token = tokens.data();
+        size_t i = 0, misses = 0;
+        while (i + MIN_MATCH <= size)
+        {
+            unsigned int word = read32(data + i);
+            unsigned int hash = (word * 2654435761u) >> (32 - HASH_BITS);
+            int candidate = head[hash];
+            head[hash] = (int)i;
+            if (candidate >= 0 && i - (size_t)candidate <= (size_t)WINDOW && read32(data + candidate) == word)
+            {
+                size_t limit = std::min((size_t)MAX_MATCH, size - i), length = MIN_MATCH;
+                while (length + 8 <= limit)
+                {
+                    unsigned long long a, b;
+                    std::memcpy(&a, data + candidate + length, 8);
+                    std::memcpy(&b, data + i + length, 8);
+                    if (a != b)
+                        break;
+                    length += 8;
+                }
+                while (length < limit && data[candidate + length] == data[i + length])
+                    length++;
+                *token++ = MATCH_FLAG | (unsigned int)length << 16 | (unsigned int)(i - candidate);
+                // short matches enter every position they cover, long ones only their last,
+                // which is enough to keep runs chaining
+                size_t end = i + length;
+                for (size_t p = length > 32 ? end - 1 : i + 1; p + MIN_MATCH <= size && p < end; p++)
+                    head[(read32(data + p) * 2654435761u) >> (32 - HASH_BITS)] = (int)p;
+                i = end;
+                misses = 0;
+            }
+            else
+            {
+                size_t end = std::min(size, i + 1 + (misses++ >> 5));
+                while (i < end)
+                    *token++ = data[i++];
+            }
+        }
+        while (i < size)
+            *token++ = data[i++];
+        tokens.resize(token - tokens.data());
+    }
+
+    inline void storedBlocks(const unsigned char* data, size_t size, bool final, BitWriter& writer)
+    {
+        do
+        {
+            size_t part = std::min(size, (size_t)65535);
+            size -= part;
+            writer.reserve(8);
+            writer.put(final && !size ? 1 : 0, 1);
+            writer.put(0, 2);
+            writer.align();
+            writer.put((unsigned int)part, 16);
+            writer.put((unsigned int)part ^ 0xFFFF, 16);
+            writer.bytes(data, part);
+            data += part;
+        } while (size);
+    }
+
+    // compresses data into out as a run of deflate blocks; unless final, ends with an empty
+    // stored block so that the output stops on a byte boundary and more blocks can follow
+    inline void compress(const unsigned char* data, size_t size, bool final, std::vector<unsigned char>& out)
+    {
+        std::vector<unsigned int> tokens;
+        findMatches(data, size, tokens);
+
+        unsigned int litFreq[286] = {}, distFreq[30] = {};
+        for (size_t t = 0; t < tokens.size(); t++)
+        {
+            unsigned int token = tokens[t];
+            if (token & MATCH_FLAG)
+            {
+                litFreq[257 + lengthCode((token >> 16) & 0x1FF)]++;
+                distFreq[distanceCode(token & 0xFFFF)]++;
+            }
+            else
+                litFreq[token]++;
+        }
+        litFreq[256] = 1;
+        unsigned char litLengths[286], distLengths[30];
+        codeLengths(litFreq, 286, 15, litLengths);
+        codeLengths(distFreq, 30, 15, distLengths);
+
+        int hlit = 286, hdist = 30;
+        while (hlit > 257 && !litLengths[hlit - 1])
+            hlit--;
+        while (hdist > 1 && !distLengths[hdist - 1])
+            hdist--;
+
+        // the two length lists, run-length coded with symbols 16 (repeat previous), 17 and 18 (zeros)
+        unsigned char all[286 + 30];
+        std::memcpy(all, litLengths, hlit);
+        std::memcpy(all + hlit, distLengths, hdist);
+        std::vector<unsigned short> lengthTokens;     // symbol | extra bits << 5
+        unsigned int clFreq[19] = {};
+        for (int i = 0; i < hlit + hdist;)
+        {
+            int value = all[i], run = 1;
+            while (i + run < hlit + hdist && all[i + run] == value)
+                run++;
+            i += run;
+            if (value == 0)
+            {
+                while (run >= 11)
+                {
+                    int part = std::min(run, 138);
+                    lengthTokens.push_back((unsigned short)(18 | (part - 11) << 5));
+                    clFreq[18]++;
+                    run -= part;
+                }
+                if (run >= 3)
+                {
+                    lengthTokens.push_back((unsigned short)(17 | (run - 3) << 5));
+                    clFreq[17]++;
+                    run = 0;
+                }
+            }
+            else
+            {
+                lengthTokens.push_back((unsigned short)value);
+                clFreq[value]++;
+                run--;
+                while (run >= 3)
+                {
+                    int part = std::min(run, 6);
+                    lengthTokens.push_back((unsigned short)(16 | (part - 3) << 5));
+                    clFreq[16]++;
+                    run -= part;
+                }
+            }
+            for (; run > 0; run--)
+            {
+                lengthTokens.push_back((unsigned short)value);
+                clFreq[value]++;
+            }
+        }
+        unsigned char clLengths[19];
+        codeLengths(clFreq, 19, 7, clLengths);
+        int hclen = 19;
+        while (hclen > 4 && !clLengths[CODE_LENGTH_ORDER[hclen - 1]])
+            hclen--;
+
+        // size of the dynamic block in bits against storing
+        unsigned long long dynamicBits = 3 + 5 + 5 + 4 + 3 * hclen;
+        for (size_t t = 0; t < lengthTokens.size(); t++)
+        {
+            int symbol = lengthTokens[t] & 31;
+            dynamicBits += clLengths[symbol] + (symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0);
+        }
+        for (int s = 0; s < 286; s++)
+            dynamicBits += (unsigned long long)litFreq[s] * (litLengths[s] + (s > 256 ? LENGTH_EXTRA[s - 257] : 0));
+        for (int s = 0; s < 30; s++)
+            dynamicBits += (unsigned long long)distFreq[s] * (distLengths[s] + DISTANCE_EXTRA[s]);
+        unsigned long long storedBits = ((unsigned long long)size + 5 * (size / 65535 + 1)) * 8;
+
+        BitWriter writer(out);
+        if (size == 0 || dynamicBits >= storedBits)
+            storedBlocks(data, size, final, writer);
+        else
+        {
+            writer.reserve((size_t)(dynamicBits / 8) + 8);
+            unsigned short litCodes[286], distCodes[30], clCodes[19];
+            canonicalCodes(litLengths, 286, litCodes);
+            canonicalCodes(distLengths, 30, distCodes);
+            canonicalCodes(clLengths, 19, clCodes);
+            writer.put(final ? 1 : 0, 1);
+            writer.put(2, 2);
+            writer.put(hlit - 257, 5);
+            writer.put(hdist - 1, 5);
+            writer.put(hclen - 4, 4);
+            for (int i = 0; i < hclen; i++)
+                writer.put(clLengths[CODE_LENGTH_ORDER[i]], 3);
+            for (size_t t = 0; t < lengthTokens.size(); t++)
+            {
+                int symbol = lengthTokens[t] & 31, extra = lengthTokens[t] >> 5;
+                writer.put(clCodes[symbol], clLengths[symbol]);
+                if (symbol >= 16)
+                    writer.put(extra, symbol == 16 ? 2 : symbol == 17 ? 3 : 7);
+            }
+            for (size_t t = 0; t < tokens.size(); t++)
+            {
+                unsigned int token = tokens[t];
+                if (!(token & MATCH_FLAG))
+                {
+                    writer.put(litCodes[token], litLengths[token]);
+                    continue;
+                }
+                int length = (token >> 16) & 0x1FF, distance = token & 0xFFFF;
+                int lc = lengthCode(length), dc = distanceCode(distance);
+                writer.put(litCodes[257 + lc], litLengths[257 + lc]);
+                writer.put(length - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+                writer.put(distCodes[dc], distLengths[dc]);
+                writer.put(distance - DISTANCE_BASE[dc], DISTANCE_EXTRA[dc]);
+            }
+            writer.put(litCodes[256], litLengths[256]);
+        }
+        if (!final)
+        {
+            writer.reserve(8);
+            writer.put(0, 3);
+            writer.align();
+            writer.put(0, 16);
+            writer.put(0xFFFF, 16);
+        }
+        writer.finish();
+    }
+}
+
+namespace png
+{
+    const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    inline void putBigEndian(unsigned int value, unsigned char* out)
+    {
+        out[0] = (unsigned char)(value >> 24);
+        out[1] = (unsigned char)(value >> 16);
+        out[2] = (unsigned char)(value >> 8);
+        out[3] = (unsigned char)value;
+    }
+
+    // a whole chunk: length, type, data and CRC
+    inline void appendChunk(const char type[4], const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+    {
+        size_t start = out.size();
+        out.resize(start + 8);
+        putBigEndian((unsigned int)size, &out[start]);
+        std::memcpy(&out[start + 4], type, 4);
+        out.insert(out.end(), data, data + size);
+        unsigned char crc[4];
+        putBigEndian(deflate::crc32(&out[start + 4], size + 4), crc);
+        out.insert(out.end(), crc, crc + 4);
+    }
+
+    // signature, IHDR for 8-bit RGB or RGBA, and an IDAT holding the zlib header
+    inline void header(int width, int height, bool alpha, std::vector<unsigned char>& out)
+    {
+        out.insert(out.end(), SIGNATURE, SIGNATURE + 8);
+        unsigned char ihdr[13];
+        putBigEndian((unsigned int)width, ihdr);
+        putBigEndian((unsigned int)height, ihdr + 4);
+        ihdr[8] = 8;
+        ihdr[9] = alpha ? 6 : 2;
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;
+        appendChunk("IHDR", ihdr, 13, out);
+        // deflate with a 32K window, no preset dictionary, fastest level
+        const unsigned char zlib[2] = { 0x78, 0x01 };
+        appendChunk("IDAT", zlib, 2, out);
+    }
+
+    // one IDAT chunk with rows of width RGBA8 pixels (rows stride bytes apart, top first) filtered
+    // with Up and deflated; above is the row before the band (NULL for the first). Sets adler
+    // to the Adler-32 of the filtered bytes and filteredBytes to their number.
+    inline void encodeBand(const unsigned char* pixels, int width, int rows, std::ptrdiff_t stride, const unsigned char* above,
+                           bool alpha, std::vector<unsigned char>& out, unsigned int& adler, size_t& filteredBytes)
+    {
+        int channels = alpha ? 4 : 3;
+        size_t rowBytes = (size_t)width * channels + 1;
+        std::vector<unsigned char> filtered(rowBytes * rows), zeros(above ? 0 : (size_t)width * 4);
+        for (int y = 0; y < rows; y++)
+        {
+            const unsigned char* row = pixels + y * stride;
+            const unsigned char* prior = y ? row - stride : above ? above : zeros.data();
+            unsigned char* f = &filtered[rowBytes * y];
+            *f++ = 2;
+            if (alpha)
+                for (int i = 0; i < width * 4; i++)
+                    f[i] = (unsigned char)(row[i] - prior[i]);
+            else
+                for (int x = 0; x < width; x++)
+                {
+                    f[x * 3] = (unsigned char)(row[x * 4] - prior[x * 4]);
+                    f[x * 3 + 1] = (unsigned char)(row[x * 4 + 1] - prior[x * 4 + 1]);
+                    f[x * 3 + 2] = (unsigned char)(row[x * 4 + 2] - prior[x * 4 + 2]);
+                }
+        }
+        adler = deflate::adler32(filtered.data(), filtered.size());
+        filteredBytes = filtered.size();
+        std::vector<unsigned char> compressed;
+        deflate::compress(filtered.data(), filtered.size(), false, compressed);
+        appendChunk("IDAT", compressed.data(), compressed.size(), out);
+    }
+
+    // the final empty deflate block and the Adler-32 of everything filtered, then IEND
+    inline void trailer(unsigned int adler, std::vector<unsigned char>& out)
+    {
+        unsigned char end[9] = { 0x01, 0x00, 0x00, 0xFF, 0xFF };
+        putBigEndian(adler, end + 5);
+        appendChunk("IDAT", end, 9, out);
+        appendChunk("IEND", NULL, 0, out);
+    }
+}
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ImageEncoder.h"
+#include "OutputFile.h"
+#include "ThreadPool.h"
+
+// streaming image output
+// ----------------------
+// An ImageSink takes an RGBA8 image a few rows at a time, top row first, so whoever produces
+// the rows (the poster renderer, a frame grab) never needs the whole image in memory. PpmWriter
+// writes binary PPM (P6, the alpha channel dropped) through one large stdio buffer. QoiWriter and
+// PngWriter compress: they gather rows into a batch of bands, encode the bands of a full batch at
+// once on a thread pool (see ImageEncoder.h) and write the results in order through an
+// OutputFile, optionally bypassing the page cache. createImageWriter() picks one by extension.
+
+class ImageSink
+{
+public:
+    virtual ~ImageSink() {}
+
+    // called once before any rows; false when the output cannot be opened
+    virtual bool begin(int width, int height) = 0;
+    // count rows of width RGBA8 pixels, top first; stride is the distance in bytes from one row
+    // to the one below it, negative for bottom-up buffers such as glReadPixels fills
+    virtual bool write(const unsigned char* rows, int count, std::ptrdiff_t stride) = 0;
+    // after the last row; false when anything went wrong on the way
+    virtual bool finish() = 0;
+};
+
+class PpmWriter : public ImageSink
+{
+public:
+    explicit PpmWriter(const std::string& path, size_t bufferBytes = 4 * 1024 * 1024)
+        : file(path), bufferSize(bufferBytes)
+    {
+    }
+    ~PpmWriter()
+    {
+        if (out)
+            std::fclose(out);
+    }
+
+    bool begin(int width, int height)
+    {
+        out = std::fopen(file.c_str(), "wb");
+        if (!out)
+            return false;
+        std::setvbuf(out, NULL, _IOFBF, bufferSize);
+        imageWidth = width;
+        rowsLeft = height;
+        row.resize((size_t)width * 3);
+        ok = std::fprintf(out, "P6\n%d %d\n255\n", width, height) > 0;
+        return ok;
+    }
+
+    bool write(const unsigned char* rows, int count, std::ptrdiff_t stride)
+    {
+        for (int y = 0; y < count && ok; y++)
+        {
+            const unsigned char* in = rows + y * stride;
+            for (int x = 0; x < imageWidth; x++)
+                for (int c = 0; c < 3; c++)
+                    row[(size_t)x * 3 + c] = in[x * 4 + c];
+            ok = std::fwrite(row.data(), 1, row.size(), out) == row.size();
+        }
+        rowsLeft -= count;
+        return ok;
+    }
+
+    bool finish()
+    {
+        if (!out)
+            return false;
+        bool closed = std::fclose(out) == 0;
+        out = NULL;
+        return closed && ok && rowsLeft == 0;
+    }
+
+private:
+    std::string file;
+    size_t bufferSize;
+    FILE* out = NULL;
+    int imageWidth = 0, rowsLeft = 0;
+    std::vector<unsigned char> row;
+    bool ok = false;
+};
+
+// rows gathered into batches of bandRows-row bands; a full batch is encoded band by band in
+// parallel, the caller's thread included, then written out in order. Each band sees the row above
+// it, kept across batches, so the encoders can predict from it.
+class BandedImageWriter : public ImageSink
+{
+public:
+    BandedImageWriter(const std::string& path, ThreadPool* pool, bool alpha, bool direct, int bandRows)
+        : keepAlpha(alpha), file(path), workers(pool), uncached(direct), rowsPerBand(std::max(1, bandRows))
+    {
+    }
+
+    bool begin(int width, int height)
+    {
+        imageWidth = width;
+        rowsLeft = height;
+        // two bands per thread even out their differing costs
+        bands = workers ? 2 * ((int)workers->size() + 1) : 1;
+        rowBytes = (size_t)width * 4;
+        pending.resize(rowBytes * rowsPerBand * bands);
+        above.clear();
+        pendingRows = 0;
+        encoded.assign(bands, std::vector<unsigned char>());
+        ok = output.open(file.c_str(), uncached);
+        if (!ok)
+            return false;
+        std::vector<unsigned char> start;
+        header(width, height, start);
+        ok = output.write(start.data(), start.size());
+        return ok;
+    }
+
+    bool write(const unsigned char* rows, int count, std::ptrdiff_t stride)
+    {
+        int capacity = rowsPerBand * bands;
+        for (int y = 0; y < count && ok; y++)
+        {
+            std::memcpy(&pending[rowBytes * pendingRows], rows + y * stride, rowBytes);
+            if (++pendingRows == capacity)
+                encodeBatch();
+        }
+        rowsLeft -= count;
+        return ok;
+    }
+
+    bool finish()
+    {
+        if (!output.isOpen())
+            return false;
+        if (pendingRows)
+            encodeBatch();
+        std::vector<unsigned char> end;
+        trailer(end);
+        ok = output.write(end.data(), end.size()) && ok;
+        return output.close() && ok && rowsLeft == 0;
+    }
+
+    // bytes written so far
+    unsigned long long bytesWritten() const
+    {
+        return output.size();
+    }
+    // bands encoded together, set by begin()
+    int batchBands() const
+    {
+        return bands;
+    }
+
+protected:
+    bool keepAlpha;
+
+    virtual void header(int width, int height, std::vector<unsigned char>& out) = 0;
+    // encodes rows of the image's width (4 bytes a pixel, packed), band of the current batch;
+    // above is the row before them, NULL at the top of the image. Runs on any thread.
+    virtual void encodeBand(int band, const unsigned char* pixels, int rows, const unsigned char* above, std::vector<unsigned char>& out) = 0;
+    // after the batch's bands, in order, on the calling thread
+    virtual void batchEncoded(int)
+    {
+    }
+    virtual void trailer(std::vector<unsigned char>& out) = 0;
+
+    int imageWidth = 0;
+
+private:
+    std::string file;
+    ThreadPool* workers;
+    bool uncached;
+    int rowsPerBand, bands = 1, pendingRows = 0, rowsLeft = 0;
+    size_t rowBytes = 0;
+    std::vector<unsigned char> pending, above;
+    std::vector<std::vector<unsigned char> > encoded;
+    OutputFile output;
+    bool ok = false;
+
+    void encodeBatch()
+    {
+        int count = (pendingRows + rowsPerBand - 1) / rowsPerBand;
+        std::vector<int> rows(count);
+        for (int b = 0; b < count; b++)
+            rows[b] = std::min(rowsPerBand, pendingRows - b * rowsPerBand);
+        auto body = [&](int b)
+        {
+            const unsigned char* pixels = &pending[rowBytes * rowsPerBand * b];
+            const unsigned char* prior = b ? pixels - rowBytes : (above.empty() ? NULL : above.data());
+            encoded[b].clear();
+            encodeBand(b, pixels, rows[b], prior, encoded[b]);
+        };
+        if (workers)
+            workers->parallelFor(count, body);
+        else
+            for (int b = 0; b < count; b++)
+                body(b);
+        batchEncoded(count);
+        for (int b = 0; b < count && ok; b++)
+            ok = output.write(encoded[b].data(), encoded[b].size());
+        above.assign(pending.begin() + rowBytes * (pendingRows - 1), pending.begin() + rowBytes * pendingRows);
+        pendingRows = 0;
+    }
+
+    BandedImageWriter(const BandedImageWriter&);
+    BandedImageWriter& operator=(const BandedImageWriter&);
+};
+
+// QOI, the alpha channel kept only when asked for
+class QoiWriter : public BandedImageWriter
+{
+public:
+    explicit QoiWriter(const std::string& path, ThreadPool* pool = NULL, bool alpha = false, bool direct = false, int bandRows = 64)
+        : BandedImageWriter(path, pool, alpha, direct, bandRows)
+    {
+    }
+
+protected:
+    void header(int width, int height, std::vector<unsigned char>& out)
+    {
+        out.resize(14);
+        qoi::header(width, height, keepAlpha ? 4 : 3, out.data());
+    }
+    void encodeBand(int /*band*/, const unsigned char* pixels, int rows, const unsigned char* above, std::vector<unsigned char>& out)
+    {
+        qoi::encodeBand(pixels, imageWidth, rows, (std::ptrdiff_t)imageWidth * 4, above ? above + (imageWidth - 1) * 4 : NULL,
+                        keepAlpha, out);
+    }
+    void trailer(std::vector<unsigned char>& out)
+    {
+        out.assign(qoi::END_MARKER, qoi::END_MARKER + 8);
+    }
+};
+
+// PNG, 8-bit RGB (or RGBA when asked for), one IDAT chunk per band
+class PngWriter : public BandedImageWriter
+{
+public:
+    explicit PngWriter(const std::string& path, ThreadPool* pool = NULL, bool alpha = false, bool direct = false, int bandRows = 64)
+        : BandedImageWriter(path, pool, alpha, direct, bandRows)
+    {
+    }
+
+protected:
+    void header(int width, int height, std::vector<unsigned char>& out)
+    {
+        png::header(width, height, keepAlpha, out);
+        adler = 1;
+        bandAdler.assign(batchBands(), 1);
+        bandLength.assign(batchBands(), 0);
+    }
+    void encodeBand(int band, const unsigned char* pixels, int rows, const unsigned char* above, std::vector<unsigned char>& out)
+    {
+        size_t length = 0;
+        png::encodeBand(pixels, imageWidth, rows, (std::ptrdiff_t)imageWidth * 4, above, keepAlpha, out, bandAdler[band], length);
+        bandLength[band] = length;
+    }
+    void batchEncoded(int bandCount)
+    {
+        for (int b = 0; b < bandCount; b++)
+            adler = deflate::adler32Combine(adler, bandAdler[b], bandLength[b]);
+    }
+    void trailer(std::vector<unsigned char>& out)
+    {
+        png::trailer(adler, out);
+    }
+
+private:
+    unsigned int adler = 1;
+    std::vector<unsigned int> bandAdler;
+    std::vector<size_t> bandLength;
+};
+
+// a writer for path by its extension: .png, .qoi, else PPM. pool (may be NULL) encodes the
+// compressed formats in parallel; direct asks them to bypass the page cache.
+inline std::unique_ptr<ImageSink> createImageWriter(const std::string& path, ThreadPool* pool = NULL, bool direct = false)
+{
+    std::string extension = path.size() >= 4 ? path.substr(path.size() - 4) : std::string();
+    for (size_t i = 0; i < extension.size(); i++)
+        extension[i] = (char)std::tolower((unsigned char)extension[i]);
+    if (extension == ".png")
+        return std::unique_ptr<ImageSink>(new PngWriter(path, pool, false, direct));
+    if (extension == ".qoi")
+        return std::unique_ptr<ImageSink>(new QoiWriter(path, pool, false, direct));
+    return std::unique_ptr<ImageSink>(new PpmWriter(path));
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "../Q3/stb_image.h"
+
+#include <cstddef>
+
+// read-only memory mapping of a whole file
+// ----------------------------------------
+// Owns a view from stbi_map_file(), so textures, cache files and stbi_load_mapped() all map
+// files one way: regular, non-empty files up to INT_MAX bytes, read-ahead hinted as sequential.
+class MappedFile
+{
+public:
+    MappedFile() : bytes(NULL), length(0)
+    {
+    }
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // maps path; returns false (and stays closed) for missing, empty or unmappable files
+    bool open(const char* path)
+    {
+        close();
+        size_t size = 0;
+        bytes = (const unsigned char*)stbi_map_file(path, &size);
+        if (bytes)
+            length = size;
+        return bytes != NULL;
+    }
+
+    void close()
+    {
+        if (!bytes)
+            return;
+        stbi_unmap_file((void*)bytes, length);
+        bytes = NULL;
+        length = 0;
+    }
+
+    const unsigned char* data() const
+    {
+        return bytes;
+    }
+    size_t size() const
+    {
+        return length;
+    }
+
+private:
+    const unsigned char* bytes;
+    size_t length;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// material table shared by every shape in a scene
+// -----------------------------------------------
+// Colours (and whether a shape samples a texture or uses its vertex colours) live in one
+// std140 uniform buffer instead of being baked into a fragment shader per colour. Every
+// shape then draws with the same program and just names the material it wants, either
+// once per draw (useMaterial, i.e. the current value of MATERIAL_ATTRIB) or per vertex / per instance
+// (an integer vertex attribute on MATERIAL_ATTRIB), so differently coloured shapes can
+// share a single draw call.
+
+// uniform block binding point and vertex attribute location reserved for materials
+const unsigned int MATERIAL_BINDING = 0;
+const unsigned int MATERIAL_ATTRIB = 3;
+const unsigned int MAX_MATERIALS = 256;
+
+// material flags
+const unsigned int MATERIAL_TEXTURED = 1u;      // multiply by texture(ourTexture, TexCoord)
+const unsigned int MATERIAL_VERTEX_COLOUR = 2u; // multiply by the interpolated aColor
+
+// std140 layout: vec4 colour, int textureIndex, uint flags, padded to 32 bytes
+struct Material
+{
+    float colour[4];
+    int textureIndex;   // index into the caller's texture list, -1 for untextured
+    unsigned int flags;
+    float padding[2];
+};
+
+inline Material solidMaterial(float r, float g, float b, float a = 1.0f)
+{
+    Material material = { { r, g, b, a }, -1, 0u, { 0.0f, 0.0f } };
+    return material;
+}
+
+inline Material texturedMaterial(int textureIndex)
+{
+    Material material = { { 1.0f, 1.0f, 1.0f, 1.0f }, textureIndex, MATERIAL_TEXTURED, { 0.0f, 0.0f } };
+    return material;
+}
+
+inline Material vertexColourMaterial()
+{
+    Material material = { { 1.0f, 1.0f, 1.0f, 1.0f }, -1, MATERIAL_VERTEX_COLOUR, { 0.0f, 0.0f } };
+    return material;
+}
+
+// one program for every material: position at 0, texture coordinates at 1, vertex colour
+// at 2 and the material index at MATERIAL_ATTRIB. Unused attributes may stay disabled.
+// view maps positions to clip space as in shapeVertexShaderSource; it starts out as the
+// identity, and Camera2D::applyScreen() narrows it to a poster tile.
+const char* const materialVertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec3 aPos;\n"
+"layout (location = 1) in vec2 aTexCoord;\n"
+"layout (location = 2) in vec3 aColor;\n"
+"layout (location = 3) in int aMaterial;\n"
+"uniform vec4 view = vec4(0.0, 0.0, 1.0, 1.0);\n"
+"out vec2 TexCoord;\n"
+"out vec3 ourColor;\n"
+"flat out int materialIndex;\n"
+"void main()\n"
+"{\n"
+"   gl_Position = vec4((aPos.xy - view.xy) * view.zw, aPos.z, 1.0);\n"
+"   TexCoord = aTexCoord;\n"
+"   ourColor = aColor;\n"
+"   materialIndex = aMaterial;\n"
+"}\0";
+const char* const materialFragmentShaderSource = "#version 330 core\n"
+"struct Material\n"
+"{\n"
+"   vec4 colour;\n"
+"   int textureIndex;\n"
+"   uint flags;\n"
+"};\n"
+"layout (std140) uniform Materials\n"
+"{\n"
+"   Material materials[256];\n"
+"};\n"
+"out vec4 FragColor;\n"
+"in vec2 TexCoord;\n"
+"in vec3 ourColor;\n"
+"flat in int materialIndex;\n"
+"uniform sampler2D ourTexture;\n"
+"void main()\n"
+"{\n"
+"   Material material = materials[materialIndex];\n"
+"   vec4 colour = material.colour;\n"
+"   if ((material.flags & 2u) != 0u)\n"
+"       colour *= vec4(ourColor, 1.0);\n"
+"   if ((material.flags & 1u) != 0u)\n"
+"       colour *= texture(ourTexture, TexCoord);\n"
+"   FragColor = colour;\n"
+"}\n\0";
+
+class MaterialTable
+{
+public:
+    unsigned int UBO;
+
+    // creates the uniform buffer; needs a current GL context. The buffer is released with
+    // glDeleteBuffers(1, &UBO) alongside the caller's other GL objects.
+    MaterialTable()
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(Material), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    // appends a material and returns its index, or -1 once the table is full
+    int add(const Material& material)
+    {
+        if (materials.size() >= MAX_MATERIALS)
+            return -1;
+        materials.push_back(material);
+        markDirty((unsigned int)materials.size() - 1);
+        return (int)materials.size() - 1;
+    }
+    void set(int index, const Material& material)
+    {
+        materials[index] = material;
+        markDirty(index);
+    }
+    const Material& get(int index) const
+    {
+        return materials[index];
+    }
+    unsigned int size() const
+    {
+        return (unsigned int)materials.size();
+    }
+
+    // pushes the materials changed since the last upload (one contiguous range)
+    void upload()
+    {
+        if (dirtyBegin == dirtyEnd)
+            return;
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, dirtyBegin * sizeof(Material), (dirtyEnd - dirtyBegin) * sizeof(Material), &materials[dirtyBegin]);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    // points the program's Materials block at the table; call once per program after linking
+    void attach(unsigned int program) const
+    {
+        unsigned int blockIndex = glGetUniformBlockIndex(program, "Materials");
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, blockIndex, MATERIAL_BINDING);
+    }
+    // binds the table to the material binding point, uploading any pending changes first
+    void bind()
+    {
+        upload();
+        glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BINDING, UBO);
+    }
+
+private:
+    std::vector<Material> materials;
+    unsigned int dirtyBegin, dirtyEnd;
+
+    void markDirty(unsigned int index)
+    {
+        if (dirtyBegin == dirtyEnd)
+        {
+            dirtyBegin = index;
+            dirtyEnd = index + 1;
+            return;
+        }
+        if (index < dirtyBegin) dirtyBegin = index;
+        if (index + 1 > dirtyEnd) dirtyEnd = index + 1;
+    }
+};
+
+// selects the material for the following draws when MATERIAL_ATTRIB is not an enabled array
+inline void useMaterial(int index)
+{
+    glVertexAttribI4i(MATERIAL_ATTRIB, index, 0, 0, 0);
+}
+
+#endif
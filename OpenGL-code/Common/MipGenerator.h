@@ -0,0 +1,456 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <vector>
+
+// CPU mip chain generator
+// -----------------------
+// Builds every level below a decoded 8-bit image so textures can be uploaded with
+// glTexStorage2D plus one glTexSubImage2D per level instead of glGenerateMipmap, whose speed
+// (llvmpipe runs it single-threaded) and filter are up to the driver. Two filters:
+//   MIP_FILTER_BOX     2x2 average, rounded, exact across the scalar/SSE2/AVX2/NEON paths
+//   MIP_FILTER_KAISER  separable 12-tap Kaiser-windowed sinc, sharper on photographs
+// Each level is split into bands of output rows that run on the optional ThreadPool.
+
+enum MipFilter
+{
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER
+};
+
+struct MipLevel
+{
+    int width, height;
+    std::vector<unsigned char> pixels;
+};
+
+namespace mipgenerator
+{
+    // ---------------------------------------------------------------- box filter kernels
+
+    // sum[i] = a[i] + b[i] for n bytes; layout independent
+    inline void addRowsScalar(const unsigned char* a, const unsigned char* b, unsigned short* sum, int n, int start)
+    {
+        for (int i = start; i < n; i++)
+            sum[i] = (unsigned short)(a[i] + b[i]);
+    }
+
+    // out pixel x = (sum[2x] + sum[2x + 1] + 2) / 4 per channel, starting at output pixel start
+    inline void halvePairsScalar(const unsigned short* sum, int outWidth, int channels, unsigned char* out, int start)
+    {
+        for (int x = start; x < outWidth; x++)
+            for (int c = 0; c < channels; c++)
+                out[x * channels + c] = (unsigned char)((sum[2 * x * channels + c] + sum[(2 * x + 1) * channels + c] + 2) >> 2);
+    }
+
+#ifdef CPU_SSE2
+    inline int addRowsSSE2(const unsigned char* a, const unsigned char* b, unsigned short* sum, int n)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            _mm_storeu_si128((__m128i*)(sum + i), _mm_add_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+            _mm_storeu_si128((__m128i*)(sum + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)));
+        }
+        return i;
+    }
+
+    // four channels: four output pixels per iteration
+    inline int halvePairs4SSE2(const unsigned short* sum, int outWidth, unsigned char* out)
+    {
+        const __m128i two = _mm_set1_epi16(2);
+        int x = 0;
+        for (; x + 4 <= outWidth; x += 4)
+        {
+            const __m128i* in = (const __m128i*)(sum + x * 8);
+            __m128i p01 = _mm_loadu_si128(in), p23 = _mm_loadu_si128(in + 1);
+            __m128i p45 = _mm_loadu_si128(in + 2), p67 = _mm_loadu_si128(in + 3);
+            __m128i q01 = _mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23));
+            __m128i q23 = _mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67));
+            q01 = _mm_srli_epi16(_mm_add_epi16(q01, two), 2);
+            q23 = _mm_srli_epi16(_mm_add_epi16(q23, two), 2);
+            _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(q01, q23));
+        }
+        return x;
+    }
+
+    // one channel: eight output pixels per iteration
+    inline int halvePairs1SSE2(const unsigned short* sum, int outWidth, unsigned char* out)
+    {
+        const __m128i ones = _mm_set1_epi16(1), two = _mm_set1_epi16(2);
+        int x = 0;
+        for (; x + 8 <= outWidth; x += 8)
+        {
+            __m128i lo = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sum + 2 * x)), ones);
+            __m128i hi = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sum + 2 * x + 8)), ones);
+            __m128i q = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(lo, hi), two), 2);
+            _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(q, q));
+        }
+        return x;
+    }
+#endif
+
+#ifdef CPU_X86
+    TARGET_AVX2 inline int addRowsAVX2(const unsigned char* a, const unsigned char* b, unsigned short* sum, int n)
+    {
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+            __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+            _mm256_storeu_si256((__m256i*)(sum + i), _mm256_add_epi16(va, vb));
+        }
+        return i;
+    }
+
+    // four channels: eight output pixels per iteration
+    TARGET_AVX2 inline int halvePairs4AVX2(const unsigned short* sum, int outWidth, unsigned char* out)
+    {
+        const __m256i two = _mm256_set1_epi16(2);
+        // packus leaves output pixels as [0 2 4 6 | 1 3 5 7] across the two lanes
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        int x = 0;
+        for (; x + 8 <= outWidth; x += 8)
+        {
+            const __m256i* in = (const __m256i*)(sum + x * 8);
+            __m256i a = _mm256_loadu_si256(in), b = _mm256_loadu_si256(in + 1);
+            __m256i c = _mm256_loadu_si256(in + 2), d = _mm256_loadu_si256(in + 3);
+            __m256i q0 = _mm256_add_epi16(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+            __m256i q1 = _mm256_add_epi16(_mm256_unpacklo_epi64(c, d), _mm256_unpackhi_epi64(c, d));
+            q0 = _mm256_srli_epi16(_mm256_add_epi16(q0, two), 2);
+            q1 = _mm256_srli_epi16(_mm256_add_epi16(q1, two), 2);
+            __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(q0, q1), order);
+            _mm256_storeu_si256((__m256i*)(out + x * 4), packed);
+        }
+        return x;
+    }
+#endif
+
+#ifdef CPU_NEON
+    inline int addRowsNEON(const unsigned char* a, const unsigned char* b, unsigned short* sum, int n)
+    {
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            uint8x16_t va = vld1q_u8(a + i), vb = vld1q_u8(b + i);
+            vst1q_u16(sum + i, vaddl_u8(vget_low_u8(va), vget_low_u8(vb)));
+            vst1q_u16(sum + i + 8, vaddl_u8(vget_high_u8(va), vget_high_u8(vb)));
+        }
+        return i;
+    }
+
+    // four channels: two output pixels per iteration; vrshrn rounds exactly like (s + 2) >> 2
+    inline int halvePairs4NEON(const unsigned short* sum, int outWidth, unsigned char* out)
+    {
+        int x = 0;
+        for (; x + 2 <= outWidth; x += 2)
+        {
+            uint16x8_t p01 = vld1q_u16(sum + x * 8), p23 = vld1q_u16(sum + x * 8 + 8);
+            uint16x8_t q = vcombine_u16(vadd_u16(vget_low_u16(p01), vget_high_u16(p01)), vadd_u16(vget_low_u16(p23), vget_high_u16(p23)));
+            vst1_u8(out + x * 4, vrshrn_n_u16(q, 2));
+        }
+        return x;
+    }
+#endif
+
+    inline void addRows(const unsigned char* a, const unsigned char* b, unsigned short* sum, int n)
+    {
+        int done = 0;
+#if defined(CPU_X86)
+        if (cpufeatures::hasAVX2())
+            done = addRowsAVX2(a, b, sum, n);
+#if defined(CPU_SSE2)
+        else
+            done = addRowsSSE2(a, b, sum, n);
+#endif
+#elif defined(CPU_NEON)
+        done = addRowsNEON(a, b, sum, n);
+#endif
+        addRowsScalar(a, b, sum, n, done);
+    }
+
+    inline void halvePairs(const unsigned short* sum, int outWidth, int channels, unsigned char* out)
+    {
+        int done = 0;
+        if (channels == 4)
+        {
+#if defined(CPU_X86)
+            if (cpufeatures::hasAVX2())
+                done = halvePairs4AVX2(sum, outWidth, out);
+#if defined(CPU_SSE2)
+            done += halvePairs4SSE2(sum + done * 8, outWidth - done, out + done * 4);
+#endif
+#elif defined(CPU_NEON)
+            done = halvePairs4NEON(sum, outWidth, out);
+#endif
+        }
+#if defined(CPU_SSE2)
+        else if (channels == 1)
+            done = halvePairs1SSE2(sum, outWidth, out);
+#endif
+        halvePairsScalar(sum, outWidth, channels, out, done);
+    }
+
+    // output rows [rowBegin, rowEnd) of the box-filtered level
+    inline void boxRows(const unsigned char* src, int width, int height, int channels, unsigned char* dst, int rowBegin, int rowEnd)
+    {
+        int outWidth = width > 1 ? width / 2 : 1;
+        size_t srcStride = (size_t)width * channels, dstStride = (size_t)outWidth * channels;
+        // a one pixel wide source pairs each pixel with itself
+        std::vector<unsigned short> sum(width > 1 ? srcStride : 2 * channels);
+        for (int y = rowBegin; y < rowEnd; y++)
+        {
+            const unsigned char* row0 = src + (size_t)(2 * y < height ? 2 * y : height - 1) * srcStride;
+            const unsigned char* row1 = src + (size_t)(2 * y + 1 < height ? 2 * y + 1 : height - 1) * srcStride;
+            addRows(row0, row1, sum.data(), (int)srcStride);
+            if (width == 1)
+                for (int c = 0; c < channels; c++)
+                    sum[channels + c] = sum[c];
+            halvePairs(sum.data(), outWidth, channels, dst + (size_t)y * dstStride);
+        }
+    }
+
+    // ---------------------------------------------------------------- Kaiser filter
+
+    const int KAISER_TAPS = 12;
+
+    inline double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // taps for a 2:1 reduction: output pixel x covers source pixels 2x - 5 .. 2x + 6
+    inline const float* kaiserWeights()
+    {
+        struct Weights
+        {
+            float taps[KAISER_TAPS];
+            Weights()
+            {
+                const double pi = 3.14159265358979323846, alpha = 4.0, radius = 3.0;
+                double total = 0.0, raw[KAISER_TAPS];
+                for (int k = 0; k < KAISER_TAPS; k++)
+                {
+                    // distance from the output pixel centre, in output pixels
+                    double t = (k - 5.5) / 2.0;
+                    double sinc = t == 0.0 ? 1.0 : sin(pi * t) / (pi * t);
+                    double window = t / radius;
+                    raw[k] = sinc * (window * window < 1.0 ? besselI0(alpha * sqrt(1.0 - window * window)) / besselI0(alpha) : 0.0);
+                    total += raw[k];
+                }
+                for (int k = 0; k < KAISER_TAPS; k++)
+                    taps[k] = (float)(raw[k] / total);
+            }
+        };
+        static const Weights weights;
+        return weights.taps;
+    }
+
+    inline int clampIndex(int i, int size)
+    {
+        return i < 0 ? 0 : (i >= size ? size - 1 : i);
+    }
+
+    inline unsigned char toByte(float v)
+    {
+        v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+        return (unsigned char)(int)(v + 0.5f);
+    }
+
+    // out[i] = sum over taps of w[k] * rows[k][i], rounded; starting at element start
+    inline void verticalKaiserScalar(const float* const* rows, const float* w, int n, unsigned char* out, int start)
+    {
+        for (int i = start; i < n; i++)
+        {
+            float acc = 0.0f;
+            for (int k = 0; k < KAISER_TAPS; k++)
+                acc += w[k] * rows[k][i];
+            out[i] = toByte(acc);
+        }
+    }
+
+#ifdef CPU_SSE2
+    inline int verticalKaiserSSE2(const float* const* rows, const float* w, int n, unsigned char* out)
+    {
+        const __m128 zero = _mm_setzero_ps(), top = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < KAISER_TAPS; k++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(rows[k] + i)));
+            acc = _mm_add_ps(_mm_min_ps(_mm_max_ps(acc, zero), top), half);
+            __m128i v = _mm_cvttps_epi32(acc);
+            v = _mm_packs_epi32(v, v);
+            v = _mm_packus_epi16(v, v);
+            *(int*)(out + i) = _mm_cvtsi128_si32(v);
+        }
+        return i;
+    }
+#endif
+
+#ifdef CPU_X86
+    TARGET_AVX2 inline int verticalKaiserAVX2(const float* const* rows, const float* w, int n, unsigned char* out)
+    {
+        const __m256 zero = _mm256_setzero_ps(), top = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 acc = _mm256_setzero_ps();
+            for (int k = 0; k < KAISER_TAPS; k++)
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(rows[k] + i)));
+            acc = _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(acc, zero), top), half);
+            __m256i v = _mm256_cvttps_epi32(acc);
+            __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(packed, packed));
+        }
+        return i;
+    }
+#endif
+
+#ifdef CPU_NEON
+    inline int verticalKaiserNEON(const float* const* rows, const float* w, int n, unsigned char* out)
+    {
+        const float32x4_t zero = vdupq_n_f32(0.0f), top = vdupq_n_f32(255.0f), half = vdupq_n_f32(0.5f);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            float32x4_t lo = vdupq_n_f32(0.0f), hi = vdupq_n_f32(0.0f);
+            for (int k = 0; k < KAISER_TAPS; k++)
+            {
+                // separate multiply and add so the rounding matches the other paths
+                lo = vaddq_f32(lo, vmulq_n_f32(vld1q_f32(rows[k] + i), w[k]));
+                hi = vaddq_f32(hi, vmulq_n_f32(vld1q_f32(rows[k] + i + 4), w[k]));
+            }
+            lo = vaddq_f32(vminq_f32(vmaxq_f32(lo, zero), top), half);
+            hi = vaddq_f32(vminq_f32(vmaxq_f32(hi, zero), top), half);
+            uint16x8_t v = vcombine_u16(vmovn_u32(vcvtq_u32_f32(lo)), vmovn_u32(vcvtq_u32_f32(hi)));
+            vst1_u8(out + i, vmovn_u16(v));
+        }
+        return i;
+    }
+#endif
+
+    // output rows [rowBegin, rowEnd) of the Kaiser-filtered level
+    inline void kaiserRows(const unsigned char* src, int width, int height, int channels, unsigned char* dst, int rowBegin, int rowEnd)
+    {
+        const float* w = kaiserWeights();
+        int outWidth = width > 1 ? width / 2 : 1;
+        int n = outWidth * channels;
+        // horizontally filtered copies of every source row this band touches
+        int firstRow = 2 * rowBegin - 5, lastRow = 2 * (rowEnd - 1) + 6;
+        std::vector<float> filtered((size_t)(lastRow - firstRow + 1) * n);
+        // each source row as floats with its edge pixels repeated 5 to the left and enough to the right
+        int padded = 2 * outWidth + KAISER_TAPS;
+        std::vector<float> row((size_t)padded * channels);
+        for (int r = firstRow; r <= lastRow; r++)
+        {
+            const unsigned char* in = src + (size_t)clampIndex(r, height) * width * channels;
+            for (int x = 0; x < padded; x++)
+                for (int c = 0; c < channels; c++)
+                    row[x * channels + c] = in[clampIndex(x - 5, width) * channels + c];
+            float* out = &filtered[(size_t)(r - firstRow) * n];
+            for (int x = 0; x < outWidth; x++)
+            {
+                const float* taps = &row[(size_t)2 * x * channels];
+                for (int c = 0; c < channels; c++)
+                {
+                    float acc = 0.0f;
+                    for (int k = 0; k < KAISER_TAPS; k++)
+                        acc += w[k] * taps[k * channels + c];
+                    out[x * channels + c] = acc;
+                }
+            }
+        }
+        const float* rows[KAISER_TAPS];
+        for (int y = rowBegin; y < rowEnd; y++)
+        {
+            for (int k = 0; k < KAISER_TAPS; k++)
+                rows[k] = &filtered[(size_t)(2 * y - 5 + k - firstRow) * n];
+            unsigned char* out = dst + (size_t)y * n;
+            int done = 0;
+#if defined(CPU_X86)
+            if (cpufeatures::hasAVX2())
+                done = verticalKaiserAVX2(rows, w, n, out);
+#if defined(CPU_SSE2)
+            else
+                done = verticalKaiserSSE2(rows, w, n, out);
+#endif
+#elif defined(CPU_NEON)
+            done = verticalKaiserNEON(rows, w, n, out);
+#endif
+            verticalKaiserScalar(rows, w, n, out, done);
+        }
+    }
+}
+
+// writes the next mip level of src into dst (sized (width / 2) x (height / 2), at least 1x1)
+inline void downsampleLevel(const unsigned char* src, int width, int height, int channels, MipFilter filter, unsigned char* dst, ThreadPool* pool = NULL)
+{
+    int outHeight = height > 1 ? height / 2 : 1;
+    // bands of at least 16 rows, a few per worker so uneven bands even out
+    int bands = pool ? (int)pool->size() * 4 + 4 : 1;
+    if (bands > outHeight / 16)
+        bands = outHeight / 16 > 0 ? outHeight / 16 : 1;
+    auto band = [&](int index) {
+        int rowBegin = (int)((long long)outHeight * index / bands);
+        int rowEnd = (int)((long long)outHeight * (index + 1) / bands);
+        if (filter == MIP_FILTER_KAISER)
+            mipgenerator::kaiserRows(src, width, height, channels, dst, rowBegin, rowEnd);
+        else
+            mipgenerator::boxRows(src, width, height, channels, dst, rowBegin, rowEnd);
+    };
+    if (pool && bands > 1)
+        pool->parallelFor(bands, band);
+    else
+        for (int i = 0; i < bands; i++)
+            band(i);
+}
+
+// every level below base down to 1x1; level i of the result is mip level i + 1
+inline std::vector<MipLevel> generateMipChain(const unsigned char* base, int width, int height, int channels, MipFilter filter = MIP_FILTER_BOX, ThreadPool* pool = NULL)
+{
+    std::vector<MipLevel> levels;
+    const unsigned char* src = base;
+    while (width > 1 || height > 1)
+    {
+        MipLevel level;
+        level.width = width > 1 ? width / 2 : 1;
+        level.height = height > 1 ? height / 2 : 1;
+        level.pixels.resize((size_t)level.width * level.height * channels);
+        downsampleLevel(src, width, height, channels, filter, level.pixels.data(), pool);
+        levels.push_back(std::move(level));
+        src = levels.back().pixels.data();
+        width = levels.back().width;
+        height = levels.back().height;
+    }
+    return levels;
+}
+
+// number of levels in a full chain, base included, as glTexStorage2D wants it
+inline int mipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        levels++;
+    }
+    return levels;
+}
+
+#endif
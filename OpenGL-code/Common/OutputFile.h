@@ -0,0 +1,214 @@
+#ifndef OUTPUT_FILE_H
+#define OUTPUT_FILE_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// sequential write-only file with one large buffer
+// ------------------------------------------------
+// Everything written goes through a block-aligned buffer that reaches the OS only when full, so
+// encoders can hand over a few bytes at a time and the disk still sees multi-megabyte writes.
+// With direct set the file bypasses the OS page cache where the platform allows (O_DIRECT on
+// Linux, F_NOCACHE on macOS, FILE_FLAG_NO_BUFFERING on Windows), which keeps long captures from
+// evicting everything else; when the file system refuses, the file is opened normally instead.
+// Direct writes must be whole blocks, so close() pads the last one and trims the file back.
+class OutputFile
+{
+public:
+    static const size_t BLOCK = 4096;
+
+    OutputFile()
+    {
+    }
+    ~OutputFile()
+    {
+        close();
+        freeBuffer();
+    }
+
+    // creates (or truncates) path; the buffer is rounded up to whole blocks
+    bool open(const char* path, bool direct = false, size_t bufferBytes = 8 * 1024 * 1024)
+    {
+        close();
+        size_t capacity = (bufferBytes + BLOCK - 1) / BLOCK * BLOCK;
+        capacity = capacity ? capacity : BLOCK;
+        if (capacity != bufferSize)
+        {
+            freeBuffer();
+#ifdef _WIN32
+            buffer = (unsigned char*)_aligned_malloc(capacity, BLOCK);
+#else
+            void* memory = NULL;
+            buffer = posix_memalign(&memory, BLOCK, capacity) == 0 ? (unsigned char*)memory : NULL;
+#endif
+            bufferSize = buffer ? capacity : 0;
+        }
+        if (!buffer)
+            return false;
+        unbuffered = false;
+#ifdef _WIN32
+        if (direct)
+        {
+            file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            unbuffered = file != INVALID_HANDLE_VALUE;
+        }
+        if (!unbuffered)
+            file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+#else
+#ifdef O_DIRECT
+        if (direct)
+        {
+            fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+            unbuffered = fd >= 0;
+        }
+#endif
+        if (fd < 0)
+            fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+#ifdef F_NOCACHE
+        if (direct)
+            fcntl(fd, F_NOCACHE, 1);
+#endif
+#endif
+        filled = 0;
+        written = 0;
+        ok = true;
+        return true;
+    }
+
+    bool isOpen() const
+    {
+#ifdef _WIN32
+        return file != INVALID_HANDLE_VALUE;
+#else
+        return fd >= 0;
+#endif
+    }
+    // true when writes bypass the page cache
+    bool direct() const
+    {
+        return unbuffered;
+    }
+    // bytes written so far, buffered ones included
+    unsigned long long size() const
+    {
+        return written + filled;
+    }
+
+    bool write(const void* data, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        while (size && ok)
+        {
+            size_t part = bufferSize - filled < size ? bufferSize - filled : size;
+            std::memcpy(buffer + filled, bytes, part);
+            filled += part;
+            bytes += part;
+            size -= part;
+            if (filled == bufferSize)
+                flush();
+        }
+        return ok;
+    }
+
+    // flushes and closes; false when any write failed
+    bool close()
+    {
+        if (!isOpen())
+            return false;
+        unsigned long long length = size();
+        if (filled && unbuffered)
+        {
+            // whole blocks only: pad with zeros, then cut the file back to its length
+            size_t padded = (filled + BLOCK - 1) / BLOCK * BLOCK;
+            std::memset(buffer + filled, 0, padded - filled);
+            filled = padded;
+        }
+        flush();
+#ifdef _WIN32
+        if (unbuffered && ok)
+        {
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)length;
+            ok = SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file);
+        }
+        ok = CloseHandle(file) && ok;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (unbuffered && ok)
+            ok = ftruncate(fd, (off_t)length) == 0;
+        ok = ::close(fd) == 0 && ok;
+        fd = -1;
+#endif
+        return ok;
+    }
+
+private:
+    unsigned char* buffer = NULL;
+    size_t bufferSize = 0, filled = 0;
+    unsigned long long written = 0;
+    bool ok = false, unbuffered = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+
+    void flush()
+    {
+        size_t done = 0;
+        while (done < filled && ok)
+        {
+#ifdef _WIN32
+            DWORD part = 0;
+            ok = WriteFile(file, buffer + done, (DWORD)(filled - done), &part, NULL) && part > 0;
+#else
+            ssize_t part = ::write(fd, buffer + done, filled - done);
+            if (part < 0 && errno == EINTR)
+                continue;
+            ok = part > 0;
+#endif
+            if (ok)
+                done += (size_t)part;
+        }
+        written += filled;
+        filled = 0;
+    }
+
+    void freeBuffer()
+    {
+#ifdef _WIN32
+        _aligned_free(buffer);
+#else
+        std::free(buffer);
+#endif
+        buffer = NULL;
+        bufferSize = 0;
+    }
+
+    OutputFile(const OutputFile&);
+    OutputFile& operator=(const OutputFile&);
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef POSTER_RENDERER_H
+#define POSTER_RENDERER_H
+
+#include <GL/glew.h>
+
+#include "Camera2D.h"
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// tiled rendering of images larger than any framebuffer
+// ------------------------------------------------------
+// A poster of any size is cut into bands of tileHeight rows, each band into tiles of tileWidth
+// columns. Every tile is drawn into one reusable framebuffer object through the camera's tile
+// (Camera2D::setTile), which maps that part of the whole view onto the framebuffer, so scenes
+// draw exactly as they would into a poster-sized window. glReadPixels puts the tile straight into
+// its place in a band buffer; finished bands go to an ImageSink top row first. Memory therefore
+// stays at one tile of GPU storage plus width x tileHeight pixels on the host, whatever the
+// poster's height; lower the tile height for very wide posters.
+
+struct PosterStats
+{
+    int tiles = 0, bands = 0;
+    size_t bandBytes = 0;       // the host band buffer
+};
+
+class PosterRenderer
+{
+public:
+    // creates the tile framebuffer, at most tileWidth x tileHeight and within what the driver
+    // allows for renderbuffers and viewports; needs a current GL context
+    PosterRenderer(int tileWidth = 2048, int tileHeight = 256)
+    {
+        int maxRenderbuffer = 0, maxViewport[2] = { 0, 0 };
+        glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+        glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+        width = std::max(1, std::min(tileWidth, std::min(maxRenderbuffer, maxViewport[0])));
+        height = std::max(1, std::min(tileHeight, std::min(maxRenderbuffer, maxViewport[1])));
+
+        glGenFramebuffers(1, &FBO);
+        glGenRenderbuffers(1, &colourBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colourBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colourBuffer);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    bool valid() const
+    {
+        return complete;
+    }
+    int tileWidth() const
+    {
+        return width;
+    }
+    int tileHeight() const
+    {
+        return height;
+    }
+    const PosterStats& stats() const
+    {
+        return counters;
+    }
+
+    // renders a posterWidth x posterHeight image into sink. drawTile clears and draws the scene
+    // as for one frame, seen through camera; camera is resized to the poster and given each tile
+    // in turn, and gets its size and whole view back afterwards, as do the viewport and the
+    // framebuffer binding. False when the sink fails.
+    bool render(int posterWidth, int posterHeight, Camera2D& camera, const std::function<void()>& drawTile, ImageSink& sink)
+    {
+        counters = PosterStats();
+        if (!complete || posterWidth < 1 || posterHeight < 1 || !sink.begin(posterWidth, posterHeight))
+            return false;
+        int viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        int cameraWidth = camera.width, cameraHeight = camera.height;
+        camera.resize(posterWidth, posterHeight);
+
+        std::vector<unsigned char> band((size_t)posterWidth * height * 4);
+        counters.bandBytes = band.size();
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_PACK_ROW_LENGTH, posterWidth);
+        bool ok = true;
+        // bands from the top; window y runs up, so band rows are stored bottom first
+        for (int top = posterHeight; top > 0 && ok; top -= height)
+        {
+            int bottom = top - height, rows = std::min(height, top);
+            for (int left = 0; left < posterWidth; left += width)
+            {
+                // every tile keeps the full tile size, so the last column and the bottom band
+                // reach past the poster's edge and only their inner part is read
+                camera.setTile(2.0f * left / posterWidth - 1.0f, 2.0f * bottom / posterHeight - 1.0f,
+                               2.0f * (left + width) / posterWidth - 1.0f, 2.0f * top / posterHeight - 1.0f);
+                drawTile();
+                int columns = std::min(width, posterWidth - left);
+                glReadPixels(0, height - rows, columns, rows, GL_RGBA, GL_UNSIGNED_BYTE, &band[(size_t)left * 4]);
+                counters.tiles++;
+            }
+            std::ptrdiff_t stride = (std::ptrdiff_t)posterWidth * 4;
+            ok = sink.write(&band[(size_t)(rows - 1) * stride], rows, -stride);
+            counters.bands++;
+        }
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        camera.resize(cameraWidth, cameraHeight);
+        camera.resetTile();
+        return sink.finish() && ok;
+    }
+
+    void release()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteRenderbuffers(1, &colourBuffer);
+    }
+
+private:
+    unsigned int FBO = 0, colourBuffer = 0;
+    int width = 1, height = 1;
+    bool complete = false;
+    PosterStats counters;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+
+// shader compilation and a registry of linked programs
+// ----------------------------------------------------
+// compileProgram() is the compile/link/check sequence every demo spells out in main();
+// compileComputeProgram() is the same for a GL 4.3 compute shader.
+// ShaderRegistry keeps each program under a name so several scenes sharing one GL context
+// compile a program once and look it up afterwards.
+
+// compiles and links a vertex/fragment pair, printing the driver's log on failure; returns 0
+// when either stage or the link failed
+inline unsigned int compileProgram(const char* vertexSource, const char* fragmentSource)
+{
+    int success;
+    char infoLog[512];
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexSource, NULL);
+    glCompileShader(vertexShader);
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    bool ok = success != 0;
+    if (!success)
+    {
+        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+    glCompileShader(fragmentShader);
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    ok = ok && success;
+    if (!success)
+    {
+        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    ok = ok && success;
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    if (!ok)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// compiles and links a compute shader the same way; needs a GL 4.3 context
+inline unsigned int compileComputeProgram(const char* computeSource)
+{
+    int success;
+    char infoLog[512];
+    unsigned int computeShader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShader, 1, &computeSource, NULL);
+    glCompileShader(computeShader);
+    glGetShaderiv(computeShader, GL_COMPILE_STATUS, &success);
+    bool ok = success != 0;
+    if (!success)
+    {
+        glGetShaderInfoLog(computeShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, computeShader);
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    ok = ok && success;
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    glDeleteShader(computeShader);
+    if (!ok)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+class ShaderRegistry
+{
+public:
+    // the program registered as name, compiled from the given sources the first time it is asked for
+    unsigned int get(const std::string& name, const char* vertexSource, const char* fragmentSource)
+    {
+        std::map<std::string, unsigned int>::const_iterator found = programs.find(name);
+        if (found != programs.end())
+            return found->second;
+        unsigned int program = compileProgram(vertexSource, fragmentSource);
+        programs[name] = program;
+        return program;
+    }
+
+    // a program registered earlier, or 0
+    unsigned int find(const std::string& name) const
+    {
+        std::map<std::string, unsigned int>::const_iterator found = programs.find(name);
+        return found != programs.end() ? found->second : 0;
+    }
+
+    // deletes every program; needs the context they were created in
+    void release()
+    {
+        for (std::map<std::string, unsigned int>::const_iterator i = programs.begin(); i != programs.end(); ++i)
+            if (i->second)
+                glDeleteProgram(i->second);
+        programs.clear();
+    }
+
+private:
+    std::map<std::string, unsigned int> programs;
+};
+
+#endif
@@ -0,0 +1,626 @@
+#ifndef SHAPE_STORE_H
+#define SHAPE_STORE_H
+
+#include <GL/glew.h>
+
+#include "Material.h"
+
+#include <cmath>
+#include <vector>
+
+// structure-of-arrays store for very many disks, rings and right trapezia
+// -----------------------------------------------------------------------
+// Every kind keeps its shapes densely packed in parallel arrays (centre x, centre y, radius,
+// inner radius, material index), so an update is a plain loop over float arrays the compiler
+// can vectorise and an upload is one copy per array. Shapes are named by handles that stay
+// valid while others come and go: a handle picks a slot, the slot records where the shape
+// currently sits in its kind's arrays. add() appends, remove() moves the last shape of the
+// kind into the hole, both O(1). The arrays themselves are public; code that writes them
+// directly calls markDirty() for the range it touched so the renderer uploads only that.
+//
+// ShapeStoreRenderer draws a store with instanced draws: rings are annuli between inner radius
+// and radius, disks the same mesh with an inner radius of 0, trapezia the demo trapezium scaled
+// by radius (its half width). The annulus comes in a chain of levels of detail, from 8 sides up
+// to the demos' 360, all in one vertex buffer. The renderer either mirrors the whole store at
+// one level (upload) or only the shapes a SpatialGrid query found on screen, each at the level
+// its size on screen calls for (uploadVisible).
+
+enum ShapeKind { SHAPE_DISK, SHAPE_RING, SHAPE_TRAPEZIUM, SHAPE_KINDS };
+
+struct ShapeHandle
+{
+    unsigned int slot;
+    unsigned int generation;
+};
+
+struct ShapeArrays
+{
+    std::vector<float> centreX, centreY, radius, innerRadius;
+    std::vector<int> material;
+    std::vector<unsigned int> slot;     // slot of the shape at each index, for remove()
+    size_t dirtyBegin = 0, dirtyEnd = 0;
+
+    size_t size() const
+    {
+        return centreX.size();
+    }
+
+    void markDirty(size_t begin, size_t end)
+    {
+        if (begin >= end)
+            return;
+        if (dirtyBegin == dirtyEnd)
+        {
+            dirtyBegin = begin;
+            dirtyEnd = end;
+            return;
+        }
+        if (begin < dirtyBegin) dirtyBegin = begin;
+        if (end > dirtyEnd) dirtyEnd = end;
+    }
+};
+
+class ShapeStore
+{
+public:
+    void reserve(ShapeKind kind, size_t count)
+    {
+        ShapeArrays& a = kinds[kind];
+        a.centreX.reserve(count);
+        a.centreY.reserve(count);
+        a.radius.reserve(count);
+        a.innerRadius.reserve(count);
+        a.material.reserve(count);
+        a.slot.reserve(count);
+    }
+
+    // innerRadius only matters for rings
+    ShapeHandle add(ShapeKind kind, float centreX, float centreY, float radius, float innerRadius, int material)
+    {
+        unsigned int s;
+        if (!freeSlots.empty())
+        {
+            s = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            s = (unsigned int)slots.size();
+            slots.push_back(Slot());
+        }
+        ShapeArrays& a = kinds[kind];
+        slots[s].kind = kind;
+        slots[s].index = (unsigned int)a.size();
+        a.centreX.push_back(centreX);
+        a.centreY.push_back(centreY);
+        a.radius.push_back(radius);
+        a.innerRadius.push_back(kind == SHAPE_RING ? innerRadius : 0.0f);
+        a.material.push_back(material);
+        a.slot.push_back(s);
+        a.markDirty(a.size() - 1, a.size());
+        ShapeHandle handle = { s, slots[s].generation };
+        return handle;
+    }
+
+    // appends count zeroed shapes of one kind and returns the index of the first; the caller
+    // fills them in through arrays(kind) and names them later with handle(kind, index). For
+    // building big scenes this skips the per-shape bookkeeping of add().
+    size_t append(ShapeKind kind, size_t count)
+    {
+        ShapeArrays& a = kinds[kind];
+        size_t first = a.size(), n = first + count;
+        a.centreX.resize(n);
+        a.centreY.resize(n);
+        a.radius.resize(n);
+        a.innerRadius.resize(n);
+        a.material.resize(n);
+        a.slot.resize(n);
+        unsigned int* slotOf = a.slot.data();
+        size_t i = first;
+        for (; i < n && !freeSlots.empty(); i++)
+        {
+            slotOf[i] = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        unsigned int next = (unsigned int)slots.size();
+        slots.resize(slots.size() + (n - i));
+        for (; i < n; i++)
+            slotOf[i] = next++;
+        for (i = first; i < n; i++)
+        {
+            slots[slotOf[i]].kind = kind;
+            slots[slotOf[i]].index = (unsigned int)i;
+        }
+        a.markDirty(first, n);
+        return first;
+    }
+
+    ShapeHandle handle(ShapeKind kind, size_t index) const
+    {
+        unsigned int s = kinds[kind].slot[index];
+        ShapeHandle h = { s, slots[s].generation };
+        return h;
+    }
+
+    // frees the handle; later lookups of it fail even once its slot is reused
+    void remove(ShapeHandle handle)
+    {
+        if (!valid(handle))
+            return;
+        Slot& removed = slots[handle.slot];
+        ShapeArrays& a = kinds[removed.kind];
+        size_t hole = removed.index, last = a.size() - 1;
+        if (hole != last)
+        {
+            a.centreX[hole] = a.centreX[last];
+            a.centreY[hole] = a.centreY[last];
+            a.radius[hole] = a.radius[last];
+            a.innerRadius[hole] = a.innerRadius[last];
+            a.material[hole] = a.material[last];
+            a.slot[hole] = a.slot[last];
+            slots[a.slot[hole]].index = (unsigned int)hole;
+            a.markDirty(hole, hole + 1);
+        }
+        a.centreX.pop_back();
+        a.centreY.pop_back();
+        a.radius.pop_back();
+        a.innerRadius.pop_back();
+        a.material.pop_back();
+        a.slot.pop_back();
+        // nothing past the end is uploaded
+        if (a.dirtyEnd > a.size())
+            a.dirtyEnd = a.size();
+        if (a.dirtyBegin >= a.dirtyEnd)
+            a.dirtyBegin = a.dirtyEnd = 0;
+        removed.generation++;
+        freeSlots.push_back(handle.slot);
+    }
+
+    bool valid(ShapeHandle handle) const
+    {
+        return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation;
+    }
+
+    // where a live handle's shape sits right now; the index changes when other shapes of the
+    // same kind are removed
+    ShapeKind kind(ShapeHandle handle) const
+    {
+        return (ShapeKind)slots[handle.slot].kind;
+    }
+    size_t index(ShapeHandle handle) const
+    {
+        return slots[handle.slot].index;
+    }
+    // kind and index of whatever shape holds slot now, for indexes that track slots
+    void locate(unsigned int slot, ShapeKind& kind, size_t& index) const
+    {
+        kind = (ShapeKind)slots[slot].kind;
+        index = slots[slot].index;
+    }
+
+    void setCentre(ShapeHandle handle, float x, float y)
+    {
+        const Slot& s = slots[handle.slot];
+        ShapeArrays& a = kinds[s.kind];
+        a.centreX[s.index] = x;
+        a.centreY[s.index] = y;
+        a.markDirty(s.index, s.index + 1);
+    }
+    void setRadius(ShapeHandle handle, float radius, float innerRadius = 0.0f)
+    {
+        const Slot& s = slots[handle.slot];
+        ShapeArrays& a = kinds[s.kind];
+        a.radius[s.index] = radius;
+        a.innerRadius[s.index] = s.kind == SHAPE_RING ? innerRadius : 0.0f;
+        a.markDirty(s.index, s.index + 1);
+    }
+    void setMaterial(ShapeHandle handle, int material)
+    {
+        const Slot& s = slots[handle.slot];
+        kinds[s.kind].material[s.index] = material;
+        kinds[s.kind].markDirty(s.index, s.index + 1);
+    }
+
+    ShapeArrays& arrays(ShapeKind kind)
+    {
+        return kinds[kind];
+    }
+    const ShapeArrays& arrays(ShapeKind kind) const
+    {
+        return kinds[kind];
+    }
+    void markDirty(ShapeKind kind, size_t begin, size_t end)
+    {
+        kinds[kind].markDirty(begin, end);
+    }
+    // forgets the dirty ranges once everything that follows them (renderer, spatial index) is
+    // up to date; ShapeStoreRenderer::upload() and uploadVisible() call it
+    void clearDirty()
+    {
+        for (int k = 0; k < SHAPE_KINDS; k++)
+            kinds[k].dirtyBegin = kinds[k].dirtyEnd = 0;
+    }
+
+    size_t size() const
+    {
+        return kinds[0].size() + kinds[1].size() + kinds[2].size();
+    }
+
+    // one more than the highest slot ever handed out, for per-slot side tables
+    size_t slotCount() const
+    {
+        return slots.size();
+    }
+
+    // moves every shape by (dx, dy)
+    void translate(float dx, float dy)
+    {
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            ShapeArrays& a = kinds[k];
+            float* x = a.centreX.data();
+            float* y = a.centreY.data();
+            size_t n = a.size();
+            for (size_t i = 0; i < n; i++)
+            {
+                x[i] += dx;
+                y[i] += dy;
+            }
+            a.markDirty(0, n);
+        }
+    }
+
+    // turns every centre by angle radians about (originX, originY)
+    void rotate(float angle, float originX = 0.0f, float originY = 0.0f)
+    {
+        float c = std::cos(angle), s = std::sin(angle);
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            ShapeArrays& a = kinds[k];
+            float* x = a.centreX.data();
+            float* y = a.centreY.data();
+            size_t n = a.size();
+            for (size_t i = 0; i < n; i++)
+            {
+                float px = x[i] - originX, py = y[i] - originY;
+                x[i] = originX + c * px - s * py;
+                y[i] = originY + s * px + c * py;
+            }
+            a.markDirty(0, n);
+        }
+    }
+
+private:
+    struct Slot
+    {
+        unsigned int kind = 0, index = 0, generation = 0;
+    };
+    ShapeArrays kinds[SHAPE_KINDS];
+    std::vector<Slot> slots;
+    std::vector<unsigned int> freeSlots;
+};
+
+// the indices, per kind, of the shapes a frame draws, plus how many were skipped
+struct VisibleShapes
+{
+    std::vector<unsigned int> indices[SHAPE_KINDS];
+    size_t visible = 0, culled = 0;
+
+    void clear()
+    {
+        for (int k = 0; k < SHAPE_KINDS; k++)
+            indices[k].clear();
+        visible = culled = 0;
+    }
+};
+
+// fills an empty store with the Shape Field scenes' shapes: count of them split evenly over the
+// kinds, at scrambled but repeatable places in -1 .. 1, each in one of the six palette materials
+inline void fillShapeField(ShapeStore& store, size_t count, const int palette[6])
+{
+    for (int k = 0; k < SHAPE_KINDS; k++)
+    {
+        size_t n = count / SHAPE_KINDS + ((size_t)k < count % SHAPE_KINDS ? 1 : 0);
+        size_t first = store.append((ShapeKind)k, n);
+        ShapeArrays& a = store.arrays((ShapeKind)k);
+        for (size_t i = first; i < first + n; i++)
+        {
+            unsigned int h = (unsigned int)(i * SHAPE_KINDS + k) * 2654435761u;
+            unsigned int g = (h ^ (h >> 15)) * 2246822519u;
+            a.centreX[i] = (h >> 8) * (2.0f / 16777216.0f) - 1.0f;
+            a.centreY[i] = (g >> 8) * (2.0f / 16777216.0f) - 1.0f;
+            a.radius[i] = 0.002f + (g & 255) * (0.006f / 255.0f);
+            a.innerRadius[i] = k == SHAPE_RING ? a.radius[i] * 0.6f : 0.0f;
+            a.material[i] = palette[(h >> 4) % 6];
+        }
+    }
+}
+
+// instanced version of materialVertexShaderSource for ShapeStoreRenderer; pair it with
+// materialFragmentShaderSource. aPos is the unit outline: xy the direction from the centre,
+// z 1 on the outer edge and 0 on the inner one. view maps world to clip space as set by
+// Camera2D::apply(); (0, 0, 1, 1) draws world coordinates as they are.
+const char* const shapeVertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec3 aPos;\n"
+"layout (location = 3) in int aMaterial;\n"
+"layout (location = 4) in float aCentreX;\n"
+"layout (location = 5) in float aCentreY;\n"
+"layout (location = 6) in float aRadius;\n"
+"layout (location = 7) in float aInnerRadius;\n"
+"uniform vec4 view;\n"
+"out vec2 TexCoord;\n"
+"out vec3 ourColor;\n"
+"flat out int materialIndex;\n"
+"void main()\n"
+"{\n"
+"   float radius = mix(aInnerRadius, aRadius, aPos.z);\n"
+"   vec2 world = vec2(aCentreX, aCentreY) + aPos.xy * radius;\n"
+"   gl_Position = vec4((world - view.xy) * view.zw, 0.0, 1.0);\n"
+"   TexCoord = aPos.xy * 0.5 + 0.5;\n"
+"   ourColor = vec3(1.0);\n"
+"   materialIndex = aMaterial;\n"
+"}\0";
+
+// levels of detail for disks and rings: the number of sides of each level, and the radius in
+// pixels from which it is used, so that an outline is never more than about a quarter of a
+// pixel inside the true circle
+const int SHAPE_LOD_LEVELS = 6;
+const int shapeLodSegments[SHAPE_LOD_LEVELS] = { 8, 16, 32, 64, 128, 360 };
+const float shapeLodPixels[SHAPE_LOD_LEVELS] = { 0.0f, 3.0f, 12.0f, 48.0f, 200.0f, 800.0f };
+// a shape keeps its level until it shrinks below this fraction of the level's threshold, so
+// one that hovers around a threshold does not flip every frame
+const float SHAPE_LOD_HYSTERESIS = 0.8f;
+
+// the level for a shape of the given radius in pixels that was drawn at previous last time
+// (-1 for none)
+inline int shapeLod(float radiusPixels, int previous)
+{
+    int level = 0;
+    while (level + 1 < SHAPE_LOD_LEVELS &&
+           radiusPixels >= shapeLodPixels[level + 1] * (level + 1 <= previous ? SHAPE_LOD_HYSTERESIS : 1.0f))
+        level++;
+    return level;
+}
+
+// unit outlines for every level of the annulus followed by the trapezium, all triangle strips of
+// (x, y, outer) vertices; mesh m (a level, or SHAPE_LOD_LEVELS for the trapezium) is the
+// count[m] vertices from first[m]
+inline std::vector<float> shapeOutlines(int first[SHAPE_LOD_LEVELS + 1], int count[SHAPE_LOD_LEVELS + 1])
+{
+    std::vector<float> outline;
+    for (int level = 0; level < SHAPE_LOD_LEVELS; level++)
+    {
+        int segments = shapeLodSegments[level];
+        first[level] = (int)(outline.size() / 3);
+        count[level] = 2 * (segments + 1);
+        for (int i = 0; i <= segments; i++)
+        {
+            float angle = i * 6.28318531f / segments;
+            float point[6] = { std::cos(angle), std::sin(angle), 1.0f, std::cos(angle), std::sin(angle), 0.0f };
+            outline.insert(outline.end(), point, point + 6);
+        }
+    }
+    static const float trapezium[4 * 3] = {
+        1.0f, 1.0f, 1.0f,
+        -1.0f, 1.0f, 1.0f,
+        1.0f, -1.0f, 1.0f,
+        -1.0f, 0.0f, 1.0f
+    };
+    first[SHAPE_LOD_LEVELS] = (int)(outline.size() / 3);
+    count[SHAPE_LOD_LEVELS] = 4;
+    outline.insert(outline.end(), trapezium, trapezium + 4 * 3);
+    return outline;
+}
+
+class ShapeStoreRenderer
+{
+public:
+    // builds the unit meshes; needs a current GL context
+    ShapeStoreRenderer()
+    {
+        std::vector<float> outline = shapeOutlines(meshFirst, meshCount);
+        glGenBuffers(1, &meshVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        glBufferData(GL_ARRAY_BUFFER, outline.size() * sizeof(float), outline.data(), GL_STATIC_DRAW);
+        glGenVertexArrays(SHAPE_KINDS, VAO);
+        glGenBuffers(SHAPE_KINDS, instanceVBO);
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            capacity[k] = 0;
+            for (int level = 0; level < SHAPE_LOD_LEVELS; level++)
+                runFirst[k][level] = runCount[k][level] = 0;
+            glBindVertexArray(VAO[k]);
+            glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // copies what changed since the last upload into the instance buffers, growing them (and
+    // then copying everything) when a kind outgrew its buffer; disks and rings are drawn at level
+    void upload(ShapeStore& store, int level = 2)
+    {
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            ShapeArrays& a = store.arrays((ShapeKind)k);
+            size_t n = a.size();
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO[k]);
+            if (n > capacity[k] || mirrorsSelection)
+            {
+                if (n > capacity[k])
+                    grow(k, n);
+                a.dirtyBegin = 0;
+                a.dirtyEnd = n;
+            }
+            if (a.dirtyBegin < a.dirtyEnd)
+            {
+                size_t begin = a.dirtyBegin, count = a.dirtyEnd - a.dirtyBegin;
+                const void* streams[5] = { a.centreX.data(), a.centreY.data(), a.radius.data(),
+                                           a.innerRadius.data(), a.material.data() };
+                for (int s = 0; s < 5; s++)
+                    glBufferSubData(GL_ARRAY_BUFFER, (s * capacity[k] + begin) * 4, count * 4, (const char*)streams[s] + begin * 4);
+            }
+            for (int l = 0; l < SHAPE_LOD_LEVELS; l++)
+                runFirst[k][l] = runCount[k][l] = 0;
+            runCount[k][k == SHAPE_TRAPEZIUM ? 0 : level] = n;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        store.clearDirty();
+        mirrorsSelection = false;
+    }
+
+    // replaces the instance buffers with just the listed shapes, gathered from the store's
+    // arrays straight into the mapped buffers and grouped by level of detail. Levels come from
+    // each shape's radius times pixelsPerUnit (Camera2D::pixelsPerUnit()) and the level the same
+    // slot had last time.
+    void uploadVisible(ShapeStore& store, const VisibleShapes& visible, float pixelsPerUnit)
+    {
+        if (slotLevel.size() < store.slotCount())
+            slotLevel.resize(store.slotCount(), -1);
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            const ShapeArrays& a = store.arrays((ShapeKind)k);
+            const std::vector<unsigned int>& list = visible.indices[k];
+            size_t n = list.size();
+            for (int l = 0; l < SHAPE_LOD_LEVELS; l++)
+                runFirst[k][l] = runCount[k][l] = 0;
+            if (!n)
+                continue;
+
+            // pick the levels, then lay the runs out one after another
+            levels.resize(n);
+            const unsigned int* index = list.data();
+            for (size_t i = 0; i < n; i++)
+            {
+                int level = 0;
+                if (k != SHAPE_TRAPEZIUM)
+                {
+                    signed char& last = slotLevel[a.slot[index[i]]];
+                    level = last = (signed char)shapeLod(a.radius[index[i]] * pixelsPerUnit, last);
+                }
+                levels[i] = (unsigned char)level;
+                runCount[k][level]++;
+            }
+            size_t cursor[SHAPE_LOD_LEVELS];
+            for (int l = 0; l < SHAPE_LOD_LEVELS; l++)
+                cursor[l] = runFirst[k][l] = l ? runFirst[k][l - 1] + runCount[k][l - 1] : 0;
+
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO[k]);
+            if (n > capacity[k])
+                grow(k, n);
+            unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, capacity[k] * STREAM_BYTES,
+                                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (!mapped)
+            {
+                for (int l = 0; l < SHAPE_LOD_LEVELS; l++)
+                    runCount[k][l] = 0;
+                continue;
+            }
+            float* x = (float*)mapped;
+            float* y = x + capacity[k];
+            float* r = y + capacity[k];
+            float* inner = r + capacity[k];
+            int* material = (int*)(inner + capacity[k]);
+            for (size_t i = 0; i < n; i++)
+            {
+                unsigned int j = index[i];
+                size_t to = cursor[levels[i]]++;
+                x[to] = a.centreX[j];
+                y[to] = a.centreY[j];
+                r[to] = a.radius[j];
+                inner[to] = a.innerRadius[j];
+                material[to] = a.material[j];
+            }
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        store.clearDirty();
+        mirrorsSelection = true;
+    }
+
+    // one instanced draw per kind and level over whatever the last upload put in the buffers;
+    // the caller has the program, its view and the material table bound
+    void draw() const
+    {
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            glBindVertexArray(VAO[k]);
+            for (int l = 0; l < SHAPE_LOD_LEVELS; l++)
+            {
+                if (!runCount[k][l])
+                    continue;
+                // GL 3.3 has no base instance, so each run gets its own attribute offsets
+                bindStreams(k, runFirst[k][l]);
+                int mesh = k == SHAPE_TRAPEZIUM ? SHAPE_LOD_LEVELS : l;
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, meshFirst[mesh], meshCount[mesh], (GLsizei)runCount[k][l]);
+            }
+        }
+        glBindVertexArray(0);
+    }
+
+    // vertices the last upload draws, and what they would be with every disk and ring at 360 sides
+    size_t vertices() const
+    {
+        size_t total = 0;
+        for (int k = 0; k < SHAPE_KINDS; k++)
+            for (int l = 0; l < SHAPE_LOD_LEVELS; l++)
+                total += runCount[k][l] * meshCount[k == SHAPE_TRAPEZIUM ? SHAPE_LOD_LEVELS : l];
+        return total;
+    }
+    size_t fullDetailVertices() const
+    {
+        size_t total = 0;
+        for (int k = 0; k < SHAPE_KINDS; k++)
+            for (int l = 0; l < SHAPE_LOD_LEVELS; l++)
+                total += runCount[k][l] * meshCount[k == SHAPE_TRAPEZIUM ? SHAPE_LOD_LEVELS : SHAPE_LOD_LEVELS - 1];
+        return total;
+    }
+
+    void release()
+    {
+        glDeleteVertexArrays(SHAPE_KINDS, VAO);
+        glDeleteBuffers(SHAPE_KINDS, instanceVBO);
+        glDeleteBuffers(1, &meshVBO);
+    }
+
+private:
+    // centre x, centre y, radius and inner radius floats plus the int material, 4 bytes each
+    static const size_t STREAM_BYTES = 5 * 4;
+
+    unsigned int VAO[SHAPE_KINDS], instanceVBO[SHAPE_KINDS], meshVBO;
+    size_t capacity[SHAPE_KINDS];
+    size_t runFirst[SHAPE_KINDS][SHAPE_LOD_LEVELS], runCount[SHAPE_KINDS][SHAPE_LOD_LEVELS];
+    bool mirrorsSelection = false;     // the buffers hold an uploadVisible() gather, not the store
+    int meshFirst[SHAPE_LOD_LEVELS + 1], meshCount[SHAPE_LOD_LEVELS + 1];
+    std::vector<signed char> slotLevel;     // per slot: the level it was last drawn at, -1 for none
+    std::vector<unsigned char> levels;      // uploadVisible() scratch
+
+    // reallocates kind k's instance buffer (bound) for at least n shapes; the old contents are lost
+    void grow(int k, size_t n)
+    {
+        capacity[k] = n > 2 * capacity[k] ? n : 2 * capacity[k];
+        glBufferData(GL_ARRAY_BUFFER, capacity[k] * STREAM_BYTES, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    // points kind k's instance attributes at the instances from first on; the instance buffer
+    // holds each array as its own block of capacity values. Leaves the VAO bound.
+    void bindStreams(int k, size_t first) const
+    {
+        glBindVertexArray(VAO[k]);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO[k]);
+        for (int s = 0; s < 4; s++)
+        {
+            glVertexAttribPointer(4 + s, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)((s * capacity[k] + first) * 4));
+            glVertexAttribDivisor(4 + s, 1);
+            glEnableVertexAttribArray(4 + s);
+        }
+        glVertexAttribIPointer(MATERIAL_ATTRIB, 1, GL_INT, sizeof(int), (void*)((4 * capacity[k] + first) * 4));
+        glVertexAttribDivisor(MATERIAL_ATTRIB, 1);
+        glEnableVertexAttribArray(MATERIAL_ATTRIB);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,1217 @@
+#ifndef SOFT_RASTERIZER_H
+#define SOFT_RASTERIZER_H
+
+#include "CpuFeatures.h"
+#include "Geometry.h"
+#include "Material.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// CPU backend for the demo shapes
+// -------------------------------
+// Draws what the material program draws (solid, vertex-coloured and textured triangles and
+// lines, one material per primitive) into an RGBA8 framebuffer, with no GL context at all.
+// draw() assembles and sets up the primitives and sorts them into 64x64 pixel tiles in
+// submission order; finish() then rasterizes the tiles on the ThreadPool, every worker owning a
+// queue of tiles and stealing from the back of the others' once its own is empty. Vertices are
+// snapped to 1/256 of a pixel as Mesa snaps them, and coverage follows GL's top-left rule at
+// pixel centres; lines take one pixel per step along their major axis, leaving out the last one
+// as GL's diamond-exit rule does. Untextured triangles are filled by the gradient kernels, 4
+// (SSE2, NEON), 8 (AVX2) or 16 (AVX-512) pixels per step: edge functions and colours stepped
+// along the row, blended into the row by the coverage mask. Textured pixels are sampled one by
+// one, nearest or bilinear, picking the min or mag filter per primitive as GL does per pixel.
+// fillTriangle() runs the same setup and kernels on one triangle of any RGBA8 image.
+//
+// The image is pixel-comparable with the GL path rather than bit-identical: interpolation and
+// texture filtering round differently on llvmpipe and on GPUs. Rows are stored bottom first, as
+// glReadPixels returns them. Primitives are clipped to a guard band reaching one framebuffer
+// size beyond every side (normalized coordinates between -3 and 3).
+
+// RGBA8 texture for SoftRasterizer: row 0 is t = 0, as uploaded by glTexImage2D; wrap is
+// GL_REPEAT or GL_CLAMP_TO_EDGE and each filter GL_NEAREST or GL_LINEAR (mipmapped min filters
+// sample the base level like their non-mipmapped halves)
+struct SoftTexture
+{
+    int width = 0, height = 0;
+    std::vector<unsigned char> texels;
+    int wrap = GL_REPEAT, minFilter = GL_NEAREST, magFilter = GL_LINEAR;
+
+    // copies 8-bit pixels with 1-4 channels, filling in the rest as GL does for GL_RED, GL_RG
+    // and GL_RGB textures
+    void assign(const unsigned char* pixels, int pixelWidth, int pixelHeight, int channels)
+    {
+        width = pixelWidth;
+        height = pixelHeight;
+        texels.resize((size_t)width * height * 4);
+        for (size_t i = 0; i < (size_t)width * height; i++)
+        {
+            const unsigned char* in = pixels + i * channels;
+            unsigned char* out = &texels[i * 4];
+            out[0] = in[0];
+            out[1] = channels > 1 ? in[1] : 0;
+            out[2] = channels > 2 ? in[2] : 0;
+            out[3] = channels > 3 ? in[3] : 255;
+        }
+    }
+};
+
+struct SoftRasterizerStats
+{
+    // since the last clear(): primitives set up (after clipping and dropping empty ones) and
+    // (primitive, tile) pairs binned
+    size_t triangles = 0, lines = 0;
+    size_t binned = 0;
+    size_t tiles = 0;                    // tiles rasterized by the last finish()
+    size_t steals = 0;                   // of those, tiles taken from another worker's queue
+};
+
+namespace softraster
+{
+    const int TILE_SIZE = 64;
+    const int SUBPIXEL = 256;
+    // guard band, in normalized device coordinates; it keeps the values of an edge over a tile it
+    // crosses within 32 bits for framebuffers up to MAX_SIZE
+    const float GUARD = 3.0f;
+    const int MAX_SIZE = 16384;
+    // attributes interpolated per vertex: u, v, r, g, b, a
+    const int ATTRIBUTES = 6;
+    const int COLOUR_ATTRIBUTE = 2;
+
+    inline int wrapTexel(int i, int size, int wrap)
+    {
+        if (wrap == GL_CLAMP_TO_EDGE)
+            return i < 0 ? 0 : i >= size ? size - 1 : i;
+        i %= size;
+        return i < 0 ? i + size : i;
+    }
+
+    inline void sampleNearest(const SoftTexture& texture, float u, float v, float texel[4])
+    {
+        int x = wrapTexel((int)std::floor(u * texture.width), texture.width, texture.wrap);
+        int y = wrapTexel((int)std::floor(v * texture.height), texture.height, texture.wrap);
+        const unsigned char* t = &texture.texels[((size_t)y * texture.width + x) * 4];
+        for (int c = 0; c < 4; c++)
+            texel[c] = t[c] * (1.0f / 255.0f);
+    }
+
+    inline void sampleLinear(const SoftTexture& texture, float u, float v, float texel[4])
+    {
+        float fx = u * texture.width - 0.5f, fy = v * texture.height - 0.5f;
+        float x0f = std::floor(fx), y0f = std::floor(fy);
+        float wx = fx - x0f, wy = fy - y0f;
+        int x0 = wrapTexel((int)x0f, texture.width, texture.wrap), x1 = wrapTexel((int)x0f + 1, texture.width, texture.wrap);
+        int y0 = wrapTexel((int)y0f, texture.height, texture.wrap), y1 = wrapTexel((int)y0f + 1, texture.height, texture.wrap);
+        const unsigned char* row0 = &texture.texels[(size_t)y0 * texture.width * 4];
+        const unsigned char* row1 = &texture.texels[(size_t)y1 * texture.width * 4];
+        for (int c = 0; c < 4; c++)
+        {
+            float top = row0[x0 * 4 + c] + (row0[x1 * 4 + c] - row0[x0 * 4 + c]) * wx;
+            float bottom = row1[x0 * 4 + c] + (row1[x1 * 4 + c] - row1[x0 * 4 + c]) * wx;
+            texel[c] = (top + (bottom - top) * wy) * (1.0f / 255.0f);
+        }
+    }
+
+    inline unsigned char toUnorm8(float c)
+    {
+        c = c < 0.0f ? 0.0f : c > 1.0f ? 1.0f : c;
+        // to nearest, ties to even, as Mesa converts
+        return (unsigned char)std::lrint(c * 255.0f);
+    }
+
+    inline int ctz(unsigned long long mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, mask);
+        return (int)index;
+#else
+        return __builtin_ctzll(mask);
+#endif
+    }
+
+    // ---------------------------------------------------------------- coverage kernels
+    // bit i of the result is set when pixel i of a row of count (at most 64) pixels is inside all
+    // three edges; e holds the edge values at the first pixel, step their increase per pixel, and
+    // a pixel is inside when all three values are >= 0
+
+    inline unsigned long long coverRowScalar(const int e[3], const int step[3], int count)
+    {
+        unsigned long long mask = 0;
+        int e0 = e[0], e1 = e[1], e2 = e[2];
+        for (int i = 0; i < count; i++, e0 += step[0], e1 += step[1], e2 += step[2])
+            if ((e0 | e1 | e2) >= 0)
+                mask |= 1ull << i;
+        return mask;
+    }
+
+#ifdef CPU_SSE2
+    inline unsigned long long coverRowSSE2(const int e[3], const int step[3], int count)
+    {
+        __m128i v[3], advance[3];
+        for (int k = 0; k < 3; k++)
+        {
+            v[k] = _mm_setr_epi32(e[k], e[k] + step[k], e[k] + 2 * step[k], e[k] + 3 * step[k]);
+            advance[k] = _mm_set1_epi32(step[k] * 4);
+        }
+        unsigned long long mask = 0;
+        for (int i = 0; i < count; i += 4)
+        {
+            __m128i outside = _mm_or_si128(_mm_or_si128(v[0], v[1]), v[2]);
+            unsigned long long bits = (unsigned long long)(~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF);
+            mask |= bits << i;
+            for (int k = 0; k < 3; k++)
+                v[k] = _mm_add_epi32(v[k], advance[k]);
+        }
+        return count < 64 ? mask & ((1ull << count) - 1) : mask;
+    }
+#endif
+
+#ifdef CPU_X86
+    TARGET_AVX2 inline unsigned long long coverRowAVX2(const int e[3], const int step[3], int count)
+    {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i v[3], advance[3];
+        for (int k = 0; k < 3; k++)
+        {
+            __m256i s = _mm256_set1_epi32(step[k]);
+            v[k] = _mm256_add_epi32(_mm256_set1_epi32(e[k]), _mm256_mullo_epi32(s, lanes));
+            advance[k] = _mm256_slli_epi32(s, 3);
+        }
+        unsigned long long mask = 0;
+        for (int i = 0; i < count; i += 8)
+        {
+            __m256i outside = _mm256_or_si256(_mm256_or_si256(v[0], v[1]), v[2]);
+            unsigned long long bits = (unsigned long long)(~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF);
+            mask |= bits << i;
+            for (int k = 0; k < 3; k++)
+                v[k] = _mm256_add_epi32(v[k], advance[k]);
+        }
+        return count < 64 ? mask & ((1ull << count) - 1) : mask;
+    }
+#endif
+
+#ifdef CPU_NEON
+    inline unsigned long long coverRowNEON(const int e[3], const int step[3], int count)
+    {
+        static const int lanesInit[4] = { 0, 1, 2, 3 };
+        const int32x4_t lanes = vld1q_s32(lanesInit);
+        static const unsigned int weightsInit[4] = { 1, 2, 4, 8 };
+        const uint32x4_t weights = vld1q_u32(weightsInit);
+        int32x4_t v[3], advance[3];
+        for (int k = 0; k < 3; k++)
+        {
+            v[k] = vmlaq_n_s32(vdupq_n_s32(e[k]), lanes, step[k]);
+            advance[k] = vdupq_n_s32(step[k] * 4);
+        }
+        unsigned long long mask = 0;
+        for (int i = 0; i < count; i += 4)
+        {
+            int32x4_t outside = vorrq_s32(vorrq_s32(v[0], v[1]), v[2]);
+            uint32x4_t inside = vcgeq_s32(outside, vdupq_n_s32(0));
+            uint32x4_t lanesSet = vandq_u32(inside, weights);
+            uint32x2_t pairs = vorr_u32(vget_low_u32(lanesSet), vget_high_u32(lanesSet));
+            unsigned long long bits = vget_lane_u32(pairs, 0) | vget_lane_u32(pairs, 1);
+            mask |= bits << i;
+            for (int k = 0; k < 3; k++)
+                v[k] = vaddq_s32(v[k], advance[k]);
+        }
+        return count < 64 ? mask & ((1ull << count) - 1) : mask;
+    }
+#endif
+
+    inline unsigned long long coverRow(const int e[3], const int step[3], int count)
+    {
+#if defined(CPU_X86)
+        if (cpufeatures::hasAVX2())
+            return coverRowAVX2(e, step, count);
+#if defined(CPU_SSE2)
+        return coverRowSSE2(e, step, count);
+#endif
+#elif defined(CPU_NEON)
+        return coverRowNEON(e, step, count);
+#endif
+        return coverRowScalar(e, step, count);
+    }
+
+    // ---------------------------------------------------------------- gradient kernels
+    // write the covered pixels of a row of count (at most 64) RGBA8 pixels and leave the others
+    // alone: channel c of pixel i is scale[c] * (start[c] + i * delta[c]), clamped and rounded as
+    // toUnorm8() does; e and step are as for coverRow. The SIMD kernels return how many pixels
+    // from the first they did: SSE2 and NEON whole groups of 4, AVX2 and AVX-512 the whole row
+    // with masked stores. The scalar one does pixels from first on. All paths write the same
+    // bytes, except when the compiler fuses the scalar multiply-add (-ffp-contract with FMA
+    // enabled), which can move a channel by one.
+
+    inline void gradientRowScalar(const int e[3], const int step[3], int count, const float start[4], const float delta[4],
+                                  const float scale[4], unsigned char* out, int first)
+    {
+        for (int i = first; i < count; i++)
+        {
+            if (((e[0] + i * step[0]) | (e[1] + i * step[1]) | (e[2] + i * step[2])) < 0)
+                continue;
+            for (int c = 0; c < 4; c++)
+                out[i * 4 + c] = toUnorm8(scale[c] * (start[c] + (float)i * delta[c]));
+        }
+    }
+
+#ifdef CPU_SSE2
+    inline __m128i gradientChannelSSE2(__m128 index, float start, float delta, float scale)
+    {
+        __m128 v = _mm_mul_ps(_mm_set1_ps(scale), _mm_add_ps(_mm_set1_ps(start), _mm_mul_ps(index, _mm_set1_ps(delta))));
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+    }
+
+    inline int gradientRowSSE2(const int e[3], const int step[3], int count, const float start[4], const float delta[4],
+                               const float scale[4], unsigned char* out)
+    {
+        __m128i v[3], advance[3];
+        for (int k = 0; k < 3; k++)
+        {
+            v[k] = _mm_setr_epi32(e[k], e[k] + step[k], e[k] + 2 * step[k], e[k] + 3 * step[k]);
+            advance[k] = _mm_set1_epi32(step[k] * 4);
+        }
+        __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        int done = 0;
+        for (; done + 4 <= count; done += 4)
+        {
+            __m128i outside = _mm_or_si128(_mm_or_si128(v[0], v[1]), v[2]);
+            if (_mm_movemask_ps(_mm_castsi128_ps(outside)) != 0xF)
+            {
+                __m128i pixel = gradientChannelSSE2(index, start[0], delta[0], scale[0]);
+                pixel = _mm_or_si128(pixel, _mm_slli_epi32(gradientChannelSSE2(index, start[1], delta[1], scale[1]), 8));
+                pixel = _mm_or_si128(pixel, _mm_slli_epi32(gradientChannelSSE2(index, start[2], delta[2], scale[2]), 16));
+                pixel = _mm_or_si128(pixel, _mm_slli_epi32(gradientChannelSSE2(index, start[3], delta[3], scale[3]), 24));
+                __m128i* target = (__m128i*)(out + done * 4);
+                __m128i keep = _mm_srai_epi32(outside, 31);
+                _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(keep, _mm_loadu_si128(target)), _mm_andnot_si128(keep, pixel)));
+            }
+            for (int k = 0; k < 3; k++)
+                v[k] = _mm_add_epi32(v[k], advance[k]);
+            index = _mm_add_ps(index, _mm_set1_ps(4.0f));
+        }
+        return done;
+    }
+#endif
+
+#ifdef CPU_X86
+    TARGET_AVX2 inline __m256i gradientChannelAVX2(__m256 index, float start, float delta, float scale)
+    {
+        __m256 v = _mm256_mul_ps(_mm256_set1_ps(scale), _mm256_add_ps(_mm256_set1_ps(start), _mm256_mul_ps(index, _mm256_set1_ps(delta))));
+        v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        return _mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(255.0f)));
+    }
+
+    TARGET_AVX2 inline int gradientRowAVX2(const int e[3], const int step[3], int count, const float start[4], const float delta[4],
+                                           const float scale[4], unsigned char* out)
+    {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i v[3], advance[3];
+        for (int k = 0; k < 3; k++)
+        {
+            __m256i s = _mm256_set1_epi32(step[k]);
+            v[k] = _mm256_add_epi32(_mm256_set1_epi32(e[k]), _mm256_mullo_epi32(s, lanes));
+            advance[k] = _mm256_slli_epi32(s, 3);
+        }
+        __m256 index = _mm256_cvtepi32_ps(lanes);
+        int done = 0;
+        for (; done < count; done += 8)
+        {
+            // maskstore writes the lanes whose top bit is set: those with no negative edge and
+            // within the row, and it never touches the memory of the others
+            __m256i outside = _mm256_or_si256(_mm256_or_si256(v[0], v[1]), v[2]);
+            __m256i inside = _mm256_andnot_si256(outside, _mm256_cmpgt_epi32(_mm256_set1_epi32(count - done), lanes));
+            if (_mm256_movemask_ps(_mm256_castsi256_ps(inside)))
+            {
+                __m256i pixel = gradientChannelAVX2(index, start[0], delta[0], scale[0]);
+                pixel = _mm256_or_si256(pixel, _mm256_slli_epi32(gradientChannelAVX2(index, start[1], delta[1], scale[1]), 8));
+                pixel = _mm256_or_si256(pixel, _mm256_slli_epi32(gradientChannelAVX2(index, start[2], delta[2], scale[2]), 16));
+                pixel = _mm256_or_si256(pixel, _mm256_slli_epi32(gradientChannelAVX2(index, start[3], delta[3], scale[3]), 24));
+                _mm256_maskstore_epi32((int*)(out + done * 4), inside, pixel);
+            }
+            for (int k = 0; k < 3; k++)
+                v[k] = _mm256_add_epi32(v[k], advance[k]);
+            index = _mm256_add_ps(index, _mm256_set1_ps(8.0f));
+        }
+        return count;
+    }
+
+    // GCC 12's avx512fintrin.h starts several intrinsics from a self-initialised __Y
+    // (_mm512_undefined_*), which -Wall reports as uninitialised once they are inlined here
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+    // index * delta with an explicit rounding mode, which the compiler cannot fuse into the add
+    // that follows; fused, it would round differently from the other paths
+#define GRADIENT_ROUNDING (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+    TARGET_AVX512 inline __m512i gradientChannelAVX512(__m512 index, float start, float delta, float scale)
+    {
+        __m512 step = _mm512_mul_round_ps(index, _mm512_set1_ps(delta), GRADIENT_ROUNDING);
+        __m512 v = _mm512_mul_ps(_mm512_set1_ps(scale), _mm512_add_ps(_mm512_set1_ps(start), step));
+        v = _mm512_min_ps(_mm512_max_ps(v, _mm512_setzero_ps()), _mm512_set1_ps(1.0f));
+        return _mm512_cvtps_epi32(_mm512_mul_ps(v, _mm512_set1_ps(255.0f)));
+    }
+#undef GRADIENT_ROUNDING
+
+    TARGET_AVX512 inline int gradientRowAVX512(const int e[3], const int step[3], int count, const float start[4], const float delta[4],
+                                               const float scale[4], unsigned char* out)
+    {
+        const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        __m512i v[3], advance[3];
+        for (int k = 0; k < 3; k++)
+        {
+            __m512i s = _mm512_set1_epi32(step[k]);
+            v[k] = _mm512_add_epi32(_mm512_set1_epi32(e[k]), _mm512_mullo_epi32(s, lanes));
+            advance[k] = _mm512_slli_epi32(s, 4);
+        }
+        __m512 index = _mm512_cvtepi32_ps(lanes);
+        int done = 0;
+        for (; done < count; done += 16)
+        {
+            // masked-off lanes, past the row included, are neither written nor faulted on
+            __m512i outside = _mm512_or_si512(_mm512_or_si512(v[0], v[1]), v[2]);
+            __mmask16 row = count - done >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - done)) - 1);
+            __mmask16 inside = _mm512_mask_cmpge_epi32_mask(row, outside, _mm512_setzero_si512());
+            if (inside)
+            {
+                __m512i pixel = gradientChannelAVX512(index, start[0], delta[0], scale[0]);
+                pixel = _mm512_or_si512(pixel, _mm512_slli_epi32(gradientChannelAVX512(index, start[1], delta[1], scale[1]), 8));
+                pixel = _mm512_or_si512(pixel, _mm512_slli_epi32(gradientChannelAVX512(index, start[2], delta[2], scale[2]), 16));
+                pixel = _mm512_or_si512(pixel, _mm512_slli_epi32(gradientChannelAVX512(index, start[3], delta[3], scale[3]), 24));
+                _mm512_mask_storeu_epi32(out + done * 4, inside, pixel);
+            }
+            for (int k = 0; k < 3; k++)
+                v[k] = _mm512_add_epi32(v[k], advance[k]);
+            index = _mm512_add_ps(index, _mm512_set1_ps(16.0f));
+        }
+        return count;
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+#if defined(CPU_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+    // AArch64 only: 32-bit NEON has no round-to-nearest conversion
+    inline uint32x4_t gradientChannelNEON(float32x4_t index, float start, float delta, float scale)
+    {
+        float32x4_t v = vmulq_n_f32(vaddq_f32(vdupq_n_f32(start), vmulq_n_f32(index, delta)), scale);
+        v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+        return vreinterpretq_u32_s32(vcvtnq_s32_f32(vmulq_n_f32(v, 255.0f)));
+    }
+
+    inline int gradientRowNEON(const int e[3], const int step[3], int count, const float start[4], const float delta[4],
+                               const float scale[4], unsigned char* out)
+    {
+        static const int lanesInit[4] = { 0, 1, 2, 3 };
+        const int32x4_t lanes = vld1q_s32(lanesInit);
+        int32x4_t v[3], advance[3];
+        for (int k = 0; k < 3; k++)
+        {
+            v[k] = vmlaq_n_s32(vdupq_n_s32(e[k]), lanes, step[k]);
+            advance[k] = vdupq_n_s32(step[k] * 4);
+        }
+        float32x4_t index = vcvtq_f32_s32(lanes);
+        int done = 0;
+        for (; done + 4 <= count; done += 4)
+        {
+            uint32x4_t inside = vcgeq_s32(vorrq_s32(vorrq_s32(v[0], v[1]), v[2]), vdupq_n_s32(0));
+            if (vmaxvq_u32(inside))
+            {
+                uint32x4_t pixel = gradientChannelNEON(index, start[0], delta[0], scale[0]);
+                pixel = vorrq_u32(pixel, vshlq_n_u32(gradientChannelNEON(index, start[1], delta[1], scale[1]), 8));
+                pixel = vorrq_u32(pixel, vshlq_n_u32(gradientChannelNEON(index, start[2], delta[2], scale[2]), 16));
+                pixel = vorrq_u32(pixel, vshlq_n_u32(gradientChannelNEON(index, start[3], delta[3], scale[3]), 24));
+                unsigned int* target = (unsigned int*)(out + done * 4);
+                vst1q_u32(target, vbslq_u32(inside, pixel, vld1q_u32(target)));
+            }
+            for (int k = 0; k < 3; k++)
+                v[k] = vaddq_s32(v[k], advance[k]);
+            index = vaddq_f32(index, vdupq_n_f32(4.0f));
+        }
+        return done;
+    }
+#endif
+
+    inline void gradientRow(const int e[3], const int step[3], int count, const float start[4], const float delta[4],
+                            const float scale[4], unsigned char* out)
+    {
+        int done = 0;
+#if defined(CPU_X86)
+        if (cpufeatures::hasAVX512BW())
+            done = gradientRowAVX512(e, step, count, start, delta, scale, out);
+        else if (cpufeatures::hasAVX2())
+            done = gradientRowAVX2(e, step, count, start, delta, scale, out);
+#if defined(CPU_SSE2)
+        else
+            done = gradientRowSSE2(e, step, count, start, delta, scale, out);
+#endif
+#elif defined(CPU_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+        done = gradientRowNEON(e, step, count, start, delta, scale, out);
+#endif
+        gradientRowScalar(e, step, count, start, delta, scale, out, done);
+    }
+
+    // ---------------------------------------------------------------- primitives
+
+    struct Vertex
+    {
+        float x, y;     // normalized device coordinates
+        float attributes[ATTRIBUTES];
+        int material;
+    };
+
+    struct Triangle
+    {
+        int A[3], B[3];         // edge i: A x + B y + C >= 0 inside pixel (x, y)
+        long long C[3];         // with the top-left bias folded in
+        int minX, minY, maxX, maxY;     // covered pixels lie in here (inclusive)
+        float originX, originY;         // vertex 0, in pixels
+        float plane[ATTRIBUTES][3];     // value at the origin, change per pixel in x and in y
+        int material;
+        bool minify;
+    };
+
+    struct Line
+    {
+        float x0, y0, x1, y1;   // window coordinates, pixels
+        float attributes0[ATTRIBUTES], attributes1[ATTRIBUTES];
+        int material;
+        bool minify;
+    };
+
+    inline long long floorDiv(long long a, long long b)
+    {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+    inline long long ceilDiv(long long a, long long b)
+    {
+        return -floorDiv(-a, b);
+    }
+
+    inline bool insideGuard(const Vertex& v)
+    {
+        return std::fabs(v.x) <= GUARD && std::fabs(v.y) <= GUARD;
+    }
+
+    // >= 0 on the kept side of guard plane 0-3 (x <= G, x >= -G, y <= G, y >= -G)
+    inline float guardDistance(const Vertex& v, int plane)
+    {
+        float coordinate = plane < 2 ? v.x : v.y;
+        return plane % 2 == 0 ? GUARD - coordinate : GUARD + coordinate;
+    }
+
+    inline Vertex lerp(const Vertex& p, const Vertex& q, float t)
+    {
+        Vertex v = p;
+        v.x = p.x + (q.x - p.x) * t;
+        v.y = p.y + (q.y - p.y) * t;
+        for (int a = 0; a < ATTRIBUTES; a++)
+            v.attributes[a] = p.attributes[a] + (q.attributes[a] - p.attributes[a]) * t;
+        return v;
+    }
+
+    // the part of triangle abc inside the guard band, as a convex polygon (empty when none is)
+    inline void clipToGuard(const Vertex& a, const Vertex& b, const Vertex& c, std::vector<Vertex>& polygon)
+    {
+        std::vector<Vertex> clipped;
+        polygon.assign(1, a);
+        polygon.push_back(b);
+        polygon.push_back(c);
+        for (int plane = 0; plane < 4 && !polygon.empty(); plane++)
+        {
+            clipped.clear();
+            for (size_t i = 0; i < polygon.size(); i++)
+            {
+                const Vertex& p = polygon[i];
+                const Vertex& q = polygon[(i + 1) % polygon.size()];
+                float dp = guardDistance(p, plane), dq = guardDistance(q, plane);
+                if (dp >= 0.0f)
+                    clipped.push_back(p);
+                if ((dp >= 0.0f) != (dq >= 0.0f))
+                    clipped.push_back(lerp(p, q, dp / (dp - dq)));
+            }
+            polygon.swap(clipped);
+        }
+    }
+
+    // sets t up from three vertices in window coordinates (pixels, y up, inside the guard band)
+    // and their attributes, for a width x height target; false when it covers no pixel centre.
+    // Leaves the material and minify to the caller.
+    inline bool setupTriangle(const float x[3], const float y[3], const float* const attributes[3], int width, int height, Triangle& t)
+    {
+        long long X[3], Y[3];
+        int order[3] = { 0, 1, 2 };
+        for (int i = 0; i < 3; i++)
+        {
+            X[i] = (long long)std::floor((double)x[i] * SUBPIXEL + 0.5);
+            Y[i] = (long long)std::floor((double)y[i] * SUBPIXEL + 0.5);
+        }
+        long long area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+        if (area == 0)
+            return false;
+        if (area < 0)
+        {
+            // counter-clockwise from here on, whatever the submitted winding
+            std::swap(order[1], order[2]);
+            std::swap(X[1], X[2]);
+            std::swap(Y[1], Y[2]);
+        }
+
+        long long minXs = std::min(X[0], std::min(X[1], X[2])), maxXs = std::max(X[0], std::max(X[1], X[2]));
+        long long minYs = std::min(Y[0], std::min(Y[1], Y[2])), maxYs = std::max(Y[0], std::max(Y[1], Y[2]));
+        // pixel x is sampled at x * SUBPIXEL + SUBPIXEL / 2
+        t.minX = (int)std::max(0LL, ceilDiv(minXs - SUBPIXEL / 2, SUBPIXEL));
+        t.maxX = (int)std::min((long long)width - 1, floorDiv(maxXs - SUBPIXEL / 2, SUBPIXEL));
+        t.minY = (int)std::max(0LL, ceilDiv(minYs - SUBPIXEL / 2, SUBPIXEL));
+        t.maxY = (int)std::min((long long)height - 1, floorDiv(maxYs - SUBPIXEL / 2, SUBPIXEL));
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return false;
+
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3;
+            long long dx = X[j] - X[i], dy = Y[j] - Y[i];
+            t.A[i] = (int)-dy;
+            t.B[i] = (int)dx;
+            // left edges (going down) and top edges (going left) own the pixels centred on them
+            bool topLeft = dy < 0 || (dy == 0 && dx < 0);
+            long long c = dy * X[i] - dx * Y[i] - (topLeft ? 0 : 1);
+            // at the centre of pixel (x, y) the edge is SUBPIXEL * (A x + B y) + A * SUBPIXEL / 2 +
+            // B * SUBPIXEL / 2 + c, and as A x + B y is a whole number it is >= 0 exactly when
+            // A x + B y + floor((the rest) / SUBPIXEL) is; steps per pixel stay as small as A and B
+            t.C[i] = floorDiv((dx - dy) * (SUBPIXEL / 2) + c, SUBPIXEL);
+        }
+
+        // attribute planes, from the snapped positions
+        float px[3], py[3];
+        for (int i = 0; i < 3; i++)
+        {
+            px[i] = (float)X[i] / SUBPIXEL;
+            py[i] = (float)Y[i] / SUBPIXEL;
+        }
+        float det = (px[1] - px[0]) * (py[2] - py[0]) - (px[2] - px[0]) * (py[1] - py[0]);
+        t.originX = px[0];
+        t.originY = py[0];
+        const float* a0 = attributes[order[0]];
+        const float* a1 = attributes[order[1]];
+        const float* a2 = attributes[order[2]];
+        for (int k = 0; k < ATTRIBUTES; k++)
+        {
+            float d1 = a1[k] - a0[k], d2 = a2[k] - a0[k];
+            t.plane[k][0] = a0[k];
+            t.plane[k][1] = (d1 * (py[2] - py[0]) - d2 * (py[1] - py[0])) / det;
+            t.plane[k][2] = (d2 * (px[1] - px[0]) - d1 * (px[2] - px[0])) / det;
+        }
+        t.material = 0;
+        t.minify = false;
+        return true;
+    }
+
+    // GL's scale factor rho from the texture coordinate derivatives
+    inline bool minifies(const Triangle& t, const SoftTexture& texture)
+    {
+        float rx = std::hypot(t.plane[0][1] * texture.width, t.plane[1][1] * texture.height);
+        float ry = std::hypot(t.plane[0][2] * texture.width, t.plane[1][2] * texture.height);
+        return std::max(rx, ry) > 1.0f;
+    }
+
+    // the largest (or smallest) value of edge i over the pixel centres of a rectangle
+    inline long long edgeRange(const Triangle& t, int i, int x0, int y0, int x1, int y1, bool largest)
+    {
+        bool pickX1 = (t.A[i] > 0) == largest, pickY1 = (t.B[i] > 0) == largest;
+        return (long long)t.A[i] * (pickX1 ? x1 : x0) + (long long)t.B[i] * (pickY1 ? y1 : y0) + t.C[i];
+    }
+
+    // the material program's fragment shader for a material of the given colour and flags
+    inline void shadePixel(const float colour[4], unsigned int flags, const SoftTexture* texture, bool minify,
+                           const float attributes[ATTRIBUTES], unsigned char* out)
+    {
+        float c[4] = { colour[0], colour[1], colour[2], colour[3] };
+        if (flags & MATERIAL_VERTEX_COLOUR)
+            for (int k = 0; k < 4; k++)
+                c[k] *= attributes[COLOUR_ATTRIBUTE + k];
+        if (flags & MATERIAL_TEXTURED)
+        {
+            float texel[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            if (texture)
+            {
+                if ((minify ? texture->minFilter : texture->magFilter) == GL_NEAREST ||
+                    (minify && (texture->minFilter == GL_NEAREST_MIPMAP_NEAREST || texture->minFilter == GL_NEAREST_MIPMAP_LINEAR)))
+                    sampleNearest(*texture, attributes[0], attributes[1], texel);
+                else
+                    sampleLinear(*texture, attributes[0], attributes[1], texel);
+            }
+            for (int k = 0; k < 4; k++)
+                c[k] *= texel[k];
+        }
+        for (int k = 0; k < 4; k++)
+            out[k] = toUnorm8(c[k]);
+    }
+
+    // shades the pixels of t within a block of at most TILE_SIZE x TILE_SIZE pixels (inclusive
+    // bounds) of an RGBA8 image whose rows are stride bytes apart, as shadePixel() would; untextured
+    // rows go through gradientRow(), textured ones pixel by pixel. Attributes step along the row
+    // from its first pixel on every path, so they shade alike.
+    inline void fillBlock(const Triangle& t, int x0, int y0, int x1, int y1, unsigned char* pixels, size_t stride,
+                          const float colour[4], unsigned int flags, const SoftTexture* texture)
+    {
+        x0 = std::max(x0, t.minX);
+        y0 = std::max(y0, t.minY);
+        x1 = std::min(x1, t.maxX);
+        y1 = std::min(y1, t.maxY);
+        if (x0 > x1 || y0 > y1)
+            return;
+        // per edge: values at (x0, y0) and steps per pixel; an edge that is non-negative over the
+        // whole block drops out (0, 0, 0), which also keeps the rest within 32 bits
+        int e[3], stepX[3], stepY[3];
+        for (int i = 0; i < 3; i++)
+        {
+            if (edgeRange(t, i, x0, y0, x1, y1, true) < 0)
+                return;
+            if (edgeRange(t, i, x0, y0, x1, y1, false) >= 0)
+            {
+                e[i] = stepX[i] = stepY[i] = 0;
+                continue;
+            }
+            e[i] = (int)((long long)t.A[i] * x0 + (long long)t.B[i] * y0 + t.C[i]);
+            stepX[i] = t.A[i];
+            stepY[i] = t.B[i];
+        }
+        int count = x1 - x0 + 1;
+        static const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f }, flat[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int y = y0; y <= y1; y++)
+        {
+            float dx = x0 + 0.5f - t.originX, dy = y + 0.5f - t.originY;
+            float start[ATTRIBUTES], delta[ATTRIBUTES];
+            for (int k = 0; k < ATTRIBUTES; k++)
+            {
+                start[k] = t.plane[k][0] + t.plane[k][1] * dx + t.plane[k][2] * dy;
+                delta[k] = t.plane[k][1];
+            }
+            unsigned char* row = pixels + (size_t)y * stride + (size_t)x0 * 4;
+            if (!(flags & MATERIAL_TEXTURED))
+            {
+                if (flags & MATERIAL_VERTEX_COLOUR)
+                    gradientRow(e, stepX, count, start + COLOUR_ATTRIBUTE, delta + COLOUR_ATTRIBUTE, colour, row);
+                else
+                    gradientRow(e, stepX, count, white, flat, colour, row);
+            }
+            else
+            {
+                unsigned long long mask = coverRow(e, stepX, count);
+                while (mask)
+                {
+                    int bit = ctz(mask);
+                    mask &= mask - 1;
+                    float attributes[ATTRIBUTES];
+                    for (int k = 0; k < ATTRIBUTES; k++)
+                        attributes[k] = start[k] + (float)bit * delta[k];
+                    shadePixel(colour, flags, texture, t.minify, attributes, row + bit * 4);
+                }
+            }
+            for (int i = 0; i < 3; i++)
+                e[i] += stepY[i];
+        }
+    }
+
+    struct FillVertex
+    {
+        float x, y;         // window coordinates: pixels from the bottom left, centres at .5
+        float colour[4];
+        float u, v;
+    };
+
+    // fills a triangle into a width x height RGBA8 image whose rows, bottom first, are stride
+    // bytes apart, with the vertex colours interpolated across it and, when texture is given,
+    // multiplied by the texture: what the material program draws for a vertex-coloured (and
+    // textured) material, with SoftRasterizer's coverage, clipping and kernels. width and height
+    // are at most MAX_SIZE.
+    inline void fillTriangle(unsigned char* pixels, int width, int height, size_t stride, const FillVertex vertices[3],
+                             const SoftTexture* texture = NULL)
+    {
+        Vertex v[3];
+        for (int i = 0; i < 3; i++)
+        {
+            v[i].x = vertices[i].x / width * 2.0f - 1.0f;
+            v[i].y = vertices[i].y / height * 2.0f - 1.0f;
+            v[i].attributes[0] = vertices[i].u;
+            v[i].attributes[1] = vertices[i].v;
+            for (int c = 0; c < 4; c++)
+                v[i].attributes[COLOUR_ATTRIBUTE + c] = vertices[i].colour[c];
+            v[i].material = 0;
+        }
+        static const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        unsigned int flags = MATERIAL_VERTEX_COLOUR | (texture ? MATERIAL_TEXTURED : 0u);
+        auto fill = [&](const float x[3], const float y[3], const float* const attributes[3])
+        {
+            Triangle t;
+            if (!setupTriangle(x, y, attributes, width, height, t))
+                return;
+            t.minify = texture && minifies(t, *texture);
+            // on the tile grid, so rows start where SoftRasterizer's do and shade alike
+            for (int by = t.minY / TILE_SIZE * TILE_SIZE; by <= t.maxY; by += TILE_SIZE)
+                for (int bx = t.minX / TILE_SIZE * TILE_SIZE; bx <= t.maxX; bx += TILE_SIZE)
+                    fillBlock(t, bx, by, bx + TILE_SIZE - 1, by + TILE_SIZE - 1, pixels, stride, white, flags, texture);
+        };
+        if (insideGuard(v[0]) && insideGuard(v[1]) && insideGuard(v[2]))
+        {
+            // the window coordinates as given, so that nothing is lost converting
+            float x[3] = { vertices[0].x, vertices[1].x, vertices[2].x };
+            float y[3] = { vertices[0].y, vertices[1].y, vertices[2].y };
+            const float* attributes[3] = { v[0].attributes, v[1].attributes, v[2].attributes };
+            fill(x, y, attributes);
+            return;
+        }
+        std::vector<Vertex> polygon;
+        clipToGuard(v[0], v[1], v[2], polygon);
+        for (size_t i = 1; i + 1 < polygon.size(); i++)
+        {
+            const Vertex* corners[3] = { &polygon[0], &polygon[i], &polygon[i + 1] };
+            float x[3], y[3];
+            const float* attributes[3];
+            for (int k = 0; k < 3; k++)
+            {
+                x[k] = (corners[k]->x + 1.0f) * 0.5f * width;
+                y[k] = (corners[k]->y + 1.0f) * 0.5f * height;
+                attributes[k] = corners[k]->attributes;
+            }
+            fill(x, y, attributes);
+        }
+    }
+}
+
+class SoftRasterizer
+{
+public:
+    // pool may be NULL to rasterize on the calling thread only
+    SoftRasterizer(int width, int height, ThreadPool* pool = NULL) : workers(pool)
+    {
+        resize(width, height);
+    }
+
+    // also drops anything drawn but not yet finished
+    void resize(int width, int height)
+    {
+        fbWidth = width < 1 ? 1 : width > softraster::MAX_SIZE ? softraster::MAX_SIZE : width;
+        fbHeight = height < 1 ? 1 : height > softraster::MAX_SIZE ? softraster::MAX_SIZE : height;
+        colour.assign((size_t)fbWidth * fbHeight * 4, 0);
+        tilesX = (fbWidth + softraster::TILE_SIZE - 1) / softraster::TILE_SIZE;
+        tilesY = (fbHeight + softraster::TILE_SIZE - 1) / softraster::TILE_SIZE;
+        bins.assign((size_t)tilesX * tilesY, std::vector<unsigned int>());
+        triangles.clear();
+        lines.clear();
+        clearPending = false;
+    }
+
+    int width() const
+    {
+        return fbWidth;
+    }
+    int height() const
+    {
+        return fbHeight;
+    }
+    // RGBA8, bottom row first; complete after finish()
+    const std::vector<unsigned char>& pixels() const
+    {
+        return colour;
+    }
+    const SoftRasterizerStats& stats() const
+    {
+        return counters;
+    }
+
+    // the material table; materials name textures by their index in the texture list
+    int addMaterial(const Material& material)
+    {
+        materials.push_back(material);
+        return (int)materials.size() - 1;
+    }
+    // the texture must outlive every finish() that samples it
+    int addTexture(const SoftTexture* texture)
+    {
+        textures.push_back(texture);
+        return (int)textures.size() - 1;
+    }
+
+    // clears to the colour before the next finish() rasterizes anything
+    void clear(float r, float g, float b, float a = 1.0f)
+    {
+        clearColour[0] = softraster::toUnorm8(r);
+        clearColour[1] = softraster::toUnorm8(g);
+        clearColour[2] = softraster::toUnorm8(b);
+        clearColour[3] = softraster::toUnorm8(a);
+        clearPending = true;
+        counters = SoftRasterizerStats();
+        for (size_t i = 0; i < bins.size(); i++)
+            bins[i].clear();
+        triangles.clear();
+        lines.clear();
+    }
+
+    // queues vertices laid out as for createMesh(), in GL_TRIANGLES, GL_TRIANGLE_STRIP,
+    // GL_TRIANGLE_FAN, GL_LINES, GL_LINE_STRIP or GL_LINE_LOOP order. Each primitive takes the
+    // material of its last vertex from vertexMaterials when given, else material.
+    void draw(const std::vector<float>& vertices, unsigned int layout, GLenum mode, int material,
+              const std::vector<int>* vertexMaterials = NULL)
+    {
+        int floats = vertexFloats(layout);
+        int count = (int)(vertices.size() / floats);
+        std::vector<softraster::Vertex> v(count);
+        for (int i = 0; i < count; i++)
+        {
+            const float* in = &vertices[(size_t)i * floats];
+            softraster::Vertex& out = v[i];
+            out.x = in[0];
+            out.y = in[1];
+            for (int a = 0; a < softraster::ATTRIBUTES; a++)
+                out.attributes[a] = 0.0f;
+            // ourColor is a vec3; the shader multiplies by (ourColor, 1)
+            out.attributes[softraster::COLOUR_ATTRIBUTE + 3] = 1.0f;
+            int next = 3;
+            if (layout & VERTEX_TEXCOORD)
+            {
+                out.attributes[0] = in[next];
+                out.attributes[1] = in[next + 1];
+                next += 2;
+            }
+            if (layout & VERTEX_COLOUR)
+                for (int c = 0; c < 3; c++)
+                    out.attributes[softraster::COLOUR_ATTRIBUTE + c] = in[next + c];
+            out.material = vertexMaterials && i < (int)vertexMaterials->size() ? (*vertexMaterials)[i] : material;
+        }
+
+        switch (mode)
+        {
+        case GL_TRIANGLES:
+            for (int i = 0; i + 2 < count; i += 3)
+                addTriangle(v[i], v[i + 1], v[i + 2]);
+            break;
+        case GL_TRIANGLE_STRIP:
+            for (int i = 0; i + 2 < count; i++)
+                addTriangle(v[i], v[i + 1], v[i + 2]);
+            break;
+        case GL_TRIANGLE_FAN:
+            for (int i = 1; i + 1 < count; i++)
+                addTriangle(v[0], v[i], v[i + 1]);
+            break;
+        case GL_LINES:
+            for (int i = 0; i + 1 < count; i += 2)
+                addLine(v[i], v[i + 1]);
+            break;
+        case GL_LINE_STRIP:
+        case GL_LINE_LOOP:
+            for (int i = 0; i + 1 < count; i++)
+                addLine(v[i], v[i + 1]);
+            if (mode == GL_LINE_LOOP && count > 2)
+                addLine(v[count - 1], v[0]);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // rasterizes everything drawn since the last finish() (or clear()) into pixels()
+    void finish()
+    {
+        std::vector<int> jobs;
+        for (int t = 0; t < (int)bins.size(); t++)
+            if (clearPending || !bins[t].empty())
+                jobs.push_back(t);
+        counters.tiles = jobs.size();
+        counters.steals = 0;
+
+        // one queue per worker, dealt round-robin so that neighbouring (similarly busy) tiles
+        // start out on different workers
+        int workerCount = workers ? (int)workers->size() + 1 : 1;
+        if (workerCount > (int)jobs.size())
+            workerCount = jobs.empty() ? 1 : (int)jobs.size();
+        std::unique_ptr<TileQueue[]> queues(new TileQueue[workerCount]);
+        for (size_t i = 0; i < jobs.size(); i++)
+            queues[i % workerCount].tiles.push_back(jobs[i]);
+        std::atomic<size_t> steals(0);
+        TileQueue* queueList = queues.get();
+        auto work = [this, queueList, workerCount, &steals](int self) {
+            int tile;
+            while (take(queueList, workerCount, self, tile, steals))
+                renderTile(tile);
+        };
+        if (workers && workerCount > 1)
+            workers->parallelFor(workerCount, work);
+        else
+            work(0);
+        counters.steals = steals.load();
+
+        for (size_t i = 0; i < bins.size(); i++)
+            bins[i].clear();
+        triangles.clear();
+        lines.clear();
+        clearPending = false;
+    }
+
+private:
+    struct TileQueue
+    {
+        std::mutex mutex;
+        std::deque<int> tiles;
+    };
+
+    static const unsigned int LINE_BIT = 0x80000000u;
+
+    ThreadPool* workers;
+    int fbWidth = 1, fbHeight = 1, tilesX = 1, tilesY = 1;
+    std::vector<unsigned char> colour;
+    unsigned char clearColour[4] = { 0, 0, 0, 255 };
+    bool clearPending = false;
+    std::vector<Material> materials;
+    std::vector<const SoftTexture*> textures;
+    std::vector<softraster::Triangle> triangles;
+    std::vector<softraster::Line> lines;
+    std::vector<std::vector<unsigned int> > bins;     // per tile: primitives in submission order
+    SoftRasterizerStats counters;
+
+    // the front of the worker's own queue, else the back of the first other queue with tiles left
+    static bool take(TileQueue* queues, int count, int self, int& tile, std::atomic<size_t>& steals)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues[self].mutex);
+            if (!queues[self].tiles.empty())
+            {
+                tile = queues[self].tiles.front();
+                queues[self].tiles.pop_front();
+                return true;
+            }
+        }
+        for (int i = 1; i < count; i++)
+        {
+            TileQueue& victim = queues[(self + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tiles.empty())
+            {
+                tile = victim.tiles.back();
+                victim.tiles.pop_back();
+                steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const SoftTexture* textureOf(int material) const
+    {
+        if (material < 0 || material >= (int)materials.size() || !(materials[material].flags & MATERIAL_TEXTURED))
+            return NULL;
+        int index = materials[material].textureIndex;
+        return index >= 0 && index < (int)textures.size() ? textures[index] : NULL;
+    }
+
+    // a material's colour and flags; out-of-range indices shade white
+    void materialOf(int material, const float*& materialColour, unsigned int& flags) const
+    {
+        static const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        bool known = material >= 0 && material < (int)materials.size();
+        materialColour = known ? materials[material].colour : white;
+        flags = known ? materials[material].flags : 0u;
+    }
+
+    // ---------------------------------------------------------------- setup and binning
+
+    // clips against the guard band, then fans the polygon into set-up triangles
+    void addTriangle(const softraster::Vertex& a, const softraster::Vertex& b, const softraster::Vertex& c)
+    {
+        using namespace softraster;
+        if (insideGuard(a) && insideGuard(b) && insideGuard(c))
+        {
+            setupTriangle(a, b, c, c.material);
+            return;
+        }
+        std::vector<Vertex> polygon;
+        clipToGuard(a, b, c, polygon);
+        for (size_t i = 1; i + 1 < polygon.size(); i++)
+            setupTriangle(polygon[0], polygon[i], polygon[i + 1], c.material);
+    }
+
+    void toWindow(const softraster::Vertex& v, float& x, float& y) const
+    {
+        x = (v.x + 1.0f) * 0.5f * fbWidth;
+        y = (v.y + 1.0f) * 0.5f * fbHeight;
+    }
+
+    void setupTriangle(const softraster::Vertex& a, const softraster::Vertex& b, const softraster::Vertex& c, int material)
+    {
+        using namespace softraster;
+        const Vertex* v[3] = { &a, &b, &c };
+        float x[3], y[3];
+        const float* attributes[3];
+        for (int i = 0; i < 3; i++)
+        {
+            toWindow(*v[i], x[i], y[i]);
+            attributes[i] = v[i]->attributes;
+        }
+        Triangle t;
+        if (!softraster::setupTriangle(x, y, attributes, fbWidth, fbHeight, t))
+            return;
+        t.material = material;
+        if (const SoftTexture* texture = textureOf(material))
+            t.minify = minifies(t, *texture);
+
+        unsigned int index = (unsigned int)triangles.size();
+        triangles.push_back(t);
+        counters.triangles++;
+        int tx0 = t.minX / TILE_SIZE, tx1 = t.maxX / TILE_SIZE;
+        int ty0 = t.minY / TILE_SIZE, ty1 = t.maxY / TILE_SIZE;
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++)
+            {
+                // skip the tiles of the bounding box that one edge leaves entirely outside
+                int x0 = std::max(t.minX, tx * TILE_SIZE), x1 = std::min(t.maxX, tx * TILE_SIZE + TILE_SIZE - 1);
+                int y0 = std::max(t.minY, ty * TILE_SIZE), y1 = std::min(t.maxY, ty * TILE_SIZE + TILE_SIZE - 1);
+                bool outside = false;
+                for (int i = 0; i < 3 && !outside; i++)
+                    outside = edgeRange(t, i, x0, y0, x1, y1, true) < 0;
+                if (outside)
+                    continue;
+                bins[(size_t)ty * tilesX + tx].push_back(index);
+                counters.binned++;
+            }
+    }
+
+    void addLine(const softraster::Vertex& a, const softraster::Vertex& b)
+    {
+        using namespace softraster;
+        // clip the segment to the guard band
+        float t0 = 0.0f, t1 = 1.0f;
+        for (int plane = 0; plane < 4; plane++)
+        {
+            float da = guardDistance(a, plane), db = guardDistance(b, plane);
+            if (da < 0.0f && db < 0.0f)
+                return;
+            if (da < 0.0f)
+                t0 = std::max(t0, da / (da - db));
+            else if (db < 0.0f)
+                t1 = std::min(t1, da / (da - db));
+        }
+        if (t0 >= t1)
+            return;
+        Vertex p = lerp(a, b, t0), q = lerp(a, b, t1);
+
+        Line line;
+        toWindow(p, line.x0, line.y0);
+        toWindow(q, line.x1, line.y1);
+        for (int k = 0; k < ATTRIBUTES; k++)
+        {
+            line.attributes0[k] = p.attributes[k];
+            line.attributes1[k] = q.attributes[k];
+        }
+        line.material = b.material;
+        line.minify = false;
+        float major = std::max(std::fabs(line.x1 - line.x0), std::fabs(line.y1 - line.y0));
+        if (major == 0.0f)
+            return;
+        if (const SoftTexture* texture = textureOf(line.material))
+            line.minify = std::hypot((q.attributes[0] - p.attributes[0]) * texture->width,
+                                     (q.attributes[1] - p.attributes[1]) * texture->height) / major > 1.0f;
+
+        int minX = std::max(0, (int)std::floor(std::min(line.x0, line.x1)) - 1);
+        int maxX = std::min(fbWidth - 1, (int)std::floor(std::max(line.x0, line.x1)) + 1);
+        int minY = std::max(0, (int)std::floor(std::min(line.y0, line.y1)) - 1);
+        int maxY = std::min(fbHeight - 1, (int)std::floor(std::max(line.y0, line.y1)) + 1);
+        if (minX > maxX || minY > maxY)
+            return;
+        unsigned int index = (unsigned int)lines.size() | LINE_BIT;
+        lines.push_back(line);
+        counters.lines++;
+        for (int ty = minY / TILE_SIZE; ty <= maxY / TILE_SIZE; ty++)
+            for (int tx = minX / TILE_SIZE; tx <= maxX / TILE_SIZE; tx++)
+            {
+                bins[(size_t)ty * tilesX + tx].push_back(index);
+                counters.binned++;
+            }
+    }
+
+    // ---------------------------------------------------------------- rasterization
+
+    void renderTile(int tile)
+    {
+        using namespace softraster;
+        int tx = tile % tilesX, ty = tile / tilesX;
+        int x0 = tx * TILE_SIZE, x1 = std::min(fbWidth, x0 + TILE_SIZE);
+        int y0 = ty * TILE_SIZE, y1 = std::min(fbHeight, y0 + TILE_SIZE);
+        if (clearPending)
+        {
+            unsigned char* first = &colour[((size_t)y0 * fbWidth + x0) * 4];
+            for (int x = 0; x < x1 - x0; x++)
+                std::memcpy(first + x * 4, clearColour, 4);
+            for (int y = y0 + 1; y < y1; y++)
+                std::memcpy(&colour[((size_t)y * fbWidth + x0) * 4], first, (size_t)(x1 - x0) * 4);
+        }
+        const std::vector<unsigned int>& bin = bins[tile];
+        for (size_t i = 0; i < bin.size(); i++)
+        {
+            if (bin[i] & LINE_BIT)
+            {
+                rasterizeLine(lines[bin[i] & ~LINE_BIT], x0, y0, x1 - 1, y1 - 1);
+                continue;
+            }
+            const Triangle& t = triangles[bin[i]];
+            const float* materialColour;
+            unsigned int flags;
+            materialOf(t.material, materialColour, flags);
+            fillBlock(t, x0, y0, x1 - 1, y1 - 1, colour.data(), (size_t)fbWidth * 4, materialColour, flags, textureOf(t.material));
+        }
+    }
+
+    // the line's pixels within the tile's inclusive bounds
+    void rasterizeLine(const softraster::Line& line, int tileX0, int tileY0, int tileX1, int tileY1)
+    {
+        using namespace softraster;
+        bool xMajor = std::fabs(line.x1 - line.x0) >= std::fabs(line.y1 - line.y0);
+        // walk the major axis from a to b: one pixel for every pixel centre in [a, b)
+        float a = xMajor ? line.x0 : line.y0, b = xMajor ? line.x1 : line.y1;
+        float minorA = xMajor ? line.y0 : line.x0, minorB = xMajor ? line.y1 : line.x1;
+        int first, last;
+        if (a < b)
+        {
+            first = (int)std::ceil(a - 0.5f);
+            last = (int)std::ceil(b - 0.5f) - 1;
+        }
+        else
+        {
+            // going down: pixel centres in (b, a]
+            first = (int)std::floor(b - 0.5f) + 1;
+            last = (int)std::floor(a - 0.5f);
+        }
+        first = std::max(first, xMajor ? tileX0 : tileY0);
+        last = std::min(last, xMajor ? tileX1 : tileY1);
+        const float* materialColour;
+        unsigned int flags;
+        materialOf(line.material, materialColour, flags);
+        const SoftTexture* texture = textureOf(line.material);
+        for (int m = first; m <= last; m++)
+        {
+            float t = (m + 0.5f - a) / (b - a);
+            int n = (int)std::floor(minorA + (minorB - minorA) * t);
+            int x = xMajor ? m : n, y = xMajor ? n : m;
+            if (x < tileX0 || x > tileX1 || y < tileY0 || y > tileY1)
+                continue;
+            float attributes[ATTRIBUTES];
+            for (int k = 0; k < ATTRIBUTES; k++)
+                attributes[k] = line.attributes0[k] + (line.attributes1[k] - line.attributes0[k]) * t;
+            shadePixel(materialColour, flags, texture, line.minify, attributes, &colour[((size_t)y * fbWidth + x) * 4]);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include "ShapeStore.h"
+
+#include <cmath>
+#include <vector>
+
+// loose uniform grid over a ShapeStore
+// ------------------------------------
+// Each shape sits in exactly one cell, the one holding its centre (centres outside the grid's
+// bounds go to the nearest border cell), and cells list shape slots, so handles and swap-removes
+// in the store never invalidate it. Because a shape can overhang its cell by its radius, queries
+// widen the rectangle by the largest radius seen and then test each candidate exactly.
+// update() only looks at the store's dirty ranges and relinks the shapes that changed cell, so it
+// must run before the renderer's upload clears those ranges.
+class SpatialGrid
+{
+public:
+    SpatialGrid(float minX, float minY, float maxX, float maxY, int cellsPerSide = 256)
+        : originX(minX), originY(minY), side(cellsPerSide > 0 ? cellsPerSide : 1), maxRadius(0.0f)
+    {
+        float w = maxX - minX, h = maxY - minY;
+        cellSize = (w > h ? w : h) / side;
+        if (!(cellSize > 0.0f))
+            cellSize = 1.0f;
+        cells.resize((size_t)side * side);
+    }
+
+    // files every shape in the store, dropping whatever was there before
+    void build(const ShapeStore& store)
+    {
+        for (size_t c = 0; c < cells.size(); c++)
+            cells[c].clear();
+        cellOf.clear();
+        position.clear();
+        maxRadius = 0.0f;
+        for (int k = 0; k < SHAPE_KINDS; k++)
+            file(store.arrays((ShapeKind)k), 0, store.arrays((ShapeKind)k).size());
+    }
+
+    // relinks the shapes in the store's dirty ranges
+    void update(const ShapeStore& store)
+    {
+        for (int k = 0; k < SHAPE_KINDS; k++)
+        {
+            const ShapeArrays& a = store.arrays((ShapeKind)k);
+            size_t end = a.dirtyEnd < a.size() ? a.dirtyEnd : a.size();
+            if (a.dirtyBegin < end)
+                file(a, a.dirtyBegin, end);
+        }
+    }
+
+    // takes a shape out of the grid; call it alongside ShapeStore::remove()
+    void remove(ShapeHandle handle)
+    {
+        if (handle.slot < cellOf.size() && cellOf[handle.slot] >= 0)
+            unlink(handle.slot);
+    }
+
+    // the shapes overlapping the rectangle, by kind, as indices into the store's arrays
+    void query(const ShapeStore& store, float minX, float minY, float maxX, float maxY, VisibleShapes& visible) const
+    {
+        visible.clear();
+        int x0 = column(minX - maxRadius), x1 = column(maxX + maxRadius);
+        int y0 = row(minY - maxRadius), y1 = row(maxY + maxRadius);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                const std::vector<unsigned int>& cell = cells[(size_t)y * side + x];
+                // interior cells whose every shape is on screen whatever its radius skip the exact test
+                bool inside = x > 0 && y > 0 && x < side - 1 && y < side - 1 &&
+                              originX + x * cellSize - maxRadius >= minX && originX + (x + 1) * cellSize + maxRadius <= maxX &&
+                              originY + y * cellSize - maxRadius >= minY && originY + (y + 1) * cellSize + maxRadius <= maxY;
+                for (size_t i = 0; i < cell.size(); i++)
+                {
+                    ShapeKind kind;
+                    size_t index;
+                    store.locate(cell[i], kind, index);
+                    if (!inside)
+                    {
+                        const ShapeArrays& a = store.arrays(kind);
+                        float cx = a.centreX[index], cy = a.centreY[index], r = a.radius[index];
+                        if (cx + r < minX || cx - r > maxX || cy + r < minY || cy - r > maxY)
+                            continue;
+                    }
+                    visible.indices[kind].push_back((unsigned int)index);
+                }
+            }
+        }
+        for (int k = 0; k < SHAPE_KINDS; k++)
+            visible.visible += visible.indices[k].size();
+        visible.culled = store.size() - visible.visible;
+    }
+
+private:
+    float originX, originY, cellSize;
+    int side;
+    float maxRadius;     // only grows; a stale value just widens queries
+    std::vector<std::vector<unsigned int> > cells;
+    std::vector<int> cellOf;               // per slot: its cell, -1 when not filed
+    std::vector<unsigned int> position;    // per slot: its place in that cell's list
+
+    int column(float x) const
+    {
+        float c = std::floor((x - originX) / cellSize);
+        return c < 0.0f ? 0 : c >= (float)side ? side - 1 : (int)c;
+    }
+    int row(float y) const
+    {
+        float r = std::floor((y - originY) / cellSize);
+        return r < 0.0f ? 0 : r >= (float)side ? side - 1 : (int)r;
+    }
+
+    void file(const ShapeArrays& a, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            unsigned int slot = a.slot[i];
+            if (slot >= cellOf.size())
+            {
+                cellOf.resize(slot + 1, -1);
+                position.resize(slot + 1, 0);
+            }
+            if (a.radius[i] > maxRadius)
+                maxRadius = a.radius[i];
+            int cell = row(a.centreY[i]) * side + column(a.centreX[i]);
+            if (cellOf[slot] == cell)
+                continue;
+            if (cellOf[slot] >= 0)
+                unlink(slot);
+            cellOf[slot] = cell;
+            position[slot] = (unsigned int)cells[cell].size();
+            cells[cell].push_back(slot);
+        }
+    }
+
+    // swap-removes slot from its cell's list
+    void unlink(unsigned int slot)
+    {
+        std::vector<unsigned int>& cell = cells[cellOf[slot]];
+        unsigned int last = cell.back();
+        cell[position[slot]] = last;
+        position[last] = position[slot];
+        cell.pop_back();
+        cellOf[slot] = -1;
+    }
+};
+
+#endif
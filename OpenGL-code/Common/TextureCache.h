@@ -0,0 +1,378 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <GL/glew.h>
+
+#include "../Q3/stb_image.h"
+#include "BlockCompression.h"
+#include "DecodeArena.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GPU-ready texture cache
+// -----------------------
+// The first time a source image is requested it is decoded, given a full mip chain and
+// transcoded into the block format the context samples natively (BC1 or ETC2, RGBA8 when
+// neither is available or the source has alpha, which BC1 and ETC2 RGB would drop). The
+// result is written next to the source as a KTX2 file ("Sea.jpg.bc1.ktx2") and memory-mapped
+// on every later run, so a warm load is a page-in followed by glCompressedTexImage2D straight
+// from the mapping. The source's size and modification time are stored in the file's
+// key/value data, together with the mip filter; a mismatch rebuilds the entry. The chain
+// itself comes from MipGenerator, so it is the same on every driver.
+
+enum TextureCacheFormat
+{
+    CACHE_FORMAT_RGBA8,
+    CACHE_FORMAT_BC1,
+    CACHE_FORMAT_ETC2
+};
+
+struct CachedLevel
+{
+    int width, height;
+    const unsigned char* data;
+    size_t size;
+};
+
+// a mapped cache entry; level 0 is the full-size image
+struct CachedTexture
+{
+    int format;
+    std::vector<CachedLevel> levels;
+    MappedFile file;
+};
+
+class TextureCache
+{
+public:
+    // pool, when given, spreads mip generation of each build across its workers
+    explicit TextureCache(int cacheFormat, MipFilter mipFilter = MIP_FILTER_BOX, ThreadPool* pool = NULL)
+        : format(cacheFormat), filter(mipFilter), workers(pool) {}
+
+    // best format the current context can sample; call on the GL thread after glewInit
+    static int supportedFormat()
+    {
+        if (GLEW_EXT_texture_compression_s3tc)
+            return CACHE_FORMAT_BC1;
+        if (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility)
+            return CACHE_FORMAT_ETC2;
+        return CACHE_FORMAT_RGBA8;
+    }
+    static bool isCompressed(int cacheFormat)
+    {
+        return cacheFormat != CACHE_FORMAT_RGBA8;
+    }
+    static unsigned int internalFormat(int cacheFormat)
+    {
+        switch (cacheFormat)
+        {
+        case CACHE_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case CACHE_FORMAT_ETC2: return GL_COMPRESSED_RGB8_ETC2;
+        default: return GL_RGBA8;
+        }
+    }
+
+    // entries built for a maxSize get their own file ("Sea.jpg.max512.bc1.ktx2"), so loads of
+    // the same source at different sizes do not keep rebuilding each other's
+    std::string cachePath(const std::string& source, int maxSize = 0) const
+    {
+        static const char* suffixes[] = { ".rgba8.ktx2", ".bc1.ktx2", ".etc2.ktx2" };
+        return source + (maxSize > 0 ? ".max" + std::to_string(maxSize) : std::string()) + suffixes[format];
+    }
+
+    // maps an up-to-date cache entry for source, transcoding it first when it is missing or
+    // stale. Safe to call from worker threads. A nonzero maxSize builds the entry from a scaled
+    // JPEG decode (see stbi_set_jpeg_max_dimension) and has an entry of its own.
+    bool fetch(const std::string& source, CachedTexture& texture, int maxSize = 0) const
+    {
+        std::string stamp = sourceStamp(source);
+        if (stamp.empty())
+            return false;
+        stamp += filter == MIP_FILTER_KAISER ? " kaiser" : " box";
+        if (maxSize > 0)
+            stamp += " max" + std::to_string(maxSize);
+        std::string path = cachePath(source, maxSize);
+        if (open(path, stamp, texture))
+            return true;
+        return build(source, path, stamp, maxSize) && open(path, stamp, texture);
+    }
+
+private:
+    int format;
+    MipFilter filter;
+    ThreadPool* workers;
+
+    // KTX2 constants for the three formats
+    static unsigned int vkFormat(int cacheFormat)
+    {
+        switch (cacheFormat)
+        {
+        case CACHE_FORMAT_BC1: return 131;  // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case CACHE_FORMAT_ETC2: return 147; // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        default: return 37;                 // VK_FORMAT_R8G8B8A8_UNORM
+        }
+    }
+    static size_t levelSize(int cacheFormat, int width, int height)
+    {
+        if (isCompressed(cacheFormat))
+            return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+        return (size_t)width * height * 4;
+    }
+
+    static const unsigned char* identifier()
+    {
+        static const unsigned char id[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        return id;
+    }
+
+    static std::string sourceStamp(const std::string& source)
+    {
+        struct stat info;
+        if (stat(source.c_str(), &info) != 0)
+            return std::string();
+        return std::to_string((long long)info.st_size) + " " + std::to_string((long long)info.st_mtime);
+    }
+
+    static unsigned int read32(const unsigned char* p)
+    {
+        return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+    static unsigned long long read64(const unsigned char* p)
+    {
+        return (unsigned long long)read32(p) | ((unsigned long long)read32(p + 4) << 32);
+    }
+    static void put32(std::vector<unsigned char>& out, unsigned int value)
+    {
+        for (int i = 0; i < 4; i++)
+            out.push_back((unsigned char)(value >> (8 * i)));
+    }
+    static void put64(std::vector<unsigned char>& out, unsigned long long value)
+    {
+        put32(out, (unsigned int)value);
+        put32(out, (unsigned int)(value >> 32));
+    }
+    static void set64(std::vector<unsigned char>& out, size_t at, unsigned long long value)
+    {
+        for (int i = 0; i < 8; i++)
+            out[at + i] = (unsigned char)(value >> (8 * i));
+    }
+    static void pad(std::vector<unsigned char>& out, size_t alignment)
+    {
+        while (out.size() % alignment)
+            out.push_back(0);
+    }
+
+    bool open(const std::string& path, const std::string& stamp, CachedTexture& texture) const
+    {
+        if (!texture.file.open(path.c_str()))
+            return false;
+        const unsigned char* p = texture.file.data();
+        size_t size = texture.file.size();
+        // an entry holds the cache's format, or RGBA8 for a source with alpha
+        unsigned int stored = size < 80 ? 0 : read32(p + 12);
+        int entryFormat = stored == vkFormat(format) ? format : CACHE_FORMAT_RGBA8;
+        if (size < 80 || memcmp(p, identifier(), 12) != 0 || stored != vkFormat(entryFormat))
+        {
+            texture.file.close();
+            return false;
+        }
+        int width = (int)read32(p + 20), height = (int)read32(p + 24);
+        unsigned int levelCount = read32(p + 40);
+        unsigned int kvdOffset = read32(p + 56), kvdLength = read32(p + 60);
+        if (levelCount == 0 || 80 + (size_t)levelCount * 24 > size || (size_t)kvdOffset + kvdLength > size
+            || !hasStamp(p + kvdOffset, kvdLength, stamp))
+        {
+            texture.file.close();
+            return false;
+        }
+        texture.format = entryFormat;
+        texture.levels.clear();
+        for (unsigned int level = 0; level < levelCount; level++)
+        {
+            const unsigned char* entry = p + 80 + level * 24;
+            unsigned long long offset = read64(entry), length = read64(entry + 8);
+            CachedLevel cached;
+            cached.width = width >> level > 0 ? width >> level : 1;
+            cached.height = height >> level > 0 ? height >> level : 1;
+            cached.data = p + offset;
+            cached.size = (size_t)length;
+            if (offset + length > size || cached.size != levelSize(entryFormat, cached.width, cached.height))
+            {
+                texture.file.close();
+                return false;
+            }
+            texture.levels.push_back(cached);
+        }
+        return true;
+    }
+
+    static bool hasStamp(const unsigned char* kvd, unsigned int length, const std::string& stamp)
+    {
+        static const char key[] = "OpenGLcode.source";
+        unsigned int at = 0;
+        while (at + 4 <= length)
+        {
+            unsigned int entryLength = read32(kvd + at);
+            const char* entry = (const char*)kvd + at + 4;
+            if (at + 4 + entryLength > length)
+                return false;
+            if (entryLength == sizeof(key) + stamp.size() + 1 && memcmp(entry, key, sizeof(key)) == 0
+                && memcmp(entry + sizeof(key), stamp.c_str(), stamp.size() + 1) == 0)
+                return true;
+            at += 4 + ((entryLength + 3) & ~3u);
+        }
+        return false;
+    }
+
+    // decodes source, builds the mip chain, transcodes every level and writes the KTX2 file to path
+    bool build(const std::string& source, const std::string& path, const std::string& stamp, int maxSize) const
+    {
+        // sized from the header, so the decoder writes RGBA straight into it
+        MappedFile image;
+        int width, height, channels;
+        stbi_set_jpeg_max_dimension_thread(maxSize);
+        if (!image.open(source.c_str())
+            || !stbi_info_from_memory(image.data(), (int)image.size(), &width, &height, &channels))
+            return false;
+        int entryFormat = channels == 2 || channels == 4 ? CACHE_FORMAT_RGBA8 : format;
+        std::vector<unsigned char> pixels((size_t)width * height * 4);
+        {
+            ScopedDecodeArena scratch;
+            if (!stbi_load_from_memory_into(image.data(), (int)image.size(), pixels.data(), width * 4, height,
+                                            &width, &height, &channels, 4))
+                return false;
+        }
+        image.close();
+
+        std::vector<std::vector<unsigned char> > levels;
+        levels.push_back(encodeLevel(entryFormat, pixels.data(), width, height));
+        std::vector<MipLevel> mips = generateMipChain(pixels.data(), width, height, 4, filter, workers);
+        std::vector<unsigned char>().swap(pixels);
+        for (size_t i = 0; i < mips.size(); i++)
+        {
+            levels.push_back(encodeLevel(entryFormat, mips[i].pixels.data(), mips[i].width, mips[i].height));
+            std::vector<unsigned char>().swap(mips[i].pixels);
+        }
+
+        std::vector<unsigned char> file(identifier(), identifier() + 12);
+        put32(file, vkFormat(entryFormat));
+        put32(file, 1);                         // typeSize
+        put32(file, width);
+        put32(file, height);
+        put32(file, 0);                         // pixelDepth
+        put32(file, 0);                         // layerCount
+        put32(file, 1);                         // faceCount
+        put32(file, (unsigned int)levels.size());
+        put32(file, 0);                         // supercompressionScheme
+        std::vector<unsigned char> dfd = dataFormatDescriptor(entryFormat);
+        std::vector<unsigned char> kvd = keyValueData(stamp);
+        size_t indexEnd = 80 + levels.size() * 24;
+        put32(file, (unsigned int)indexEnd);
+        put32(file, (unsigned int)dfd.size());
+        put32(file, (unsigned int)(indexEnd + dfd.size()));
+        put32(file, (unsigned int)kvd.size());
+        put64(file, 0);                         // sgdByteOffset
+        put64(file, 0);                         // sgdByteLength
+        size_t levelIndex = file.size();
+        file.resize(indexEnd, 0);
+        file.insert(file.end(), dfd.begin(), dfd.end());
+        file.insert(file.end(), kvd.begin(), kvd.end());
+        // level data is stored smallest mip first
+        size_t alignment = isCompressed(entryFormat) ? 8 : 4;
+        for (size_t level = levels.size(); level-- > 0;)
+        {
+            pad(file, alignment);
+            set64(file, levelIndex + level * 24, file.size());
+            set64(file, levelIndex + level * 24 + 8, levels[level].size());
+            set64(file, levelIndex + level * 24 + 16, levels[level].size());
+            file.insert(file.end(), levels[level].begin(), levels[level].end());
+        }
+
+        // write to a private temporary and rename it into place so readers never see half a file
+        std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        FILE* out = fopen(temporary.c_str(), "wb");
+        if (!out)
+            return false;
+        bool written = fwrite(file.data(), 1, file.size(), out) == file.size();
+        written = fclose(out) == 0 && written;
+        if (written)
+        {
+            remove(path.c_str());
+            written = rename(temporary.c_str(), path.c_str()) == 0;
+        }
+        if (!written)
+            remove(temporary.c_str());
+        return written;
+    }
+
+    static std::vector<unsigned char> encodeLevel(int cacheFormat, const unsigned char* rgba, int width, int height)
+    {
+        if (!isCompressed(cacheFormat))
+            return std::vector<unsigned char>(rgba, rgba + (size_t)width * height * 4);
+        std::vector<unsigned char> blocks(levelSize(cacheFormat, width, height));
+        blockcompression::compressImage(rgba, width, height,
+            cacheFormat == CACHE_FORMAT_BC1 ? blockcompression::encodeBC1Block : blockcompression::encodeETC2Block, blocks.data());
+        return blocks;
+    }
+
+    // Khronos basic data format descriptor for a cache format
+    static std::vector<unsigned char> dataFormatDescriptor(int cacheFormat)
+    {
+        std::vector<unsigned char> dfd;
+        int samples = isCompressed(cacheFormat) ? 1 : 4;
+        put32(dfd, 4 + 24 + 16 * samples);                   // dfdTotalSize
+        put32(dfd, 0);                                       // vendorId, descriptorType
+        put32(dfd, 2 | ((24 + 16 * samples) << 16));         // versionNumber, descriptorBlockSize
+        if (isCompressed(cacheFormat))
+        {
+            unsigned int model = cacheFormat == CACHE_FORMAT_BC1 ? 128 : 161; // KHR_DF_MODEL_BC1A / ETC2
+            put32(dfd, model | (1 << 8) | (1 << 16));        // BT709 primaries, linear transfer
+            put32(dfd, 3 | (3 << 8));                        // 4x4 texel blocks
+            put32(dfd, 8);                                   // bytesPlane0
+            put32(dfd, 0);
+            unsigned int channel = cacheFormat == CACHE_FORMAT_BC1 ? 0 : 2; // BC1A_COLOR / ETC2_COLOR
+            put32(dfd, 0 | (63 << 16) | (channel << 24));
+            put32(dfd, 0);
+            put32(dfd, 0);
+            put32(dfd, 0xFFFFFFFFu);
+        }
+        else
+        {
+            put32(dfd, 1 | (1 << 8) | (1 << 16));            // KHR_DF_MODEL_RGBSDA, BT709, linear
+            put32(dfd, 0);                                   // 1x1 texel blocks
+            put32(dfd, 4);                                   // bytesPlane0
+            put32(dfd, 0);
+            static const unsigned int channels[4] = { 0, 1, 2, 15 }; // R, G, B, A
+            for (int c = 0; c < 4; c++)
+            {
+                put32(dfd, (8 * c) | (7 << 16) | (channels[c] << 24));
+                put32(dfd, 0);
+                put32(dfd, 0);
+                put32(dfd, 255);
+            }
+        }
+        return dfd;
+    }
+
+    static std::vector<unsigned char> keyValueData(const std::string& stamp)
+    {
+        std::vector<unsigned char> kvd;
+        static const char key[] = "OpenGLcode.source";
+        put32(kvd, (unsigned int)(sizeof(key) + stamp.size() + 1));
+        kvd.insert(kvd.end(), key, key + sizeof(key));
+        kvd.insert(kvd.end(), stamp.c_str(), stamp.c_str() + stamp.size() + 1);
+        pad(kvd, 4);
+        return kvd;
+    }
+};
+
+#endif
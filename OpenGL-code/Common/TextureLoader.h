@@ -0,0 +1,420 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <GL/glew.h>
+
+#include "../Q3/stb_image.h"
+#include "DecodeArena.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// asynchronous texture loader
+// ---------------------------
+// load() returns immediately with a handle whose texture() is a small placeholder. Worker
+// threads memory-map the image file (or read it through stdio when it cannot be mapped) and
+// read its header first; update(), called once per frame on the GL thread, allocates the real
+// texture from that size and channel count while the worker is still decoding, then streams
+// the decoded pixels into it through a pixel-unpack buffer, at most uploadBudget bytes per
+// frame, and swaps the handle over once every row is in.
+// Storage is immutable (glTexStorage2D, whole mip chain) when available, in the image's own
+// channel count. Mipmapped textures get their chain from MipGenerator on the worker, so the
+// driver never runs a glGenerateMipmap pass.
+// With enableCache() the workers go through a TextureCache instead and the GL thread
+// uploads the cached, usually block-compressed, mip levels straight from the mapped file.
+// Decoder scratch memory comes from each worker's DecodeArena, so only the pixels hit the heap.
+// The loader also installs its pool as stb_image's (process-wide) parallel-for hook, so keep
+// one loader alive at a time.
+// Include this header before the translation unit that defines STB_IMAGE_IMPLEMENTATION.
+class TextureLoader
+{
+public:
+    // creates the placeholder texture and the upload buffer; needs a current GL context
+    TextureLoader(unsigned int workerCount = 0, size_t uploadBudget = 4 * 1024 * 1024)
+        : budget(uploadBudget), pool(new ThreadPool(workerCount))
+    {
+        // 2x2 grey checker shown until the real image is ready
+        unsigned char checker[] = {
+            96, 96, 96,     160, 160, 160,
+            160, 160, 160,  96, 96, 96
+        };
+        glGenTextures(1, &placeholder);
+        glBindTexture(GL_TEXTURE_2D, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 2, 2, 0, GL_RGB, GL_UNSIGNED_BYTE, checker);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glGenBuffers(1, &PBO);
+
+        // let stb_image split restart segments and colour conversion of large JPEGs across the pool
+        stbi_set_parallel_for(runParallel, pool.get());
+    }
+    // stops the workers and frees pending pixels; GL objects are released separately with release()
+    ~TextureLoader()
+    {
+        // joins the workers first so no decode still writes to an entry
+        stbi_set_parallel_for(NULL, NULL);
+        pool.reset();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            stbi_image_free(entries[i]->pixels);
+            delete entries[i];
+        }
+    }
+
+    // routes every later load() through a GPU-ready cache in the given TextureCacheFormat
+    // (usually TextureCache::supportedFormat()); sources that cannot be cached are decoded as usual
+    void enableCache(int format)
+    {
+        cache.reset(new TextureCache(format, filter, pool.get()));
+    }
+
+    // filter for CPU-generated mip levels of later load()s (and of a cache enabled afterwards)
+    void setMipFilter(MipFilter mipFilter)
+    {
+        filter = mipFilter;
+    }
+
+    // queues path for decoding and returns its handle. wrap/filter parameters are applied to
+    // the real texture; mip levels are built on the CPU when minFilter uses them. A nonzero
+    // maxSize (say, the largest on-screen size of the textured shape) lets a JPEG decode at 1/2,
+    // 1/4 or 1/8 size as long as its larger side stays at least that big.
+    int load(const char* path, int wrap = GL_REPEAT, int minFilter = GL_NEAREST, int magFilter = GL_LINEAR,
+             int maxSize = 0)
+    {
+        Entry* entry = new Entry();
+        entry->path = path;
+        entry->wrap = wrap;
+        entry->minFilter = minFilter;
+        entry->magFilter = magFilter;
+        entry->maxSize = maxSize;
+        entries.push_back(entry);
+        const TextureCache* textureCache = cache.get();
+        ThreadPool* workers = pool.get();
+        MipFilter mipFilter = filter;
+        pool->enqueue([entry, textureCache, workers, mipFilter]() { decode(entry, textureCache, workers, mipFilter); });
+        return (int)entries.size() - 1;
+    }
+
+    // the texture to bind for handle this frame: the placeholder until the image is uploaded
+    unsigned int texture(int handle) const
+    {
+        const Entry* entry = entries[handle];
+        return entry->state == READY ? entry->texture : placeholder;
+    }
+    bool ready(int handle) const
+    {
+        return entries[handle]->state == READY;
+    }
+    bool failed(int handle) const
+    {
+        return entries[handle]->state == FAILED;
+    }
+
+    // uploads decoded rows, at most the per-frame budget; GL thread only. Leaves GL_TEXTURE_2D
+    // bound to whichever texture was touched last.
+    void update()
+    {
+        size_t remaining = budget;
+        for (size_t i = 0; i < entries.size() && remaining > 0; i++)
+        {
+            Entry* entry = entries[i];
+            int state = entry->state;
+            if ((state == PROBED || state == DECODED) && !entry->texture)
+                createTexture(entry);
+            if (state == DECODED)
+                entry->state = UPLOADING;
+            else if (state == FAILED && entry->texture)
+            {
+                // the header was fine but the pixels were not
+                glDeleteTextures(1, &entry->texture);
+                entry->texture = 0;
+            }
+            if (entry->state == UPLOADING)
+            {
+                size_t used = entry->cached ? uploadLevels(entry, remaining) : uploadRows(entry, remaining);
+                remaining = used < remaining ? remaining - used : 0;
+            }
+        }
+    }
+
+    // deletes every GL object the loader created
+    void release()
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i]->texture)
+                glDeleteTextures(1, &entries[i]->texture);
+            entries[i]->texture = 0;
+        }
+        glDeleteTextures(1, &placeholder);
+        glDeleteBuffers(1, &PBO);
+        placeholder = PBO = 0;
+    }
+
+private:
+    enum State { QUEUED, PROBED, DECODED, UPLOADING, READY, FAILED };
+
+    // width, height and channels are written by a worker before it publishes PROBED (or,
+    // for cached textures, DECODED) and never change after; the decoded fields are written
+    // before it publishes DECODED. The GL thread only reads each after it has seen that state.
+    struct Entry
+    {
+        std::string path;
+        int wrap, minFilter, magFilter, maxSize;
+        std::atomic<int> state { QUEUED };
+        int width = 0, height = 0, channels = 0;
+        unsigned char* pixels = NULL;
+        std::vector<MipLevel> mips;
+        std::unique_ptr<CachedTexture> cached;
+        int levelsUploaded = 0, rowsUploaded = 0;
+        bool immutable = false;
+        unsigned int texture = 0;
+    };
+
+    size_t budget;
+    MipFilter filter = MIP_FILTER_BOX;
+    unsigned int placeholder, PBO;
+    std::vector<Entry*> entries;
+    std::unique_ptr<TextureCache> cache;
+    std::unique_ptr<ThreadPool> pool;
+
+    // stb_image's parallel-for hook; decodes already running on a worker join in through parallelFor
+    static void runParallel(void* user, int count, void (*task)(void* arg, int index), void* arg)
+    {
+        static_cast<ThreadPool*>(user)->parallelFor(count, [task, arg](int index) { task(arg, index); });
+    }
+
+    // worker thread: map the cache entry, or map (failing that, open) the source file, publish
+    // its header, decode it and build its mip chain when the min filter samples one
+    static void decode(Entry* entry, const TextureCache* cache, ThreadPool* workers, MipFilter filter)
+    {
+        if (cache)
+        {
+            std::unique_ptr<CachedTexture> cached(new CachedTexture());
+            if (cache->fetch(entry->path, *cached, entry->maxSize))
+            {
+                entry->width = cached->levels[0].width;
+                entry->height = cached->levels[0].height;
+                entry->channels = 4;
+                entry->cached = std::move(cached);
+                entry->state = DECODED;
+                return;
+            }
+        }
+
+        MappedFile file;
+        int width = 0, height = 0, channels = 0;
+        ScopedDecodeArena scratch;
+        // set before the probe too, so it reports the size the JPEG will be decoded at
+        stbi_set_jpeg_max_dimension_thread(entry->maxSize);
+        // a file that cannot be mapped is read through stdio instead, as stbi_load_mapped() does;
+        // one view serves both the probe and the decode
+        bool mapped = file.open(entry->path.c_str());
+        bool probed = mapped ? stbi_info_from_memory(file.data(), (int)file.size(), &width, &height, &channels) != 0
+                             : stbi_info(entry->path.c_str(), &width, &height, &channels) != 0;
+        if (!probed)
+        {
+            std::cout << "Failed to load texture " << entry->path << std::endl;
+            entry->state = FAILED;
+            return;
+        }
+        entry->width = width;
+        entry->height = height;
+        entry->channels = channels;
+        entry->state = PROBED;
+
+        // decoded to the probed channel count, whatever the loader would have picked itself
+        unsigned char* pixels = mapped ? stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &channels, entry->channels)
+                                       : stbi_load(entry->path.c_str(), &width, &height, &channels, entry->channels);
+        if (pixels && (width != entry->width || height != entry->height))
+        {
+            stbi_image_free(pixels);
+            pixels = NULL;
+        }
+        if (!pixels)
+        {
+            std::cout << "Failed to load texture " << entry->path << std::endl;
+            entry->state = FAILED;
+            return;
+        }
+        file.close();
+        entry->pixels = pixels;
+        if (usesMipmaps(entry->minFilter))
+            entry->mips = generateMipChain(pixels, width, height, entry->channels, filter, workers);
+        entry->state = DECODED;
+    }
+
+    static bool usesMipmaps(int minFilter)
+    {
+        return minFilter != GL_NEAREST && minFilter != GL_LINEAR;
+    }
+
+    // immutable storage lets the driver allocate the whole chain once, up front
+    static bool hasTextureStorage()
+    {
+        return GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    }
+
+    static unsigned int pixelFormat(int channels)
+    {
+        switch (channels)
+        {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 3: return GL_RGB;
+        default: return GL_RGBA;
+        }
+    }
+    static unsigned int sizedFormat(int channels)
+    {
+        switch (channels)
+        {
+        case 1: return GL_R8;
+        case 2: return GL_RG8;
+        case 3: return GL_RGB8;
+        default: return GL_RGBA8;
+        }
+    }
+
+    // allocates the texture, every level of it, as soon as the size is known; update() starts
+    // uploading once the pixels are in as well
+    void createTexture(Entry* entry)
+    {
+        unsigned int format = pixelFormat(entry->channels);
+        glGenTextures(1, &entry->texture);
+        glBindTexture(GL_TEXTURE_2D, entry->texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, entry->wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, entry->wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, entry->minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, entry->magFilter);
+        entry->immutable = hasTextureStorage();
+        if (entry->cached)
+        {
+            CachedTexture& cached = *entry->cached;
+            int levels = (int)cached.levels.size();
+            if (entry->immutable)
+                glTexStorage2D(GL_TEXTURE_2D, levels, TextureCache::internalFormat(cached.format), entry->width, entry->height);
+            else
+                // levels are specified one by one from the mapping in uploadLevels
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            return;
+        }
+        // the mip chain may not be built yet, but it will have every level down to 1x1
+        int levels = usesMipmaps(entry->minFilter) ? mipLevelCount(entry->width, entry->height) : 1;
+        if (entry->immutable)
+            glTexStorage2D(GL_TEXTURE_2D, levels, sizedFormat(entry->channels), entry->width, entry->height);
+        else
+        {
+            int width = entry->width, height = entry->height;
+            for (int level = 0; level < levels; level++)
+            {
+                glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+                width = width > 1 ? width / 2 : 1;
+                height = height > 1 ? height / 2 : 1;
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        }
+        if (entry->channels <= 2)
+        {
+            // keep grey (+ alpha) images grey instead of red (+ green)
+            int swizzle[] = { GL_RED, GL_RED, GL_RED, entry->channels == 2 ? GL_GREEN : GL_ONE };
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+    }
+
+    // copies the next band of rows of the current level through the PBO and returns the bytes it used
+    size_t uploadRows(Entry* entry, size_t allowance)
+    {
+        int level = entry->levelsUploaded;
+        int width = level ? entry->mips[level - 1].width : entry->width;
+        int height = level ? entry->mips[level - 1].height : entry->height;
+        const unsigned char* pixels = level ? entry->mips[level - 1].pixels.data() : entry->pixels;
+        size_t rowBytes = (size_t)width * entry->channels;
+        int rows = (int)(allowance / rowBytes);
+        if (rows < 1)
+            rows = 1; // always make progress, even on rows wider than the budget
+        if (rows > height - entry->rowsUploaded)
+            rows = height - entry->rowsUploaded;
+        size_t bytes = rowBytes * rows;
+        const unsigned char* band = pixels + rowBytes * entry->rowsUploaded;
+
+        glBindTexture(GL_TEXTURE_2D, entry->texture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        // orphan the previous band so the driver never stalls on a buffer still being read
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        bool staged = mapped != NULL;
+        if (staged)
+        {
+            memcpy(mapped, band, bytes);
+            // false when the store was lost while mapped, leaving it undefined
+            staged = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+        }
+        // a band that could not be staged goes straight from client memory, so the entry still
+        // finishes instead of retrying the same rows every frame
+        if (!staged)
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, entry->rowsUploaded, width, rows, pixelFormat(entry->channels), GL_UNSIGNED_BYTE, staged ? (void*)0 : band);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        entry->rowsUploaded += rows;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (entry->rowsUploaded == height)
+        {
+            entry->rowsUploaded = 0;
+            entry->levelsUploaded++;
+            if (entry->levelsUploaded > (int)entry->mips.size())
+            {
+                stbi_image_free(entry->pixels);
+                entry->pixels = NULL;
+                std::vector<MipLevel>().swap(entry->mips);
+                entry->state = READY;
+            }
+        }
+        return bytes;
+    }
+
+    // uploads whole cached mip levels, largest first, until the allowance is spent; returns the bytes used
+    size_t uploadLevels(Entry* entry, size_t allowance)
+    {
+        CachedTexture& cached = *entry->cached;
+        unsigned int format = TextureCache::internalFormat(cached.format);
+        size_t used = 0;
+        glBindTexture(GL_TEXTURE_2D, entry->texture);
+        while (entry->levelsUploaded < (int)cached.levels.size() && used < allowance)
+        {
+            const CachedLevel& level = cached.levels[entry->levelsUploaded];
+            bool compressed = TextureCache::isCompressed(cached.format);
+            if (entry->immutable && compressed)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, entry->levelsUploaded, 0, 0, level.width, level.height, format, (int)level.size, level.data);
+            else if (entry->immutable)
+                glTexSubImage2D(GL_TEXTURE_2D, entry->levelsUploaded, 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, level.data);
+            else if (compressed)
+                glCompressedTexImage2D(GL_TEXTURE_2D, entry->levelsUploaded, format, level.width, level.height, 0, (int)level.size, level.data);
+            else
+                glTexImage2D(GL_TEXTURE_2D, entry->levelsUploaded, format, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.data);
+            used += level.size;
+            entry->levelsUploaded++;
+        }
+        if (entry->levelsUploaded == (int)cached.levels.size())
+        {
+            entry->cached.reset();
+            entry->state = READY;
+        }
+        return used;
+    }
+};
+
+#endif
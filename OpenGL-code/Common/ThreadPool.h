@@ -0,0 +1,127 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed-size pool of worker threads pulling tasks from one FIFO queue
+// -------------------------------------------------------------------
+class ThreadPool
+{
+public:
+    // threadCount 0 picks one worker per hardware thread, leaving one for the render thread
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            threadCount = hardware > 1 ? hardware - 1 : 1;
+        }
+        stopping = false;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::run, this));
+    }
+    // drops tasks that have not started yet and waits for the running ones
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            tasks.clear();
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    void enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // runs body(0) .. body(count - 1) across the pool and the calling thread, returning when all are done
+    void parallelFor(int count, const std::function<void(int)>& body)
+    {
+        if (count <= 0)
+            return;
+        if (count == 1)
+        {
+            body(0);
+            return;
+        }
+        struct Job
+        {
+            std::mutex mutex;
+            std::condition_variable finished;
+            int next, done, count;
+        };
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->next = 0;
+        job->done = 0;
+        job->count = count;
+        const std::function<void(int)>* work = &body;
+        // each helper keeps claiming indices until none are left, so a slow index does not stall the rest
+        std::function<void()> drain = [job, work]() {
+            for (;;)
+            {
+                int index;
+                {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    if (job->next >= job->count)
+                        return;
+                    index = job->next++;
+                }
+                (*work)(index);
+                std::lock_guard<std::mutex> lock(job->mutex);
+                if (++job->done == job->count)
+                    job->finished.notify_all();
+            }
+        };
+        unsigned int helpers = (unsigned int)count - 1 < size() ? (unsigned int)count - 1 : size();
+        for (unsigned int i = 0; i < helpers; i++)
+            enqueue(drain);
+        drain();
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job]() { return job->done == job->count; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping)
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef YUV_CONVERTER_H
+#define YUV_CONVERTER_H
+
+#include "CpuFeatures.h"
+
+#include <cstddef>
+#include <vector>
+
+// RGBA8 to planar YUV 4:2:0 (I420)
+// --------------------------------
+// BT.601 limited range in 8.8 fixed point, the matrix video encoders assume for standard
+// definition and Y4M readers default to. Luma is per pixel; each chroma sample is taken from the
+// rounded average of a 2x2 block, which puts it at the block's centre (Y4M's "420jpeg" siting).
+// The kernels convert a pair of rows at a time; every path computes exactly the same integers, so
+// the output does not depend on the machine:
+//   Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16
+//   U = ((-38 R - 74 G + 112 B + 128) >> 8) + 128      (R, G, B the block averages)
+//   V = ((112 R - 94 G - 18 B + 128) >> 8) + 128
+
+namespace yuv
+{
+    // ---------------------------------------------------------------- row pair kernels
+    // top and bottom are rows of width RGBA8 pixels; y0 and y1 get their luma, u and v the chroma
+    // of the pair, (width + 1) / 2 samples. The SIMD kernels return how many pixels from the
+    // first they did (a multiple of 16); the scalar one does the pixels from first on, which must
+    // be even, repeating the last column when width is odd.
+
+    inline void rowPairScalar(const unsigned char* top, const unsigned char* bottom, int width, unsigned char* y0,
+                              unsigned char* y1, unsigned char* u, unsigned char* v, int first)
+    {
+        for (int x = first; x < width; x += 2)
+        {
+            int next = x + 1 < width ? x + 1 : x;
+            const unsigned char* p[4] = { top + x * 4, top + next * 4, bottom + x * 4, bottom + next * 4 };
+            int sum[3] = { 0, 0, 0 };
+            for (int i = 0; i < 4; i++)
+                for (int c = 0; c < 3; c++)
+                    sum[c] += p[i][c];
+            for (int i = 0; i < 4; i++)
+            {
+                if ((i & 1) && next == x)
+                    continue;
+                unsigned char* luma = (i < 2 ? y0 : y1) + x + (i & 1);
+                *luma = (unsigned char)(((66 * p[i][0] + 129 * p[i][1] + 25 * p[i][2] + 128) >> 8) + 16);
+            }
+            int r = (sum[0] + 2) >> 2, g = (sum[1] + 2) >> 2, b = (sum[2] + 2) >> 2;
+            u[x / 2] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[x / 2] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+#ifdef CPU_SSE2
+    // R, G and B of 8 pixels as 16-bit lanes
+    inline void channelsSSE2(const unsigned char* pixels, __m128i& r, __m128i& g, __m128i& b)
+    {
+        const __m128i low = _mm_set1_epi32(0xFF);
+        __m128i a = _mm_loadu_si128((const __m128i*)pixels), c = _mm_loadu_si128((const __m128i*)(pixels + 16));
+        r = _mm_packs_epi32(_mm_and_si128(a, low), _mm_and_si128(c, low));
+        g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), low), _mm_and_si128(_mm_srli_epi32(c, 8), low));
+        b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), low), _mm_and_si128(_mm_srli_epi32(c, 16), low));
+    }
+
+    // the luma sum stays below 2^16, so 16-bit wrapping products and a logical shift are exact
+    inline __m128i lumaSSE2(__m128i r, __m128i g, __m128i b)
+    {
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+        return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+    }
+
+    // rounded 2x2 averages of 8 columns of two rows, as 4 32-bit lanes
+    inline __m128i averageSSE2(__m128i top, __m128i bottom)
+    {
+        __m128i pairs = _mm_madd_epi16(_mm_add_epi16(top, bottom), _mm_set1_epi16(1));
+        return _mm_srai_epi32(_mm_add_epi32(pairs, _mm_set1_epi32(2)), 2);
+    }
+
+    // the chroma sums lie within +-28688, inside 16 bits
+    inline __m128i chromaSSE2(__m128i r, __m128i g, __m128i b, short kr, short kg, short kb)
+    {
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(kr)), _mm_mullo_epi16(g, _mm_set1_epi16(kg)));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(kb)), _mm_set1_epi16(128)));
+        return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+    }
+
+    inline int rowPairSSE2(const unsigned char* top, const unsigned char* bottom, int width, unsigned char* y0,
+                           unsigned char* y1, unsigned char* u, unsigned char* v)
+    {
+        int done = 0;
+        for (; done + 16 <= width; done += 16)
+        {
+            __m128i r[4], g[4], b[4];
+            channelsSSE2(top + done * 4, r[0], g[0], b[0]);
+            channelsSSE2(top + done * 4 + 32, r[1], g[1], b[1]);
+            channelsSSE2(bottom + done * 4, r[2], g[2], b[2]);
+            channelsSSE2(bottom + done * 4 + 32, r[3], g[3], b[3]);
+            _mm_storeu_si128((__m128i*)(y0 + done), _mm_packus_epi16(lumaSSE2(r[0], g[0], b[0]), lumaSSE2(r[1], g[1], b[1])));
+            _mm_storeu_si128((__m128i*)(y1 + done), _mm_packus_epi16(lumaSSE2(r[2], g[2], b[2]), lumaSSE2(r[3], g[3], b[3])));
+            __m128i ra = _mm_packs_epi32(averageSSE2(r[0], r[2]), averageSSE2(r[1], r[3]));
+            __m128i ga = _mm_packs_epi32(averageSSE2(g[0], g[2]), averageSSE2(g[1], g[3]));
+            __m128i ba = _mm_packs_epi32(averageSSE2(b[0], b[2]), averageSSE2(b[1], b[3]));
+            __m128i chroma = _mm_packus_epi16(chromaSSE2(ra, ga, ba, -38, -74, 112), chromaSSE2(ra, ga, ba, 112, -94, -18));
+            _mm_storel_epi64((__m128i*)(u + done / 2), chroma);
+            _mm_storel_epi64((__m128i*)(v + done / 2), _mm_srli_si128(chroma, 8));
+        }
+        return done;
+    }
+#endif
+
+#ifdef CPU_X86
+    // R, G and B of 16 pixels as 16-bit lanes, in pixel order
+    TARGET_AVX2 inline void channelsAVX2(const unsigned char* pixels, __m256i& r, __m256i& g, __m256i& b)
+    {
+        const __m256i low = _mm256_set1_epi32(0xFF);
+        __m256i a = _mm256_loadu_si256((const __m256i*)pixels), c = _mm256_loadu_si256((const __m256i*)(pixels + 32));
+        // packs works within 128-bit lanes; the permute puts the pixels back in order
+        r = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(a, low), _mm256_and_si256(c, low)), 0xD8);
+        g = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 8), low),
+                                                        _mm256_and_si256(_mm256_srli_epi32(c, 8), low)), 0xD8);
+        b = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 16), low),
+                                                        _mm256_and_si256(_mm256_srli_epi32(c, 16), low)), 0xD8);
+    }
+
+    TARGET_AVX2 inline __m256i lumaAVX2(__m256i r, __m256i g, __m256i b)
+    {
+        __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)), _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+        sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(25)), _mm256_set1_epi16(128)));
+        return _mm256_add_epi16(_mm256_srli_epi16(sum, 8), _mm256_set1_epi16(16));
+    }
+
+    // 8 chroma samples from the 32-bit block averages
+    TARGET_AVX2 inline __m256i chromaAVX2(__m256i r, __m256i g, __m256i b, int kr, int kg, int kb)
+    {
+        __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(kr)), _mm256_mullo_epi32(g, _mm256_set1_epi32(kg)));
+        sum = _mm256_add_epi32(sum, _mm256_add_epi32(_mm256_mullo_epi32(b, _mm256_set1_epi32(kb)), _mm256_set1_epi32(128)));
+        return _mm256_add_epi32(_mm256_srai_epi32(sum, 8), _mm256_set1_epi32(128));
+    }
+
+    TARGET_AVX2 inline int rowPairAVX2(const unsigned char* top, const unsigned char* bottom, int width, unsigned char* y0,
+                                       unsigned char* y1, unsigned char* u, unsigned char* v)
+    {
+        const __m256i ones = _mm256_set1_epi16(1), two = _mm256_set1_epi32(2);
+        int done = 0;
+        for (; done + 16 <= width; done += 16)
+        {
+            __m256i rt, gt, bt, rb, gb, bb;
+            channelsAVX2(top + done * 4, rt, gt, bt);
+            channelsAVX2(bottom + done * 4, rb, gb, bb);
+            // [top 0-7, bottom 0-7, top 8-15, bottom 8-15] reordered to top then bottom
+            __m256i luma = _mm256_permute4x64_epi64(_mm256_packus_epi16(lumaAVX2(rt, gt, bt), lumaAVX2(rb, gb, bb)), 0xD8);
+            _mm_storeu_si128((__m128i*)(y0 + done), _mm256_castsi256_si128(luma));
+            _mm_storeu_si128((__m128i*)(y1 + done), _mm256_extracti128_si256(luma, 1));
+            __m256i ra = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_add_epi16(rt, rb), ones), two), 2);
+            __m256i ga = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_add_epi16(gt, gb), ones), two), 2);
+            __m256i ba = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_add_epi16(bt, bb), ones), two), 2);
+            // [U 0-3, V 0-3, U 4-7, V 4-7] reordered to U then V, then narrowed to bytes per lane
+            __m256i chroma = _mm256_permute4x64_epi64(_mm256_packs_epi32(chromaAVX2(ra, ga, ba, -38, -74, 112),
+                                                                         chromaAVX2(ra, ga, ba, 112, -94, -18)), 0xD8);
+            chroma = _mm256_packus_epi16(chroma, chroma);
+            _mm_storel_epi64((__m128i*)(u + done / 2), _mm256_castsi256_si128(chroma));
+            _mm_storel_epi64((__m128i*)(v + done / 2), _mm256_extracti128_si256(chroma, 1));
+        }
+        return done;
+    }
+#endif
+
+#ifdef CPU_NEON
+    inline uint8x8_t lumaNEON(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+    {
+        uint16x8_t sum = vmlal_u8(vmlal_u8(vmull_u8(r, vdup_n_u8(66)), g, vdup_n_u8(129)), b, vdup_n_u8(25));
+        return vadd_u8(vshrn_n_u16(vaddq_u16(sum, vdupq_n_u16(128)), 8), vdup_n_u8(16));
+    }
+
+    inline uint8x8_t chromaNEON(int16x8_t r, int16x8_t g, int16x8_t b, short kr, short kg, short kb)
+    {
+        int16x8_t sum = vmlaq_n_s16(vmlaq_n_s16(vmulq_n_s16(r, kr), g, kg), b, kb);
+        sum = vshrq_n_s16(vaddq_s16(sum, vdupq_n_s16(128)), 8);
+        return vqmovun_s16(vaddq_s16(sum, vdupq_n_s16(128)));
+    }
+
+    inline int rowPairNEON(const unsigned char* top, const unsigned char* bottom, int width, unsigned char* y0,
+                           unsigned char* y1, unsigned char* u, unsigned char* v)
+    {
+        int done = 0;
+        for (; done + 16 <= width; done += 16)
+        {
+            uint8x16x4_t t = vld4q_u8(top + done * 4), d = vld4q_u8(bottom + done * 4);
+            vst1q_u8(y0 + done, vcombine_u8(lumaNEON(vget_low_u8(t.val[0]), vget_low_u8(t.val[1]), vget_low_u8(t.val[2])),
+                                            lumaNEON(vget_high_u8(t.val[0]), vget_high_u8(t.val[1]), vget_high_u8(t.val[2]))));
+            vst1q_u8(y1 + done, vcombine_u8(lumaNEON(vget_low_u8(d.val[0]), vget_low_u8(d.val[1]), vget_low_u8(d.val[2])),
+                                            lumaNEON(vget_high_u8(d.val[0]), vget_high_u8(d.val[1]), vget_high_u8(d.val[2]))));
+            // pairwise sums of the top row plus those of the bottom, then (sum + 2) >> 2
+            int16x8_t average[3];
+            for (int c = 0; c < 3; c++)
+                average[c] = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(t.val[c]), d.val[c]), 2));
+            vst1_u8(u + done / 2, chromaNEON(average[0], average[1], average[2], -38, -74, 112));
+            vst1_u8(v + done / 2, chromaNEON(average[0], average[1], average[2], 112, -94, -18));
+        }
+        return done;
+    }
+#endif
+
+    inline void rowPair(const unsigned char* top, const unsigned char* bottom, int width, unsigned char* y0, unsigned char* y1,
+                        unsigned char* u, unsigned char* v)
+    {
+        int done = 0;
+#if defined(CPU_X86)
+        if (cpufeatures::hasAVX2())
+            done = rowPairAVX2(top, bottom, width, y0, y1, u, v);
+#if defined(CPU_SSE2)
+        else
+            done = rowPairSSE2(top, bottom, width, y0, y1, u, v);
+#endif
+#elif defined(CPU_NEON)
+        done = rowPairNEON(top, bottom, width, y0, y1, u, v);
+#endif
+        rowPairScalar(top, bottom, width, y0, y1, u, v, done);
+    }
+
+    // ---------------------------------------------------------------- whole images
+
+    // bytes of a width x height I420 image: the Y plane, then U, then V
+    inline size_t frameBytes(int width, int height)
+    {
+        size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+        return (size_t)width * height + 2 * chroma;
+    }
+
+    // converts width x height RGBA8 pixels, rows stride bytes apart from the top one (negative
+    // for bottom-up images such as glReadPixels returns), into an I420 image at out
+    inline void rgbaToI420(const unsigned char* rgba, std::ptrdiff_t stride, int width, int height, unsigned char* out)
+    {
+        int chromaWidth = (width + 1) / 2;
+        unsigned char* yPlane = out;
+        unsigned char* uPlane = out + (size_t)width * height;
+        unsigned char* vPlane = uPlane + (size_t)chromaWidth * ((height + 1) / 2);
+        std::vector<unsigned char> spare(height & 1 ? width : 0);
+        for (int y = 0; y < height; y += 2)
+        {
+            // an odd last row pairs with itself; its copy of the luma goes nowhere
+            bool single = y + 1 == height;
+            const unsigned char* top = rgba + y * stride;
+            unsigned char* row = yPlane + (size_t)y * width;
+            rowPair(top, single ? top : top + stride, width, row, single ? spare.data() : row + width,
+                    uPlane + (size_t)(y / 2) * chromaWidth, vPlane + (size_t)(y / 2) * chromaWidth);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,281 @@
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../Common/FrameCapture.h"
+#include "Scenes.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Q3/stb_image.h"
+
+// every demo in one window
+// ------------------------
+// GLFW, the window, GLEW, the material program, the material table and the texture loader are
+// set up once, then every scene creates its buffers up front. Switching is only a change of
+// which scene render() is called on, so it costs microseconds instead of a relaunch.
+// Keys: 1-9 and 0 pick one of the first ten scenes, Left/Right step through all of them, Escape
+// quits. WASD pans and Q/E (or the mouse wheel) zoom the camera of scenes that use one. The first
+// argument may name the starting scene ("Ring", "Texture Disk", ...). Run from the Engine folder
+// so that ../Q3/Sea.jpg resolves.
+//
+// usage: Engine [SCENE] [--capture FILE] [--raw] [--fps N]
+//   --capture FILE  record every frame at the starting window size as a Y4M video (FrameCapture.h);
+//                   "-" writes to stdout, for piping into an encoder, and moves the log to stderr
+//   --raw           bare I420 frames instead of Y4M
+//   --fps N         the frame rate written into the Y4M header, 60 by default
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void processInput(GLFWwindow* window, float dt);
+
+// settings
+const unsigned int SCR_WIDTH = 1000;
+const unsigned int SCR_HEIGHT = 1000;
+
+// scene selection, written by the key callback and applied at the start of the next frame
+static int requestedScene = 0;
+static int sceneCount = 0;
+
+// the shared camera; framebuffer_size_callback keeps its viewport size current
+static Camera2D camera;
+
+int main(int argc, char** argv)
+{
+    const char* startScene = NULL;
+    std::string captureFile;
+    bool captureRaw = false;
+    int captureFps = 60;
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--capture") && hasValue)
+            captureFile = argv[++i];
+        else if (!std::strcmp(argv[i], "--raw"))
+            captureRaw = true;
+        else if (!std::strcmp(argv[i], "--fps") && hasValue)
+            captureFps = std::atoi(argv[++i]);
+        else
+            startScene = argv[i];
+    }
+    // the video owns stdout, so the log goes to stderr
+    if (captureFile == "-")
+        std::cout.rdbuf(std::cerr.rdbuf());
+
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
+#endif
+
+    // glfw window creation: 4.3 for the compute-shader scenes where the driver has it, else 3.3
+    // ------------------------------------------------------------------------------------------
+    GLFWwindow* window = NULL;
+    const int versions[2][2] = { { 4, 3 }, { 3, 3 } };
+    for (int i = 0; i < 2 && window == NULL; i++)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, versions[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, versions[i][1]);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Engine", NULL, NULL);
+    }
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    camera.resize(framebufferWidth, framebufferHeight);
+
+    // glew: load all OpenGL function pointers
+    // ---------------------------------------
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK)
+    {
+        std::cout << "Failed to initialize GLEW" << std::endl;
+        return -1;
+    }
+
+    // shared resources: one of each for every scene
+    // ---------------------------------------------
+    {
+        ShaderRegistry shaders;
+        MaterialTable materials;
+        TextureLoader textures;
+        textures.enableCache(TextureCache::supportedFormat());
+        SceneContext context(window, shaders, materials, textures, camera, SCR_WIDTH > SCR_HEIGHT ? SCR_WIDTH : SCR_HEIGHT);
+
+        std::vector<std::unique_ptr<Scene> > scenes;
+        registerScenes(scenes);
+        sceneCount = (int)scenes.size();
+        context.time = glfwGetTime();
+        auto initStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < scenes.size(); i++)
+            scenes[i]->init(context);
+        auto initEnd = std::chrono::steady_clock::now();
+        std::cout << "initialised " << scenes.size() << " scenes in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(initEnd - initStart).count() << " us" << std::endl;
+
+        for (int i = 0; startScene && i < sceneCount; i++)
+            if (!std::strcmp(startScene, scenes[i]->name()))
+                requestedScene = i;
+        int current = -1;
+        double lastFrame = glfwGetTime();
+
+        // capture: frames are read back and encoded behind the render loop, dropped rather than waited for
+        FrameCapture capture;
+        if (!captureFile.empty())
+        {
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            if (capture.start(captureFile, framebufferWidth, framebufferHeight, captureFps, captureRaw))
+                std::cout << "capturing " << framebufferWidth << " x " << framebufferHeight << " to " << captureFile << std::endl;
+            else
+                std::cout << "could not open " << captureFile << " for capture" << std::endl;
+        }
+
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(window))
+        {
+            // switch: the time from here to the end of the new scene's first render() is the
+            // whole cost of a scene change on the CPU side
+            bool switched = requestedScene != current;
+            auto switchStart = std::chrono::steady_clock::now();
+            int previous = current;
+            current = requestedScene;
+            Scene& scene = *scenes[current];
+
+            // input
+            // -----
+            double now = glfwGetTime();
+            processInput(window, (float)(now - lastFrame));
+            lastFrame = now;
+            context.time = now;
+
+            // upload whatever the loader has decoded
+            textures.update();
+
+            // render
+            // ------
+            const float* clear = scene.clear();
+            glClearColor(clear[0], clear[1], clear[2], 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            scene.render(context);
+
+            if (switched)
+            {
+                auto switchEnd = std::chrono::steady_clock::now();
+                long long us = std::chrono::duration_cast<std::chrono::microseconds>(switchEnd - switchStart).count();
+                if (previous >= 0)
+                    std::cout << scenes[previous]->name() << " -> ";
+                std::cout << scene.name() << ": first frame submitted in " << us << " us" << std::endl;
+                glfwSetWindowTitle(window, scene.name());
+            }
+
+            if (capture.active())
+            {
+                glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+                capture.capture(framebufferWidth, framebufferHeight);
+            }
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+        if (capture.active())
+        {
+            capture.stop();
+            CaptureStats stats = capture.stats();
+            std::cout << "capture: " << stats.written << " of " << stats.offered << " frames written, "
+                      << stats.droppedReadback << " dropped waiting for read-back, " << stats.droppedQueue
+                      << " dropped with the encoder busy, " << stats.skipped << " skipped at another size"
+                      << (stats.writeFailed ? ", output failed" : "") << std::endl;
+        }
+
+        // de-allocate all resources once they've outlived their purpose
+        // -------------------------------------------------------------
+        for (size_t i = 0; i < scenes.size(); i++)
+            scenes[i]->release();
+        glDeleteBuffers(1, &materials.UBO);
+        shaders.release();
+        textures.release();
+    }
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return 0;
+}
+
+// scene keys: 1-9 and 0 (the tenth) select directly, Left/Right step, Escape closes the window
+// ---------------------------------------------------------------------------------------------
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+    if (key == GLFW_KEY_ESCAPE)
+        glfwSetWindowShouldClose(window, true);
+    else if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9 && key - GLFW_KEY_1 < sceneCount)
+        requestedScene = key - GLFW_KEY_1;
+    else if (key == GLFW_KEY_0 && sceneCount >= 10)
+        requestedScene = 9;
+    else if (key == GLFW_KEY_RIGHT)
+        requestedScene = (requestedScene + 1) % sceneCount;
+    else if (key == GLFW_KEY_LEFT)
+        requestedScene = (requestedScene + sceneCount - 1) % sceneCount;
+}
+
+// camera: WASD pans by one view height per second whatever the zoom, Q/E zoom in and out
+// ---------------------------------------------------------------------------------------
+void processInput(GLFWwindow* window, float dt)
+{
+    dt = dt < 0.1f ? dt : 0.1f;
+    float step = 2.0f * camera.halfHeight() * dt;
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        camera.centreX -= step;
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        camera.centreX += step;
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        camera.centreY -= step;
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        camera.centreY += step;
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+        camera.zoom *= 1.0f + 2.0f * dt;
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+        camera.zoom /= 1.0f + 2.0f * dt;
+}
+
+// glfw: whenever the mouse wheel scrolls, this callback is called
+// ----------------------------------------------------------------
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    camera.zoom *= yoffset > 0.0 ? 1.25f : yoffset < 0.0 ? 0.8f : 1.0f;
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    // make sure the viewport matches the new window dimensions; note that width and
+    // height will be significantly larger than specified on retina displays.
+    glViewport(0, 0, width, height);
+    camera.resize(width, height);
+}
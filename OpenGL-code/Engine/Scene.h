@@ -0,0 +1,104 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "../Common/Camera2D.h"
+#include "../Common/Material.h"
+#include "../Common/Shader.h"
+#include "../Common/TextureLoader.h"
+
+#include <map>
+#include <string>
+
+// what every scene shares: the window and its GL context, one shader registry, one material
+// table, one texture loader (with its cache) and the camera the engine drives from the keyboard,
+// mouse wheel and framebuffer size. The engine creates all of it once.
+struct SceneContext
+{
+    GLFWwindow* window;
+    ShaderRegistry& shaders;
+    MaterialTable& materials;
+    TextureLoader& textures;
+    Camera2D& camera;
+    int windowSize;     // the window's larger side, for TextureLoader's maxSize
+    // seconds, for animation: set before every frame, and held still over a poster's tiles
+    double time = 0.0;
+
+    SceneContext(GLFWwindow* contextWindow, ShaderRegistry& shaderRegistry, MaterialTable& materialTable,
+                 TextureLoader& textureLoader, Camera2D& sceneCamera, int size)
+        : window(contextWindow), shaders(shaderRegistry), materials(materialTable), textures(textureLoader),
+          camera(sceneCamera), windowSize(size)
+    {
+    }
+
+    // the material program every demo shape draws with, attached to the material table
+    unsigned int materialProgram()
+    {
+        unsigned int program = shaders.find("material");
+        if (!program)
+        {
+            program = shaders.get("material", materialVertexShaderSource, materialFragmentShaderSource);
+            materials.attach(program);
+        }
+        return program;
+    }
+
+    // loader handle for path; scenes naming the same file share one load
+    int texture(const std::string& path, int wrap = GL_REPEAT, int minFilter = GL_NEAREST, int magFilter = GL_LINEAR)
+    {
+        std::map<std::string, int>::const_iterator found = textureHandles.find(path);
+        if (found != textureHandles.end())
+            return found->second;
+        int handle = textures.load(path.c_str(), wrap, minFilter, magFilter, windowSize);
+        textureHandles[path] = handle;
+        return handle;
+    }
+
+    // true once every texture the scenes asked for is uploaded or has failed
+    bool texturesSettled() const
+    {
+        for (std::map<std::string, int>::const_iterator i = textureHandles.begin(); i != textureHandles.end(); ++i)
+            if (!textures.ready(i->second) && !textures.failed(i->second))
+                return false;
+        return true;
+    }
+
+private:
+    std::map<std::string, int> textureHandles;
+};
+
+// one demo: init() creates its GL objects once, render() draws a frame, release() frees
+// what init() made. Switching scenes calls nothing but render() on the new one.
+class Scene
+{
+public:
+    explicit Scene(const char* sceneName, float r = 0.0f, float g = 0.0f, float b = 0.0f)
+        : title(sceneName)
+    {
+        clearColour[0] = r;
+        clearColour[1] = g;
+        clearColour[2] = b;
+    }
+    virtual ~Scene() {}
+
+    const char* name() const
+    {
+        return title;
+    }
+    const float* clear() const
+    {
+        return clearColour;
+    }
+
+    virtual void init(SceneContext& context) = 0;
+    virtual void render(SceneContext& context) = 0;
+    virtual void release() = 0;
+
+private:
+    const char* title;
+    float clearColour[3];
+};
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "Scene.h"
+#include "../Common/Geometry.h"
+#include "../Common/GpuShapeRenderer.h"
+#include "../Common/ShapeStore.h"
+#include "../Common/SpatialGrid.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// the Q1-Q3 demos as engine scenes
+// --------------------------------
+// Each draws what its standalone main() draws, with the shared material program: the shape's
+// colour, vertex colours or Sea.jpg come from a material instead of a shader of its own.
+
+// path of the demos' photo, relative to the engine's working directory
+const char* const SEA_TEXTURE = "../Q3/Sea.jpg";
+
+// one mesh in one material, optionally sampling Sea.jpg
+class ShapeScene : public Scene
+{
+public:
+    typedef std::vector<float> (*Builder)(unsigned int layout);
+
+    ShapeScene(const char* name, Builder vertexBuilder, GLenum drawMode, bool sampleTexture, const Material& shapeMaterial,
+               float r, float g, float b)
+        : Scene(name, r, g, b), build(vertexBuilder), mode(drawMode), textured(sampleTexture), colour(shapeMaterial)
+    {
+    }
+
+    void init(SceneContext& context)
+    {
+        program = context.materialProgram();
+        material = context.materials.add(colour);
+        unsigned int layout = textured ? VERTEX_TEXCOORD : 0u;
+        mesh = createMesh(build(layout), layout, mode);
+        if (textured)
+            texture = context.texture(SEA_TEXTURE);
+    }
+
+    void render(SceneContext& context)
+    {
+        glUseProgram(program);
+        context.camera.applyScreen(program);
+        context.materials.bind();
+        if (textured)
+            glBindTexture(GL_TEXTURE_2D, context.textures.texture(texture));
+        useMaterial(material);
+        mesh.draw();
+    }
+
+    void release()
+    {
+        mesh.release();
+    }
+
+private:
+    Builder build;
+    GLenum mode;
+    bool textured;
+    Material colour;
+    unsigned int program = 0;
+    int material = 0, texture = -1;
+    Mesh mesh;
+};
+
+class GradientTriangleScene : public Scene
+{
+public:
+    GradientTriangleScene() : Scene("Colour Gradient Triangle") {}
+
+    void init(SceneContext& context)
+    {
+        program = context.materialProgram();
+        material = context.materials.add(vertexColourMaterial());
+        mesh = createMesh(gradientTriangleVertices(), VERTEX_COLOUR, GL_TRIANGLES);
+    }
+
+    void render(SceneContext& context)
+    {
+        glUseProgram(program);
+        context.camera.applyScreen(program);
+        context.materials.bind();
+        useMaterial(material);
+        mesh.draw();
+    }
+
+    void release()
+    {
+        mesh.release();
+    }
+
+private:
+    unsigned int program = 0;
+    int material = 0;
+    Mesh mesh;
+};
+
+// black and white board in one draw call with per-vertex materials; the textured variant
+// fills the light squares with Sea.jpg instead of white
+class ChessBoardScene : public Scene
+{
+public:
+    explicit ChessBoardScene(bool sampleTexture)
+        : Scene(sampleTexture ? "Texture Chess Board" : "Chess Board"), textured(sampleTexture)
+    {
+    }
+
+    void init(SceneContext& context)
+    {
+        program = context.materialProgram();
+        int dark = context.materials.add(solidMaterial(0.0f, 0.0f, 0.0f));
+        int light = context.materials.add(textured ? texturedMaterial(0) : solidMaterial(1.0f, 1.0f, 1.0f));
+        unsigned int layout = textured ? VERTEX_TEXCOORD : 0u;
+        std::vector<int> squareMaterials;
+        std::vector<float> vertices = chessBoardVertices(layout, dark, light, squareMaterials);
+        mesh = createMesh(vertices, layout, GL_TRIANGLES, squareMaterials);
+        if (textured)
+            texture = context.texture(SEA_TEXTURE);
+    }
+
+    void render(SceneContext& context)
+    {
+        glUseProgram(program);
+        context.camera.applyScreen(program);
+        context.materials.bind();
+        if (textured)
+            glBindTexture(GL_TEXTURE_2D, context.textures.texture(texture));
+        mesh.draw();
+    }
+
+    void release()
+    {
+        mesh.release();
+    }
+
+private:
+    bool textured;
+    unsigned int program = 0;
+    int texture = -1;
+    Mesh mesh;
+};
+
+// a million disks, rings and trapezia in a ShapeStore, turning slowly about the centre and seen
+// through the engine camera. Every frame moves every centre, relinks the shapes that changed grid
+// cell, and uploads and draws only those the grid finds on screen, each at the level of detail its
+// size on screen calls for. Prints the build time once, and every few seconds the visible and
+// culled counts, the vertices drawn against drawing every outline at 360 sides, and the average
+// update, cull and upload times.
+// The GPU variant uploads the moved shapes and leaves culling and draw generation to
+// GpuShapeRenderer's compute passes, falling back to the grid when the context is older than 4.3.
+class ShapeFieldScene : public Scene
+{
+public:
+    explicit ShapeFieldScene(size_t shapeCount = 1000000, bool gpuCulling = false)
+        : Scene(gpuCulling ? "GPU Shape Field" : "Shape Field", 0.05f, 0.05f, 0.08f), count(shapeCount),
+          gpu(gpuCulling), grid(-1.5f, -1.5f, 1.5f, 1.5f)
+    {
+    }
+
+    void init(SceneContext& context)
+    {
+        program = context.shaders.get("shapes", shapeVertexShaderSource, materialFragmentShaderSource);
+        context.materials.attach(program);
+        int palette[6];
+        palette[0] = context.materials.add(solidMaterial(1.0f, 0.5f, 0.2f));
+        palette[1] = context.materials.add(solidMaterial(0.9f, 0.8f, 0.3f));
+        palette[2] = context.materials.add(solidMaterial(0.3f, 0.7f, 0.9f));
+        palette[3] = context.materials.add(solidMaterial(0.6f, 0.4f, 0.8f));
+        palette[4] = context.materials.add(solidMaterial(0.4f, 0.8f, 0.5f));
+        palette[5] = context.materials.add(solidMaterial(0.9f, 0.3f, 0.4f));
+
+        auto start = std::chrono::steady_clock::now();
+        fillShapeField(store, count, palette);
+        if (gpu && GpuShapeRenderer::supported())
+        {
+            gpuRenderer.reset(new GpuShapeRenderer());
+            if (!gpuRenderer->valid())
+            {
+                gpuRenderer->release();
+                gpuRenderer.reset();
+            }
+        }
+        if (gpu && !gpuRenderer)
+            std::cout << name() << ": no GL 4.3 compute support, culling on the CPU" << std::endl;
+        if (!gpuRenderer)
+            grid.build(store);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << name() << ": built " << store.size() << " shapes in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+        if (!gpuRenderer)
+            renderer.reset(new ShapeStoreRenderer());
+        lastTime = context.time;
+    }
+
+    void render(SceneContext& context)
+    {
+        double now = context.time;
+        float dt = (float)(now - lastTime);
+        lastTime = now;
+        dt = dt < 0.1f ? dt : 0.1f;
+
+        auto start = std::chrono::steady_clock::now();
+        store.rotate(0.1f * dt);
+        if (!gpuRenderer)
+            grid.update(store);
+        auto updated = std::chrono::steady_clock::now();
+        if (gpuRenderer)
+        {
+            // upload, then cull; the cull time is only what it takes to queue the passes
+            gpuRenderer->upload(store);
+            auto uploaded = std::chrono::steady_clock::now();
+            gpuRenderer->cull(context.camera);
+            uploadMs += std::chrono::duration<double, std::milli>(uploaded - updated).count();
+            cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploaded).count();
+        }
+        else
+        {
+            float minX, minY, maxX, maxY;
+            context.camera.bounds(minX, minY, maxX, maxY);
+            grid.query(store, minX, minY, maxX, maxY, visible);
+            auto culled = std::chrono::steady_clock::now();
+            renderer->uploadVisible(store, visible, context.camera.pixelsPerUnit());
+            cullMs += std::chrono::duration<double, std::milli>(culled - updated).count();
+            uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - culled).count();
+        }
+        updateMs += std::chrono::duration<double, std::milli>(updated - start).count();
+        if (++frames == 240)
+        {
+            size_t vertices, fullDetail;
+            if (gpuRenderer)
+            {
+                unsigned int counts[SHAPE_BUCKETS];
+                visible.visible = gpuRenderer->visibleCount(counts);
+                visible.culled = store.size() - visible.visible;
+                vertices = gpuRenderer->vertices(counts);
+                fullDetail = gpuRenderer->vertices(counts, true);
+            }
+            else
+            {
+                vertices = renderer->vertices();
+                fullDetail = renderer->fullDetailVertices();
+            }
+            std::cout << name() << ": " << visible.visible << " visible, " << visible.culled << " culled; "
+                      << vertices << " vertices, " << (fullDetail ? 100.0 - 100.0 * vertices / fullDetail : 0.0)
+                      << "% fewer than at full detail; update " << updateMs / frames << " ms, cull " << cullMs / frames
+                      << " ms, upload " << uploadMs / frames << " ms per frame" << std::endl;
+            frames = 0;
+            updateMs = cullMs = uploadMs = 0.0;
+        }
+
+        glUseProgram(program);
+        context.camera.apply(program);
+        context.materials.bind();
+        if (gpuRenderer)
+            gpuRenderer->draw();
+        else
+            renderer->draw();
+    }
+
+    void release()
+    {
+        if (renderer)
+            renderer->release();
+        renderer.reset();
+        if (gpuRenderer)
+            gpuRenderer->release();
+        gpuRenderer.reset();
+    }
+
+private:
+    size_t count;
+    bool gpu;
+    ShapeStore store;
+    SpatialGrid grid;
+    VisibleShapes visible;
+    std::unique_ptr<ShapeStoreRenderer> renderer;
+    std::unique_ptr<GpuShapeRenderer> gpuRenderer;
+    unsigned int program = 0;
+    double lastTime = 0.0, updateMs = 0.0, cullMs = 0.0, uploadMs = 0.0;
+    int frames = 0;
+};
+
+// every demo, in the order the number keys select them
+inline void registerScenes(std::vector<std::unique_ptr<Scene> >& scenes)
+{
+    const Material orange = solidMaterial(1.0f, 0.5f, 0.2f);
+    const Material sea = texturedMaterial(0);
+    scenes.emplace_back(new ShapeScene("Disk", diskVertices, GL_TRIANGLE_FAN, false, orange, 0.2f, 0.3f, 0.3f));
+    scenes.emplace_back(new ShapeScene("Ring", ringVertices, GL_LINE_STRIP, false, orange, 0.2f, 0.3f, 0.3f));
+    scenes.emplace_back(new ShapeScene("Right Trapezium", rightTrapeziumVertices, GL_TRIANGLE_FAN, false, orange, 0.2f, 0.3f, 0.3f));
+    scenes.emplace_back(new GradientTriangleScene());
+    scenes.emplace_back(new ChessBoardScene(false));
+    scenes.emplace_back(new ShapeScene("Texture Disk", diskVertices, GL_TRIANGLE_FAN, true, sea, 0.0f, 0.0f, 0.0f));
+    scenes.emplace_back(new ShapeScene("Texture Ring", ringVertices, GL_LINE_STRIP, true, sea, 0.0f, 0.0f, 0.0f));
+    scenes.emplace_back(new ShapeScene("Texture Right Trapezium", rightTrapeziumVertices, GL_TRIANGLE_FAN, true, sea, 0.0f, 0.0f, 0.0f));
+    scenes.emplace_back(new ChessBoardScene(true));
+    scenes.emplace_back(new ShapeFieldScene());
+    scenes.emplace_back(new ShapeFieldScene(1000000, true));
+}
+
+#endif
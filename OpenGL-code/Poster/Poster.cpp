@@ -0,0 +1,172 @@
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Common/ImageWriter.h"
+#include "../Common/PosterRenderer.h"
+#include "../Engine/Scenes.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Q3/stb_image.h"
+
+// one engine scene as a poster of any size
+// ----------------------------------------
+// Opens a hidden window for its GL context, initialises the chosen scene as Engine.cpp would
+// (with Sea.jpg decoded for the poster's size rather than the window's), waits for its textures
+// and renders it tile by tile with PosterRenderer, streaming the rows into the output file, which
+// is PNG, QOI or PPM by its extension (the compressed ones encoded on a thread pool as the bands
+// arrive). The scene sees one frame at a fixed time, so animated scenes show the same instant in
+// every tile. Run from the Poster folder so that ../Q3/Sea.jpg resolves.
+//
+// usage: Poster [--scene NAME] [--size N | --size WxH] [--tile N] [--band N] [--threads N] [--direct] [--out FILE]
+//   --scene NAME  the scene to render, "Texture Chess Board" by default
+//   --size        the poster in pixels, 16384 x 16384 by default
+//   --tile N      tile width, 2048 by default (the driver's limits permitting)
+//   --band N      tile height, i.e. rows held on the host per band, 256 by default
+//   --threads N   encoding workers besides the render thread, one per other hardware thread by default
+//   --direct      write the file past the OS page cache where the platform allows
+//   --out FILE    the .png, .qoi or .ppm to write, poster.ppm by default
+
+int main(int argc, char** argv)
+{
+    std::string sceneName = "Texture Chess Board", outFile = "poster.ppm";
+    int width = 16384, height = 16384, tileWidth = 2048, tileHeight = 256, threads = 0;
+    bool direct = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scene" && hasValue)
+            sceneName = argv[++i];
+        else if (arg == "--size" && hasValue)
+        {
+            const char* size = argv[++i];
+            width = height = std::atoi(size);
+            if (const char* x = std::strchr(size, 'x'))
+                height = std::atoi(x + 1);
+        }
+        else if (arg == "--tile" && hasValue)
+            tileWidth = std::atoi(argv[++i]);
+        else if (arg == "--band" && hasValue)
+            tileHeight = std::atoi(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (arg == "--direct")
+            direct = true;
+        else if (arg == "--out" && hasValue)
+            outFile = argv[++i];
+        else
+            width = 0;
+    }
+    if (width < 1 || height < 1 || tileWidth < 1 || tileHeight < 1 || threads < 0)
+    {
+        std::fprintf(stderr, "usage: %s [--scene NAME] [--size N | --size WxH] [--tile N] [--band N] [--threads N] [--direct] "
+                             "[--out FILE]\n", argv[0]);
+        return 2;
+    }
+
+    // glfw: a hidden window, 4.3 for the compute-shader scene where the driver has it, else 3.3
+    // ------------------------------------------------------------------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* window = NULL;
+    const int versions[2][2] = { { 4, 3 }, { 3, 3 } };
+    for (int i = 0; i < 2 && window == NULL; i++)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, versions[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, versions[i][1]);
+        window = glfwCreateWindow(64, 64, "Poster", NULL, NULL);
+    }
+    if (window == NULL)
+    {
+        std::fprintf(stderr, "Failed to create GLFW window\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK)
+    {
+        std::fprintf(stderr, "Failed to initialize GLEW\n");
+        return 1;
+    }
+
+    int status = 0;
+    {
+        ShaderRegistry shaders;
+        MaterialTable materials;
+        TextureLoader textures;
+        textures.enableCache(TextureCache::supportedFormat());
+        Camera2D camera;
+        SceneContext context(window, shaders, materials, textures, camera, width > height ? width : height);
+
+        std::vector<std::unique_ptr<Scene> > scenes;
+        registerScenes(scenes);
+        Scene* scene = NULL;
+        for (size_t i = 0; i < scenes.size(); i++)
+            if (sceneName == scenes[i]->name())
+                scene = scenes[i].get();
+        PosterRenderer poster(tileWidth, tileHeight);
+        if (!scene)
+        {
+            std::fprintf(stderr, "Poster: no scene called \"%s\"\n", sceneName.c_str());
+            status = 2;
+        }
+        else if (!poster.valid())
+        {
+            std::fprintf(stderr, "Poster: could not create a %d x %d tile framebuffer\n", poster.tileWidth(), poster.tileHeight());
+            status = 1;
+        }
+        else
+        {
+            scene->init(context);
+            while (!context.texturesSettled())
+            {
+                textures.update();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            ThreadPool encoders(threads);
+            std::unique_ptr<ImageSink> writer = createImageWriter(outFile, &encoders, direct);
+            auto start = std::chrono::steady_clock::now();
+            bool written = poster.render(width, height, camera, [&]()
+            {
+                const float* clear = scene->clear();
+                glClearColor(clear[0], clear[1], clear[2], 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+                scene->render(context);
+            }, *writer);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const PosterStats& stats = poster.stats();
+            if (written)
+                std::printf("%s: %d x %d in %d tiles of %d x %d, %.2f s (%.1f Mpix/s), %.1f MB band buffer\n",
+                            outFile.c_str(), width, height, stats.tiles, poster.tileWidth(), poster.tileHeight(), seconds,
+                            (double)width * height / 1e6 / seconds, stats.bandBytes / 1e6);
+            else
+            {
+                std::fprintf(stderr, "Poster: could not write %s\n", outFile.c_str());
+                status = 1;
+            }
+            scene->release();
+        }
+        poster.release();
+        glDeleteBuffers(1, &materials.UBO);
+        shaders.release();
+        textures.release();
+    }
+    glfwTerminate();
+    return status;
+}
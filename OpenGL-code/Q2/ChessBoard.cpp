@@ -4,6 +4,8 @@
 
 #include <iostream>
 
+#include "../Common/Material.h"
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 
@@ -11,25 +13,6 @@ void processInput(GLFWwindow* window);
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 800;
 
-const char* vertexShaderSource = "#version 330 core\n"
-"layout (location = 0) in vec3 aPos;\n"
-"void main()\n"
-"{\n"
-"   gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
-"}\0";
-const char* fragmentShaderSourceBlack = "#version 330 core\n"
-"out vec4 FragColor;\n"
-"void main()\n"
-"{\n"
-"   FragColor = vec4(0.0f, 0.0f, 0.0f, 1.0f);\n"
-"}\n\0";
-const char* fragmentShaderSourceWhite = "#version 330 core\n"
-"out vec4 FragColor;\n"
-"void main()\n"
-"{\n"
-"   FragColor = vec4(1.0f, 1.0f, 1.0f, 1.0f);\n"
-"}\n\0";
-
 int main()
 {
     // glfw: initialize and configure
@@ -67,7 +50,7 @@ int main()
     // ------------------------------------
     // vertex shader
     int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 1, &materialVertexShaderSource, NULL);
     glCompileShader(vertexShader);
     // check for shader compile errors
     int success;
@@ -78,49 +61,37 @@ int main()
         glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
     }
-    // fragment shaders
-    int fragmentShaderBlack = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShaderBlack, 1, &fragmentShaderSourceBlack, NULL);
-    glCompileShader(fragmentShaderBlack);
-    int fragmentShaderWhite = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShaderWhite, 1, &fragmentShaderSourceWhite, NULL);
-    glCompileShader(fragmentShaderWhite);
+    // fragment shader: black and white squares share it, their colours come from the material table
+    int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &materialFragmentShaderSource, NULL);
+    glCompileShader(fragmentShader);
     // check for shader compile errors
-    glGetShaderiv(fragmentShaderBlack, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(fragmentShaderBlack, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-    glGetShaderiv(fragmentShaderWhite, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderWhite, 512, NULL, infoLog);
+        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
     }
     // link shaders
-    int shaderProgramBlack = glCreateProgram();
-    glAttachShader(shaderProgramBlack, vertexShader);
-    glAttachShader(shaderProgramBlack, fragmentShaderBlack);
-    glLinkProgram(shaderProgramBlack);
-    int shaderProgramWhite = glCreateProgram();
-    glAttachShader(shaderProgramWhite, vertexShader);
-    glAttachShader(shaderProgramWhite, fragmentShaderWhite);
-    glLinkProgram(shaderProgramWhite);
+    int shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glLinkProgram(shaderProgram);
     // check for linking errors
-    glGetProgramiv(shaderProgramBlack, GL_LINK_STATUS, &success);
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(shaderProgramBlack, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
-    glGetProgramiv(shaderProgramWhite, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgramWhite, 512, NULL, infoLog);
+        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
     glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShaderBlack);
-    glDeleteShader(fragmentShaderWhite);
+    glDeleteShader(fragmentShader);
+
+    // materials
+    // ---------
+    MaterialTable materials;
+    int black = materials.add(solidMaterial(0.0f, 0.0f, 0.0f));
+    int white = materials.add(solidMaterial(1.0f, 1.0f, 1.0f));
+    materials.attach(shaderProgram);
 
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
@@ -188,45 +159,42 @@ int main()
         BlackSquareVertices[i + 5] = vertices[c + 5];
         BlackSquareVertices[i + 6] = vertices[c + 6];
         BlackSquareVertices[i + 7] = vertices[c + 7];
-        WhiteSquareVertices[i + 8] = vertices[c + 8];
+        BlackSquareVertices[i + 8] = vertices[c + 8];
     }
 
-    unsigned int VBOB,VBOW, VAOB, VAOW;
-    glGenVertexArrays(1, &VAOB);
-    glGenBuffers(1, &VBOB);
+    // both colours go into one buffer, black squares first, with a per-vertex material index
+    // so the whole board is a single draw call
+    int squareMaterials[384];
+    for (int i = 0;i < 192;i++) squareMaterials[i] = black;
+    for (int i = 192;i < 384;i++) squareMaterials[i] = white;
+
+    unsigned int VBO, materialVBO, VAO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &materialVBO);
     // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-    glBindVertexArray(VAOB);
+    glBindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBOB);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(BlackSquareVertices), BlackSquareVertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BlackSquareVertices) + sizeof(WhiteSquareVertices), NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(BlackSquareVertices), BlackSquareVertices);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(BlackSquareVertices), sizeof(WhiteSquareVertices), WhiteSquareVertices);
 
     // position attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    // material index attribute
+    glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(squareMaterials), squareMaterials, GL_STATIC_DRAW);
+    glVertexAttribIPointer(MATERIAL_ATTRIB, 1, GL_INT, sizeof(int), (void*)0);
+    glEnableVertexAttribArray(MATERIAL_ATTRIB);
+
     // You can unbind the VAO afterwards so other VAO calls won't accidentally modify this VAO, but this rarely happens. Modifying other
     // VAOs requires a call to glBindVertexArray anyways so we generally don't unbind VAOs (nor VBOs) when it's not directly necessary.
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glGenVertexArrays(1, &VAOW);
-    glGenBuffers(1, &VBOW);
-    // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-    glBindVertexArray(VAOW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBOW);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(WhiteSquareVertices), WhiteSquareVertices, GL_STATIC_DRAW);
-
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // You can unbind the VAO afterwards so other VAO calls won't accidentally modify this VAO, but this rarely happens. Modifying other
-    // VAOs requires a call to glBindVertexArray anyways so we generally don't unbind VAOs (nor VBOs) when it's not directly necessary.
-     glBindVertexArray(0);
-     glBindBuffer(GL_ARRAY_BUFFER, 0);
-
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
@@ -240,14 +208,11 @@ int main()
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        // render the triangle
-        glUseProgram(shaderProgramBlack);
-        glBindVertexArray(VAOB);
-        glDrawArrays(GL_TRIANGLES, 0, 192);
-
-        glUseProgram(shaderProgramWhite);
-        glBindVertexArray(VAOW);
-        glDrawArrays(GL_TRIANGLES, 0, 192);
+        // render the board
+        glUseProgram(shaderProgram);
+        materials.bind();
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 384);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -257,10 +222,10 @@ int main()
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAOB);
-    glDeleteBuffers(1, &VBOB);
-    glDeleteVertexArrays(1, &VAOW);
-    glDeleteBuffers(1, &VBOW);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &materialVBO);
+    glDeleteBuffers(1, &materials.UBO);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
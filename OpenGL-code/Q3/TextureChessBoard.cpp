@@ -5,6 +5,8 @@
 #include <corecrt_math_defines.h>
 #include <iostream>
 
+#include "../Common/TextureLoader.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -243,30 +245,14 @@ int main()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     // load and create a texture 
- // -------------------------
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    // The FileSystem::getPath(...) is part of the GitHub repository so we can find files on any IDE/platform; replace it with your own image path.
-    unsigned char* data = stbi_load("Sea.jpg", &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
+    // -------------------------
+    // Sea.jpg is loaded on a worker thread and streamed in over the first frames; until then
+    // textures.texture(sea) is a placeholder, so the first frame never waits on the decode.
+    // The first run transcodes it into a block-compressed Sea.jpg.*.ktx2 next to the source,
+    // later runs map that file instead of decoding the JPEG again.
+    TextureLoader textures;
+    textures.enableCache(TextureCache::supportedFormat());
+    int sea = textures.load("Sea.jpg", GL_REPEAT, GL_NEAREST, GL_LINEAR);
 
     // render loop
     // -----------
@@ -276,8 +262,9 @@ int main()
         // -----
         processInput(window);
 
-        // bind Texture
-        glBindTexture(GL_TEXTURE_2D, texture);
+        // upload whatever the loader has decoded, then bind Texture
+        textures.update();
+        glBindTexture(GL_TEXTURE_2D, textures.texture(sea));
 
         // render
         // ------
@@ -301,6 +288,7 @@ int main()
     glDeleteBuffers(1, &VBOB);
     glDeleteVertexArrays(1, &VAOW);
     glDeleteBuffers(1, &VBOW);
+    textures.release();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
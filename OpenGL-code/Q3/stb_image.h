@@ -179,6 +179,55 @@ RECENT REVISION HISTORY:
 //
 // ===========================================================================
 //
+// MEMORY-MAPPED FILES:
+//
+//   stbi_load_mapped() takes the same arguments as stbi_load() but maps the
+//   whole file read-only (mmap with MADV_SEQUENTIAL, or a Win32 file mapping)
+//   and decodes it with stbi_load_from_memory(), instead of refilling a
+//   128-byte buffer with fread. Pipes, devices and anything else that cannot
+//   be mapped fall back to stbi_load(). Define STBI_NO_MMAP to leave it out.
+//
+//   stbi_map_file() and stbi_unmap_file() expose the mapping itself, so a
+//   caller can probe and decode from one view (stbi_info_from_memory(), then
+//   stbi_load_from_memory()) or map other files the same way. stbi_map_file()
+//   returns NULL for anything it would not map.
+//
+// ===========================================================================
+//
+// HUFFMAN LOOKUP TABLES:
+//
+//   JPEG and zlib codes up to STBI_FAST_BITS / STBI_ZFAST_BITS bits long (9 by
+//   default, up to 12) are decoded with one table lookup; longer ones take a
+//   bit-by-bit search. In zlib streams the same lookup also returns runs of two
+//   or three short literal codes at once. Wider tables send more codes down the
+//   fast path but are rebuilt for every JPEG DHT segment and deflate block, so
+//   10 or 11 pays off on large images and costs time on icon-sized ones.
+//
+// ===========================================================================
+//
+// DECODING INTO CALLER MEMORY:
+//
+//   stbi_load_from_memory_into() and stbi_load_mapped_into() write the image
+//   into memory you provide -- say a mapped pixel-unpack buffer -- with row j
+//   at out + j * out_stride, instead of returning a new allocation. Get the
+//   size first with stbi_info_from_memory(). desired_channels is required;
+//   the call fails if the image is wider than out_stride / desired_channels
+//   or taller than out_rows. JPEGs are colour-converted straight into those
+//   rows; other formats are decoded as usual and reach them in one pass that
+//   also does the channel conversion and the vertical flip.
+//
+// ===========================================================================
+//
+// SCALED JPEG DECODE:
+//
+//   After stbi_set_jpeg_max_dimension(n), a JPEG whose larger side is at least
+//   2n, 4n or 8n pixels decodes at 1/2, 1/4 or 1/8 size. Each 8x8 block goes
+//   through a 4x4 or 2x2 IDCT of its lowest frequencies, or just its DC term,
+//   so the component planes, upsampling and colour conversion all shrink with
+//   the output. The entropy decoding still reads every coefficient.
+//
+// ===========================================================================
+//
 // Philosophy
 //
 // stb libraries are designed with the following priorities:
@@ -224,11 +273,24 @@ RECENT REVISION HISTORY:
 // code.)
 //
 // On x86, SSE2 will automatically be used when available based on a run-time
-// test; if not, the generic C versions are used as a fall-back. On ARM targets,
+// test; if not, the generic C versions are used as a fall-back. On top of that,
+// AVX2 versions of the IDCT (two horizontally adjacent blocks at a time), the
+// YCbCr-to-RGB conversion and the 2x2 chroma upsampler (16 pixels at a time)
+// are compiled with per-function target attributes and picked by a run-time
+// CPUID/XGETBV check; define STBI_NO_AVX2 to leave them out. Like the SSE2
+// kernels, they are bit-identical to the generic C code. On ARM targets,
 // the typical path is to have separate builds for NEON and non-NEON devices
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// The PNG decoder uses SSE2 for the Up filter and, on 8-bit RGB and RGBA
+// images, for the Sub, Avg and Paeth filters; it has no NEON or AVX2
+// versions, since Sub, Avg and Paeth only go one pixel at a time anyway.
+//
+// Changing the channel count between grey or grey+alpha and RGBA, or between
+// RGB and RGBA, uses SSSE3 byte shuffles when a run-time check finds it; define
+// STBI_NO_SSSE3 to leave them out. 16-bit results are narrowed with SSE2.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
@@ -380,6 +442,17 @@ extern "C" {
     STBIDEF stbi_uc* stbi_load(char const* filename, int* x, int* y, int* channels_in_file, int desired_channels);
     STBIDEF stbi_uc* stbi_load_from_file(FILE* f, int* x, int* y, int* channels_in_file, int desired_channels);
     // for stbi_load_from_file, file pointer is left pointing immediately after image
+#ifndef STBI_NO_MMAP
+    STBIDEF stbi_uc* stbi_load_mapped(char const* filename, int* x, int* y, int* channels_in_file, int desired_channels);
+    STBIDEF void* stbi_map_file(char const* filename, size_t* size);
+    STBIDEF void stbi_unmap_file(void* view, size_t size);
+#endif
+#endif
+
+    // these return 1 on success and 0 on failure; see "DECODING INTO CALLER MEMORY" above
+    STBIDEF int stbi_load_from_memory_into(stbi_uc const* buffer, int len, stbi_uc* out, int out_stride, int out_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+#if !defined(STBI_NO_STDIO) && !defined(STBI_NO_MMAP)
+    STBIDEF int stbi_load_mapped_into(char const* filename, stbi_uc* out, int out_stride, int out_rows, int* x, int* y, int* channels_in_file, int desired_channels);
 #endif
 
 #ifndef STBI_NO_GIF
@@ -475,6 +548,38 @@ extern "C" {
     // calling it will fail to link if your compiler doesn't
     STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+    // decode JPEGs at 1/2, 1/4 or 1/8 size, in the DCT domain, as long as the larger side stays
+    // at least max_dimension pixels; 0 (the default) always decodes at full size. stbi_info
+    // reports the reduced size. The _thread variant applies to the calling thread only, with
+    // the same availability as stbi_set_flip_vertically_on_load_thread.
+    STBIDEF void stbi_set_jpeg_max_dimension(int max_dimension);
+    STBIDEF void stbi_set_jpeg_max_dimension_thread(int max_dimension);
+
+    // lets the JPEG decoder spread independent work across threads: fn must call
+    // task(arg, i) once for every i in [0, count), in any order and on any threads, and
+    // return when all of them have finished. It may be called from several decodes at once.
+    // Restart segments of baseline JPEGs that are decoded from memory, and the upsampling and
+    // colour conversion of every JPEG, are split this way; the output is identical to a serial
+    // decode. Pass NULL to go back to decoding on the calling thread only.
+    typedef void stbi_parallel_for(void* user, int count, void (*task)(void* arg, int index), void* arg);
+    STBIDEF void stbi_set_parallel_for(stbi_parallel_for* fn, void* user);
+
+    // memory the decoders allocate and free again before returning (JPEG component planes,
+    // line buffers and decoder state, PNG IDAT data and the inflate output) comes from this
+    // allocator instead of STBI_MALLOC, on the thread that calls the function. The image
+    // returned by stbi_load* still comes from STBI_MALLOC. A block is always freed on the
+    // thread that allocated it, so a bump arena that is reset between images is enough.
+    // realloc gets the old size. Pass NULL to go back to STBI_MALLOC. Same availability as
+    // stbi_set_flip_vertically_on_load_thread.
+    typedef struct
+    {
+        void* (*alloc)(void* user, size_t size);
+        void* (*realloc)(void* user, void* p, size_t oldsize, size_t newsize);
+        void  (*free)(void* user, void* p);
+        void* user;
+    } stbi_scratch_allocator;
+    STBIDEF void stbi_set_scratch_allocator_thread(const stbi_scratch_allocator* allocator);
+
     // ZLIB client - used by PNG, available for other purposes
 
     STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int initial_size, int* outlen);
@@ -547,6 +652,12 @@ extern "C" {
 
 #ifndef STBI_NO_STDIO
 #include <stdio.h>
+#if !defined(STBI_NO_MMAP) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #endif
 
 #ifndef STBI_ASSERT
@@ -588,12 +699,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -605,16 +718,6 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32) == 4 ? 1 : -1];
 #define STBI_NOTUSED(v)  (void)sizeof(v)
 #endif
 
-#ifdef _MSC_VER
-#define STBI_HAS_LROTL
-#endif
-
-#ifdef STBI_HAS_LROTL
-#define stbi_lrot(x,y)  _lrotl(x,y)
-#else
-#define stbi_lrot(x,y)  (((x) << (y)) | ((x) >> (32 - (y))))
-#endif
-
 #if defined(STBI_MALLOC) && defined(STBI_FREE) && (defined(STBI_REALLOC) || defined(STBI_REALLOC_SIZED))
 // ok
 #elif !defined(STBI_MALLOC) && !defined(STBI_FREE) && !defined(STBI_REALLOC) && !defined(STBI_REALLOC_SIZED)
@@ -695,18 +798,15 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     int info3 = stbi__cpuid3();
     return ((info3 >> 26) & 1) != 0;
 }
-#endif
 
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     // If we're even attempting to compile this on GCC/Clang, that means
@@ -714,9 +814,79 @@ static int stbi__sse2_available(void)
     // instructions at will, and so are we.
     return 1;
 }
+
+#endif
+#endif
+
+// x86 AVX2: compiled per function and only called when the CPU and OS support it
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG) \
+    && ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define STBI_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+#else
+#include <cpuid.h>
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
 #endif
 
+static int stbi__avx2_available(void)
+{
+    unsigned int regs[4];
+    unsigned long long xcr0;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+    __cpuid(info, 1);
+    regs[2] = (unsigned int)info[2];
+#else
+    __cpuid(0, regs[0], regs[1], regs[2], regs[3]);
+    if (regs[0] < 7) return 0;
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
 #endif
+    // OSXSAVE and AVX, then check that the OS saves the YMM registers
+    if ((regs[2] & (1u << 27)) == 0 || (regs[2] & (1u << 28)) == 0) return 0;
+#ifdef _MSC_VER
+    xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    regs[1] = (unsigned int)info[1];
+#else
+    {
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        xcr0 = ((unsigned long long)edx << 32) | eax;
+    }
+    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    return (xcr0 & 6) == 6 && (regs[1] & (1u << 5)) != 0;
+}
+#endif
+
+// x86 SSSE3 (pshufb) for the channel-count conversions: compiled per function like AVX2
+#if defined(STBI_SSE2) && !defined(STBI_NO_SSSE3) \
+    && ((defined(_MSC_VER) && _MSC_VER >= 1500) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define STBI_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#define STBI__SSSE3_TARGET
+#else
+#include <cpuid.h>
+#define STBI__SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+
+static int stbi__ssse3_available(void)
+{
+    unsigned int regs[4];
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    regs[2] = (unsigned int)info[2];
+#else
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    return (regs[2] & (1u << 9)) != 0;
+}
 #endif
 
 // ARM NEON
@@ -754,6 +924,10 @@ typedef struct
 
     stbi_uc* img_buffer, * img_buffer_end;
     stbi_uc* img_buffer_original, * img_buffer_original_end;
+
+    // stbi_load_*_into: rows of dest_comp-channel pixels the decoder may write straight into
+    stbi_uc* dest;
+    int dest_stride, dest_rows, dest_comp;
 } stbi__context;
 
 
@@ -764,6 +938,7 @@ static void stbi__start_mem(stbi__context* s, stbi_uc const* buffer, int len)
 {
     s->io.read = NULL;
     s->read_from_callbacks = 0;
+    s->dest = NULL;
     s->img_buffer = s->img_buffer_original = (stbi_uc*)buffer;
     s->img_buffer_end = s->img_buffer_original_end = (stbi_uc*)buffer + len;
 }
@@ -775,6 +950,7 @@ static void stbi__start_callbacks(stbi__context* s, stbi_io_callbacks* c, void*
     s->io_user_data = user;
     s->buflen = sizeof(s->buffer_start);
     s->read_from_callbacks = 1;
+    s->dest = NULL;
     s->img_buffer_original = s->buffer_start;
     stbi__refill_buffer(s);
     s->img_buffer_original_end = s->img_buffer_end;
@@ -833,6 +1009,7 @@ typedef struct
     int bits_per_channel;
     int num_channels;
     int channel_order;
+    int flipped;            // rows already stored bottom-up, as stbi_set_flip_vertically_on_load asks
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -995,6 +1172,55 @@ static void* stbi__malloc_mad4(int a, int b, int c, int d, int add)
 }
 #endif
 
+// scratch memory: never handed back to the caller, so it can come from the thread's
+// stbi_set_scratch_allocator_thread allocator
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL stbi_scratch_allocator stbi__scratch;
+static STBI_THREAD_LOCAL int stbi__scratch_set;
+
+STBIDEF void stbi_set_scratch_allocator_thread(const stbi_scratch_allocator* allocator)
+{
+    stbi__scratch_set = allocator != NULL;
+    if (allocator) stbi__scratch = *allocator;
+}
+
+static void* stbi__scratch_malloc(size_t size)
+{
+    return stbi__scratch_set ? stbi__scratch.alloc(stbi__scratch.user, size) : STBI_MALLOC(size);
+}
+
+#ifndef STBI_NO_ZLIB
+static void* stbi__scratch_realloc(void* p, size_t oldsize, size_t newsize)
+{
+    return stbi__scratch_set ? stbi__scratch.realloc(stbi__scratch.user, p, oldsize, newsize) : STBI_REALLOC_SIZED(p, oldsize, newsize);
+}
+#endif
+
+static void stbi__scratch_free(void* p)
+{
+    if (!stbi__scratch_set) STBI_FREE(p);
+    else if (p) stbi__scratch.free(stbi__scratch.user, p);
+}
+#else
+#define stbi__scratch_malloc(sz)             STBI_MALLOC(sz)
+#define stbi__scratch_realloc(p,oldsz,newsz) STBI_REALLOC_SIZED(p,oldsz,newsz)
+#define stbi__scratch_free(p)                STBI_FREE(p)
+#endif
+
+#ifndef STBI_NO_JPEG
+static void* stbi__scratch_malloc_mad2(int a, int b, int add)
+{
+    if (!stbi__mad2sizes_valid(a, b, add)) return NULL;
+    return stbi__scratch_malloc(a * b + add);
+}
+
+static void* stbi__scratch_malloc_mad3(int a, int b, int c, int add)
+{
+    if (!stbi__mad3sizes_valid(a, b, c, add)) return NULL;
+    return stbi__scratch_malloc(a * b * c + add);
+}
+#endif
+
 // stbi__err - error
 // stbi__errpf - error returning pointer to float
 // stbi__errpuc - error returning pointer to unsigned char
@@ -1046,6 +1272,38 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_max_dimension_global = 0;
+
+STBIDEF void stbi_set_jpeg_max_dimension(int max_dimension)
+{
+    stbi__jpeg_max_dimension_global = max_dimension;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_max_dimension  stbi__jpeg_max_dimension_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_max_dimension_local, stbi__jpeg_max_dimension_set;
+
+STBIDEF void stbi_set_jpeg_max_dimension_thread(int max_dimension)
+{
+    stbi__jpeg_max_dimension_local = max_dimension;
+    stbi__jpeg_max_dimension_set = 1;
+}
+
+#define stbi__jpeg_max_dimension  (stbi__jpeg_max_dimension_set       \
+                                    ? stbi__jpeg_max_dimension_local  \
+                                    : stbi__jpeg_max_dimension_global)
+#endif // STBI_THREAD_LOCAL
+
+static stbi_parallel_for* stbi__parallel_for_fn = NULL;
+static void* stbi__parallel_for_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for* fn, void* user)
+{
+    stbi__parallel_for_fn = fn;
+    stbi__parallel_for_user = user;
+}
+
 static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
 {
     memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1102,7 +1360,16 @@ static stbi_uc* stbi__convert_16_to_8(stbi__uint16* orig, int w, int h, int chan
     reduced = (stbi_uc*)stbi__malloc(img_len);
     if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
 
-    for (i = 0; i < img_len; ++i)
+    i = 0;
+#ifdef STBI_SSE2
+    if (stbi__sse2_available())
+        for (; i + 16 <= img_len; i += 16) {
+            __m128i lo = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(orig + i)), 8);
+            __m128i hi = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(orig + i + 8)), 8);
+            _mm_storeu_si128((__m128i*)(reduced + i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+    for (; i < img_len; ++i)
         reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
 
     STBI_FREE(orig);
@@ -1125,16 +1392,16 @@ static stbi__uint16* stbi__convert_8_to_16(stbi_uc* orig, int w, int h, int chan
     return enlarged;
 }
 
-static void stbi__vertical_flip(void* image, int w, int h, int bytes_per_pixel)
+// flips h rows of bytes_per_row bytes that start stride bytes apart
+static void stbi__vertical_flip_rows(void* image, int h, size_t bytes_per_row, size_t stride)
 {
     int row;
-    size_t bytes_per_row = (size_t)w * bytes_per_pixel;
     stbi_uc temp[2048];
     stbi_uc* bytes = (stbi_uc*)image;
 
     for (row = 0; row < (h >> 1); row++) {
-        stbi_uc* row0 = bytes + row * bytes_per_row;
-        stbi_uc* row1 = bytes + (h - row - 1) * bytes_per_row;
+        stbi_uc* row0 = bytes + row * stride;
+        stbi_uc* row1 = bytes + (h - row - 1) * stride;
         // swap row0 with row1
         size_t bytes_left = bytes_per_row;
         while (bytes_left) {
@@ -1149,6 +1416,12 @@ static void stbi__vertical_flip(void* image, int w, int h, int bytes_per_pixel)
     }
 }
 
+static void stbi__vertical_flip(void* image, int w, int h, int bytes_per_pixel)
+{
+    size_t bytes_per_row = (size_t)w * bytes_per_pixel;
+    stbi__vertical_flip_rows(image, h, bytes_per_row, bytes_per_row);
+}
+
 #ifndef STBI_NO_GIF
 static void stbi__vertical_flip_slices(void* image, int w, int h, int z, int bytes_per_pixel)
 {
@@ -1179,7 +1452,7 @@ static unsigned char* stbi__load_and_postprocess_8bit(stbi__context* s, int* x,
 
     // @TODO: move stbi__convert_format to here
 
-    if (stbi__vertically_flip_on_load) {
+    if (stbi__vertically_flip_on_load && !ri.flipped) {
         int channels = req_comp ? req_comp : *comp;
         stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
     }
@@ -1204,7 +1477,7 @@ static stbi__uint16* stbi__load_and_postprocess_16bit(stbi__context* s, int* x,
     // @TODO: move stbi__convert_format16 to here
     // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-    if (stbi__vertically_flip_on_load) {
+    if (stbi__vertically_flip_on_load && !ri.flipped) {
         int channels = req_comp ? req_comp : *comp;
         stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
     }
@@ -1311,6 +1584,97 @@ STBIDEF stbi_us* stbi_load_16(char const* filename, int* x, int* y, int* comp, i
     return result;
 }
 
+#ifndef STBI_NO_MMAP
+#ifdef _WIN32
+// declared by hand, as above, so the implementation does not pull in windows.h
+struct _SECURITY_ATTRIBUTES;
+STBI_EXTERN __declspec(dllimport) void* __stdcall CreateFileA(const char* name, unsigned long access, unsigned long share, struct _SECURITY_ATTRIBUTES* security, unsigned long disposition, unsigned long flags, void* templateFile);
+STBI_EXTERN __declspec(dllimport) void* __stdcall CreateFileW(const wchar_t* name, unsigned long access, unsigned long share, struct _SECURITY_ATTRIBUTES* security, unsigned long disposition, unsigned long flags, void* templateFile);
+STBI_EXTERN __declspec(dllimport) unsigned long __stdcall GetFileSize(void* file, unsigned long* sizeHigh);
+STBI_EXTERN __declspec(dllimport) unsigned long __stdcall GetFileType(void* file);
+STBI_EXTERN __declspec(dllimport) void* __stdcall CreateFileMappingA(void* file, struct _SECURITY_ATTRIBUTES* security, unsigned long protect, unsigned long sizeHigh, unsigned long sizeLow, const char* name);
+STBI_EXTERN __declspec(dllimport) void* __stdcall MapViewOfFile(void* mapping, unsigned long access, unsigned long offsetHigh, unsigned long offsetLow, size_t bytes);
+STBI_EXTERN __declspec(dllimport) int __stdcall UnmapViewOfFile(const void* view);
+STBI_EXTERN __declspec(dllimport) int __stdcall CloseHandle(void* object);
+#endif
+
+// maps a regular, non-empty file read-only; returns NULL when it cannot (pipes, devices,
+// missing files), leaving the caller to fall back to stdio
+STBIDEF void* stbi_map_file(char const* filename, size_t* size)
+{
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+    void* view = NULL;
+    unsigned long high = 0, low;
+#if defined(_MSC_VER) && defined(STBI_WINDOWS_UTF8)
+    wchar_t wFilename[1024];
+    if (0 == MultiByteToWideChar(65001 /* UTF8 */, 0, filename, -1, wFilename, sizeof(wFilename)))
+        return NULL;
+    file = CreateFileW(wFilename, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, NULL, 3 /* OPEN_EXISTING */, 0x08000000 /* FILE_FLAG_SEQUENTIAL_SCAN */, NULL);
+#else
+    file = CreateFileA(filename, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, NULL, 3 /* OPEN_EXISTING */, 0x08000000 /* FILE_FLAG_SEQUENTIAL_SCAN */, NULL);
+#endif
+    if (file == (void*)(ptrdiff_t)-1 /* INVALID_HANDLE_VALUE */)
+        return NULL;
+    low = GetFileSize(file, &high);
+    // FILE_TYPE_DISK only; stb_image takes an int length, so larger files go through stdio
+    if (GetFileType(file) == 1 && high == 0 && low > 0 && low <= INT_MAX) {
+        mapping = CreateFileMappingA(file, NULL, 0x02 /* PAGE_READONLY */, 0, 0, NULL);
+        if (mapping) {
+            view = MapViewOfFile(mapping, 0x0004 /* FILE_MAP_READ */, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps the mapping alive
+            *size = low;
+        }
+    }
+    CloseHandle(file);
+    return view;
+#else
+    struct stat info;
+    void* view = NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && info.st_size <= INT_MAX) {
+        view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED)
+            view = NULL;
+        else {
+            *size = (size_t)info.st_size;
+#ifdef MADV_SEQUENTIAL
+            // every decoder reads front to back: read ahead aggressively, drop pages behind
+            madvise(view, *size, MADV_SEQUENTIAL);
+#endif
+        }
+    }
+    close(fd);
+    return view;
+#endif
+}
+
+STBIDEF void stbi_unmap_file(void* view, size_t size)
+{
+#ifdef _WIN32
+    STBI_NOTUSED(size);
+    UnmapViewOfFile(view);
+#else
+    munmap(view, size);
+#endif
+}
+
+STBIDEF stbi_uc* stbi_load_mapped(char const* filename, int* x, int* y, int* comp, int req_comp)
+{
+    size_t size = 0;
+    unsigned char* result;
+    void* view = stbi_map_file(filename, &size);
+    if (!view)
+        return stbi_load(filename, x, y, comp, req_comp);
+    result = stbi_load_from_memory((stbi_uc const*)view, (int)size, x, y, comp, req_comp);
+    stbi_unmap_file(view, size);
+    return result;
+}
+#endif // !STBI_NO_MMAP
+
 
 #endif //!STBI_NO_STDIO
 
@@ -1630,9 +1994,6 @@ static stbi__uint32 stbi__get32le(stbi__context* s)
 
 #define STBI__BYTECAST(x)  ((stbi_uc) ((x) & 255))  // truncate int to byte without warnings
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
-// nothing
-#else
 //////////////////////////////////////////////////////////////////////////////
 //
 //  generic converter from built-in img_n to req_comp
@@ -1648,14 +2009,137 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 {
     return (stbi_uc)(((r * 77) + (g * 150) + (29 * b)) >> 8);
 }
+
+#ifdef STBI_SSSE3
+// grey to RGBA, grey+alpha to RGBA, RGB to RGBA and RGBA to RGB with byte shuffles; returns how
+// many leading pixels it converted and leaves the rest to the scalar loops. Neither loads nor
+// stores go past the end of the row.
+static STBI__SSSE3_TARGET int stbi__convert_row_ssse3(const stbi_uc* src, int img_n, stbi_uc* dest, int req_comp, int x)
+{
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    int i = 0;
+    switch (img_n * 8 + req_comp) {
+    case 1 * 8 + 4: {
+        // each step of the mask moves on four pixels; its zeroing bytes stay negative
+        const __m128i mask = _mm_setr_epi8(0, 0, 0, -128, 1, 1, 1, -128, 2, 2, 2, -128, 3, 3, 3, -128);
+        const __m128i four = _mm_set1_epi8(4);
+        for (; i + 16 <= x; i += 16) {
+            __m128i g = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i m = mask;
+            int k;
+            for (k = 0; k < 4; ++k, m = _mm_add_epi8(m, four))
+                _mm_storeu_si128((__m128i*)(dest + 4 * i + 16 * k), _mm_or_si128(_mm_shuffle_epi8(g, m), alpha));
+        }
+        break;
+    }
+    case 2 * 8 + 4: {
+        const __m128i lo = _mm_setr_epi8(0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7);
+        const __m128i hi = _mm_add_epi8(lo, _mm_set1_epi8(8));
+        for (; i + 8 <= x; i += 8) {
+            __m128i ga = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+            _mm_storeu_si128((__m128i*)(dest + 4 * i), _mm_shuffle_epi8(ga, lo));
+            _mm_storeu_si128((__m128i*)(dest + 4 * i + 16), _mm_shuffle_epi8(ga, hi));
+        }
+        break;
+    }
+    case 3 * 8 + 4: {
+        const __m128i mask = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+        for (; i + 16 <= x; i += 16) {
+            const stbi_uc* p = src + 3 * i;
+            __m128i a = _mm_loadu_si128((const __m128i*)p);
+            __m128i b = _mm_loadu_si128((const __m128i*)(p + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(p + 32));
+            stbi_uc* o = dest + 4 * i;
+            _mm_storeu_si128((__m128i*)o, _mm_or_si128(_mm_shuffle_epi8(a, mask), alpha));
+            _mm_storeu_si128((__m128i*)(o + 16), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), mask), alpha));
+            _mm_storeu_si128((__m128i*)(o + 32), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), mask), alpha));
+            _mm_storeu_si128((__m128i*)(o + 48), _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), mask), alpha));
+        }
+        // 16-byte loads of 4 pixels, while they stay inside the row
+        for (; i + 6 <= x; i += 4)
+            _mm_storeu_si128((__m128i*)(dest + 4 * i), _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 3 * i)), mask), alpha));
+        break;
+    }
+    case 4 * 8 + 3: {
+        const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+        for (; i + 16 <= x; i += 16) {
+            const stbi_uc* p = src + 4 * i;
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), mask);
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), mask);
+            __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 32)), mask);
+            __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 48)), mask);
+            stbi_uc* o = dest + 3 * i;
+            _mm_storeu_si128((__m128i*)o, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+            _mm_storeu_si128((__m128i*)(o + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+            _mm_storeu_si128((__m128i*)(o + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+        }
+        // 16-byte stores of 4 pixels, while they stay inside the row
+        for (; i + 6 <= x; i += 4)
+            _mm_storeu_si128((__m128i*)(dest + 3 * i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 4 * i)), mask));
+        break;
+    }
+    }
+    return i;
+}
+#endif
+
+// whether stbi__convert_row may use its SIMD loops; checked once per image
+static int stbi__convert_simd(void)
+{
+#ifdef STBI_SSSE3
+    return stbi__ssse3_available();
+#else
+    return 0;
+#endif
+}
+
+// converts one row of x pixels; also used to copy into caller memory by stbi__load_into.
+// simd is stbi__convert_simd()
+static void stbi__convert_row(const unsigned char* src, int img_n, unsigned char* dest, int req_comp, unsigned int x, int simd)
+{
+    int i;
+
+#ifdef STBI_SSSE3
+    if (simd) {
+        int done = stbi__convert_row_ssse3(src, img_n, dest, req_comp, (int)x);
+        src += (size_t)done * img_n;
+        dest += (size_t)done * req_comp;
+        x -= (unsigned int)done;
+    }
+#else
+    STBI_NOTUSED(simd);
 #endif
 
+#define STBI__COMBO(a,b)  ((a)*8+(b))
+#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+    // convert source image with img_n components to one with req_comp components;
+    // avoid switch per pixel, so use switch per scanline and massive macros
+    switch (STBI__COMBO(img_n, req_comp)) {
+        STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 255; } break;
+        STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+        STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255; } break;
+        STBI__CASE(2, 1) { dest[0] = src[0]; } break;
+        STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+        STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
+        STBI__CASE(3, 4) { dest[0] = src[0];dest[1] = src[1];dest[2] = src[2];dest[3] = 255; } break;
+        STBI__CASE(3, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
+        STBI__CASE(3, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = 255; } break;
+        STBI__CASE(4, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
+        STBI__CASE(4, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = src[3]; } break;
+        STBI__CASE(4, 3) { dest[0] = src[0];dest[1] = src[1];dest[2] = src[2]; } break;
+    default:
+        if (img_n == req_comp) memcpy(dest, src, (size_t)x * img_n);
+        else STBI_ASSERT(0);
+    }
+#undef STBI__CASE
+}
+
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
 static unsigned char* stbi__convert_format(unsigned char* data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-    int i, j;
+    int j, simd;
     unsigned char* good;
 
     if (req_comp == img_n) return data;
@@ -1667,31 +2151,9 @@ static unsigned char* stbi__convert_format(unsigned char* data, int img_n, int r
         return stbi__errpuc("outofmem", "Out of memory");
     }
 
-    for (j = 0; j < (int)y; ++j) {
-        unsigned char* src = data + j * x * img_n;
-        unsigned char* dest = good + j * x * req_comp;
-
-#define STBI__COMBO(a,b)  ((a)*8+(b))
-#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-        // convert source image with img_n components to one with req_comp components;
-        // avoid switch per pixel, so use switch per scanline and massive macros
-        switch (STBI__COMBO(img_n, req_comp)) {
-            STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 255; } break;
-            STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-            STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255; } break;
-            STBI__CASE(2, 1) { dest[0] = src[0]; } break;
-            STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-            STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
-            STBI__CASE(3, 4) { dest[0] = src[0];dest[1] = src[1];dest[2] = src[2];dest[3] = 255; } break;
-            STBI__CASE(3, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
-            STBI__CASE(3, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = 255; } break;
-            STBI__CASE(4, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
-            STBI__CASE(4, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = src[3]; } break;
-            STBI__CASE(4, 3) { dest[0] = src[0];dest[1] = src[1];dest[2] = src[2]; } break;
-        default: STBI_ASSERT(0);
-        }
-#undef STBI__CASE
-    }
+    simd = stbi__convert_simd();
+    for (j = 0; j < (int)y; ++j)
+        stbi__convert_row(data + (size_t)j * x * img_n, img_n, good + (size_t)j * x * req_comp, req_comp, x, simd);
 
     STBI_FREE(data);
     return good;
@@ -1755,6 +2217,100 @@ static stbi__uint16* stbi__convert_format16(stbi__uint16* data, int img_n, int r
 }
 #endif
 
+//////////////////////////////////////////////////////////////////////////////
+//
+//  decoding into caller memory
+//    the JPEG loader colour-converts straight into s->dest when it is set; every
+//    other loader returns its native channels, which are converted, flipped and
+//    strided in the one pass that copies them out
+
+static int stbi__load_into(stbi__context* s, stbi_uc* out, int out_stride, int out_rows, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__result_info ri;
+    void* result;
+    int w, h, n, channels, j, simd;
+    size_t row_bytes;
+
+    if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+    if (!out || out_stride <= 0 || out_rows <= 0) return stbi__err("bad output", "Empty output buffer");
+
+    s->dest = out;
+    s->dest_stride = out_stride;
+    s->dest_rows = out_rows;
+    s->dest_comp = req_comp;
+    result = stbi__load_main(s, &w, &h, &n, 0, &ri, 8);
+    s->dest = NULL;
+    if (result == NULL)
+        return 0;
+
+    row_bytes = (size_t)w * req_comp;
+    if (result == out) {
+        if (stbi__vertically_flip_on_load && !ri.flipped)
+            stbi__vertical_flip_rows(out, h, row_bytes, (size_t)out_stride);
+    }
+    else {
+        if (row_bytes > (size_t)out_stride || h > out_rows) {
+            STBI_FREE(result);
+            return stbi__err("buffer too small", "Output buffer smaller than image");
+        }
+        channels = n;
+        if (ri.bits_per_channel != 8) {
+            STBI_ASSERT(ri.bits_per_channel == 16);
+#if !defined(STBI_NO_PNG) || !defined(STBI_NO_PSD)
+            // convert at 16 bits, so grey values round as they do in stbi_load()
+            result = stbi__convert_format16((stbi__uint16*)result, n, req_comp, w, h);
+            if (result == NULL)
+                return 0;
+            channels = req_comp;
+#endif
+            result = stbi__convert_16_to_8((stbi__uint16*)result, w, h, channels);
+            if (result == NULL)
+                return 0;
+        }
+        simd = stbi__convert_simd();
+        for (j = 0; j < h; ++j) {
+            int row = stbi__vertically_flip_on_load ? h - 1 - j : j;
+            stbi__convert_row((stbi_uc*)result + (size_t)j * w * channels, channels, out + (size_t)row * out_stride, req_comp, (unsigned int)w, simd);
+        }
+        STBI_FREE(result);
+    }
+
+    *x = w;
+    *y = h;
+    if (comp) *comp = n;
+    return 1;
+}
+
+STBIDEF int stbi_load_from_memory_into(stbi_uc const* buffer, int len, stbi_uc* out, int out_stride, int out_rows, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    return stbi__load_into(&s, out, out_stride, out_rows, x, y, comp, req_comp);
+}
+
+#if !defined(STBI_NO_STDIO) && !defined(STBI_NO_MMAP)
+STBIDEF int stbi_load_mapped_into(char const* filename, stbi_uc* out, int out_stride, int out_rows, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    size_t size = 0;
+    int result;
+    void* view = stbi_map_file(filename, &size);
+    if (view) {
+        stbi__start_mem(&s, (stbi_uc const*)view, (int)size);
+        result = stbi__load_into(&s, out, out_stride, out_rows, x, y, comp, req_comp);
+        stbi_unmap_file(view, size);
+    }
+    else {
+        FILE* f = stbi__fopen(filename, "rb");
+        if (!f) return stbi__err("can't fopen", "Unable to open file");
+        stbi__start_file(&s, f);
+        result = stbi__load_into(&s, out, out_stride, out_rows, x, y, comp, req_comp);
+        fclose(f);
+    }
+    return result;
+}
+#endif
+
 #ifndef STBI_NO_LINEAR
 static float* stbi__ldr_to_hdr(stbi_uc* data, int x, int y, int comp)
 {
@@ -1834,7 +2390,13 @@ static stbi_uc* stbi__hdr_to_ldr(float* data, int x, int y, int comp)
 #ifndef STBI_NO_JPEG
 
 // huffman decoding acceleration
-#define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
+#ifndef STBI_FAST_BITS
+#define STBI_FAST_BITS 9
+#endif
+#if STBI_FAST_BITS < 9 || STBI_FAST_BITS > 12
+#error "STBI_FAST_BITS must be between 9 and 12"
+#endif
+#define FAST_BITS   STBI_FAST_BITS  // larger handles more cases; smaller stomps less cache
 
 typedef struct
 {
@@ -1875,9 +2437,10 @@ typedef struct
         stbi_uc* linebuf;
         short* coeff;   // progressive only
         int      coeff_w, coeff_h; // number of 8x8 coefficient blocks
+        int hscale, vscale; // this component's DCT-domain downscale, see stbi__process_frame_header
     } img_comp[4];
 
-    stbi__uint32   code_buffer; // jpeg entropy-coded buffer
+    stbi__uint64   code_buffer; // jpeg entropy-coded buffer, MSB-aligned
     int            code_bits;   // number of valid bits
     unsigned char  marker;      // marker seen while filling entropy buffer
     int            nomore;      // flag if we saw a marker so must stop
@@ -1894,9 +2457,12 @@ typedef struct
 
     int scan_n, order[4];
     int restart_interval, todo;
+    int scale;  // log2 of the DCT-domain downscale: blocks decode to (8 >> scale)^2 pixels
 
     // kernels
     void (*idct_block_kernel)(stbi_uc* out, int out_stride, short data[64]);
+    // two horizontally adjacent blocks with consecutive coefficients, or NULL
+    void (*idct_block2_kernel)(stbi_uc* out, int out_stride, short data[128]);
     void (*YCbCr_to_RGB_kernel)(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb, const stbi_uc* pcr, int count, int step);
     stbi_uc* (*resample_row_hv_2_kernel)(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs);
 } stbi__jpeg;
@@ -1970,8 +2536,32 @@ static void stbi__build_fast_ac(stbi__int16* fast_ac, stbi__huffman* h)
     }
 }
 
+// 8 bytes as a big-endian integer; compilers turn this into a load and a byte swap
+stbi_inline static stbi__uint64 stbi__load64_be(const stbi_uc* p)
+{
+    return ((stbi__uint64)p[0] << 56) | ((stbi__uint64)p[1] << 48) | ((stbi__uint64)p[2] << 40) | ((stbi__uint64)p[3] << 32) |
+        ((stbi__uint64)p[4] << 24) | ((stbi__uint64)p[5] << 16) | ((stbi__uint64)p[6] << 8) | (stbi__uint64)p[7];
+}
+
+// nonzero if any byte of v is 0xff
+#define STBI__HAS_FF_BYTE(v)  (((~(v) - 0x0101010101010101ull) & (v) & 0x8080808080808080ull) != 0)
+
 static void stbi__grow_buffer_unsafe(stbi__jpeg* j)
 {
+    stbi__context* s = j->s;
+    // fast path: take as many whole bytes as fit in one go, as long as none of
+    // them is 0xff (a stuffed zero or a marker, which need the byte loop below)
+    if (!j->nomore && j->code_bits >= 0 && s->img_buffer_end - s->img_buffer >= 8) {
+        int n = (64 - j->code_bits) >> 3;
+        stbi__uint64 bytes = stbi__load64_be(s->img_buffer);
+        if (n < 8) bytes &= ~(~(stbi__uint64)0 >> (n * 8));
+        if (!STBI__HAS_FF_BYTE(bytes)) {
+            j->code_buffer |= bytes >> j->code_bits;
+            j->code_bits += n * 8;
+            s->img_buffer += n;
+            return;
+        }
+    }
     do {
         unsigned int b = j->nomore ? 0 : stbi__get8(j->s);
         if (b == 0xff) {
@@ -1983,14 +2573,11 @@ static void stbi__grow_buffer_unsafe(stbi__jpeg* j)
                 return;
             }
         }
-        j->code_buffer |= b << (24 - j->code_bits);
+        j->code_buffer |= (stbi__uint64)b << (56 - j->code_bits);
         j->code_bits += 8;
-    } while (j->code_bits <= 24);
+    } while (j->code_bits <= 56);
 }
 
-// (1 << n) - 1
-static const stbi__uint32 stbi__bmask[17] = { 0,1,3,7,15,31,63,127,255,511,1023,2047,4095,8191,16383,32767,65535 };
-
 // decode a jpeg huffman value from the bitstream
 stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg* j, stbi__huffman* h)
 {
@@ -2001,7 +2588,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg* j, stbi__huffman* h)
 
     // look at the top FAST_BITS and determine what symbol ID it is,
     // if the code is <= FAST_BITS
-    c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS) - 1);
+    c = (int)(j->code_buffer >> (64 - FAST_BITS));
     k = h->fast[c];
     if (k < 255) {
         int s = h->size[k];
@@ -2018,7 +2605,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg* j, stbi__huffman* h)
     // end; in other words, regardless of the number of bits, it
     // wants to be compared against something shifted to have 16;
     // that way we don't need to shift inside the loop.
-    temp = j->code_buffer >> 16;
+    temp = (unsigned int)(j->code_buffer >> 48);
     for (k = FAST_BITS + 1; ; ++k)
         if (temp < h->maxcode[k])
             break;
@@ -2032,8 +2619,8 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg* j, stbi__huffman* h)
         return -1;
 
     // convert the huffman code to the symbol id
-    c = ((j->code_buffer >> (32 - k)) & stbi__bmask[k]) + h->delta[k];
-    STBI_ASSERT((((j->code_buffer) >> (32 - h->size[c])) & stbi__bmask[h->size[c]]) == h->code[c]);
+    c = (int)(j->code_buffer >> (64 - k)) + h->delta[k];
+    STBI_ASSERT((j->code_buffer >> (64 - h->size[c])) == h->code[c]);
 
     // convert the id to a symbol
     j->code_bits -= k;
@@ -2052,11 +2639,10 @@ stbi_inline static int stbi__extend_receive(stbi__jpeg* j, int n)
     int sgn;
     if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
 
-    sgn = (stbi__int32)j->code_buffer >> 31; // sign bit is always in MSB
-    k = stbi_lrot(j->code_buffer, n);
-    STBI_ASSERT(n >= 0 && n < (int)(sizeof(stbi__bmask) / sizeof(*stbi__bmask)));
-    j->code_buffer = k & ~stbi__bmask[n];
-    k &= stbi__bmask[n];
+    STBI_ASSERT(n > 0 && n <= 16);
+    sgn = (stbi__int32)(j->code_buffer >> 32) >> 31; // sign bit is always in MSB
+    k = (unsigned int)(j->code_buffer >> (64 - n));
+    j->code_buffer <<= n;
     j->code_bits -= n;
     return k + (stbi__jbias[n] & ~sgn);
 }
@@ -2066,21 +2652,21 @@ stbi_inline static int stbi__jpeg_get_bits(stbi__jpeg* j, int n)
 {
     unsigned int k;
     if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
-    k = stbi_lrot(j->code_buffer, n);
-    j->code_buffer = k & ~stbi__bmask[n];
-    k &= stbi__bmask[n];
+    STBI_ASSERT(n > 0 && n <= 16);
+    k = (unsigned int)(j->code_buffer >> (64 - n));
+    j->code_buffer <<= n;
     j->code_bits -= n;
     return k;
 }
 
 stbi_inline static int stbi__jpeg_get_bit(stbi__jpeg* j)
 {
-    unsigned int k;
+    int k;
     if (j->code_bits < 1) stbi__grow_buffer_unsafe(j);
-    k = j->code_buffer;
+    k = (int)(j->code_buffer >> 63);
     j->code_buffer <<= 1;
     --j->code_bits;
-    return k & 0x80000000;
+    return k;
 }
 
 // given a value that's at position X in the zigzag stream,
@@ -2124,7 +2710,7 @@ static int stbi__jpeg_decode_block(stbi__jpeg* j, short data[64], stbi__huffman*
         unsigned int zig;
         int c, r, s;
         if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-        c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS) - 1);
+        c = (int)(j->code_buffer >> (64 - FAST_BITS));
         r = fac[c];
         if (r) { // fast-AC path
             k += (r >> 4) & 15; // run
@@ -2201,7 +2787,7 @@ static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg* j, short data[64], stbi__
             unsigned int zig;
             int c, r, s;
             if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-            c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS) - 1);
+            c = (int)(j->code_buffer >> (64 - FAST_BITS));
             r = fac[c];
             if (r) { // fast-AC path
                 k += (r >> 4) & 15; // run
@@ -2421,6 +3007,57 @@ static void stbi__idct_block(stbi_uc* out, int out_stride, short data[64])
     }
 }
 
+// IDCT of the lowest (8 >> hscale) x (8 >> vscale) coefficients onto a block that size: N-point
+// IDCTs with the 8-point normalisation, so each output pixel is roughly the mean of the area it
+// replaces. Subsampled chroma can be scaled down less in one direction than the other.
+static void stbi__idct_reduced(stbi_uc* out, int out_stride, short data[64], int hscale, int vscale)
+{
+    // C(u) * cos((2x + 1) * u * pi / 2N) / 2 with 12 fractional bits, row x, column u
+    static const short w8[64] = {
+        1448,  2009,  1892,  1703,  1448,  1138,   784,   400,
+        1448,  1703,   784,  -400, -1448, -2009, -1892, -1138,
+        1448,  1138,  -784, -2009, -1448,   400,  1892,  1703,
+        1448,   400, -1892, -1138,  1448,  1703,  -784, -2009,
+        1448,  -400, -1892,  1138,  1448, -1703,  -784,  2009,
+        1448, -1138,  -784,  2009, -1448,  -400,  1892, -1703,
+        1448, -1703,   784,   400, -1448,  2009, -1892,  1138,
+        1448, -2009,  1892, -1703,  1448, -1138,   784,  -400
+    };
+    static const short w4[16] = {
+        1448,  1892,  1448,   784,
+        1448,   784, -1448, -1892,
+        1448,  -784, -1448,  1892,
+        1448, -1892,  1448,  -784
+    };
+    static const short w2[4] = {
+        1448,  1448,
+        1448, -1448
+    };
+    static const short w1[1] = { 1448 };
+    static const short* const weights[4] = { w8, w4, w2, w1 };
+    const short* wx = weights[hscale], * wy = weights[vscale];
+    int nx = 8 >> hscale, ny = 8 >> vscale, tmp[32], x, y, k;
+
+    if (hscale == 3 && vscale == 3) {
+        out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+        return;
+    }
+    // rows of coefficients, keeping 2 fractional bits
+    for (y = 0; y < ny; ++y)
+        for (x = 0; x < nx; ++x) {
+            int sum = 0;
+            for (k = 0; k < nx; ++k) sum += wx[x * nx + k] * data[y * 8 + k];
+            tmp[y * nx + x] = (sum + 512) >> 10;
+        }
+    // then columns; 14 fractional bits to round away
+    for (y = 0; y < ny; ++y, out += out_stride)
+        for (x = 0; x < nx; ++x) {
+            int sum = 0;
+            for (k = 0; k < ny; ++k) sum += wy[y * ny + k] * tmp[k * nx + x];
+            out[x] = stbi__clamp(((sum + 8192) >> 14) + 128);
+        }
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2602,6 +3239,180 @@ static void stbi__idct_simd(stbi_uc* out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above, run on two horizontally adjacent blocks at
+// once: block 0 in the low 128-bit lane, block 1 in the high one. Every step is a
+// lane-local copy of the sse2 code, so it is bit-identical to the generic C version.
+STBI__AVX2_TARGET static void stbi__idct_simd2_avx2(stbi_uc* out, int out_stride, short data[128])
+{
+    __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+    __m256i tmp;
+
+#define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+#define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+#define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+#define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+#define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+#define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+// row r of block 0 in the low lane, row r of block 1 in the high lane
+#define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i*) (data + (r) * 8))), \
+                              _mm_load_si128((const __m128i*) (data + 64 + (r) * 8)), 1)
+
+// p holds rows r and r+1 of both blocks; reorder to (r of 0, r of 1 | r+1 of 0, r+1 of 1) and store
+#define dct_store2(p) \
+      { \
+         __m256i rows = _mm256_permute4x64_epi64((p), 0xd8); \
+         _mm_storeu_si128((__m128i*) out, _mm256_castsi256_si128(rows)); out += out_stride; \
+         _mm_storeu_si128((__m128i*) out, _mm256_extracti128_si256(rows, 1)); out += out_stride; \
+      }
+
+    __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+    __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f(0.765366865f), stbi__f2f(0.5411961f));
+    __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+    __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+    __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f(0.298631336f), stbi__f2f(-1.961570560f));
+    __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f(3.072711026f));
+    __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f(2.053119869f), stbi__f2f(-0.390180644f));
+    __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f(1.501321110f));
+
+    __m256i bias_0 = _mm256_set1_epi32(512);
+    __m256i bias_1 = _mm256_set1_epi32(65536 + (128 << 17));
+
+    row0 = dct_load(0);
+    row1 = dct_load(1);
+    row2 = dct_load(2);
+    row3 = dct_load(3);
+    row4 = dct_load(4);
+    row5 = dct_load(5);
+    row6 = dct_load(6);
+    row7 = dct_load(7);
+
+    // column pass
+    dct_pass(bias_0, 10);
+
+    {
+        // 16bit 8x8 transpose, per lane
+        dct_interleave16(row0, row4);
+        dct_interleave16(row1, row5);
+        dct_interleave16(row2, row6);
+        dct_interleave16(row3, row7);
+
+        dct_interleave16(row0, row2);
+        dct_interleave16(row1, row3);
+        dct_interleave16(row4, row6);
+        dct_interleave16(row5, row7);
+
+        dct_interleave16(row0, row1);
+        dct_interleave16(row2, row3);
+        dct_interleave16(row4, row5);
+        dct_interleave16(row6, row7);
+    }
+
+    // row pass
+    dct_pass(bias_1, 17);
+
+    {
+        __m256i p0 = _mm256_packus_epi16(row0, row1);
+        __m256i p1 = _mm256_packus_epi16(row2, row3);
+        __m256i p2 = _mm256_packus_epi16(row4, row5);
+        __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+        // 8bit 8x8 transpose, per lane
+        dct_interleave8(p0, p2);
+        dct_interleave8(p1, p3);
+
+        dct_interleave8(p0, p1);
+        dct_interleave8(p2, p3);
+
+        dct_interleave8(p0, p2);
+        dct_interleave8(p1, p3);
+
+        // both blocks are side by side in the output, so each row is one 16-byte store
+        dct_store2(p0);
+        dct_store2(p2);
+        dct_store2(p1);
+        dct_store2(p3);
+    }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store2
+}
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2844,68 +3655,231 @@ static void stbi__jpeg_reset(stbi__jpeg* j)
     // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
+// IDCTs count (1 or 2) horizontally adjacent blocks of component n, starting at block (bx, by),
+// whose coefficients follow each other in data
+static void stbi__jpeg_idct_blocks(stbi__jpeg* z, int n, int bx, int by, short* data, int count)
 {
-    stbi__jpeg_reset(z);
-    if (!z->progressive) {
-        if (z->scan_n == 1) {
-            int i, j;
-            STBI_SIMD_ALIGN(short, data[64]);
-            int n = z->order[0];
-            // non-interleaved data, we just need to process one block at a time,
-            // in trivial scanline order
-            // number of blocks to do just depends on how many actual "pixels" this
-            // component has, independent of interleaved MCU blocking and such
-            int w = (z->img_comp[n].x + 7) >> 3;
-            int h = (z->img_comp[n].y + 7) >> 3;
-            for (j = 0; j < h; ++j) {
-                for (i = 0; i < w; ++i) {
-                    int ha = z->img_comp[n].ha;
-                    if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
-                    // every data block is an MCU, so countdown the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        // if it's NOT a restart, then just bail, so we get corrupt data
-                        // rather than no data
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
-                    }
-                }
+    int hscale = z->img_comp[n].hscale, vscale = z->img_comp[n].vscale, out_stride = z->img_comp[n].w2;
+    stbi_uc* out = z->img_comp[n].data + out_stride * by * (8 >> vscale) + bx * (8 >> hscale);
+    if (hscale || vscale) {
+        stbi__idct_reduced(out, out_stride, data, hscale, vscale);
+        if (count == 2)
+            stbi__idct_reduced(out + (8 >> hscale), out_stride, data + 64, hscale, vscale);
+        return;
+    }
+    if (count == 2 && z->idct_block2_kernel) {
+        z->idct_block2_kernel(out, out_stride, data);
+        return;
+    }
+    z->idct_block_kernel(out, out_stride, data);
+    if (count == 2)
+        z->idct_block_kernel(out + 8, out_stride, data + 64);
+}
+
+// decodes MCUs [first, last) of a baseline scan (single blocks when the scan has one component).
+// Like the original loops, it counts down the restart interval and stops early at a marker
+// that is not a restart.
+static int stbi__jpeg_decode_mcus(stbi__jpeg* z, int first, int last)
+{
+    STBI_SIMD_ALIGN(short, data[128]);
+    int mcu;
+    if (z->scan_n == 1) {
+        int pending = 0;
+        int n = z->order[0];
+        // non-interleaved data, we just need to process one block at a time,
+        // in trivial scanline order
+        // number of blocks to do just depends on how many actual "pixels" this
+        // component has, independent of interleaved MCU blocking and such
+        int w = (z->img_comp[n].x + 7) >> 3;
+        for (mcu = first; mcu < last; ++mcu) {
+            int i = mcu % w, j = mcu / w;
+            int ha = z->img_comp[n].ha;
+            if (!stbi__jpeg_decode_block(z, data + 64 * pending, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            // IDCT blocks in pairs; flush a lone block at the end of the row or range, or
+            // when the restart check below might end the scan
+            if (++pending == 2 || i == w - 1 || mcu == last - 1 || z->todo <= 1) {
+                stbi__jpeg_idct_blocks(z, n, i + 1 - pending, j, data, pending);
+                pending = 0;
+            }
+            // every data block is an MCU, so countdown the restart interval
+            if (--z->todo <= 0) {
+                if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                // if it's NOT a restart, then just bail, so we get corrupt data
+                // rather than no data
+                if (!STBI__RESTART(z->marker)) return 1;
+                stbi__jpeg_reset(z);
             }
-            return 1;
         }
-        else { // interleaved
-            int i, j, k, x, y;
-            STBI_SIMD_ALIGN(short, data[64]);
-            for (j = 0; j < z->img_mcu_y; ++j) {
-                for (i = 0; i < z->img_mcu_x; ++i) {
-                    // scan an interleaved mcu... process scan_n components in order
-                    for (k = 0; k < z->scan_n; ++k) {
-                        int n = z->order[k];
-                        // scan out an mcu's worth of this component; that's just determined
-                        // by the basic H and V specified for the component
-                        for (y = 0; y < z->img_comp[n].v; ++y) {
-                            for (x = 0; x < z->img_comp[n].h; ++x) {
-                                int x2 = (i * z->img_comp[n].h + x) * 8;
-                                int y2 = (j * z->img_comp[n].v + y) * 8;
-                                int ha = z->img_comp[n].ha;
-                                if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                                z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
-                            }
-                        }
-                    }
-                    // after all interleaved components, that's an interleaved MCU,
-                    // so now count down the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
+    }
+    else { // interleaved
+        int k, x, y;
+        for (mcu = first; mcu < last; ++mcu) {
+            int i = mcu % z->img_mcu_x, j = mcu / z->img_mcu_x;
+            // scan an interleaved mcu... process scan_n components in order
+            for (k = 0; k < z->scan_n; ++k) {
+                int n = z->order[k];
+                // scan out an mcu's worth of this component; that's just determined
+                // by the basic H and V specified for the component
+                for (y = 0; y < z->img_comp[n].v; ++y) {
+                    for (x = 0; x < z->img_comp[n].h; ++x) {
+                        int ha = z->img_comp[n].ha;
+                        if (!stbi__jpeg_decode_block(z, data + 64 * (x & 1), z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        // IDCT blocks in pairs, and a lone last block of an odd row
+                        if ((x & 1) || x == z->img_comp[n].h - 1)
+                            stbi__jpeg_idct_blocks(z, n, i * z->img_comp[n].h + (x & ~1), j * z->img_comp[n].v + y, data, (x & 1) + 1);
                     }
                 }
             }
-            return 1;
+            // after all interleaved components, that's an interleaved MCU,
+            // so now count down the restart interval
+            if (--z->todo <= 0) {
+                if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                if (!STBI__RESTART(z->marker)) return 1;
+                stbi__jpeg_reset(z);
+            }
+        }
+    }
+    return 1;
+}
+
+// parallel decoding of restart segments
+//
+// Restart markers reset the entropy decoder and the DC predictors, so the MCUs between two of
+// them can be decoded without the ones before. When a parallel-for hook is installed and the
+// whole scan is in memory, the scan is split at its RST markers and contiguous runs of segments
+// are decoded as separate tasks, each on its own copy of the decoder. The run holding the last
+// segment is decoded by z itself, so afterwards z and its context are exactly where the serial
+// loop would have left them.
+
+typedef struct
+{
+    stbi__jpeg* z;
+    stbi__jpeg* proto;      // snapshot of z for the other runs to copy
+    stbi__context proto_s;
+    stbi_uc** starts;       // first entropy-coded byte of each segment
+    int segments, mcus, tasks;
+    int* ok;                // per-task result
+} stbi__jpeg_segment_job;
+
+static void stbi__jpeg_segment_task(void* arg, int task)
+{
+    stbi__jpeg_segment_job* job = (stbi__jpeg_segment_job*)arg;
+    int first = (int)((size_t)job->segments * task / job->tasks);
+    int last = (int)((size_t)job->segments * (task + 1) / job->tasks);
+    int seg, ok = 1;
+    stbi__jpeg* d;
+    stbi__context s;
+    if (task == job->tasks - 1)
+        d = job->z;
+    else {
+        d = (stbi__jpeg*)stbi__scratch_malloc(sizeof(stbi__jpeg));
+        if (!d) { job->ok[task] = 0; return; }
+        *d = *job->proto;
+        s = job->proto_s;
+        d->s = &s;
+    }
+    for (seg = first; seg < last && ok; ++seg) {
+        int mcu_end = (seg + 1) * job->z->restart_interval;
+        d->s->img_buffer = job->starts[seg];
+        stbi__jpeg_reset(d);
+        ok = stbi__jpeg_decode_mcus(d, seg * job->z->restart_interval, mcu_end < job->mcus ? mcu_end : job->mcus);
+        // a segment that doesn't end on an RST marker is where the serial loop stops the scan,
+        // so the later segments must not be decoded either
+        if (ok && seg < job->segments - 1 && d->todo <= 0)
+            ok = 0;
+    }
+    if (d != job->z)
+        stbi__scratch_free(d);
+    job->ok[task] = ok;
+}
+
+// records where each restart segment starts; returns the segment count, or 0 when the scan
+// has more RST markers than max_segments - 1
+static int stbi__jpeg_find_segments(stbi_uc* p, stbi_uc* end, stbi_uc** starts, int max_segments)
+{
+    int count = 1;
+    starts[0] = p;
+    while (p < end) {
+        stbi_uc* q = (stbi_uc*)memchr(p, 0xff, (size_t)(end - p));
+        if (!q) break;
+        ++q;
+        while (q < end && *q == 0xff) ++q; // fill bytes
+        if (q == end) break;
+        if (*q == 0) { // stuffed 0xff data byte
+            p = q + 1;
+            continue;
+        }
+        if (!STBI__RESTART(*q)) break; // end of the scan
+        if (count == max_segments) return 0;
+        starts[count++] = q + 1;
+        p = q + 1;
+    }
+    return count;
+}
+
+// returns 1 when the scan decoded, or -1 when it has to be decoded serially (including to
+// report a corrupt segment's error)
+static int stbi__jpeg_decode_segments(stbi__jpeg* z, int mcus)
+{
+    stbi__jpeg_segment_job job;
+    int segments, t, result = 1;
+    if (!stbi__parallel_for_fn || !z->restart_interval || z->s->read_from_callbacks || z->code_bits != 0)
+        return -1;
+    segments = (mcus + z->restart_interval - 1) / z->restart_interval;
+    if (segments < 2)
+        return -1;
+    job.starts = (stbi_uc**)stbi__scratch_malloc(sizeof(stbi_uc*) * segments);
+    if (!job.starts)
+        return -1;
+    // a scan whose markers don't line up with its MCU count takes the serial path and its error handling
+    if (stbi__jpeg_find_segments(z->s->img_buffer, z->s->img_buffer_end, job.starts, segments) != segments) {
+        stbi__scratch_free(job.starts);
+        return -1;
+    }
+    job.tasks = segments < 256 ? segments : 256;
+    job.proto = (stbi__jpeg*)stbi__scratch_malloc(sizeof(stbi__jpeg));
+    job.ok = (int*)stbi__scratch_malloc(sizeof(int) * job.tasks);
+    if (!job.proto || !job.ok) {
+        stbi__scratch_free(job.starts);
+        stbi__scratch_free(job.proto);
+        stbi__scratch_free(job.ok);
+        return -1;
+    }
+    *job.proto = *z;
+    job.proto_s = *z->s;
+    job.z = z;
+    job.segments = segments;
+    job.mcus = mcus;
+    stbi__parallel_for_fn(stbi__parallel_for_user, job.tasks, stbi__jpeg_segment_task, &job);
+    for (t = 0; t < job.tasks; ++t)
+        if (!job.ok[t]) result = -1;
+    // a worker's failure reason is stored on its own thread, so a failed scan is rewound and
+    // decoded again serially, to report the same error and keep the same pixels
+    if (result < 0) {
+        *z = *job.proto;
+        *z->s = job.proto_s;
+    }
+    stbi__scratch_free(job.starts);
+    stbi__scratch_free(job.proto);
+    stbi__scratch_free(job.ok);
+    return result;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
+{
+    stbi__jpeg_reset(z);
+    if (!z->progressive) {
+        int mcus, result;
+        if (z->scan_n == 1) {
+            int n = z->order[0];
+            mcus = ((z->img_comp[n].x + 7) >> 3) * ((z->img_comp[n].y + 7) >> 3);
         }
+        else
+            mcus = z->img_mcu_x * z->img_mcu_y;
+        result = stbi__jpeg_decode_segments(z, mcus);
+        if (result >= 0)
+            return result;
+        return stbi__jpeg_decode_mcus(z, 0, mcus);
     }
     else {
         if (z->scan_n == 1) {
@@ -2988,10 +3962,14 @@ static void stbi__jpeg_finish(stbi__jpeg* z)
             int w = (z->img_comp[n].x + 7) >> 3;
             int h = (z->img_comp[n].y + 7) >> 3;
             for (j = 0; j < h; ++j) {
-                for (i = 0; i < w; ++i) {
+                for (i = 0; i < w; i += 2) {
+                    // neighbouring blocks of a row are consecutive in coeff, so they IDCT as a pair
+                    int count = i + 1 < w ? 2 : 1;
                     short* data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                     stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
+                    if (count == 2)
+                        stbi__jpeg_dequantize(data + 64, z->dequant[z->img_comp[n].tq]);
+                    stbi__jpeg_idct_blocks(z, n, i, j, data, count);
                 }
             }
         }
@@ -3148,23 +4126,39 @@ static int stbi__free_jpeg_components(stbi__jpeg* z, int ncomp, int why)
     int i;
     for (i = 0; i < ncomp; ++i) {
         if (z->img_comp[i].raw_data) {
-            STBI_FREE(z->img_comp[i].raw_data);
+            stbi__scratch_free(z->img_comp[i].raw_data);
             z->img_comp[i].raw_data = NULL;
             z->img_comp[i].data = NULL;
         }
         if (z->img_comp[i].raw_coeff) {
-            STBI_FREE(z->img_comp[i].raw_coeff);
+            stbi__scratch_free(z->img_comp[i].raw_coeff);
             z->img_comp[i].raw_coeff = 0;
             z->img_comp[i].coeff = 0;
         }
         if (z->img_comp[i].linebuf) {
-            STBI_FREE(z->img_comp[i].linebuf);
+            stbi__scratch_free(z->img_comp[i].linebuf);
             z->img_comp[i].linebuf = NULL;
         }
     }
     return why;
 }
 
+static stbi__uint32 stbi__jpeg_scaled_size(stbi__uint32 size, int scale)
+{
+    return (size + (1u << scale) - 1) >> scale;
+}
+
+// the largest downscale, up to 1/8, that keeps the larger side at least stbi__jpeg_max_dimension
+static int stbi__jpeg_pick_scale(stbi__uint32 w, stbi__uint32 h)
+{
+    stbi__uint32 longest = w > h ? w : h;
+    int limit = stbi__jpeg_max_dimension, scale = 0;
+    if (limit <= 0) return 0;
+    while (scale < 3 && stbi__jpeg_scaled_size(longest, scale + 1) >= (stbi__uint32)limit)
+        ++scale;
+    return scale;
+}
+
 static int stbi__process_frame_header(stbi__jpeg* z, int scan)
 {
     stbi__context* s = z->s;
@@ -3194,6 +4188,7 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
         z->img_comp[i].v = q & 15;    if (!z->img_comp[i].v || z->img_comp[i].v > 4) return stbi__err("bad V", "Corrupt JPEG");
         z->img_comp[i].tq = stbi__get8(s);  if (z->img_comp[i].tq > 3) return stbi__err("bad TQ", "Corrupt JPEG");
     }
+    z->scale = stbi__jpeg_pick_scale(s->img_x, s->img_y);
 
     if (scan != STBI__SCAN_load) return 1;
 
@@ -3214,6 +4209,16 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
     z->img_mcu_y = (s->img_y + z->img_mcu_h - 1) / z->img_mcu_h;
 
     for (i = 0; i < s->img_n; ++i) {
+        // a subsampled component is scaled down less in each direction its sampling factor
+        // divides by two, so its plane ends up nearer the output size and needs less upsampling
+        int hs = h_max / z->img_comp[i].h, vs = v_max / z->img_comp[i].v;
+        z->img_comp[i].hscale = z->img_comp[i].vscale = z->scale;
+        if (h_max % z->img_comp[i].h == 0)
+            for (; z->img_comp[i].hscale > 0 && hs % 2 == 0; hs >>= 1)
+                --z->img_comp[i].hscale;
+        if (v_max % z->img_comp[i].v == 0)
+            for (; z->img_comp[i].vscale > 0 && vs % 2 == 0; vs >>= 1)
+                --z->img_comp[i].vscale;
         // number of effective pixels (e.g. for non-interleaved MCU)
         z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max - 1) / h_max;
         z->img_comp[i].y = (s->img_y * z->img_comp[i].v + v_max - 1) / v_max;
@@ -3224,21 +4229,21 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
         //
         // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
         // so these muls can't overflow with 32-bit ints (which we require)
-        z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-        z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+        // (decoded planes hold 8 >> scale pixels per block in each direction)
+        z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * (8 >> z->img_comp[i].hscale);
+        z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * (8 >> z->img_comp[i].vscale);
         z->img_comp[i].coeff = 0;
         z->img_comp[i].raw_coeff = 0;
         z->img_comp[i].linebuf = NULL;
-        z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+        z->img_comp[i].raw_data = stbi__scratch_malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
         if (z->img_comp[i].raw_data == NULL)
             return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
         // align blocks for idct using mmx/sse
         z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
         if (z->progressive) {
-            // w2, h2 are multiples of 8 (see above)
-            z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-            z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-            z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+            z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+            z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+            z->img_comp[i].raw_coeff = stbi__scratch_malloc_mad3(z->img_comp[i].coeff_w * 64, z->img_comp[i].coeff_h, sizeof(short), 15);
             if (z->img_comp[i].raw_coeff == NULL)
                 return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
             z->img_comp[i].coeff = (short*)(((size_t)z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3555,7 +4560,7 @@ static void stbi__YCbCr_to_RGB_row(stbi_uc* out, const stbi_uc* y, const stbi_uc
         out[0] = (stbi_uc)r;
         out[1] = (stbi_uc)g;
         out[2] = (stbi_uc)b;
-        out[3] = 255;
+        if (step == 4) out[3] = 255;
         out += step;
     }
 }
@@ -3689,16 +4694,147 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc* out, stbi_uc const* y, stbi_uc cons
         out[0] = (stbi_uc)r;
         out[1] = (stbi_uc)g;
         out[2] = (stbi_uc)b;
-        out[3] = 255;
+        if (step == 4) out[3] = 255;
         out += step;
     }
 }
 #endif
 
+#ifdef STBI_AVX2
+// 16-pixel avx2 version of the sse2 upsampler. The 16-bit row spans both lanes, so the
+// one-pixel shifts pull the neighbouring lane in with a permute before the alignr.
+STBI__AVX2_TARGET static stbi_uc* stbi__resample_row_hv_2_avx2(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs)
+{
+    int i = 0, t0, t1;
+
+    if (w == 1) {
+        out[0] = out[1] = stbi__div4(3 * in_near[0] + in_far[0] + 2);
+        return out;
+    }
+
+    t1 = 3 * in_near[0] + in_far[0];
+    for (; i < ((w - 1) & ~15); i += 16) {
+        // vertical pass: 3*x + y = 4*x + (y - x)
+        __m256i farw = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (in_far + i)));
+        __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (in_near + i)));
+        __m256i diff = _mm256_sub_epi16(farw, nearw);
+        __m256i nears = _mm256_slli_epi16(nearw, 2);
+        __m256i curr = _mm256_add_epi16(nears, diff);
+
+        // prev/next are curr shifted by one pixel, with the pixels either side of the group put in
+        __m256i lo_up = _mm256_permute2x128_si256(curr, curr, 0x08);   // (0, low lane)
+        __m256i hi_down = _mm256_permute2x128_si256(curr, curr, 0x81); // (high lane, 0)
+        __m256i prv0 = _mm256_alignr_epi8(curr, lo_up, 14);
+        __m256i nxt0 = _mm256_alignr_epi8(hi_down, curr, 2);
+        __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+        __m256i next = _mm256_insert_epi16(nxt0, 3 * in_near[i + 16] + in_far[i + 16], 15);
+
+        // horizontal pass, polyphase as in the sse2 version
+        __m256i bias = _mm256_set1_epi16(8);
+        __m256i curs = _mm256_slli_epi16(curr, 2);
+        __m256i prvd = _mm256_sub_epi16(prev, curr);
+        __m256i nxtd = _mm256_sub_epi16(next, curr);
+        __m256i curb = _mm256_add_epi16(curs, bias);
+        __m256i even = _mm256_add_epi16(prvd, curb);
+        __m256i odd = _mm256_add_epi16(nxtd, curb);
+
+        // interleaving and packing are per lane, which leaves the 32 output bytes in order
+        __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+        __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+        __m256i de0 = _mm256_srli_epi16(int0, 4);
+        __m256i de1 = _mm256_srli_epi16(int1, 4);
+        _mm256_storeu_si256((__m256i*) (out + i * 2), _mm256_packus_epi16(de0, de1));
+
+        t1 = 3 * in_near[i + 15] + in_far[i + 15];
+    }
+
+    t0 = t1;
+    t1 = 3 * in_near[i] + in_far[i];
+    out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+
+    for (++i; i < w; ++i) {
+        t0 = t1;
+        t1 = 3 * in_near[i] + in_far[i];
+        out[i * 2 - 1] = stbi__div16(3 * t0 + t1 + 8);
+        out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+    }
+    out[w * 2 - 1] = stbi__div4(t1 + 2);
+
+    STBI_NOTUSED(hs);
+
+    return out;
+}
+
+// 16-pixel avx2 version of the sse2 colour conversion; the remainder (and step 3) goes
+// through the sse2 kernel
+STBI__AVX2_TARGET static void stbi__YCbCr_to_RGB_avx2(stbi_uc* out, stbi_uc const* y, stbi_uc const* pcb, stbi_uc const* pcr, int count, int step)
+{
+    int i = 0;
+
+    if (step == 4) {
+        __m256i signflip = _mm256_set1_epi8(-0x80);
+        __m256i cr_const0 = _mm256_set1_epi16((short)(1.40200f * 4096.0f + 0.5f));
+        __m256i cr_const1 = _mm256_set1_epi16(-(short)(0.71414f * 4096.0f + 0.5f));
+        __m256i cb_const0 = _mm256_set1_epi16(-(short)(0.34414f * 4096.0f + 0.5f));
+        __m256i cb_const1 = _mm256_set1_epi16((short)(1.77200f * 4096.0f + 0.5f));
+        __m256i y_bias = _mm256_set1_epi8((char)(unsigned char)128);
+        __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+        for (; i + 15 < count; i += 16) {
+            // load 16 pixels and spread them 8 per lane, since the unpacks below are per lane
+            __m256i y_bytes = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (y + i))), 0x50);
+            __m256i cr_bytes = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (pcr + i))), 0x50);
+            __m256i cb_bytes = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (pcb + i))), 0x50);
+            __m256i cr_biased = _mm256_xor_si256(cr_bytes, signflip); // -128
+            __m256i cb_biased = _mm256_xor_si256(cb_bytes, signflip); // -128
+
+            // unpack to short (and left-shift cr, cb by 8)
+            __m256i yw = _mm256_unpacklo_epi8(y_bias, y_bytes);
+            __m256i crw = _mm256_unpacklo_epi8(_mm256_setzero_si256(), cr_biased);
+            __m256i cbw = _mm256_unpacklo_epi8(_mm256_setzero_si256(), cb_biased);
+
+            // color transform
+            __m256i yws = _mm256_srli_epi16(yw, 4);
+            __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+            __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+            __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+            __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+            __m256i rws = _mm256_add_epi16(cr0, yws);
+            __m256i gwt = _mm256_add_epi16(cb0, yws);
+            __m256i bws = _mm256_add_epi16(yws, cb1);
+            __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+            // descale
+            __m256i rw = _mm256_srai_epi16(rws, 4);
+            __m256i bw = _mm256_srai_epi16(bws, 4);
+            __m256i gw = _mm256_srai_epi16(gws, 4);
+
+            // back to byte, set up for transpose
+            __m256i brb = _mm256_packus_epi16(rw, bw);
+            __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+            // transpose to interleave channels: pixels 0-3/4-7 in the low lanes, 8-11/12-15 in the high ones
+            __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+            __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+            __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+            __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+            // store
+            _mm256_storeu_si256((__m256i*) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+            _mm256_storeu_si256((__m256i*) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+            out += 64;
+        }
+    }
+
+    stbi__YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg* j)
 {
     j->idct_block_kernel = stbi__idct_block;
+    j->idct_block2_kernel = NULL;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
     j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3710,6 +4846,14 @@ static void stbi__setup_jpeg(stbi__jpeg* j)
     }
 #endif
 
+#ifdef STBI_AVX2
+    if (stbi__avx2_available()) {
+        j->idct_block2_kernel = stbi__idct_simd2_avx2;
+        j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+        j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+    }
+#endif
+
 #ifdef STBI_NEON
     j->idct_block_kernel = stbi__idct_simd;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3740,6 +4884,171 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
     return (stbi_uc)((t + (t >> 8)) >> 8);
 }
 
+// upsamples and colour-converts output rows [row_begin, row_end); rows only depend on the
+// decoded component planes, so bands of them can be converted in parallel
+typedef struct
+{
+    stbi__jpeg* z;
+    stbi__resample res_comp[4]; // resamplers as set up for row 0
+    stbi_uc* output;
+    size_t stride;              // bytes from one output row to the next
+    stbi_uc* linebufs;          // per band: one img_x + 3 byte line per component
+    int n, decode_n, is_rgb, bands;
+    int flip;                   // store row j at img_y - 1 - j
+} stbi__jpeg_convert_job;
+
+// puts r where stepping it through rows 0..row-1 would have left it
+static void stbi__resample_seek(stbi__resample* r, stbi_uc* data, int comp_y, int w2, int row)
+{
+    int t = (r->vs >> 1) + row;
+    int wraps = t / r->vs;
+    int row1 = wraps < comp_y ? wraps : comp_y - 1;
+    int row0 = wraps == 0 ? 0 : (wraps - 1 < comp_y ? wraps - 1 : comp_y - 1);
+    r->ystep = t % r->vs;
+    r->ypos = wraps;
+    r->line0 = data + (size_t)w2 * row0;
+    r->line1 = data + (size_t)w2 * row1;
+}
+
+// the writers store n * img_x bytes of each row and nothing past them (the fourth byte of an
+// RGB pixel and the alpha of a grey one are only written when n asks for them): the next row
+// in memory may belong to another band, to the caller or, when flipping, to a row already
+// converted.
+static void stbi__jpeg_convert_rows(stbi__jpeg_convert_job* job, stbi_uc* linebuf[4], unsigned int row_begin, unsigned int row_end)
+{
+    stbi__jpeg* z = job->z;
+    stbi_uc* output = job->output;
+    int n = job->n, decode_n = job->decode_n, is_rgb = job->is_rgb;
+    int k;
+    unsigned int i, j;
+    stbi_uc* coutput[4] = { NULL, NULL, NULL, NULL };
+    stbi__resample res_comp[4];
+
+    for (k = 0; k < decode_n; ++k) {
+        res_comp[k] = job->res_comp[k];
+        stbi__resample_seek(&res_comp[k], z->img_comp[k].data, z->img_comp[k].y, z->img_comp[k].w2, (int)row_begin);
+    }
+
+    for (j = row_begin; j < row_end; ++j) {
+        stbi_uc* out = output + job->stride * (job->flip ? z->s->img_y - 1 - j : j);
+        for (k = 0; k < decode_n; ++k) {
+            stbi__resample* r = &res_comp[k];
+            int y_bot = r->ystep >= (r->vs >> 1);
+            coutput[k] = r->resample(linebuf[k],
+                y_bot ? r->line1 : r->line0,
+                y_bot ? r->line0 : r->line1,
+                r->w_lores, r->hs);
+            if (++r->ystep >= r->vs) {
+                r->ystep = 0;
+                r->line0 = r->line1;
+                if (++r->ypos < z->img_comp[k].y)
+                    r->line1 += z->img_comp[k].w2;
+            }
+        }
+        if (n >= 3) {
+            stbi_uc* y = coutput[0];
+            if (z->s->img_n == 3) {
+                if (is_rgb) {
+                    for (i = 0; i < z->s->img_x; ++i) {
+                        out[0] = y[i];
+                        out[1] = coutput[1][i];
+                        out[2] = coutput[2][i];
+                        if (n == 4) out[3] = 255;
+                        out += n;
+                    }
+                }
+                else {
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                }
+            }
+            else if (z->s->img_n == 4) {
+                if (z->app14_color_transform == 0) { // CMYK
+                    for (i = 0; i < z->s->img_x; ++i) {
+                        stbi_uc m = coutput[3][i];
+                        out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                        out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                        out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                        if (n == 4) out[3] = 255;
+                        out += n;
+                    }
+                }
+                else if (z->app14_color_transform == 2) { // YCCK
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                    for (i = 0; i < z->s->img_x; ++i) {
+                        stbi_uc m = coutput[3][i];
+                        out[0] = stbi__blinn_8x8(255 - out[0], m);
+                        out[1] = stbi__blinn_8x8(255 - out[1], m);
+                        out[2] = stbi__blinn_8x8(255 - out[2], m);
+                        out += n;
+                    }
+                }
+                else { // YCbCr + alpha?  Ignore the fourth channel for now
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                }
+            }
+            else
+                for (i = 0; i < z->s->img_x; ++i) {
+                    out[0] = out[1] = out[2] = y[i];
+                    if (n == 4) out[3] = 255;
+                    out += n;
+                }
+        }
+        else {
+            if (is_rgb) {
+                if (n == 1)
+                    for (i = 0; i < z->s->img_x; ++i)
+                        *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                else {
+                    for (i = 0; i < z->s->img_x; ++i, out += 2) {
+                        out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                        out[1] = 255;
+                    }
+                }
+            }
+            else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+                for (i = 0; i < z->s->img_x; ++i) {
+                    stbi_uc m = coutput[3][i];
+                    stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+                    stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+                    stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+                    out[0] = stbi__compute_y(r, g, b);
+                    if (n == 2) out[1] = 255;
+                    out += n;
+                }
+            }
+            else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+                for (i = 0; i < z->s->img_x; ++i) {
+                    out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+                    if (n == 2) out[1] = 255;
+                    out += n;
+                }
+            }
+            else {
+                stbi_uc* y = coutput[0];
+                if (n == 1)
+                    for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+                else
+                    for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+            }
+        }
+    }
+}
+
+static void stbi__jpeg_convert_task(void* arg, int band)
+{
+    stbi__jpeg_convert_job* job = (stbi__jpeg_convert_job*)arg;
+    stbi__jpeg* z = job->z;
+    size_t band_size = (size_t)job->decode_n * (z->s->img_x + 3);
+    stbi_uc* scratch = job->linebufs + band_size * band;
+    stbi_uc* linebuf[4];
+    int k;
+    for (k = 0; k < job->decode_n; ++k)
+        linebuf[k] = scratch + (size_t)k * (z->s->img_x + 3);
+    stbi__jpeg_convert_rows(job, linebuf,
+        (unsigned int)((size_t)z->s->img_y * band / job->bands),
+        (unsigned int)((size_t)z->s->img_y * (band + 1) / job->bands));
+}
+
 static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp, int req_comp)
 {
     int n, decode_n, is_rgb;
@@ -3751,6 +5060,26 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
     // load a jpeg image from whichever source, but leave in YCbCr format
     if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+    // the planes of a scaled decode hold the reduced image; carry on as if it were the real size
+    if (z->scale) {
+        int k;
+        z->s->img_x = stbi__jpeg_scaled_size(z->s->img_x, z->scale);
+        z->s->img_y = stbi__jpeg_scaled_size(z->s->img_y, z->scale);
+        for (k = 0; k < z->s->img_n; ++k) {
+            z->img_comp[k].x = (int)stbi__jpeg_scaled_size(z->img_comp[k].x, z->img_comp[k].hscale);
+            z->img_comp[k].y = (int)stbi__jpeg_scaled_size(z->img_comp[k].y, z->img_comp[k].vscale);
+        }
+    }
+
+    // stbi_load_*_into: convert straight into the caller's rows
+    if (z->s->dest) {
+        req_comp = z->s->dest_comp;
+        if ((size_t)req_comp * z->s->img_x > (size_t)z->s->dest_stride || z->s->img_y > (stbi__uint32)z->s->dest_rows) {
+            stbi__cleanup_jpeg(z);
+            return stbi__errpuc("buffer too small", "Output buffer smaller than image");
+        }
+    }
+
     // determine actual number of components to generate
     n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3764,22 +5093,22 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
     // resample and color-convert
     {
         int k;
-        unsigned int i, j;
         stbi_uc* output;
-        stbi_uc* coutput[4] = { NULL, NULL, NULL, NULL };
-
-        stbi__resample res_comp[4];
+        stbi_uc* linebuf[4];
+        stbi__jpeg_convert_job job;
 
         for (k = 0; k < decode_n; ++k) {
-            stbi__resample* r = &res_comp[k];
+            stbi__resample* r = &job.res_comp[k];
 
             // allocate line buffer big enough for upsampling off the edges
             // with upsample factor of 4
-            z->img_comp[k].linebuf = (stbi_uc*)stbi__malloc(z->s->img_x + 3);
+            z->img_comp[k].linebuf = (stbi_uc*)stbi__scratch_malloc(z->s->img_x + 3);
             if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+            linebuf[k] = z->img_comp[k].linebuf;
 
-            r->hs = z->img_h_max / z->img_comp[k].h;
-            r->vs = z->img_v_max / z->img_comp[k].v;
+            // less upsampling for components that were scaled down less
+            r->hs = (z->img_h_max / z->img_comp[k].h) >> (z->scale - z->img_comp[k].hscale);
+            r->vs = (z->img_v_max / z->img_comp[k].v) >> (z->scale - z->img_comp[k].vscale);
             r->ystep = r->vs >> 1;
             r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
             r->ypos = 0;
@@ -3792,114 +5121,36 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
             else                               r->resample = stbi__resample_row_generic;
         }
 
-        // can't error after this so, this is safe
-        output = (stbi_uc*)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-        if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-        // now go ahead and resample
-        for (j = 0; j < z->s->img_y; ++j) {
-            stbi_uc* out = output + n * z->s->img_x * j;
-            for (k = 0; k < decode_n; ++k) {
-                stbi__resample* r = &res_comp[k];
-                int y_bot = r->ystep >= (r->vs >> 1);
-                coutput[k] = r->resample(z->img_comp[k].linebuf,
-                    y_bot ? r->line1 : r->line0,
-                    y_bot ? r->line0 : r->line1,
-                    r->w_lores, r->hs);
-                if (++r->ystep >= r->vs) {
-                    r->ystep = 0;
-                    r->line0 = r->line1;
-                    if (++r->ypos < z->img_comp[k].y)
-                        r->line1 += z->img_comp[k].w2;
-                }
-            }
-            if (n >= 3) {
-                stbi_uc* y = coutput[0];
-                if (z->s->img_n == 3) {
-                    if (is_rgb) {
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            out[0] = y[i];
-                            out[1] = coutput[1][i];
-                            out[2] = coutput[2][i];
-                            out[3] = 255;
-                            out += n;
-                        }
-                    }
-                    else {
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
-                }
-                else if (z->s->img_n == 4) {
-                    if (z->app14_color_transform == 0) { // CMYK
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                            out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                            out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                            out[3] = 255;
-                            out += n;
-                        }
-                    }
-                    else if (z->app14_color_transform == 2) { // YCCK
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(255 - out[0], m);
-                            out[1] = stbi__blinn_8x8(255 - out[1], m);
-                            out[2] = stbi__blinn_8x8(255 - out[2], m);
-                            out += n;
-                        }
-                    }
-                    else { // YCbCr + alpha?  Ignore the fourth channel for now
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
-                }
-                else
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        out[0] = out[1] = out[2] = y[i];
-                        out[3] = 255; // not used if n==3
-                        out += n;
-                    }
-            }
-            else {
-                if (is_rgb) {
-                    if (n == 1)
-                        for (i = 0; i < z->s->img_x; ++i)
-                            *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                    else {
-                        for (i = 0; i < z->s->img_x; ++i, out += 2) {
-                            out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                            out[1] = 255;
-                        }
-                    }
-                }
-                else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        stbi_uc m = coutput[3][i];
-                        stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                        stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                        stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                        out[0] = stbi__compute_y(r, g, b);
-                        out[1] = 255;
-                        out += n;
-                    }
-                }
-                else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                        out[1] = 255;
-                        out += n;
-                    }
-                }
-                else {
-                    stbi_uc* y = coutput[0];
-                    if (n == 1)
-                        for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
-                    else
-                        for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-                }
-            }
+        job.flip = stbi__vertically_flip_on_load;
+        if (z->s->dest) {
+            output = z->s->dest;
+            job.stride = (size_t)z->s->dest_stride;
+        }
+        else {
+            // can't error after this so, this is safe
+            output = (stbi_uc*)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+            if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+            job.stride = (size_t)n * z->s->img_x;
+        }
+
+        // now go ahead and resample, in bands of at least 16 rows when there is a parallel-for hook
+        job.z = z;
+        job.output = output;
+        job.n = n;
+        job.decode_n = decode_n;
+        job.is_rgb = is_rgb;
+        job.bands = stbi__parallel_for_fn ? (int)(z->s->img_y / 16) : 1;
+        if (job.bands > 64) job.bands = 64;
+        job.linebufs = NULL;
+        if (job.bands > 1)
+            job.linebufs = (stbi_uc*)stbi__scratch_malloc_mad3(job.bands, decode_n, z->s->img_x + 3, 0);
+        if (job.linebufs) {
+            stbi__parallel_for_fn(stbi__parallel_for_user, job.bands, stbi__jpeg_convert_task, &job);
+            stbi__scratch_free(job.linebufs);
         }
+        else
+            stbi__jpeg_convert_rows(&job, linebuf, 0, z->s->img_y);
+
         stbi__cleanup_jpeg(z);
         *out_x = z->s->img_x;
         *out_y = z->s->img_y;
@@ -3911,24 +5162,25 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
 static void* stbi__jpeg_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
 {
     unsigned char* result;
-    stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
-    STBI_NOTUSED(ri);
+    stbi__jpeg* j = (stbi__jpeg*)stbi__scratch_malloc(sizeof(stbi__jpeg));
     j->s = s;
     stbi__setup_jpeg(j);
     result = load_jpeg_image(j, x, y, comp, req_comp);
-    STBI_FREE(j);
+    stbi__scratch_free(j);
+    // load_jpeg_image stores the rows bottom-up itself
+    ri->flipped = stbi__vertically_flip_on_load;
     return result;
 }
 
 static int stbi__jpeg_test(stbi__context* s)
 {
     int r;
-    stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+    stbi__jpeg* j = (stbi__jpeg*)stbi__scratch_malloc(sizeof(stbi__jpeg));
     j->s = s;
     stbi__setup_jpeg(j);
     r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
     stbi__rewind(s);
-    STBI_FREE(j);
+    stbi__scratch_free(j);
     return r;
 }
 
@@ -3938,8 +5190,8 @@ static int stbi__jpeg_info_raw(stbi__jpeg* j, int* x, int* y, int* comp)
         stbi__rewind(j->s);
         return 0;
     }
-    if (x) *x = j->s->img_x;
-    if (y) *y = j->s->img_y;
+    if (x) *x = (int)stbi__jpeg_scaled_size(j->s->img_x, j->scale);
+    if (y) *y = (int)stbi__jpeg_scaled_size(j->s->img_y, j->scale);
     if (comp) *comp = j->s->img_n >= 3 ? 3 : 1;
     return 1;
 }
@@ -3947,10 +5199,10 @@ static int stbi__jpeg_info_raw(stbi__jpeg* j, int* x, int* y, int* comp)
 static int stbi__jpeg_info(stbi__context* s, int* x, int* y, int* comp)
 {
     int result;
-    stbi__jpeg* j = (stbi__jpeg*)(stbi__malloc(sizeof(stbi__jpeg)));
+    stbi__jpeg* j = (stbi__jpeg*)(stbi__scratch_malloc(sizeof(stbi__jpeg)));
     j->s = s;
     result = stbi__jpeg_info_raw(j, x, y, comp);
-    STBI_FREE(j);
+    stbi__scratch_free(j);
     return result;
 }
 #endif
@@ -3965,7 +5217,13 @@ static int stbi__jpeg_info(stbi__context* s, int* x, int* y, int* comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#ifndef STBI_ZFAST_BITS
+#define STBI_ZFAST_BITS 9
+#endif
+#if STBI_ZFAST_BITS < 9 || STBI_ZFAST_BITS > 12
+#error "STBI_ZFAST_BITS must be between 9 and 12"
+#endif
+#define STBI__ZFAST_BITS  STBI_ZFAST_BITS // 9 accelerates all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
 // zlib-style huffman encoding
@@ -4054,14 +5312,17 @@ typedef struct
 {
     stbi_uc* zbuffer, * zbuffer_end;
     int num_bits;
-    stbi__uint32 code_buffer;
+    stbi__uint64 code_buffer;
 
     char* zout;
     char* zout_start;
     char* zout_end;
-    int   z_expandable;
+    int   z_expandable; // 0: fixed buffer, 1: grown with STBI_REALLOC, 2: scratch memory
 
     stbi__zhuffman z_length, z_distance;
+    // runs of 2-3 literals whose codes fit together in STBI__ZFAST_BITS, indexed like
+    // z_length.fast: literals in bits 0-23, total code length in bits 24-27, count in 28-29
+    stbi__uint32 z_literals[1 << STBI__ZFAST_BITS];
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf* z)
@@ -4070,20 +5331,35 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf* z)
     return *z->zbuffer++;
 }
 
+// 8 bytes as a little-endian integer; compilers turn this into a single load
+stbi_inline static stbi__uint64 stbi__load64_le(const stbi_uc* p)
+{
+    return (stbi__uint64)p[0] | ((stbi__uint64)p[1] << 8) | ((stbi__uint64)p[2] << 16) | ((stbi__uint64)p[3] << 24) |
+        ((stbi__uint64)p[4] << 32) | ((stbi__uint64)p[5] << 40) | ((stbi__uint64)p[6] << 48) | ((stbi__uint64)p[7] << 56);
+}
+
 static void stbi__fill_bits(stbi__zbuf* z)
 {
+    STBI_ASSERT(z->code_buffer < ((stbi__uint64)1 << z->num_bits));
+    if (z->zbuffer_end - z->zbuffer >= 8) {
+        // take as many whole bytes as fit below bit 63
+        int n = (63 - z->num_bits) >> 3;
+        z->code_buffer |= (stbi__load64_le(z->zbuffer) & (((stbi__uint64)1 << (n * 8)) - 1)) << z->num_bits;
+        z->num_bits += n * 8;
+        z->zbuffer += n;
+        return;
+    }
     do {
-        STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
-        z->code_buffer |= (unsigned int)stbi__zget8(z) << z->num_bits;
+        z->code_buffer |= (stbi__uint64)stbi__zget8(z) << z->num_bits;
         z->num_bits += 8;
-    } while (z->num_bits <= 24);
+    } while (z->num_bits <= 56);
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf* z, int n)
 {
     unsigned int k;
     if (z->num_bits < n) stbi__fill_bits(z);
-    k = z->code_buffer & ((1 << n) - 1);
+    k = (unsigned int)z->code_buffer & ((1 << n) - 1);
     z->code_buffer >>= n;
     z->num_bits -= n;
     return k;
@@ -4094,7 +5370,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf* a, stbi__zhuffman* z)
     int b, s, k;
     // not resolved by fast table, so compute it the slow way
     // use jpeg approach, which requires MSbits at top
-    k = stbi__bit_reverse(a->code_buffer, 16);
+    k = stbi__bit_reverse((int)(a->code_buffer & 0xffff), 16);
     for (s = STBI__ZFAST_BITS + 1; ; ++s)
         if (k < z->maxcode[s])
             break;
@@ -4111,7 +5387,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf* a, stbi__zhuffman* z)
 {
     int b, s;
     if (a->num_bits < 16) stbi__fill_bits(a);
-    b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+    b = z->fast[(int)a->code_buffer & STBI__ZFAST_MASK];
     if (b) {
         s = b >> 9;
         a->code_buffer >>= s;
@@ -4131,7 +5407,10 @@ static int stbi__zexpand(stbi__zbuf* z, char* zout, int n)  // need to make room
     limit = old_limit = (int)(z->zout_end - z->zout_start);
     while (cur + n > limit)
         limit *= 2;
-    q = (char*)STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+    if (z->z_expandable == 2)
+        q = (char*)stbi__scratch_realloc(z->zout_start, old_limit, limit);
+    else
+        q = (char*)STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
     STBI_NOTUSED(old_limit);
     if (q == NULL) return stbi__err("outofmem", "Out of memory");
     z->zout_start = q;
@@ -4154,11 +5433,68 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
 
+// fills z_literals from z_length.fast by decoding up to three literals from each index
+static void stbi__zbuild_literal_runs(stbi__zbuf* a)
+{
+    int i;
+    for (i = 0; i < (1 << STBI__ZFAST_BITS); ++i) {
+        stbi__uint32 run = 0;
+        int n = 0, used = 0;
+        while (n < 3) {
+            // the bits above 'used' that the shift brings in are zero rather than the
+            // stream's, so the entry is only valid if its code fits in what is left
+            int b = a->z_length.fast[i >> used];
+            int s = b >> 9, v = b & 511;
+            if (!b || v >= 256 || used + s > STBI__ZFAST_BITS) break;
+            run |= (stbi__uint32)v << (n * 8);
+            used += s;
+            ++n;
+        }
+        a->z_literals[i] = n >= 2 ? run | ((stbi__uint32)used << 24) | ((stbi__uint32)n << 28) : 0;
+    }
+}
+
+// copies a len-byte match from dist bytes back 16 bytes at a time, and may write up to 15 bytes
+// past the end of it. A closer match is first repeated into a 16-byte pattern, which is then
+// stored every multiple of dist bytes.
+static char* stbi__zcopy_match(char* zout, int dist, int len)
+{
+    const char* p = zout - dist;
+    char* end = zout + len;
+    if (dist >= 16) {
+        for (; zout < end; zout += 16, p += 16)
+            memcpy(zout, p, 16);
+    }
+    else {
+        char pattern[16];
+        int i, step = 16 - 16 % dist;
+        for (i = 0; i < 16; ++i)
+            pattern[i] = p[i % dist];
+        for (; zout < end; zout += step)
+            memcpy(zout, pattern, 16);
+    }
+    return end;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf* a)
 {
     char* zout = a->zout;
     for (;;) {
-        int z = stbi__zhuffman_decode(a, &a->z_length);
+        int z;
+        stbi__uint32 run;
+        if (a->num_bits < 16) stbi__fill_bits(a);
+        run = a->z_literals[(int)a->code_buffer & STBI__ZFAST_MASK];
+        if (run && a->zout_end - zout >= 3) {
+            int s = (run >> 24) & 15;
+            zout[0] = (char)run;
+            zout[1] = (char)(run >> 8);
+            zout[2] = (char)(run >> 16);
+            zout += run >> 28;
+            a->code_buffer >>= s;
+            a->num_bits -= s;
+            continue;
+        }
+        z = stbi__zhuffman_decode(a, &a->z_length);
         if (z < 256) {
             if (z < 0) return stbi__err("bad huffman code", "Corrupt PNG"); // error in huffman codes
             if (zout >= a->zout_end) {
@@ -4188,9 +5524,11 @@ static int stbi__parse_huffman_block(stbi__zbuf* a)
             }
             p = (stbi_uc*)(zout - dist);
             if (dist == 1) { // run of one byte; common in images.
-                stbi_uc v = *p;
-                if (len) { do *zout++ = v; while (--len); }
+                memset(zout, *p, len);
+                zout += len;
             }
+            else if (a->zout_end - zout >= len + 16)
+                zout = stbi__zcopy_match(zout, dist, len);
             else {
                 if (len) { do *zout++ = *p++; while (--len); }
             }
@@ -4244,6 +5582,7 @@ static int stbi__compute_huffman_codes(stbi__zbuf* a)
     }
     if (n != ntot) return stbi__err("bad codelengths", "Corrupt PNG");
     if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
+    stbi__zbuild_literal_runs(a);
     if (!stbi__zbuild_huffman(&a->z_distance, lencodes + hlit, hdist)) return 0;
     return 1;
 }
@@ -4256,21 +5595,27 @@ static int stbi__parse_uncompressed_block(stbi__zbuf* a)
         stbi__zreceive(a, a->num_bits & 7); // discard
      // drain the bit-packed data into header
     k = 0;
-    while (a->num_bits > 0) {
+    while (a->num_bits > 0 && k < 4) {
         header[k++] = (stbi_uc)(a->code_buffer & 255); // suppress MSVC run-time check
         a->code_buffer >>= 8;
         a->num_bits -= 8;
     }
-    STBI_ASSERT(a->num_bits == 0);
     // now fill header the normal way
     while (k < 4)
         header[k++] = stbi__zget8(a);
     len = header[1] * 256 + header[0];
     nlen = header[3] * 256 + header[2];
     if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt", "Corrupt PNG");
-    if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer", "Corrupt PNG");
     if (a->zout + len > a->zout_end)
         if (!stbi__zexpand(a, a->zout, len)) return 0;
+    // the bit buffer can still hold the first few bytes of the block
+    while (a->num_bits > 0 && len > 0) {
+        *a->zout++ = (char)(a->code_buffer & 255);
+        a->code_buffer >>= 8;
+        a->num_bits -= 8;
+        --len;
+    }
+    if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer", "Corrupt PNG");
     memcpy(a->zout, a->zbuffer, len);
     a->zbuffer += len;
     a->zout += len;
@@ -4339,6 +5684,7 @@ static int stbi__parse_zlib(stbi__zbuf* a, int parse_header)
             if (type == 1) {
                 // use fixed code lengths
                 if (!stbi__zbuild_huffman(&a->z_length, stbi__zdefault_length, 288)) return 0;
+                stbi__zbuild_literal_runs(a);
                 if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance, 32)) return 0;
             }
             else {
@@ -4399,6 +5745,26 @@ STBIDEF char* stbi_zlib_decode_malloc_guesssize_headerflag(const char* buffer, i
     }
 }
 
+#ifndef STBI_NO_PNG
+// stbi_zlib_decode_malloc_guesssize_headerflag for output that is freed before the load returns
+static char* stbi__zlib_decode_scratch(const char* buffer, int len, int initial_size, int* outlen, int parse_header)
+{
+    stbi__zbuf a;
+    char* p = (char*)stbi__scratch_malloc(initial_size);
+    if (p == NULL) return NULL;
+    a.zbuffer = (stbi_uc*)buffer;
+    a.zbuffer_end = (stbi_uc*)buffer + len;
+    if (stbi__do_zlib(&a, p, initial_size, 2, parse_header)) {
+        if (outlen) *outlen = (int)(a.zout - a.zout_start);
+        return a.zout_start;
+    }
+    else {
+        stbi__scratch_free(a.zout_start);
+        return NULL;
+    }
+}
+#endif
+
 STBIDEF int stbi_zlib_decode_buffer(char* obuffer, int olen, char const* ibuffer, int ilen)
 {
     stbi__zbuf a;
@@ -4514,6 +5880,112 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// one pixel in the low lanes. Only the row's last 3-byte pixel needs the exact size: before
+// that the fourth byte is read and written as well, and the next pixel overwrites it.
+static __m128i stbi__png_load_px(const stbi_uc* p, int n)
+{
+    stbi__uint32 v = 0;
+    if (n > 3) memcpy(&v, p, 4);
+    else memcpy(&v, p, 3);
+    return _mm_cvtsi32_si128((int)v);
+}
+
+static void stbi__png_store_px(stbi_uc* p, __m128i x, int n)
+{
+    stbi__uint32 v = (stbi__uint32)_mm_cvtsi128_si32(x);
+    if (n > 3) memcpy(p, &v, 4);
+    else memcpy(p, &v, 3);
+}
+
+// SSE2 versions of the Sub, Avg and Paeth loops for 8-bit 3- and 4-byte pixels, and of Up for
+// any pixel size. cur, raw and prior start at the second pixel of the row, n bytes follow.
+// Sub is a prefix sum, done four pixels at a time; Avg and Paeth depend on the pixel just
+// decoded, so they go one pixel per step with every channel at once.
+static void stbi__png_defilter_sse2(int filter, stbi_uc* cur, const stbi_uc* raw, const stbi_uc* prior, int n, int bpp)
+{
+    switch (filter) {
+    case STBI__F_up:
+        for (; n >= 16; n -= 16, cur += 16, raw += 16, prior += 16)
+            _mm_storeu_si128((__m128i*)cur, _mm_add_epi8(_mm_loadu_si128((const __m128i*)raw), _mm_loadu_si128((const __m128i*)prior)));
+        for (; n > 0; --n)
+            *cur++ = STBI__BYTECAST(*raw++ + *prior++);
+        break;
+
+    case STBI__F_sub: {
+        __m128i a = stbi__png_load_px(cur - bpp, bpp);
+        if (bpp == 4) {
+            a = _mm_shuffle_epi32(a, 0x00);
+            for (; n >= 16; n -= 16, cur += 16, raw += 16) {
+                __m128i d = _mm_loadu_si128((const __m128i*)raw);
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+                d = _mm_add_epi8(d, a);
+                _mm_storeu_si128((__m128i*)cur, d);
+                a = _mm_shuffle_epi32(d, 0xff);
+            }
+        }
+        else {
+            // 16-byte loads and stores, 12 bytes (4 pixels) of progress; the 4 bytes past them
+            // are rewritten by the next step
+            __m128i mask = _mm_cvtsi32_si128(0xffffff);
+            for (; n >= 16; n -= 12, cur += 12, raw += 12) {
+                __m128i d = _mm_loadu_si128((const __m128i*)raw);
+                __m128i prev = _mm_or_si128(_mm_or_si128(a, _mm_slli_si128(a, 3)), _mm_or_si128(_mm_slli_si128(a, 6), _mm_slli_si128(a, 9)));
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 3));
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 6));
+                d = _mm_add_epi8(d, prev);
+                _mm_storeu_si128((__m128i*)cur, d);
+                a = _mm_and_si128(_mm_srli_si128(d, 9), mask);
+            }
+        }
+        for (; n > 0; n -= bpp, cur += bpp, raw += bpp) {
+            a = _mm_add_epi8(stbi__png_load_px(raw, n), a);
+            stbi__png_store_px(cur, a, n);
+        }
+        break;
+    }
+
+    case STBI__F_avg: {
+        // _mm_avg_epu8 rounds up; the filter rounds down
+        __m128i a = stbi__png_load_px(cur - bpp, bpp), one = _mm_set1_epi8(1);
+        for (; n > 0; n -= bpp, cur += bpp, raw += bpp, prior += bpp) {
+            __m128i b = stbi__png_load_px(prior, n);
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(stbi__png_load_px(raw, n), avg);
+            stbi__png_store_px(cur, a, n);
+        }
+        break;
+    }
+
+    case STBI__F_paeth: {
+        // in 16-bit lanes: with p = a + b - c, |p - a| = |b - c|, |p - b| = |a - c| and
+        // |p - c| = |(b - c) + (a - c)|; ties go to a, then b
+        __m128i zero = _mm_setzero_si128();
+        __m128i a = _mm_unpacklo_epi8(stbi__png_load_px(cur - bpp, bpp), zero);
+        __m128i c = _mm_unpacklo_epi8(stbi__png_load_px(prior - bpp, bpp), zero);
+        for (; n > 0; n -= bpp, cur += bpp, raw += bpp, prior += bpp) {
+            __m128i b = _mm_unpacklo_epi8(stbi__png_load_px(prior, n), zero);
+            __m128i pa = _mm_sub_epi16(b, c), pb = _mm_sub_epi16(a, c), pc = _mm_add_epi16(pa, pb);
+            __m128i smallest, use_a, use_b, pred;
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            use_a = _mm_cmpeq_epi16(smallest, pa);
+            use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(smallest, pb));
+            pred = _mm_or_si128(_mm_and_si128(use_a, a), _mm_or_si128(_mm_and_si128(use_b, b), _mm_andnot_si128(_mm_or_si128(use_a, use_b), c)));
+            // bytes wrap within their 16-bit lanes, whose high halves stay zero
+            a = _mm_add_epi8(_mm_unpacklo_epi8(stbi__png_load_px(raw, n), zero), pred);
+            stbi__png_store_px(cur, _mm_packus_epi16(a, a), n);
+            c = b;
+        }
+        break;
+    }
+    }
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4527,6 +5999,9 @@ static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 r
     int output_bytes = out_n * bytes;
     int filter_bytes = img_n * bytes;
     int width = x;
+#ifdef STBI_SSE2
+    int simd = stbi__sse2_available();
+#endif
 
     STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
     a->out = (stbi_uc*)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4601,6 +6076,12 @@ static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 r
 #define STBI__CASE(f) \
              case f:     \
                 for (k=0; k < nk; ++k)
+#ifdef STBI_SSE2
+            if (simd && (filter == STBI__F_up || (depth == 8 && (filter_bytes == 3 || filter_bytes == 4)
+                && (filter == STBI__F_sub || filter == STBI__F_avg || filter == STBI__F_paeth))))
+                stbi__png_defilter_sse2(filter, cur, raw, prior, nk, filter_bytes);
+            else
+#endif
             switch (filter) {
                 // "none" filter turns into a memcpy here; make that explicit.
             case STBI__F_none:         memcpy(cur, raw, nk); break;
@@ -5034,7 +6515,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
                 while (ioff + c.length > idata_limit)
                     idata_limit *= 2;
                 STBI_NOTUSED(idata_limit_old);
-                p = (stbi_uc*)STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+                p = (stbi_uc*)stbi__scratch_realloc(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
                 z->idata = p;
             }
             if (!stbi__getn(s, z->idata + ioff, c.length)) return stbi__err("outofdata", "Corrupt PNG");
@@ -5050,9 +6531,9 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
             raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc*)stbi_zlib_decode_malloc_guesssize_headerflag((char*)z->idata, ioff, raw_len, (int*)&raw_len, !is_iphone);
+            z->expanded = (stbi_uc*)stbi__zlib_decode_scratch((char*)z->idata, ioff, raw_len, (int*)&raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
+            stbi__scratch_free(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
                 s->img_out_n = s->img_n + 1;
             else
@@ -5080,7 +6561,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
                 // non-paletted image with tRNS -> source image has (constant) alpha
                 ++s->img_n;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            stbi__scratch_free(z->expanded); z->expanded = NULL;
             // end of PNG chunk, read and skip CRC
             stbi__get32be(s);
             return 1;
@@ -5132,8 +6613,8 @@ static void* stbi__do_png(stbi__png* p, int* x, int* y, int* n, int req_comp, st
         if (n) *n = p->s->img_n;
     }
     STBI_FREE(p->out);      p->out = NULL;
-    STBI_FREE(p->expanded); p->expanded = NULL;
-    STBI_FREE(p->idata);    p->idata = NULL;
+    stbi__scratch_free(p->expanded); p->expanded = NULL;
+    stbi__scratch_free(p->idata);    p->idata = NULL;
 
     return result;
 }
@@ -7760,4 +9241,4 @@ AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
 ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
 WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 ------------------------------------------------------------------------------
-*/#pragma once
+*/
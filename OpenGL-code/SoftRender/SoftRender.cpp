@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Q3/stb_image.h"
+
+#include "../Common/Geometry.h"
+#include "../Common/ImageWriter.h"
+#include "../Common/Material.h"
+#include "../Common/ShapeStore.h"
+#include "../Common/SoftRasterizer.h"
+#include "../Common/SpatialGrid.h"
+#include "../Common/ThreadPool.h"
+
+// the demos without a GPU
+// -----------------------
+// Renders every engine scene with SoftRasterizer: the same vertex builders, materials, clear
+// colours and Sea.jpg (decoded at the size the engine would decode it for the window) as
+// Engine.cpp, the Shape Field at its first frame. Each scene is rendered with one thread and then
+// with N, and the best times, megapixels per second and speed-up are printed per scene. Only
+// needs the C++ standard library; the GLEW header is included for its GL_* constants alone.
+//
+// usage: SoftRender [--size N] [--threads N] [--repeat N] [--shapes N] [--linear] [--only TEXT]
+//                   [--sea FILE] [--out DIR]
+//   --size N      framebuffer width and height, 1000 like the demos' windows
+//   --threads N   rasterizing threads for the scaling run, all hardware threads by default
+//   --shapes N    shapes in the Shape Field, 100000 by default (the engine draws a million)
+//   --linear      minify Sea.jpg bilinearly instead of with the demos' GL_NEAREST
+//   --only TEXT   render only the scenes whose name contains TEXT
+//   --out DIR     also write every scene as DIR/<Scene_Name>.ppm
+
+// one scene: what it clears to and draws into the rasterizer
+struct SoftScene
+{
+    std::string name;
+    float clear[3];
+    std::vector<float> vertices;
+    unsigned int layout;
+    GLenum mode;
+    Material material;
+    bool chessBoard;    // light squares in white or, with VERTEX_TEXCOORD, Sea.jpg
+    bool shapeField;
+};
+
+static SoftScene softScene(const char* name, std::vector<float> vertices, unsigned int layout, GLenum mode,
+                           const Material& material, float r = 0.0f, float g = 0.0f, float b = 0.0f)
+{
+    SoftScene scene;
+    scene.name = name;
+    scene.clear[0] = r;
+    scene.clear[1] = g;
+    scene.clear[2] = b;
+    scene.vertices = vertices;
+    scene.layout = layout;
+    scene.mode = mode;
+    scene.material = material;
+    scene.chessBoard = false;
+    scene.shapeField = false;
+    return scene;
+}
+
+// the scenes of registerScenes(), in its order; the GPU Shape Field draws what the Shape Field does
+static std::vector<SoftScene> demoScenes()
+{
+    const Material orange = solidMaterial(1.0f, 0.5f, 0.2f);
+    const Material sea = texturedMaterial(0);
+    std::vector<SoftScene> scenes;
+    scenes.push_back(softScene("Disk", diskVertices(0), 0, GL_TRIANGLE_FAN, orange, 0.2f, 0.3f, 0.3f));
+    scenes.push_back(softScene("Ring", ringVertices(0), 0, GL_LINE_STRIP, orange, 0.2f, 0.3f, 0.3f));
+    scenes.push_back(softScene("Right Trapezium", rightTrapeziumVertices(0), 0, GL_TRIANGLE_FAN, orange, 0.2f, 0.3f, 0.3f));
+    scenes.push_back(softScene("Colour Gradient Triangle", gradientTriangleVertices(), VERTEX_COLOUR, GL_TRIANGLES, vertexColourMaterial()));
+    scenes.push_back(softScene("Chess Board", std::vector<float>(), 0, GL_TRIANGLES, orange));
+    scenes.back().chessBoard = true;
+    scenes.push_back(softScene("Texture Disk", diskVertices(VERTEX_TEXCOORD), VERTEX_TEXCOORD, GL_TRIANGLE_FAN, sea));
+    scenes.push_back(softScene("Texture Ring", ringVertices(VERTEX_TEXCOORD), VERTEX_TEXCOORD, GL_LINE_STRIP, sea));
+    scenes.push_back(softScene("Texture Right Trapezium", rightTrapeziumVertices(VERTEX_TEXCOORD), VERTEX_TEXCOORD, GL_TRIANGLE_FAN, sea));
+    scenes.push_back(softScene("Texture Chess Board", std::vector<float>(), VERTEX_TEXCOORD, GL_TRIANGLES, orange));
+    scenes.back().chessBoard = true;
+    scenes.push_back(softScene("Shape Field", std::vector<float>(), 0, GL_TRIANGLE_STRIP, orange, 0.05f, 0.05f, 0.08f));
+    scenes.back().shapeField = true;
+    return scenes;
+}
+
+// every shape the engine camera sees at zoom 1, each as a strip of its outline at the level of
+// detail ShapeStoreRenderer would pick and in the order it draws them: by kind, then by level
+static void drawShapeField(SoftRasterizer& raster, const ShapeStore& store, const SpatialGrid& grid, int size)
+{
+    int first[SHAPE_LOD_LEVELS + 1], count[SHAPE_LOD_LEVELS + 1];
+    std::vector<float> outline = shapeOutlines(first, count);
+    VisibleShapes visible;
+    grid.query(store, -1.0f, -1.0f, 1.0f, 1.0f, visible);
+    float pixelsPerUnit = size * 0.5f;
+    std::vector<float> strip;
+    for (int k = 0; k < SHAPE_KINDS; k++)
+    {
+        const ShapeArrays& a = store.arrays((ShapeKind)k);
+        const std::vector<unsigned int>& list = visible.indices[k];
+        for (int level = 0; level < SHAPE_LOD_LEVELS; level++)
+            for (size_t v = 0; v < list.size(); v++)
+            {
+                unsigned int i = list[v];
+                if ((k == SHAPE_TRAPEZIUM ? 0 : shapeLod(a.radius[i] * pixelsPerUnit, -1)) != level)
+                    continue;
+                int mesh = k == SHAPE_TRAPEZIUM ? SHAPE_LOD_LEVELS : level;
+                strip.clear();
+                for (int p = first[mesh]; p < first[mesh] + count[mesh]; p++)
+                {
+                    const float* unit = &outline[(size_t)p * 3];
+                    float radius = a.innerRadius[i] + (a.radius[i] - a.innerRadius[i]) * unit[2];
+                    strip.push_back(a.centreX[i] + unit[0] * radius);
+                    strip.push_back(a.centreY[i] + unit[1] * radius);
+                    strip.push_back(0.0f);
+                }
+                raster.draw(strip, 0u, GL_TRIANGLE_STRIP, a.material[i]);
+            }
+    }
+}
+
+static void render(SoftRasterizer& raster, const SoftScene& scene, int material, int dark, int light,
+                   const ShapeStore& store, const SpatialGrid& grid, int size)
+{
+    raster.clear(scene.clear[0], scene.clear[1], scene.clear[2]);
+    if (scene.shapeField)
+        drawShapeField(raster, store, grid, size);
+    else if (scene.chessBoard)
+    {
+        std::vector<int> squareMaterials;
+        std::vector<float> vertices = chessBoardVertices(scene.layout, dark, light, squareMaterials);
+        raster.draw(vertices, scene.layout, GL_TRIANGLES, dark, &squareMaterials);
+    }
+    else
+        raster.draw(scene.vertices, scene.layout, scene.mode, material);
+    raster.finish();
+}
+
+// binary PPM, top row first
+static bool writePPM(const std::string& file, const SoftRasterizer& raster)
+{
+    // the rasterizer stores rows bottom first
+    PpmWriter writer(file);
+    std::ptrdiff_t stride = (std::ptrdiff_t)raster.width() * 4;
+    bool ok = writer.begin(raster.width(), raster.height()) &&
+              writer.write(&raster.pixels()[(size_t)(raster.height() - 1) * stride], raster.height(), -stride);
+    return writer.finish() && ok;
+}
+
+int main(int argc, char** argv)
+{
+    int size = 1000, threads = 0, repeat = 3, shapes = 100000;
+    bool linear = false;
+    std::string only, seaFile = "../Q3/Sea.jpg", outDir;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue)
+            size = std::min(softraster::MAX_SIZE, std::max(1, std::atoi(argv[++i])));
+        else if (arg == "--threads" && hasValue)
+            threads = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--repeat" && hasValue)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--shapes" && hasValue)
+            shapes = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--linear")
+            linear = true;
+        else if (arg == "--only" && hasValue)
+            only = argv[++i];
+        else if (arg == "--sea" && hasValue)
+            seaFile = argv[++i];
+        else if (arg == "--out" && hasValue)
+            outDir = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--size N] [--threads N] [--repeat N] [--shapes N] [--linear] [--only TEXT]"
+                                 " [--sea FILE] [--out DIR]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (threads == 0)
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+    // Sea.jpg as the engine loads it for a window of this size
+    SoftTexture sea;
+    sea.minFilter = linear ? GL_LINEAR : GL_NEAREST;
+    stbi_set_jpeg_max_dimension_thread(size);
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(seaFile.c_str(), &width, &height, &channels, 0);
+    stbi_set_jpeg_max_dimension_thread(0);
+    if (pixels)
+    {
+        sea.assign(pixels, width, height, channels);
+        stbi_image_free(pixels);
+    }
+    else
+    {
+        std::fprintf(stderr, "SoftRender: could not load %s, texturing with white\n", seaFile.c_str());
+        unsigned char white[4] = { 255, 255, 255, 255 };
+        sea.assign(white, 1, 1, 4);
+    }
+
+    // one material table for every scene: the field's palette, the board's squares, then each
+    // scene's own material
+    std::vector<Material> materials;
+    int palette[6];
+    const float paletteColours[6][3] = {
+        { 1.0f, 0.5f, 0.2f }, { 0.9f, 0.8f, 0.3f }, { 0.3f, 0.7f, 0.9f },
+        { 0.6f, 0.4f, 0.8f }, { 0.4f, 0.8f, 0.5f }, { 0.9f, 0.3f, 0.4f }
+    };
+    for (int p = 0; p < 6; p++)
+    {
+        palette[p] = (int)materials.size();
+        materials.push_back(solidMaterial(paletteColours[p][0], paletteColours[p][1], paletteColours[p][2]));
+    }
+    int dark = (int)materials.size();
+    materials.push_back(solidMaterial(0.0f, 0.0f, 0.0f));
+    int white = (int)materials.size();
+    materials.push_back(solidMaterial(1.0f, 1.0f, 1.0f));
+    int textured = (int)materials.size();
+    materials.push_back(texturedMaterial(0));
+    std::vector<SoftScene> scenes = demoScenes();
+    int sceneMaterials = (int)materials.size();
+    for (size_t s = 0; s < scenes.size(); s++)
+        materials.push_back(scenes[s].material);
+
+    ShapeStore store;
+    SpatialGrid grid(-1.5f, -1.5f, 1.5f, 1.5f);
+    fillShapeField(store, (size_t)shapes, palette);
+    grid.build(store);
+
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 1)
+        pool.reset(new ThreadPool(threads - 1));
+    // [0] on the calling thread alone, [1] with the pool
+    std::unique_ptr<SoftRasterizer> rasters[2];
+    for (int run = 0; run < 2; run++)
+    {
+        rasters[run].reset(new SoftRasterizer(size, size, run == 0 ? NULL : pool.get()));
+        for (size_t m = 0; m < materials.size(); m++)
+            rasters[run]->addMaterial(materials[m]);
+        rasters[run]->addTexture(&sea);
+    }
+
+    std::printf("%dx%d, 1 and %d threads, best of %d\n", size, size, threads, repeat);
+    for (size_t s = 0; s < scenes.size(); s++)
+    {
+        const SoftScene& scene = scenes[s];
+        if (!only.empty() && scene.name.find(only) == std::string::npos)
+            continue;
+        int light = scene.layout & VERTEX_TEXCOORD ? textured : white;
+        double best[2] = { 1e30, 1e30 };
+        for (int run = 0; run < 2; run++)
+            for (int r = 0; r < repeat; r++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                render(*rasters[run], scene, sceneMaterials + (int)s, dark, light, store, grid, size);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                best[run] = std::min(best[run], ms);
+            }
+        const SoftRasterizerStats& stats = rasters[1]->stats();
+        if (!outDir.empty())
+        {
+            std::string file = scene.name;
+            std::replace(file.begin(), file.end(), ' ', '_');
+            file = outDir + "/" + file + ".ppm";
+            if (!writePPM(file, *rasters[1]))
+                std::fprintf(stderr, "SoftRender: could not write %s\n", file.c_str());
+        }
+        double megapixels = (double)size * size / 1e6;
+        std::printf("%-26s %7zu triangles %6zu lines %5zu tiles %4zu steals  1 thread %8.2f ms %8.1f Mpix/s"
+                    "  %d threads %8.2f ms %8.1f Mpix/s  x%.2f\n",
+                    scene.name.c_str(), stats.triangles, stats.lines, stats.tiles, stats.steals,
+                    best[0], megapixels / (best[0] / 1000.0), threads, best[1], megapixels / (best[1] / 1000.0),
+                    best[0] / best[1]);
+    }
+    return 0;
+}